@@ -0,0 +1,207 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <pthread.h>
+#include <cstring>
+#include <map>
+
+#include "rk_debug.h"
+#include "rk_mpi_mb.h"
+#include "rk_mpi_mmz.h"
+#include "mpi_cache_utils.h"
+#include "mpi_test_utils.h"
+
+typedef struct _MB_CACHE_STATE_S {
+    RK_BOOL bCacheable;
+    RK_U32  u32Size;
+    RK_U32  u32DirtyStart;
+    RK_U32  u32DirtyEnd;        // u32DirtyStart == u32DirtyEnd means clean
+    RK_U32  u32AccessOffset;
+    RK_U32  u32AccessLength;
+    RK_BOOL bReadWindow;        // a READONLY sync window is open on the access range
+} MB_CACHE_STATE_S;
+
+static pthread_mutex_t gCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<MB_BLK, MB_CACHE_STATE_S> gCacheStates;
+static MB_CACHE_STAT_S gCacheStat;
+
+static MB_CACHE_STATE_S *mpi_mb_cache_state(MB_BLK blk) {
+    std::map<MB_BLK, MB_CACHE_STATE_S>::iterator it = gCacheStates.find(blk);
+    if (it != gCacheStates.end()) {
+        return &it->second;
+    }
+
+    MB_CACHE_STATE_S stState;
+    memset(&stState, 0, sizeof(stState));
+    stState.bCacheable = (RK_MPI_MMZ_IsCacheable(blk) == 1) ? RK_TRUE : RK_FALSE;
+    stState.u32Size = (RK_U32)RK_MPI_MB_GetSize(blk);
+    return &gCacheStates.insert(std::make_pair(blk, stState)).first->second;
+}
+
+static RK_VOID mpi_mb_cache_add_dirty(MB_CACHE_STATE_S *pstState, RK_U32 u32Offset, RK_U32 u32Length) {
+    RK_U32 u32End = u32Offset + u32Length;
+    if (u32End > pstState->u32Size) {
+        u32End = pstState->u32Size;
+    }
+    if (u32Offset >= u32End) {
+        return;
+    }
+    if (pstState->u32DirtyStart == pstState->u32DirtyEnd) {
+        pstState->u32DirtyStart = u32Offset;
+        pstState->u32DirtyEnd = u32End;
+    } else {
+        pstState->u32DirtyStart = u32Offset < pstState->u32DirtyStart ? u32Offset : pstState->u32DirtyStart;
+        pstState->u32DirtyEnd = u32End > pstState->u32DirtyEnd ? u32End : pstState->u32DirtyEnd;
+    }
+}
+
+static RK_VOID mpi_mb_cache_count(MB_CACHE_STATE_S *pstState, RK_U32 u32Length) {
+    if (u32Length == 0) {
+        gCacheStat.u64Skipped++;
+    } else if (u32Length >= pstState->u32Size) {
+        gCacheStat.u64Full++;
+    } else {
+        gCacheStat.u64Partial++;
+    }
+    gCacheStat.u64FlushBytes += u32Length;
+}
+
+static RK_VOID mpi_mb_cache_add_time(RK_U64 u64StartUs) {
+    RK_U64 u64Us = mpi_test_utils_get_now_us() - u64StartUs;
+    pthread_mutex_lock(&gCacheLock);
+    gCacheStat.u64SyncUs += u64Us;
+    pthread_mutex_unlock(&gCacheLock);
+}
+
+RK_S32 mpi_mb_cpu_access_begin(MB_BLK blk, RK_U32 u32Offset, RK_U32 u32Length,
+                               MB_CPU_ACCESS_E enAccess, RK_VOID **ppVirAddr) {
+    if (blk == RK_NULL || ppVirAddr == RK_NULL) {
+        return RK_FAILURE;
+    }
+
+    pthread_mutex_lock(&gCacheLock);
+    MB_CACHE_STATE_S *pstState = mpi_mb_cache_state(blk);
+    if (u32Length == 0 || u32Offset + u32Length > pstState->u32Size) {
+        u32Length = pstState->u32Size > u32Offset ? pstState->u32Size - u32Offset : 0;
+    }
+    pstState->u32AccessOffset = u32Offset;
+    pstState->u32AccessLength = u32Length;
+    // a fill overwrites the stale lines anyway, only the clean at the end matters.
+    RK_BOOL bInvalidate = (pstState->bCacheable && u32Length > 0 && enAccess != MB_CPU_ACCESS_FILL)
+                          ? RK_TRUE : RK_FALSE;
+    if (bInvalidate) {
+        gCacheStat.u64Invalidates++;
+        gCacheStat.u64InvalidateBytes += u32Length;
+    }
+    pstState->bReadWindow = bInvalidate;
+    pthread_mutex_unlock(&gCacheLock);
+
+    /*
+     * reads and writes both invalidate through a read window, closed with
+     * the same direction in mpi_mb_cpu_access_end(). the written bytes get
+     * a write window of their own there.
+     */
+    if (bInvalidate) {
+        RK_U64 u64StartUs = mpi_test_utils_get_now_us();
+        RK_MPI_MMZ_FlushCacheStart(blk, u32Offset, u32Length, RK_MMZ_SYNC_READONLY);
+        mpi_mb_cache_add_time(u64StartUs);
+    }
+    *ppVirAddr = reinterpret_cast<RK_U8 *>(RK_MPI_MB_Handle2VirAddr(blk)) + u32Offset;
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_mb_cpu_access_end(MB_BLK blk, RK_U32 u32DirtyOffset, RK_U32 u32DirtyLength) {
+    if (blk == RK_NULL) {
+        return RK_FAILURE;
+    }
+
+    pthread_mutex_lock(&gCacheLock);
+    MB_CACHE_STATE_S *pstState = mpi_mb_cache_state(blk);
+    RK_U32 u32Offset = pstState->u32AccessOffset;
+    RK_U32 u32Length = pstState->u32AccessLength;
+    mpi_mb_cache_add_dirty(pstState, u32DirtyOffset, u32DirtyLength);
+    RK_U32 u32Start = pstState->u32DirtyStart;
+    RK_U32 u32End = pstState->u32DirtyEnd;
+    RK_BOOL bCacheable = pstState->bCacheable;
+    RK_BOOL bReadWindow = pstState->bReadWindow;
+    pstState->u32DirtyStart = pstState->u32DirtyEnd = 0;
+    pstState->u32AccessLength = 0;
+    pstState->bReadWindow = RK_FALSE;
+    mpi_mb_cache_count(pstState, bCacheable ? u32End - u32Start : 0);
+    pthread_mutex_unlock(&gCacheLock);
+
+    if (!bCacheable) {
+        return RK_SUCCESS;
+    }
+    RK_S32 s32Ret = RK_SUCCESS;
+    RK_U64 u64StartUs = mpi_test_utils_get_now_us();
+    if (bReadWindow) {
+        s32Ret = RK_MPI_MMZ_FlushCacheEnd(blk, u32Offset, u32Length, RK_MMZ_SYNC_READONLY);
+    }
+    if (u32End > u32Start) {
+        RK_MPI_MMZ_FlushCacheStart(blk, u32Start, u32End - u32Start, RK_MMZ_SYNC_WRITEONLY);
+        RK_S32 s32Clean = RK_MPI_MMZ_FlushCacheEnd(blk, u32Start, u32End - u32Start, RK_MMZ_SYNC_WRITEONLY);
+        s32Ret = (s32Ret == RK_SUCCESS) ? s32Clean : s32Ret;
+    }
+    mpi_mb_cache_add_time(u64StartUs);
+    return s32Ret;
+}
+
+RK_S32 mpi_mb_mark_dirty(MB_BLK blk, RK_U32 u32Offset, RK_U32 u32Length) {
+    if (blk == RK_NULL) {
+        return RK_FAILURE;
+    }
+
+    pthread_mutex_lock(&gCacheLock);
+    mpi_mb_cache_add_dirty(mpi_mb_cache_state(blk), u32Offset, u32Length);
+    pthread_mutex_unlock(&gCacheLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_mb_flush_dirty(MB_BLK blk) {
+    if (blk == RK_NULL) {
+        return RK_FAILURE;
+    }
+
+    pthread_mutex_lock(&gCacheLock);
+    MB_CACHE_STATE_S *pstState = mpi_mb_cache_state(blk);
+    RK_U32 u32Start = pstState->u32DirtyStart;
+    RK_U32 u32Length = pstState->bCacheable ? pstState->u32DirtyEnd - u32Start : 0;
+    pstState->u32DirtyStart = pstState->u32DirtyEnd = 0;
+    mpi_mb_cache_count(pstState, u32Length);
+    pthread_mutex_unlock(&gCacheLock);
+
+    if (u32Length == 0) {
+        return RK_SUCCESS;
+    }
+    RK_U64 u64StartUs = mpi_test_utils_get_now_us();
+    RK_MPI_MMZ_FlushCacheStart(blk, u32Start, u32Length, RK_MMZ_SYNC_WRITEONLY);
+    RK_S32 s32Ret = RK_MPI_MMZ_FlushCacheEnd(blk, u32Start, u32Length, RK_MMZ_SYNC_WRITEONLY);
+    mpi_mb_cache_add_time(u64StartUs);
+    return s32Ret;
+}
+
+RK_S32 mpi_mb_cache_forget(MB_BLK blk) {
+    pthread_mutex_lock(&gCacheLock);
+    gCacheStates.erase(blk);
+    pthread_mutex_unlock(&gCacheLock);
+    return RK_SUCCESS;
+}
+
+RK_VOID mpi_mb_cache_get_stat(MB_CACHE_STAT_S *pstStat) {
+    pthread_mutex_lock(&gCacheLock);
+    *pstStat = gCacheStat;
+    pthread_mutex_unlock(&gCacheLock);
+}
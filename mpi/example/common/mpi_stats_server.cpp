@@ -0,0 +1,359 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "rk_debug.h"
+#include "rk_mpi_mb.h"
+#include "rk_mpi_venc.h"
+#include "rk_mpi_vi.h"
+#include "rk_mpi_ao.h"
+#include "mpi_stats_server.h"
+
+#define MPI_STATS_POLL_MS       500
+#define MPI_STATS_SEND_MS       1000
+
+typedef std::pair<RK_S32, RK_S32> MPI_STATS_CHN;
+
+typedef struct _MPI_STATS_POOL_S {
+    RK_U32              u32BlkCnt;
+    RK_U64              u64Gets;
+    RK_U64              u64GetFails;        // the pool had no free block
+    std::set<MB_BLK>    blks;               // every block the pool handed out
+} MPI_STATS_POOL_S;
+
+typedef struct _MPI_STATS_SERVER_CTX_S {
+    RK_S32 s32ListenFd;
+    RK_S32 s32WakeFd;
+} MPI_STATS_SERVER_CTX_S;
+
+static pthread_mutex_t gStatsLock = PTHREAD_MUTEX_INITIALIZER;
+static std::set<RK_S32> gVencChns;
+static std::set<MPI_STATS_CHN> gViChns;
+static std::set<MPI_STATS_CHN> gAoChns;
+static std::map<MB_POOL, MPI_STATS_POOL_S> gPools;
+
+static pthread_t gStatsThread;
+static RK_BOOL gStatsRunning = RK_FALSE;
+static RK_S32 gListenFd = -1;
+static RK_S32 gWakeFds[2] = {-1, -1};
+static MPI_STATS_SERVER_CTX_S gServerCtx;
+static std::string gSockPath;
+
+static RK_VOID mpi_stats_append(std::string *pJson, const char *pFmt, ...)
+        __attribute__((format(printf, 2, 3)));
+
+static RK_VOID mpi_stats_append(std::string *pJson, const char *pFmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, pFmt);
+    vsnprintf(buf, sizeof(buf), pFmt, args);
+    va_end(args);
+    pJson->append(buf);
+}
+
+static std::string mpi_stats_build() {
+    std::set<RK_S32> vencChns;
+    std::set<MPI_STATS_CHN> viChns;
+    std::set<MPI_STATS_CHN> aoChns;
+    std::string pools;
+    pthread_mutex_lock(&gStatsLock);
+    vencChns = gVencChns;
+    viChns = gViChns;
+    aoChns = gAoChns;
+    // blocks still referenced by the app or by a module are busy, the pool is unwatched before it is destroyed.
+    for (std::map<MB_POOL, MPI_STATS_POOL_S>::iterator it = gPools.begin(); it != gPools.end(); ++it) {
+        RK_U32 u32Busy = 0;
+        for (std::set<MB_BLK>::iterator blk = it->second.blks.begin(); blk != it->second.blks.end(); ++blk) {
+            u32Busy += RK_MPI_MB_InquireUserCnt(*blk) > 0 ? 1 : 0;
+        }
+        mpi_stats_append(&pools, "%s{\"pool\":%d,\"total\":%u,\"allocated\":%u,\"busy\":%u,"
+                         "\"gets\":%llu,\"getFails\":%llu}",
+                         it == gPools.begin() ? "" : ",", static_cast<RK_S32>(it->first), it->second.u32BlkCnt,
+                         static_cast<RK_U32>(it->second.blks.size()), u32Busy,
+                         (unsigned long long)it->second.u64Gets, (unsigned long long)it->second.u64GetFails);
+    }
+    pthread_mutex_unlock(&gStatsLock);
+
+    std::string json;
+    mpi_stats_append(&json, "{\"pid\":%d,\"venc\":[", getpid());
+    for (std::set<RK_S32>::iterator it = vencChns.begin(); it != vencChns.end(); ++it) {
+        VENC_CHN_STATUS_S stStatus;
+        memset(&stStatus, 0, sizeof(stStatus));
+        RK_S32 s32Ret = RK_MPI_VENC_QueryStatus(*it, &stStatus);
+        mpi_stats_append(&json, "%s{\"chn\":%d,\"ret\":%d,\"leftPics\":%u,\"leftStreamBytes\":%u,"
+                         "\"leftStreamFrames\":%u,\"curPacks\":%u,\"leftRecvPics\":%u,\"leftEncPics\":%u}",
+                         it == vencChns.begin() ? "" : ",", *it, s32Ret,
+                         stStatus.u32LeftPics, stStatus.u32LeftStreamBytes, stStatus.u32LeftStreamFrames,
+                         stStatus.u32CurPacks, stStatus.u32LeftRecvPics, stStatus.u32LeftEncPics);
+    }
+    json.append("],\"vi\":[");
+    for (std::set<MPI_STATS_CHN>::iterator it = viChns.begin(); it != viChns.end(); ++it) {
+        VI_CHN_STATUS_S stStatus;
+        memset(&stStatus, 0, sizeof(stStatus));
+        RK_S32 s32Ret = RK_MPI_VI_QueryChnStatus(it->first, it->second, &stStatus);
+        mpi_stats_append(&json, "%s{\"pipe\":%d,\"chn\":%d,\"ret\":%d,\"enable\":%s,\"frameRate\":%u,"
+                         "\"lostFrame\":%u,\"vbFail\":%u,\"width\":%u,\"height\":%u}",
+                         it == viChns.begin() ? "" : ",", it->first, it->second, s32Ret,
+                         stStatus.bEnable ? "true" : "false", stStatus.u32FrameRate,
+                         stStatus.u32LostFrame, stStatus.u32VbFail,
+                         stStatus.stSize.u32Width, stStatus.stSize.u32Height);
+    }
+    json.append("],\"ao\":[");
+    for (std::set<MPI_STATS_CHN>::iterator it = aoChns.begin(); it != aoChns.end(); ++it) {
+        AO_CHN_STATE_S stStatus;
+        memset(&stStatus, 0, sizeof(stStatus));
+        RK_S32 s32Ret = RK_MPI_AO_QueryChnStat(it->first, it->second, &stStatus);
+        mpi_stats_append(&json, "%s{\"dev\":%d,\"chn\":%d,\"ret\":%d,\"total\":%u,\"free\":%u,\"busy\":%u}",
+                         it == aoChns.begin() ? "" : ",", it->first, it->second, s32Ret,
+                         stStatus.u32ChnTotalNum, stStatus.u32ChnFreeNum, stStatus.u32ChnBusyNum);
+    }
+    json.append("],\"pools\":[");
+    json.append(pools);
+    json.append("]}\n");
+    return json;
+}
+
+static RK_U64 mpi_stats_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<RK_U64>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static RK_VOID mpi_stats_serve(RK_S32 s32Client) {
+    std::string json = mpi_stats_build();
+    // one client at a time, a client which stops reading is dropped.
+    struct timeval stTimeout;
+    stTimeout.tv_sec = MPI_STATS_SEND_MS / 1000;
+    stTimeout.tv_usec = (MPI_STATS_SEND_MS % 1000) * 1000;
+    setsockopt(s32Client, SOL_SOCKET, SO_SNDTIMEO, &stTimeout, sizeof(stTimeout));
+    RK_U64 u64DeadlineMs = mpi_stats_now_ms() + MPI_STATS_SEND_MS;
+    size_t sent = 0;
+    while (sent < json.size() && mpi_stats_now_ms() < u64DeadlineMs) {
+        ssize_t len = send(s32Client, json.data() + sent, json.size() - sent, MSG_NOSIGNAL);
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            RK_LOGW("stats server drops a client: %s", len < 0 ? strerror(errno) : "closed");
+            break;
+        }
+        sent += len;
+    }
+}
+
+static void *mpi_stats_thread(void *pArgs) {
+    const MPI_STATS_SERVER_CTX_S *pstCtx = reinterpret_cast<const MPI_STATS_SERVER_CTX_S *>(pArgs);
+    struct pollfd fds[2];
+    fds[0].fd = pstCtx->s32ListenFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = pstCtx->s32WakeFd;
+    fds[1].events = POLLIN;
+    while (1) {
+        RK_S32 s32Ret = poll(fds, 2, MPI_STATS_POLL_MS);
+        if (s32Ret < 0 && errno != EINTR) {
+            RK_LOGE("stats server poll failed: %s", strerror(errno));
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (s32Ret > 0 && (fds[0].revents & POLLIN)) {
+            RK_S32 s32Client = accept(pstCtx->s32ListenFd, RK_NULL, RK_NULL);
+            if (s32Client >= 0) {
+                mpi_stats_serve(s32Client);
+                close(s32Client);
+            }
+        }
+    }
+    return RK_NULL;
+}
+
+static RK_VOID mpi_stats_close_fds() {
+    if (gListenFd >= 0) {
+        close(gListenFd);
+        gListenFd = -1;
+    }
+    for (RK_S32 i = 0; i < 2; i++) {
+        if (gWakeFds[i] >= 0) {
+            close(gWakeFds[i]);
+            gWakeFds[i] = -1;
+        }
+    }
+}
+
+RK_S32 mpi_stats_server_start(const char *pSockPath) {
+    struct sockaddr_un addr;
+    if (pSockPath == RK_NULL || strlen(pSockPath) >= sizeof(addr.sun_path)) {
+        return RK_FAILURE;
+    }
+    if (gStatsRunning) {
+        return RK_SUCCESS;
+    }
+
+    gListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (gListenFd < 0) {
+        RK_LOGE("stats server socket failed: %s", strerror(errno));
+        return RK_FAILURE;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, pSockPath, sizeof(addr.sun_path) - 1);
+    unlink(pSockPath);
+    if (bind(gListenFd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0
+            || listen(gListenFd, 4) < 0 || pipe(gWakeFds) < 0) {
+        RK_LOGE("stats server bind %s failed: %s", pSockPath, strerror(errno));
+        mpi_stats_close_fds();
+        return RK_FAILURE;
+    }
+    gServerCtx.s32ListenFd = gListenFd;
+    gServerCtx.s32WakeFd = gWakeFds[0];
+    if (pthread_create(&gStatsThread, RK_NULL, mpi_stats_thread, &gServerCtx) != 0) {
+        mpi_stats_close_fds();
+        return RK_FAILURE;
+    }
+    gSockPath = pSockPath;
+    gStatsRunning = RK_TRUE;
+    RK_LOGI("stats server listening on %s", pSockPath);
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_stats_server_start_from_env() {
+    const char *pSockPath = getenv(MPI_STATS_SERVER_ENV_PATH);
+    if (pSockPath == RK_NULL || pSockPath[0] == '\0') {
+        return RK_SUCCESS;
+    }
+    return mpi_stats_server_start(pSockPath);
+}
+
+RK_S32 mpi_stats_server_stop() {
+    if (!gStatsRunning) {
+        return RK_SUCCESS;
+    }
+    if (write(gWakeFds[1], "q", 1) < 0) {
+        RK_LOGE("stats server wake failed: %s", strerror(errno));
+    }
+    pthread_join(gStatsThread, RK_NULL);
+    mpi_stats_close_fds();
+    unlink(gSockPath.c_str());
+    gStatsRunning = RK_FALSE;
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_stats_server_watch_venc(VENC_CHN VeChn) {
+    pthread_mutex_lock(&gStatsLock);
+    gVencChns.insert(VeChn);
+    pthread_mutex_unlock(&gStatsLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_stats_server_watch_vi(VI_PIPE ViPipe, VI_CHN ViChn) {
+    pthread_mutex_lock(&gStatsLock);
+    gViChns.insert(std::make_pair(ViPipe, ViChn));
+    pthread_mutex_unlock(&gStatsLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_stats_server_watch_ao(AUDIO_DEV AoDevId, AO_CHN AoChn) {
+    pthread_mutex_lock(&gStatsLock);
+    gAoChns.insert(std::make_pair(AoDevId, AoChn));
+    pthread_mutex_unlock(&gStatsLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_stats_server_watch_pool(MB_POOL pool, RK_U32 u32BlkCnt) {
+    if (pool == MB_INVALID_POOLID) {
+        return RK_FAILURE;
+    }
+    pthread_mutex_lock(&gStatsLock);
+    MPI_STATS_POOL_S &stPool = gPools[pool];
+    stPool.u32BlkCnt = u32BlkCnt;
+    stPool.u64Gets = 0;
+    stPool.u64GetFails = 0;
+    stPool.blks.clear();
+    pthread_mutex_unlock(&gStatsLock);
+    return RK_SUCCESS;
+}
+
+MB_BLK mpi_stats_server_get_mb(MB_POOL pool, RK_U64 u64Size, RK_BOOL bBlock) {
+    MB_BLK blk = RK_MPI_MB_GetMB(pool, u64Size, bBlock);
+    pthread_mutex_lock(&gStatsLock);
+    std::map<MB_POOL, MPI_STATS_POOL_S>::iterator it = gPools.find(pool);
+    if (it != gPools.end()) {
+        it->second.u64Gets++;
+        if (blk == RK_NULL) {
+            it->second.u64GetFails++;
+        } else {
+            it->second.blks.insert(blk);
+        }
+    }
+    pthread_mutex_unlock(&gStatsLock);
+    return blk;
+}
+
+RK_S32 mpi_stats_server_unwatch_venc(VENC_CHN VeChn) {
+    pthread_mutex_lock(&gStatsLock);
+    gVencChns.erase(VeChn);
+    pthread_mutex_unlock(&gStatsLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_stats_server_unwatch_vi(VI_PIPE ViPipe, VI_CHN ViChn) {
+    pthread_mutex_lock(&gStatsLock);
+    gViChns.erase(std::make_pair(ViPipe, ViChn));
+    pthread_mutex_unlock(&gStatsLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_stats_server_unwatch_ao(AUDIO_DEV AoDevId, AO_CHN AoChn) {
+    pthread_mutex_lock(&gStatsLock);
+    gAoChns.erase(std::make_pair(AoDevId, AoChn));
+    pthread_mutex_unlock(&gStatsLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_stats_server_unwatch_pool(MB_POOL pool) {
+    pthread_mutex_lock(&gStatsLock);
+    gPools.erase(pool);
+    pthread_mutex_unlock(&gStatsLock);
+    return RK_SUCCESS;
+}
+
+RK_S32 mpi_stats_server_snapshot(char *pBuf, RK_U32 u32Size) {
+    if (pBuf == RK_NULL || u32Size == 0) {
+        return RK_FAILURE;
+    }
+    std::string json = mpi_stats_build();
+    if (json.size() >= u32Size) {
+        return RK_FAILURE;
+    }
+    memcpy(pBuf, json.c_str(), json.size() + 1);
+    return static_cast<RK_S32>(json.size());
+}
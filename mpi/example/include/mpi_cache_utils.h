@@ -0,0 +1,69 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TESTS_RT_MPI_MPI_CACHE_UTILS_H_
+#define SRC_TESTS_RT_MPI_MPI_CACHE_UTILS_H_
+
+#include "rk_type.h"
+#include "rk_comm_mb.h"
+
+/*
+ * CPU dirty tracking of cached MB_BLKs.
+ *
+ * the CPU accesses a block between mpi_mb_cpu_access_begin() and
+ * mpi_mb_cpu_access_end(), and reports which bytes it wrote. only that
+ * range is cleaned, nothing at all when the CPU did not write. a fill,
+ * which overwrites the range without reading it, skips the invalidate at
+ * the beginning too. uncached blocks skip every cache operation. every
+ * FlushCacheStart is closed by a FlushCacheEnd of the same range and
+ * direction: the invalidate is a READONLY window over the access, the
+ * clean a WRITEONLY window over the dirty bytes.
+ *
+ * code which writes through its own pointer marks the bytes with
+ * mpi_mb_mark_dirty() and calls mpi_mb_flush_dirty() where it used to
+ * call RK_MPI_SYS_MmzFlushCache(blk, RK_FALSE) on the whole block.
+ */
+typedef enum _MB_CPU_ACCESS_E {
+    MB_CPU_ACCESS_READ = 0,
+    MB_CPU_ACCESS_WRITE,        // read and write, the range is invalidated first
+    // writes every byte of the range without reading it, e.g. a frame read
+    // from a file. lines at the edges of the range shared with device data
+    // need MB_CPU_ACCESS_WRITE.
+    MB_CPU_ACCESS_FILL,
+} MB_CPU_ACCESS_E;
+
+typedef struct _MB_CACHE_STAT_S {
+    RK_U64 u64Skipped;      // flushes dropped, nothing was dirty or block uncached
+    RK_U64 u64Partial;      // flushes limited to the dirty range
+    RK_U64 u64Full;         // flushes of the whole block
+    RK_U64 u64FlushBytes;
+    RK_U64 u64Invalidates;  // invalidates at the beginning of an access
+    RK_U64 u64InvalidateBytes;
+    RK_U64 u64SyncUs;       // time spent in cache operations
+} MB_CACHE_STAT_S;
+
+RK_S32 mpi_mb_cpu_access_begin(MB_BLK blk, RK_U32 u32Offset, RK_U32 u32Length,
+                               MB_CPU_ACCESS_E enAccess, RK_VOID **ppVirAddr);
+RK_S32 mpi_mb_cpu_access_end(MB_BLK blk, RK_U32 u32DirtyOffset, RK_U32 u32DirtyLength);
+
+RK_S32 mpi_mb_mark_dirty(MB_BLK blk, RK_U32 u32Offset, RK_U32 u32Length);
+RK_S32 mpi_mb_flush_dirty(MB_BLK blk);
+// drops the tracking state, call it before the block goes back to its pool.
+RK_S32 mpi_mb_cache_forget(MB_BLK blk);
+
+RK_VOID mpi_mb_cache_get_stat(MB_CACHE_STAT_S *pstStat);
+
+#endif  // SRC_TESTS_RT_MPI_MPI_CACHE_UTILS_H_
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TESTS_RT_MPI_MPI_STATS_SERVER_H_
+#define SRC_TESTS_RT_MPI_MPI_STATS_SERVER_H_
+
+#include "rk_type.h"
+#include "rk_common.h"
+#include "rk_comm_venc.h"
+#include "rk_comm_vi.h"
+#include "rk_comm_aio.h"
+#include "rk_comm_mb.h"
+
+#define MPI_STATS_SERVER_ENV_PATH   "mpi_stats_server"
+
+/*
+ * live MPI channel status over a unix socket.
+ *
+ * every connection gets one json snapshot of the watched channels, built
+ * with RK_MPI_VENC_QueryStatus(), RK_MPI_VI_QueryChnStatus() and
+ * RK_MPI_AO_QueryChnStat() at the time of the request:
+ *
+ *   {"pid":..,"venc":[{"chn":0,"leftPics":..}],"vi":[..],"ao":[..]}
+ *
+ * the server runs in its own thread and never blocks the pipeline.
+ */
+RK_S32 mpi_stats_server_start(const char *pSockPath);
+// starts at the path of the mpi_stats_server environment variable, if set.
+RK_S32 mpi_stats_server_start_from_env();
+RK_S32 mpi_stats_server_stop();
+
+RK_S32 mpi_stats_server_watch_venc(VENC_CHN VeChn);
+RK_S32 mpi_stats_server_watch_vi(VI_PIPE ViPipe, VI_CHN ViChn);
+RK_S32 mpi_stats_server_watch_ao(AUDIO_DEV AoDevId, AO_CHN AoChn);
+/*
+ * pool occupancy: the blocks of a watched pool are counted when taken with
+ * mpi_stats_server_get_mb(), a block is busy while the app or a module
+ * still references it.
+ */
+RK_S32 mpi_stats_server_watch_pool(MB_POOL pool, RK_U32 u32BlkCnt);
+MB_BLK mpi_stats_server_get_mb(MB_POOL pool, RK_U64 u64Size, RK_BOOL bBlock);
+// forget a channel before it is destroyed.
+RK_S32 mpi_stats_server_unwatch_venc(VENC_CHN VeChn);
+RK_S32 mpi_stats_server_unwatch_vi(VI_PIPE ViPipe, VI_CHN ViChn);
+RK_S32 mpi_stats_server_unwatch_ao(AUDIO_DEV AoDevId, AO_CHN AoChn);
+RK_S32 mpi_stats_server_unwatch_pool(MB_POOL pool);
+
+// writes the snapshot json into pBuf, returns its length or a negative error.
+RK_S32 mpi_stats_server_snapshot(char *pBuf, RK_U32 u32Size);
+
+#endif  // SRC_TESTS_RT_MPI_MPI_STATS_SERVER_H_
@@ -30,6 +30,8 @@
 #include "rk_mpi_cal.h"
 #include "argparse.h"
 #include "mpi_test_utils.h"
+#include "mpi_cache_utils.h"
+#include "mpi_stats_server.h"
 
 #define MAX_TIME_OUT_MS          20
 #define TEST_RC_MODE             0
@@ -48,6 +50,7 @@ typedef struct _rkMpiVENCCtx {
     RK_U32          u32DstCodec;
     RK_U32          u32BufferSize;
     RK_U32          u32StreamBufCnt;
+    RK_U32          u32CpuAccess;
     RK_BOOL         threadExit;
     MB_POOL         vencPool;
 } TEST_VENC_CTX_S;
@@ -108,6 +111,20 @@ static RK_S32 read_image(RK_U8 *pVirAddr, RK_U32 u32Width, RK_U32 u32Height,
     return s32Ret;
 }
 
+// bytes from the start of the buffer up to the last one written by read_image
+static RK_U32 image_written_size(RK_U32 u32Width, RK_U32 u32Height,
+                                 RK_U32 u32VirWidth, RK_U32 u32VirHeight, RK_U32 u32PixFormat) {
+    switch (u32PixFormat) {
+        case RK_FMT_YUV420SP:
+            return u32VirWidth * u32VirHeight + u32VirWidth * (u32Height / 2 - 1) + u32Width;
+        case RK_FMT_RGB888:
+        case RK_FMT_BGR888:
+            return u32VirWidth * 3 * (u32Height - 1) + u32Width * 3;
+        default:
+            return 0;
+    }
+}
+
 static RK_S32 check_options(const TEST_VENC_CTX_S *ctx) {
     if (ctx->srcFileUri == RK_NULL) {
         goto __FAILED;
@@ -116,7 +133,9 @@ static RK_S32 check_options(const TEST_VENC_CTX_S *ctx) {
     if (ctx->u32SrcPixFormat == RK_FMT_BUTT ||
         ctx->u32DstCodec <= RK_VIDEO_ID_Unused ||
         ctx->u32SrcWidth <= 0 ||
-        ctx->u32SrcHeight <= 0) {
+        ctx->u32SrcHeight <= 0 ||
+        ctx->u32CpuAccess == MB_CPU_ACCESS_READ ||
+        ctx->u32CpuAccess > MB_CPU_ACCESS_FILL) {
         goto __FAILED;
     }
 
@@ -204,13 +223,14 @@ void* venc_send_frame(void *pArgs) {
     }
 
     while (!pstCtx->threadExit) {
-        blk = RK_MPI_MB_GetMB(pool, pstCtx->u32BufferSize, RK_TRUE);
+        blk = mpi_stats_server_get_mb(pool, pstCtx->u32BufferSize, RK_TRUE);
 
         if (RK_NULL == blk) {
             usleep(2000llu);
             continue;
         }
-        pVirAddr = reinterpret_cast<RK_U8 *>(RK_MPI_MB_Handle2VirAddr(blk));
+        mpi_mb_cpu_access_begin(blk, 0, 0, (MB_CPU_ACCESS_E)pstCtx->u32CpuAccess,
+                                reinterpret_cast<RK_VOID **>(&pVirAddr));
         s32Ret = read_image(pVirAddr, pstCtx->u32SrcWidth, pstCtx->u32SrcHeight,
                   pstCtx->u32srcVirWidth, pstCtx->u32srcVirHeight, pstCtx->u32SrcPixFormat, fp);
         if (s32Ret != RK_SUCCESS) {
@@ -220,6 +240,8 @@ void* venc_send_frame(void *pArgs) {
                 RK_LOGI("finish venc count %d\n", pstCtx->s32LoopCount - s32LoopCount);
                 if (s32LoopCount > 0) {
                     s32ReachEOS = 0;
+                    mpi_mb_cpu_access_end(blk, 0, 0);
+                    mpi_mb_cache_forget(blk);
                     RK_MPI_MB_ReleaseMB(blk);
 
                     fseek(fp, 0L, SEEK_SET);
@@ -229,7 +251,10 @@ void* venc_send_frame(void *pArgs) {
              }
         }
 
-        RK_MPI_SYS_MmzFlushCache(blk, RK_FALSE);
+        // only clean the bytes read_image() wrote instead of the whole block
+        mpi_mb_cpu_access_end(blk, 0, image_written_size(pstCtx->u32SrcWidth, pstCtx->u32SrcHeight,
+                                  pstCtx->u32srcVirWidth, pstCtx->u32srcVirHeight,
+                                  pstCtx->u32SrcPixFormat));
 
         stFrame.stVFrame.pMbBlk = blk;
         stFrame.stVFrame.u32Width = pstCtx->u32SrcWidth;
@@ -242,6 +267,7 @@ __RETRY:
         s32Ret = RK_MPI_VENC_SendFrame(u32Ch, &stFrame, -1);
         if (s32Ret < 0) {
             if (pstCtx->threadExit) {
+                mpi_mb_cache_forget(blk);
                 RK_MPI_MB_ReleaseMB(blk);
                 break;
             }
@@ -249,6 +275,7 @@ __RETRY:
             usleep(10000llu);
             goto  __RETRY;
         } else {
+            mpi_mb_cache_forget(blk);
             RK_MPI_MB_ReleaseMB(blk);
             s32FrameCount++;
             RK_LOGI("chn %d frame %d", u32Ch, s32FrameCount);
@@ -334,6 +361,7 @@ RK_S32 unit_test_mpi_venc(TEST_VENC_CTX_S *ctx) {
         stAttr.stVencAttr.u32BufSize = ctx->u32BufferSize;
 
         RK_MPI_VENC_CreateChn(u32Ch, &stAttr);
+        mpi_stats_server_watch_venc(u32Ch);
 
 #if TEST_RC_MODE
         stAttr.stRcAttr.enRcMode = VENC_RC_MODE_H264AVBR;
@@ -362,6 +390,7 @@ RK_S32 unit_test_mpi_venc(TEST_VENC_CTX_S *ctx) {
         stMbPoolCfg.enAllocType = MB_ALLOC_TYPE_DMA;
 
         ctx->vencPool = RK_MPI_MB_CreatePool(&stMbPoolCfg);
+        mpi_stats_server_watch_pool(ctx->vencPool, stMbPoolCfg.u32MBCnt);
 
         memcpy(&(stVencCtx[u32Ch]), ctx, sizeof(TEST_VENC_CTX_S));
         pthread_create(&vencThread[u32Ch], 0, venc_send_frame, reinterpret_cast<void *>(&stVencCtx[u32Ch]));
@@ -375,10 +404,22 @@ RK_S32 unit_test_mpi_venc(TEST_VENC_CTX_S *ctx) {
         stVencCtx[u32Ch].threadExit = RK_TRUE;
         RK_MPI_VENC_StopRecvFrame(u32Ch);
 
+        mpi_stats_server_unwatch_venc(u32Ch);
         RK_MPI_VENC_DestroyChn(u32Ch);
+        mpi_stats_server_unwatch_pool(stVencCtx[u32Ch].vencPool);
         RK_MPI_MB_DestroyPool(stVencCtx[u32Ch].vencPool);
     }
 
+    // compare --cpu_access 1 and 2 to see what the invalidate of the source fill costs.
+    MB_CACHE_STAT_S stCacheStat;
+    mpi_mb_cache_get_stat(&stCacheStat);
+    RK_U64 u64Frames = stCacheStat.u64Skipped + stCacheStat.u64Partial + stCacheStat.u64Full;
+    if (u64Frames > 0) {
+        RK_LOGI("cache of %lld source frames: invalidated %lld bytes/frame, cleaned %lld bytes/frame, %lld us/frame",
+                (long long)u64Frames, (long long)(stCacheStat.u64InvalidateBytes / u64Frames),
+                (long long)(stCacheStat.u64FlushBytes / u64Frames), (long long)(stCacheStat.u64SyncUs / u64Frames));
+    }
+
     return RK_SUCCESS;
 }
 
@@ -402,6 +443,7 @@ static void mpi_venc_test_show_options(const TEST_VENC_CTX_S *ctx) {
     RK_PRINT("channel num            : %d\n", ctx->u32ChNum);
     RK_PRINT("output buffer count    : %d\n", ctx->u32StreamBufCnt);
     RK_PRINT("one picture size       : %d\n", ctx->u32BufferSize);
+    RK_PRINT("source cpu access      : %d\n", ctx->u32CpuAccess);
     return;
 }
 
@@ -415,6 +457,7 @@ int main(int argc, const char **argv) {
     ctx.u32ChNum        = 1;
     ctx.u32SrcPixFormat = RK_FMT_YUV420SP;
     ctx.u32DstCodec     = RK_VIDEO_ID_AVC;
+    ctx.u32CpuAccess    = MB_CPU_ACCESS_FILL;
 
     struct argparse_option options[] = {
         OPT_HELP(),
@@ -445,6 +488,8 @@ int main(int argc, const char **argv) {
                      "venc encode output buffer count, default(8)", NULL, 0, 0),
         OPT_INTEGER('\0', "src_pic_size", &(ctx.u32BufferSize),
                      "the size of input single picture", NULL, 0, 0),
+        OPT_INTEGER('\0', "cpu_access", &(ctx.u32CpuAccess),
+                     "cpu access of the source fill(1: read-write, 2: write only). default(2)", NULL, 0, 0),
         OPT_END(),
     };
 
@@ -466,9 +511,11 @@ int main(int argc, const char **argv) {
         return s32Ret;
     }
 
+    mpi_stats_server_start_from_env();
     if (unit_test_mpi_venc(&ctx) < 0) {
         goto __FAILED;
     }
+    mpi_stats_server_stop();
 
     s32Ret = RK_MPI_SYS_Exit();
     if (s32Ret != RK_SUCCESS) {
@@ -477,6 +524,7 @@ int main(int argc, const char **argv) {
     RK_LOGE("test running success!");
     return RK_SUCCESS;
 __FAILED:
+    mpi_stats_server_stop();
     RK_MPI_SYS_Exit();
     RK_LOGE("test running failed!");
     return s32Ret;
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: nv12 frame graph of the cpu benchmarks
+ *
+ * runs one nv12 image through nodes of librockit, the way a pipeline of
+ * the aicamera configs does:
+ *
+ *   bench_image_source -> node 1 -> ... -> node N -> bench_image_sink
+ *
+ * the source sends the same image -n times, the sink keeps the first
+ * frame it gets. used to time the library path a software helper of the
+ * sdk replaces, on the board only: the nodes are those of librockit.
+ * included by one benchmark, it registers its two nodes.
+ */
+
+#ifndef TGI_BENCHMARK_RT_BENCH_GRAPH_H_
+#define TGI_BENCHMARK_RT_BENCH_GRAPH_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_time.h"
+#include "RTImageScaler.h"
+#include "RTMediaBuffer.h"
+#include "RTMediaMetaKeys.h"
+#include "RTNodeCommon.h"
+#include "RTTaskGraph.h"
+#include "RTTaskNode.h"
+#include "RTTaskNodeFactory.h"
+#include "RTVideoFrame.h"
+
+#define BENCH_GRAPH_NODE_SOURCE     "bench_image_source"
+#define BENCH_GRAPH_NODE_SINK       "bench_image_sink"
+#define BENCH_GRAPH_FMT             "image:nv12"
+#define BENCH_GRAPH_BUFFERS         3
+#define BENCH_GRAPH_EOS_TIMEOUT_US  (30 * 1000 * 1000)
+
+// one node of the chain, opts are stream_opts_extra with their values as json text.
+typedef struct _BenchGraphNode {
+    std::string                                         name;
+    INT32                                               bufferSize;
+    std::vector<std::pair<std::string, std::string>>    opts;
+} BenchGraphNode;
+
+static inline void bench_graph_opt(BenchGraphNode *node, const char *key, INT32 value) {
+    node->opts.push_back(std::make_pair(std::string(key), util_to_string(value)));
+}
+
+static inline void bench_graph_opt(BenchGraphNode *node, const char *key, const std::string &value) {
+    node->opts.push_back(std::make_pair(std::string(key), "\"" + value + "\""));
+}
+
+/*
+ * the frame in and out of the graph, the nodes are created by the factory
+ * and can not be handed a context.
+ */
+static const RTScaleImage  *gBenchGraphSrc = RT_NULL;
+static RTScaleImage         gBenchGraphOut;
+static INT32                gBenchGraphFrames = 0;
+static INT32                gBenchGraphReceived = 0;
+
+static inline UINT32 bench_graph_nv12_size(const RTScaleImage &image) {
+    return static_cast<UINT32>(image.virWidth * image.virHeight * 3 / 2);
+}
+
+// sends gBenchGraphSrc gBenchGraphFrames times, each pool buffer is filled once.
+class RTBenchImageSource : public RTTaskNode {
+ public:
+    RTBenchImageSource() : mSent(0) {}
+    virtual ~RTBenchImageSource() {}
+
+    virtual RT_RET open(RTTaskNodeContext *context) {
+        mSent = 0;
+        mFilled.clear();
+        return RT_OK;
+    }
+
+    virtual RT_RET process(RTTaskNodeContext *context) {
+        if (mSent >= gBenchGraphFrames) {
+            return RT_ERR_END_OF_STREAM;
+        }
+        RTMediaBuffer *buffer = context->dequeOutputBuffer(RT_TRUE);
+        if (buffer == RT_NULL) {
+            return RT_ERR_NO_BUFFER;
+        }
+        const RTScaleImage &src = *gBenchGraphSrc;
+        const UINT32 size = bench_graph_nv12_size(src);
+        RTVideoFrame *frame = reinterpret_vframe(buffer);
+        if (frame == RT_NULL || buffer->getSize() < size) {
+            buffer->release();
+            return RT_ERR_VALUE;
+        }
+        if (mFilled.insert(buffer->getData()).second) {
+            memcpy(buffer->getData(), src.data, size);
+        }
+        RTRect rect = { 0, 0, src.width, src.height };
+        frame->setWidth(src.width);
+        frame->setHeight(src.height);
+        frame->setVirWidth(src.virWidth);
+        frame->setVirHeight(src.virHeight);
+        frame->setPixelFormat(RT_FMT_YUV420SP);
+        frame->setOpRect(rect);
+        frame->setSeq(mSent);
+        buffer->setRange(0, size);
+        if (++mSent == gBenchGraphFrames) {
+            buffer->getMetaData()->setInt32(kKeyFrameEOS, 1);
+        } else {
+            buffer->getMetaData()->remove(kKeyFrameEOS);
+        }
+        return context->queueOutputBuffer(buffer);
+    }
+
+    virtual RT_RET close(RTTaskNodeContext *context) { return RT_OK; }
+
+ private:
+    INT32            mSent;
+    std::set<void *> mFilled;
+};
+
+// keeps the first frame in gBenchGraphOut and counts the others.
+class RTBenchImageSink : public RTTaskNode {
+ public:
+    RTBenchImageSink() {}
+    virtual ~RTBenchImageSink() {}
+
+    virtual RT_RET open(RTTaskNodeContext *context) { return RT_OK; }
+
+    virtual RT_RET process(RTTaskNodeContext *context) {
+        RTMediaBuffer *buffer = context->dequeInputBuffer();
+        if (buffer == RT_NULL) {
+            return RT_OK;
+        }
+        RTVideoFrame *frame = reinterpret_vframe(buffer);
+        if (gBenchGraphReceived++ == 0 && frame != RT_NULL) {
+            copyFrame(buffer, frame);
+        }
+        buffer->release();
+        return RT_OK;
+    }
+
+    virtual RT_RET close(RTTaskNodeContext *context) { return RT_OK; }
+
+ private:
+    // luma rows then chroma rows, from the strides of the node into those of gBenchGraphOut.
+    void copyFrame(RTMediaBuffer *buffer, RTVideoFrame *frame) {
+        RTScaleImage &out = gBenchGraphOut;
+        const INT32 virW = RT_MAX(static_cast<INT32>(frame->getVirWidth()), out.width);
+        const INT32 virH = RT_MAX(static_cast<INT32>(frame->getVirHeight()), out.height);
+        const UINT8 *data = static_cast<const UINT8 *>(buffer->getData()) + buffer->getOffset();
+        if (buffer->getSize() < static_cast<UINT32>(virW * virH * 3 / 2)) {
+            RT_LOGE("frame of %d bytes is short of %dx%d", buffer->getSize(), virW, virH);
+            return;
+        }
+        for (INT32 y = 0; y < out.height * 3 / 2; y++) {
+            const INT32 srcY = (y < out.height) ? y : virH + y - out.height;
+            const INT32 dstY = (y < out.height) ? y : out.virHeight + y - out.height;
+            memcpy(out.data + dstY * out.virWidth, data + srcY * virW, out.width);
+        }
+    }
+};
+
+static RTTaskNode* createBenchImageSource() { return new RTBenchImageSource(); }
+static RTTaskNode* createBenchImageSink() { return new RTBenchImageSink(); }
+
+static RTNodeStub node_stub_bench_image_source {
+    .mUid          = MKTAG('b', 'i', 's', 'r'),
+    .mName         = BENCH_GRAPH_NODE_SOURCE,
+    .mVersion      = "v1.0",
+    .mCreateObj    = createBenchImageSource,
+    .mCapsSrc      = { BENCH_GRAPH_FMT, RT_PAD_SRC, RT_MB_TYPE_VFRAME, {RT_NULL, RT_NULL} },
+    .mCapsSink     = { BENCH_GRAPH_FMT, RT_PAD_SINK, RT_MB_TYPE_VFRAME, {RT_NULL, RT_NULL} },
+};
+
+static RTNodeStub node_stub_bench_image_sink {
+    .mUid          = MKTAG('b', 'i', 's', 'k'),
+    .mName         = BENCH_GRAPH_NODE_SINK,
+    .mVersion      = "v1.0",
+    .mCreateObj    = createBenchImageSink,
+    .mCapsSrc      = { BENCH_GRAPH_FMT, RT_PAD_SRC, RT_MB_TYPE_VFRAME, {RT_NULL, RT_NULL} },
+    .mCapsSink     = { BENCH_GRAPH_FMT, RT_PAD_SINK, RT_MB_TYPE_VFRAME, {RT_NULL, RT_NULL} },
+};
+
+RT_NODE_FACTORY_REGISTER_STUB(node_stub_bench_image_source);
+RT_NODE_FACTORY_REGISTER_STUB(node_stub_bench_image_sink);
+
+static inline std::string bench_graph_stream(INT32 nodeId) {
+    return std::string("bench_image_") + util_to_string(nodeId);
+}
+
+static void bench_graph_append(std::string *s, INT32 nodeId, const BenchGraphNode &node, RT_BOOL last) {
+    const RT_BOOL source = (nodeId == 0) ? RT_TRUE : RT_FALSE;
+    const RT_BOOL sink = (node.bufferSize == 0) ? RT_TRUE : RT_FALSE;
+    RT_NODE_TAG_APPEND((*s), nodeId);
+    RT_NODE_OPTS_APPEND((*s));
+    RT_NODE_CONFIG_STRING_LAST_APPEND((*s), OPT_NODE_NAME, node.name);
+    RT_TAG_END((*s));
+
+    s->append("\"").append(KEY_ROOT_NODE_OPTS_EXTRA).append("\": {\n");
+    RT_NODE_CONFIG_NUMBER_APPEND((*s), OPT_NODE_BUFFER_TYPE, sink ? 1 : 0);
+    RT_NODE_CONFIG_NUMBER_APPEND((*s), OPT_NODE_BUFFER_COUNT, sink ? 0 : BENCH_GRAPH_BUFFERS);
+    RT_NODE_CONFIG_NUMBER_LAST_APPEND((*s), OPT_NODE_BUFFER_SIZE, node.bufferSize);
+    RT_TAG_END((*s));
+
+    RT_STREAM_OPTS_APPEND((*s));
+    if (!source) {
+        RT_NODE_CONFIG_STRING_APPEND((*s), "stream_input", bench_graph_stream(nodeId - 1));
+    }
+    if (!sink) {
+        RT_NODE_CONFIG_STRING_APPEND((*s), "stream_output", bench_graph_stream(nodeId));
+    }
+    RT_NODE_CONFIG_STRING_APPEND((*s), "stream_fmt_in", BENCH_GRAPH_FMT);
+    RT_NODE_CONFIG_STRING_LAST_APPEND((*s), "stream_fmt_out", BENCH_GRAPH_FMT);
+    if (node.opts.empty()) {
+        RT_TAG_LAST_END((*s));
+    } else {
+        RT_TAG_END((*s));
+        s->append("\"").append(KEY_ROOT_STREAM_OPTS_EXTRA).append("\": {\n");
+        for (size_t i = 0; i < node.opts.size(); i++) {
+            s->append("\"").append(node.opts[i].first).append("\" : ").append(node.opts[i].second);
+            s->append(i + 1 < node.opts.size() ? ",\n" : "\n");
+        }
+        RT_TAG_LAST_END((*s));
+    }
+    if (last) {
+        RT_TAG_LAST_END((*s));
+    } else {
+        RT_TAG_END((*s));
+    }
+}
+
+/*
+ * sends frames copies of src through nodes, returns us per frame or -1.
+ * the first frame out of the chain is written to out.
+ */
+static INT64 bench_graph_run(const std::vector<BenchGraphNode> &nodes, const RTScaleImage &src,
+                             const RTScaleImage &out, INT32 frames) {
+    BenchGraphNode source;
+    source.name       = BENCH_GRAPH_NODE_SOURCE;
+    source.bufferSize = static_cast<INT32>(bench_graph_nv12_size(src));
+    BenchGraphNode sink;
+    sink.name       = BENCH_GRAPH_NODE_SINK;
+    sink.bufferSize = 0;
+
+    std::string config("{\n");
+    RT_PIPE_TAG_APPEND(config, 0);
+    bench_graph_append(&config, 0, source, RT_FALSE);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        bench_graph_append(&config, static_cast<INT32>(i + 1), nodes[i], RT_FALSE);
+    }
+    bench_graph_append(&config, static_cast<INT32>(nodes.size() + 1), sink, RT_TRUE);
+    RT_TAG_LAST_END(config);
+    RT_TAG_LAST_END(config);
+
+    gBenchGraphSrc      = &src;
+    gBenchGraphOut      = out;
+    gBenchGraphFrames   = frames;
+    gBenchGraphReceived = 0;
+    RTTaskGraph graph("rt_bench_graph");
+    RT_RET ret = graph.autoBuild(config.c_str(), RT_FALSE);
+    ret = (ret == RT_OK) ? graph.prepare() : ret;
+    UINT64 start = RtTime::getRelativeTimeUs();
+    ret = (ret == RT_OK) ? graph.start() : ret;
+    ret = (ret == RT_OK) ? graph.waitUntilEos(BENCH_GRAPH_EOS_TIMEOUT_US) : ret;
+    INT64 costUs = static_cast<INT64>(RtTime::getRelativeTimeUs() - start);
+    graph.stop();
+    graph.release();
+    if (ret != RT_OK || gBenchGraphReceived != frames) {
+        RT_LOGE("bench graph failed, ret %d, %d of %d frames", ret, gBenchGraphReceived, frames);
+        return -1;
+    }
+    return costUs / frames;
+}
+
+#endif  // TGI_BENCHMARK_RT_BENCH_GRAPH_H_
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark of the software color converter
+ *
+ * converts a random NV12 frame the ways a model input is prepared, once
+ * with the scalar reference kernels and once with the simd kernels, checks
+ * that the outputs are bit-exact and prints the time per frame.
+ *
+ * usage: rt_color_bench [-w src_width] [-h src_height] [-W dst_width] [-H dst_height] [-n loops]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "RTColorConvert.h"
+
+typedef struct _ColorBenchCase {
+    const char     *name;
+    RTPixelFormat   srcFormat;
+    RTPixelFormat   dstFormat;
+    RTColorLayout   layout;
+    RTColorDataType dataType;
+    RT_BOOL         resize;
+    RTColorSpace    space;
+    RTColorRange    range;
+} ColorBenchCase;
+
+static const ColorBenchCase gCases[] = {
+    { "nv12->rgb",          RT_FMT_YUV420SP,    RT_FMT_RGB888, RT_COLOR_LAYOUT_INTERLEAVED,
+      RT_COLOR_DATA_UINT8,   RT_FALSE, RTCOL_SPC_SMPTE170M, RTCOL_RANGE_MPEG },
+    { "nv21->bgr709",       RT_FMT_YUV420SP_VU, RT_FMT_BGR888, RT_COLOR_LAYOUT_INTERLEAVED,
+      RT_COLOR_DATA_UINT8,   RT_FALSE, RTCOL_SPC_BT709,     RTCOL_RANGE_JPEG },
+    { "nv12->rgb_planar",   RT_FMT_YUV420SP,    RT_FMT_RGB888, RT_COLOR_LAYOUT_PLANAR,
+      RT_COLOR_DATA_UINT8,   RT_FALSE, RTCOL_SPC_SMPTE170M, RTCOL_RANGE_JPEG },
+    { "resize->rgb",        RT_FMT_YUV420SP,    RT_FMT_RGB888, RT_COLOR_LAYOUT_INTERLEAVED,
+      RT_COLOR_DATA_UINT8,   RT_TRUE,  RTCOL_SPC_SMPTE170M, RTCOL_RANGE_MPEG },
+    { "resize->f32_planar", RT_FMT_YUV420SP,    RT_FMT_RGB888, RT_COLOR_LAYOUT_PLANAR,
+      RT_COLOR_DATA_FLOAT32, RT_TRUE,  RTCOL_SPC_SMPTE170M, RTCOL_RANGE_MPEG },
+    { "resize->i8_planar",  RT_FMT_YUV420SP,    RT_FMT_BGR888, RT_COLOR_LAYOUT_PLANAR,
+      RT_COLOR_DATA_INT8,    RT_TRUE,  RTCOL_SPC_BT709,     RTCOL_RANGE_MPEG },
+    { "rgb->nv12",          RT_FMT_RGB888,      RT_FMT_YUV420SP, RT_COLOR_LAYOUT_INTERLEAVED,
+      RT_COLOR_DATA_UINT8,   RT_FALSE, RTCOL_SPC_SMPTE170M, RTCOL_RANGE_MPEG },
+    { "bgr->nv21",          RT_FMT_BGR888,      RT_FMT_YUV420SP_VU, RT_COLOR_LAYOUT_INTERLEAVED,
+      RT_COLOR_DATA_UINT8,   RT_FALSE, RTCOL_SPC_BT709,     RTCOL_RANGE_JPEG },
+};
+
+static void bench_fill_image(RTScaleImage *image, std::vector<UINT8> *buffer, RTPixelFormat format,
+                             INT32 width, INT32 height, UINT32 size) {
+    memset(image, 0, sizeof(*image));
+    image->format    = format;
+    image->width     = width;
+    image->height    = height;
+    image->virWidth  = width;
+    image->virHeight = height;
+    buffer->assign(size, 0);
+    image->data = &(*buffer)[0];
+}
+
+static INT64 bench_convert(RTColorConverter *converter, const RTScaleImage &src, const RTScaleImage &dst,
+                           INT32 loops) {
+    UINT64 start = RtTime::getRelativeTimeUs();
+    for (INT32 i = 0; i < loops; i++) {
+        if (converter->convert(&src, &dst, RT_SCALE_BILINEAR) != RT_OK) {
+            return -1;
+        }
+    }
+    return static_cast<INT64>(RtTime::getRelativeTimeUs() - start) / loops;
+}
+
+int main(int argc, char **argv) {
+    INT32 srcW = 1920, srcH = 1080, dstW = 640, dstH = 640;
+    INT32 loops = 20;
+    INT32 c;
+    while ((c = getopt(argc, argv, "w:h:W:H:n:")) != -1) {
+        switch (c) {
+          case 'w': srcW  = atoi(optarg); break;
+          case 'h': srcH  = atoi(optarg); break;
+          case 'W': dstW  = atoi(optarg); break;
+          case 'H': dstH  = atoi(optarg); break;
+          case 'n': loops = atoi(optarg); break;
+          default:
+            printf("usage: %s [-w src_width] [-h src_height] [-W dst_width] [-H dst_height] [-n loops]\n",
+                   argv[0]);
+            return -1;
+        }
+    }
+    if (srcW <= 0 || srcH <= 0 || dstW <= 0 || dstH <= 0 || loops <= 0 || ((srcW | srcH | dstW | dstH) & 1)) {
+        return -1;
+    }
+
+    INT32 failed = 0;
+    printf("%dx%d, resized to %dx%d, %s kernels, us per frame\n", srcW, srcH, dstW, dstH, rt_simd_name());
+    printf("%-20s %10s %10s %8s\n", "case", "scalar", "simd", "exact");
+    for (size_t i = 0; i < sizeof(gCases) / sizeof(gCases[0]); i++) {
+        const ColorBenchCase &test = gCases[i];
+        RTColorParams params;
+        rt_color_params_init(&params);
+        params.space    = test.space;
+        params.range    = test.range;
+        params.layout   = test.layout;
+        params.dataType = test.dataType;
+        for (INT32 ch = 0; ch < 3; ch++) {
+            params.mean[ch] = 127.5f;
+            params.std[ch]  = 58.0f + ch;
+        }
+        params.quantScale = 1.0f / 64;
+        RTColorConverter converter;
+        if (converter.setParams(params) != RT_OK) {
+            return -1;
+        }
+
+        std::vector<UINT8> srcBuf, refBuf, outBuf;
+        RTScaleImage src, ref, out;
+        bench_fill_image(&src, &srcBuf, test.srcFormat, srcW, srcH, srcW * srcH * 3);
+        for (size_t b = 0; b < srcBuf.size(); b++) {
+            srcBuf[b] = static_cast<UINT8>(rand());
+        }
+        bench_fill_image(&ref, &refBuf, test.dstFormat, test.resize ? dstW : srcW, test.resize ? dstH : srcH, 0);
+        UINT32 size = converter.getBufferSize(&ref);
+        bench_fill_image(&ref, &refBuf, test.dstFormat, ref.width, ref.height, size);
+        bench_fill_image(&out, &outBuf, test.dstFormat, ref.width, ref.height, size);
+
+        converter.setSimd(RT_FALSE);
+        INT64 scalarUs = bench_convert(&converter, src, ref, loops);
+        converter.setSimd(RT_TRUE);
+        INT64 simdUs = bench_convert(&converter, src, out, loops);
+        RT_BOOL exact = (scalarUs >= 0 && simdUs >= 0 && refBuf == outBuf) ? RT_TRUE : RT_FALSE;
+
+        printf("%-20s %10lld %10lld %8s\n", test.name, (long long)scalarUs, (long long)simdUs,
+               exact ? "yes" : "NO");
+        failed += exact ? 0 : 1;
+    }
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,453 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark of the demuxer packet path and keyframe index
+ *
+ * on an mpeg-ts file:
+ *  - scans the keyframe index from a cold cache and prints MB/s, then opens
+ *    it through RTKeyframeIndexCache three times: scanned and saved, loaded
+ *    from the .rtidx file, and from memory, and checks all are the same;
+ *  - gathers the video pes packets in their own blocks as the demuxer does
+ *    and hands them out copied into a new RTMediaBuffer, as ffm_demuxer did,
+ *    and wrapped without a copy, prints MB/s of both;
+ *  - seeks to random times by rescanning the file from its start, as a seek
+ *    without an index does, and through the index plus a read of the packet
+ *    found, prints the average and p99 latency and checks both find the
+ *    same keyframe.
+ *
+ * without -i an h.264 ts of -m MB is made in /tmp with a keyframe every -g
+ * frames, some without random_access_indicator and some with an sei that
+ * pushes the idr slice into the next ts packet, and pts wrapping after 20s;
+ * its index is checked against the keyframes written. a file of two ts
+ * packets followed by other bytes and an audio-only ts must both get
+ * RT_ERR_UNSUPPORT and no .rtidx.
+ *
+ * usage: rt_demux_bench [-i file] [-m file_mb] [-g gop] [-s seeks]
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_histogram.h"
+#include "RTFileSource.h"
+#include "RTKeyframeIndex.h"
+#include "RTMediaBuffer.h"
+
+#define DEMUX_BENCH_VIDEO_PID   0x100
+#define DEMUX_BENCH_AUDIO_PID   0x101
+#define DEMUX_BENCH_FRAME_PTS   3000        // 30fps at 90kHz
+#define DEMUX_BENCH_KEY_SIZE    80000
+#define DEMUX_BENCH_DELTA_SIZE  20000
+#define DEMUX_BENCH_AUDIO_SIZE  768
+
+typedef struct _DemuxBenchWriter {
+    FILE       *fp;
+    INT64       offset;
+    UINT8       counters[0x2000];
+} DemuxBenchWriter;
+
+static void bench_drop_cache(const char *path) {
+    INT32 fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static void bench_ts_packet(DemuxBenchWriter *writer, INT32 pid, RT_BOOL start, RT_BOOL randomAccess,
+                            const UINT8 *payload, UINT32 size) {
+    UINT8 packet[RT_TS_PACKET_SIZE];
+    memset(packet, 0xff, sizeof(packet));
+    packet[0] = 0x47;
+    packet[1] = (start ? 0x40 : 0x00) | ((pid >> 8) & 0x1f);
+    packet[2] = pid & 0xff;
+    UINT32 pos = 4;
+    if (randomAccess || size < RT_TS_PACKET_SIZE - 4) {
+        packet[3] = 0x30;
+        packet[4] = static_cast<UINT8>(RT_TS_PACKET_SIZE - 5 - size);
+        if (packet[4] > 0) {
+            packet[5] = randomAccess ? 0x40 : 0x00;
+        }
+        pos += 1 + packet[4];
+    } else {
+        packet[3] = 0x10;
+    }
+    packet[3] |= writer->counters[pid]++ & 0xf;
+    memcpy(packet + pos, payload, size);
+    fwrite(packet, 1, sizeof(packet), writer->fp);
+    writer->offset += sizeof(packet);
+}
+
+// returns the offset of the packet the pes starts in.
+static INT64 bench_ts_pes(DemuxBenchWriter *writer, INT32 pid, UINT8 streamId, INT64 pts, RT_BOOL randomAccess,
+                          const std::vector<UINT8> &es) {
+    std::vector<UINT8> pes(14);
+    pts &= (1LL << 33) - 1;
+    pes[0] = 0x00; pes[1] = 0x00; pes[2] = 0x01; pes[3] = streamId;
+    pes[4] = 0x00; pes[5] = 0x00; pes[6] = 0x80; pes[7] = 0x80; pes[8] = 5;
+    pes[9]  = static_cast<UINT8>(0x21 | ((pts >> 29) & 0x0e));
+    pes[10] = static_cast<UINT8>(pts >> 22);
+    pes[11] = static_cast<UINT8>(((pts >> 14) & 0xfe) | 1);
+    pes[12] = static_cast<UINT8>(pts >> 7);
+    pes[13] = static_cast<UINT8>(((pts << 1) & 0xfe) | 1);
+    pes.insert(pes.end(), es.begin(), es.end());
+
+    const INT64 offset = writer->offset;
+    for (UINT32 done = 0; done < pes.size(); ) {
+        const RT_BOOL first = (done == 0) ? RT_TRUE : RT_FALSE;
+        const UINT32 room = RT_TS_PACKET_SIZE - 4 - ((first && randomAccess) ? 2 : 0);
+        const UINT32 size = RT_MIN(room, static_cast<UINT32>(pes.size()) - done);
+        bench_ts_packet(writer, pid, first, first ? randomAccess : RT_FALSE, &pes[done], size);
+        done += size;
+    }
+    return offset;
+}
+
+static void bench_es(std::vector<UINT8> *es, RT_BOOL key, RT_BOOL sei, UINT32 size) {
+    static const UINT8 keyHeader[] = { 0, 0, 0, 1, 0x09, 0xf0, 0, 0, 0, 1, 0x67, 0x64, 0x00, 0x28, 0xac,
+                                       0, 0, 0, 1, 0x68, 0xee, 0x3c, 0x80, 0, 0, 0, 1, 0x65 };
+    static const UINT8 deltaHeader[] = { 0, 0, 0, 1, 0x09, 0xf0, 0, 0, 0, 1, 0x41 };
+    if (key) {
+        es->assign(keyHeader, keyHeader + sizeof(keyHeader));
+    } else {
+        es->assign(deltaHeader, deltaHeader + sizeof(deltaHeader));
+    }
+    // an sei after the access unit delimiter, longer than a ts packet.
+    if (sei) {
+        static const UINT8 seiHeader[] = { 0, 0, 0, 1, 0x06 };
+        std::vector<UINT8> payload(seiHeader, seiHeader + sizeof(seiHeader));
+        payload.resize(sizeof(seiHeader) + 2 * RT_TS_PACKET_SIZE, 0x5a);
+        es->insert(es->begin() + 6, payload.begin(), payload.end());
+    }
+    // no zero bytes, so the slice data holds no start code.
+    while (es->size() < size) {
+        es->push_back(static_cast<UINT8>(rand() | 1));
+    }
+}
+
+static RT_BOOL bench_make_ts(const char *path, INT64 bytes, INT32 gop, RTKeyframeIndex *expected) {
+    DemuxBenchWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.fp = fopen(path, "wb");
+    if (writer.fp == RT_NULL) {
+        return RT_FALSE;
+    }
+    const INT64 firstPts = (1LL << 33) - 20 * 90000;
+    std::vector<UINT8> es;
+    std::vector<UINT8> audio(DEMUX_BENCH_AUDIO_SIZE, 0x55);
+    const UINT8 null[RT_TS_PACKET_SIZE - 4] = { 0 };
+    for (INT32 frame = 0; writer.offset < bytes; frame++) {
+        const INT64 pts = firstPts + static_cast<INT64>(frame) * DEMUX_BENCH_FRAME_PTS;
+        const RT_BOOL key = (frame % gop == 0) ? RT_TRUE : RT_FALSE;
+        // every third keyframe relies on the nal type, as some muxers leave the flag out.
+        const RT_BOOL flagged = (key && (frame / gop) % 3 != 2) ? RT_TRUE : RT_FALSE;
+        const RT_BOOL sei = (key ? (frame / gop) % 6 == 5 : frame % 2 == 1) ? RT_TRUE : RT_FALSE;
+        bench_es(&es, key, sei, key ? DEMUX_BENCH_KEY_SIZE : DEMUX_BENCH_DELTA_SIZE + rand() % 4000);
+        const INT64 offset = bench_ts_pes(&writer, DEMUX_BENCH_VIDEO_PID, 0xe0, pts, flagged, es);
+        if (key) {
+            expected->add(0, static_cast<INT64>(frame) * DEMUX_BENCH_FRAME_PTS * 100 / 9, offset);
+        }
+        bench_ts_pes(&writer, DEMUX_BENCH_AUDIO_PID, 0xc0, pts, RT_TRUE, audio);
+        if (frame % 8 == 0) {
+            bench_ts_packet(&writer, 0x1fff, RT_FALSE, RT_FALSE, null, sizeof(null));
+        }
+    }
+    expected->seal();
+    return (fclose(writer.fp) == 0) ? RT_TRUE : RT_FALSE;
+}
+
+// a file the index must refuse: scan and open give RT_ERR_UNSUPPORT and leave no .rtidx.
+static RT_BOOL bench_reject(const char *path, RT_BOOL audioOnly) {
+    DemuxBenchWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.fp = fopen(path, "wb");
+    if (writer.fp == RT_NULL) {
+        return RT_FALSE;
+    }
+    std::vector<UINT8> audio(DEMUX_BENCH_AUDIO_SIZE, 0x55);
+    for (INT32 frame = 0; frame < (audioOnly ? 1000 : 2); frame++) {
+        bench_ts_pes(&writer, DEMUX_BENCH_AUDIO_PID, 0xc0, frame * DEMUX_BENCH_FRAME_PTS, RT_TRUE, audio);
+    }
+    if (!audioOnly) {
+        std::vector<UINT8> other(64 << 10, 0x20);
+        fwrite(&other[0], 1, other.size(), writer.fp);
+    }
+    fclose(writer.fp);
+    const std::string indexPath = RTKeyframeIndex::pathFor(path);
+    RTKeyframeIndex index;
+    RTKeyframeIndexCache::instance()->drop(path);
+    const RT_BOOL refused = (RTKeyframeIndexCache::scan(path, RT_VIDEO_ID_AVC, &index) == RT_ERR_UNSUPPORT
+                             && RTKeyframeIndexCache::instance()->open(path, RT_VIDEO_ID_AVC, &index)
+                                == RT_ERR_UNSUPPORT
+                             && access(indexPath.c_str(), F_OK) != 0) ? RT_TRUE : RT_FALSE;
+    unlink(indexPath.c_str());
+    unlink(path);
+    return refused;
+}
+
+static RT_BOOL bench_same(const RTKeyframeIndex &a, const RTKeyframeIndex &b) {
+    return (a.size() == b.size() && (a.size() == 0
+            || memcmp(a.entries(), b.entries(), a.size() * sizeof(RTKeyframeEntry)) == 0)) ? RT_TRUE : RT_FALSE;
+}
+
+static RT_RET bench_packet_free(void *block) {
+    free(block);
+    return RT_OK;
+}
+
+static UINT64 bench_consume(RTMediaBuffer *buffer) {
+    const UINT8 *bytes = reinterpret_cast<const UINT8 *>(buffer->getData());
+    UINT64 sum = buffer->getSize();
+    for (UINT32 i = 0; i < buffer->getSize(); i += 64) {
+        sum = sum * 131 + bytes[i];
+    }
+    buffer->release();
+    return sum;
+}
+
+/*
+ * the pes payload of the first video pid is gathered in a block of its own,
+ * the buffer an AVPacket references, then handed downstream.
+ */
+static INT64 bench_packets(const char *path, RT_BOOL wrap, INT64 *bytes, UINT64 *checksum) {
+    RTFileSource source;
+    if (source.open(path, RT_KEYFRAME_SCAN_CHUNK, RT_FILE_READ_MMAP, RT_FALSE) != RT_OK) {
+        return -1;
+    }
+    std::vector<UINT8> carry;
+    UINT8 *block = RT_NULL;
+    UINT32 size = 0, capacity = 0;
+    INT32 videoPid = -1;
+    RTFileChunk chunk;
+    UINT64 start = RtTime::getRelativeTimeUs();
+    while (source.read(&chunk) == RT_OK) {
+        const UINT8 *data = reinterpret_cast<const UINT8 *>(chunk.data);
+        carry.insert(carry.end(), data, data + chunk.size);
+        RTFileSource::release(&chunk);
+        UINT32 pos = 0;
+        for (; carry.size() - pos >= RT_TS_PACKET_SIZE; pos += RT_TS_PACKET_SIZE) {
+            const UINT8 *packet = &carry[pos];
+            const INT32 pid = ((packet[1] & 0x1f) << 8) | packet[2];
+            const UINT32 payload = 4 + ((packet[3] & 0x20) ? 1 + packet[4] : 0);
+            if (packet[0] != 0x47 || !(packet[3] & 0x10) || payload + 4 > RT_TS_PACKET_SIZE) {
+                continue;
+            }
+            const UINT8 *pes = packet + payload;
+            if ((packet[1] & 0x40) && pes[0] == 0 && pes[1] == 0 && pes[2] == 1 && (pes[3] & 0xf0) == 0xe0) {
+                videoPid = (videoPid < 0) ? pid : videoPid;
+                if (pid == videoPid && block != RT_NULL) {
+                    RTMediaBuffer *buffer = RT_NULL;
+                    if (wrap) {
+                        buffer = rt_media_buffer_wrap(block, size, bench_packet_free, block);
+                    } else {
+                        buffer = new RTMediaBuffer(size);
+                        memcpy(buffer->getData(), block, size);
+                        free(block);
+                    }
+                    *checksum ^= bench_consume(buffer);
+                    *bytes += size;
+                    block = RT_NULL;
+                }
+            }
+            if (pid != videoPid) {
+                continue;
+            }
+            const UINT32 length = RT_TS_PACKET_SIZE - payload;
+            if (block == RT_NULL) {
+                capacity = RT_MAX(capacity, 64u << 10);
+                block = reinterpret_cast<UINT8 *>(malloc(capacity));
+                size = 0;
+            } else if (size + length > capacity) {
+                capacity *= 2;
+                block = reinterpret_cast<UINT8 *>(realloc(block, capacity));
+            }
+            memcpy(block + size, packet + payload, length);
+            size += length;
+        }
+        carry.erase(carry.begin(), carry.begin() + pos);
+    }
+    free(block);
+    return static_cast<INT64>(RtTime::getRelativeTimeUs() - start);
+}
+
+// what a seek without an index costs: scan from the start until the target is passed.
+static RT_RET bench_seek_rescan(INT32 fd, INT64 timeUs, RTKeyframeEntry *entry) {
+    RTKeyframeIndex index;
+    RTTsIndexScanner scanner(&index, RT_VIDEO_ID_AVC);
+    std::vector<UINT8> chunk(RT_KEYFRAME_SCAN_CHUNK);
+    INT64 offset = 0;
+    ssize_t ret;
+    while ((ret = pread(fd, &chunk[0], chunk.size(), offset)) > 0) {
+        scanner.feed(&chunk[0], static_cast<UINT32>(ret), offset);
+        offset += ret;
+        if (index.size() > 0 && index.entries()[index.size() - 1].timeUs > timeUs) {
+            break;
+        }
+    }
+    index.seal();
+    return index.find(0, timeUs, RT_SEEK_PREVIOUS_SYNC, entry);
+}
+
+static RT_RET bench_seek_index(INT32 fd, const RTKeyframeIndex &index, INT64 timeUs, RTKeyframeEntry *entry) {
+    UINT8 packet[RT_TS_PACKET_SIZE];
+    RT_RET ret = index.find(0, timeUs, RT_SEEK_PREVIOUS_SYNC, entry);
+    if (ret != RT_OK) {
+        return ret;
+    }
+    // the demuxer resumes reading at the packet found.
+    if (pread(fd, packet, sizeof(packet), entry->offset) != sizeof(packet) || packet[0] != 0x47
+            || !(packet[1] & 0x40)) {
+        return RT_ERR_BAD;
+    }
+    return RT_OK;
+}
+
+static void bench_print_seek(const char *name, const RtHistogram &latency) {
+    RtHistogramSummary sum;
+    latency.summary(&sum);
+    printf("%-8s %8lld %12.1f %10lld\n", name, (long long)sum.count, sum.count ? sum.sum / (double)sum.count : 0.0,
+           (long long)sum.p99);
+}
+
+int main(int argc, char **argv) {
+    const char *path = RT_NULL;
+    INT32 fileMb = 256, gop = 30, seeks = 50;
+    INT32 c;
+    while ((c = getopt(argc, argv, "i:m:g:s:")) != -1) {
+        switch (c) {
+          case 'i': path   = optarg; break;
+          case 'm': fileMb = atoi(optarg); break;
+          case 'g': gop    = atoi(optarg); break;
+          case 's': seeks  = atoi(optarg); break;
+          default:
+            printf("usage: %s [-i file] [-m file_mb] [-g gop] [-s seeks]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (fileMb <= 0 || gop <= 0 || seeks <= 0) {
+        return -1;
+    }
+
+    char tmpPath[64];
+    RTKeyframeIndex expected;
+    const RT_BOOL own = (path == RT_NULL) ? RT_TRUE : RT_FALSE;
+    if (own) {
+        snprintf(tmpPath, sizeof(tmpPath), "/tmp/rt_demux_bench_%d.ts", static_cast<INT32>(getpid()));
+        path = tmpPath;
+        if (!bench_make_ts(path, static_cast<INT64>(fileMb) << 20, gop, &expected)) {
+            printf("can not write %s\n", path);
+            return -1;
+        }
+    }
+    INT64 fileSize = 0, mtimeNs = 0;
+    if (RTKeyframeIndex::identify(path, &fileSize, &mtimeNs) != RT_OK) {
+        printf("can not open %s\n", path);
+        return -1;
+    }
+    const std::string indexPath = RTKeyframeIndex::pathFor(path);
+    RT_BOOL ok = RT_TRUE;
+
+    // index: cold scan, then the three ways open() finds it.
+    RTKeyframeIndex scanned, opened[3];
+    bench_drop_cache(path);
+    UINT64 begin = RtTime::getRelativeTimeUs();
+    ok = (RTKeyframeIndexCache::scan(path, RT_VIDEO_ID_AVC, &scanned) == RT_OK) ? ok : RT_FALSE;
+    const INT64 scanUs = static_cast<INT64>(RtTime::getRelativeTimeUs() - begin);
+    INT64 openUs[3];
+    unlink(indexPath.c_str());
+    RTKeyframeIndexCache::instance()->drop(path);
+    for (INT32 i = 0; i < 3; i++) {
+        if (i == 1) {
+            RTKeyframeIndexCache::instance()->drop(path);
+        }
+        begin = RtTime::getRelativeTimeUs();
+        ok = (RTKeyframeIndexCache::instance()->open(path, RT_VIDEO_ID_AVC, &opened[i]) == RT_OK) ? ok : RT_FALSE;
+        openUs[i] = static_cast<INT64>(RtTime::getRelativeTimeUs() - begin);
+        ok = bench_same(scanned, opened[i]) ? ok : RT_FALSE;
+    }
+    const RT_BOOL indexed = (scanned.size() > 0 && (!own || bench_same(scanned, expected))) ? RT_TRUE : RT_FALSE;
+    ok = indexed ? ok : RT_FALSE;
+
+    // files without an index.
+    char rejectPath[64];
+    snprintf(rejectPath, sizeof(rejectPath), "/tmp/rt_demux_bench_%d.bin", static_cast<INT32>(getpid()));
+    const RT_BOOL notTs = bench_reject(rejectPath, RT_FALSE);
+    snprintf(rejectPath, sizeof(rejectPath), "/tmp/rt_demux_bench_%d_audio.ts", static_cast<INT32>(getpid()));
+    const RT_BOOL noVideo = bench_reject(rejectPath, RT_TRUE);
+    ok = (notTs && noVideo) ? ok : RT_FALSE;
+
+    // packets copied and wrapped.
+    INT64 packetBytes[2] = { 0, 0 };
+    UINT64 packetSums[2] = { 0, 0 };
+    INT64 packetUs[2];
+    for (INT32 wrap = 0; wrap < 2; wrap++) {
+        packetUs[wrap] = bench_packets(path, wrap ? RT_TRUE : RT_FALSE, &packetBytes[wrap], &packetSums[wrap]);
+    }
+    const RT_BOOL samePackets = (packetUs[0] >= 0 && packetUs[1] >= 0 && packetBytes[0] == packetBytes[1]
+                                 && packetSums[0] == packetSums[1]) ? RT_TRUE : RT_FALSE;
+    ok = samePackets ? ok : RT_FALSE;
+
+    // seeks to the same random times both ways.
+    RtHistogram rescanUs, indexUs;
+    INT32 sameSeeks = 0;
+    const INT64 durationUs = (scanned.size() > 0) ? scanned.entries()[scanned.size() - 1].timeUs + 1 : 1;
+    INT32 fd = open(path, O_RDONLY);
+    for (INT32 i = 0; fd >= 0 && i < seeks; i++) {
+        const INT64 timeUs = static_cast<INT64>((rand() / (RAND_MAX + 1.0)) * durationUs);
+        RTKeyframeEntry slow, fast;
+        memset(&slow, 0, sizeof(slow));
+        memset(&fast, 0, sizeof(fast));
+        begin = RtTime::getRelativeTimeUs();
+        RT_RET slowRet = bench_seek_rescan(fd, timeUs, &slow);
+        rescanUs.record(RtTime::getRelativeTimeUs() - begin);
+        begin = RtTime::getRelativeTimeUs();
+        RT_RET fastRet = bench_seek_index(fd, opened[2], timeUs, &fast);
+        indexUs.record(RtTime::getRelativeTimeUs() - begin);
+        if (slowRet == RT_OK && fastRet == RT_OK && slow.offset == fast.offset && slow.timeUs == fast.timeUs) {
+            sameSeeks++;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    ok = (sameSeeks == seeks) ? ok : RT_FALSE;
+    unlink(indexPath.c_str());
+    if (own) {
+        unlink(path);
+    }
+
+    const double mb = fileSize / 1048576.0;
+    printf("%s, %.1fMB, %d keyframes over %.1fs%s\n", path, mb, scanned.size(), durationUs / 1000000.0,
+           own ? (indexed ? ", index as written" : ", index NOT as written") : "");
+    printf("index scan %.1f MB/s cold, open: scanned+saved %lld us, from %s %lld us, from memory %lld us\n",
+           mb / (RT_MAX(scanUs, 1) / 1000000.0), (long long)openUs[0], RT_KEYFRAME_INDEX_SUFFIX,
+           (long long)openUs[1], (long long)openUs[2]);
+    printf("video packets: copied %.1f MB/s, wrapped %.1f MB/s, same %s\n",
+           packetBytes[0] / 1048576.0 / (RT_MAX(packetUs[0], 1) / 1000000.0),
+           packetBytes[1] / 1048576.0 / (RT_MAX(packetUs[1], 1) / 1000000.0), samePackets ? "yes" : "NO");
+    printf("%-8s %8s %12s %10s   (seek us)\n", "seek", "count", "avg", "p99");
+    bench_print_seek("rescan", rescanUs);
+    bench_print_seek("index", indexUs);
+    printf("same keyframe: %d/%d\n", sameSeeks, seeks);
+    printf("refused without .rtidx: not ts %s, audio only %s\n", notTs ? "yes" : "NO", noVideo ? "yes" : "NO");
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark of the software mosaic and line overlays
+ *
+ * draws a grid of mosaics and a fan of lines on a random NV12 frame with
+ * RTImageDrawer: one drawer per region with the scalar kernels, then all
+ * regions batched in one pass with the scalar and with the simd kernels.
+ * all outputs must be bit-exact. the lines are then drawn on a black
+ * frame, where every chroma pair must be painted exactly when a pixel of
+ * its 2x2 block is.
+ *
+ * one drawer per region is not the code this replaces. -g runs the frame
+ * through a chain of filter_image nodes of librockit, one per region, as
+ * the regions were set up before, and prints its time per frame. arm only.
+ *
+ * usage: rt_draw_bench [-w width] [-h height] [-m mosaics] [-l lines] [-b blk_size] [-n loops] [-g]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_time.h"
+#include "RTImageDraw.h"
+
+#if !defined(DRAW_BENCH_LIB) && (defined(__aarch64__) || defined(__arm__))
+#define DRAW_BENCH_LIB              1
+#endif
+
+#if defined(DRAW_BENCH_LIB)
+#include "rt_bench_graph.h"
+#endif
+
+#define DRAW_BENCH_LINE_THICK       6
+#define DRAW_BENCH_COLOR            0x20ff40
+
+typedef struct _DrawBenchRegions {
+    std::vector<RTRect> mosaics;
+    std::vector<RTRect> lines;      // x, y -> w, h as end points
+    INT32               blkSize;
+} DrawBenchRegions;
+
+static void bench_make_regions(DrawBenchRegions *regions, INT32 width, INT32 height, INT32 mosaics,
+                               INT32 lines, INT32 blkSize) {
+    regions->blkSize = blkSize;
+    INT32 cols = 1;
+    while (cols * cols < mosaics) {
+        cols++;
+    }
+    const INT32 cellW = width / cols;
+    const INT32 cellH = height / cols;
+    for (INT32 i = 0; i < mosaics; i++) {
+        RTRect rect;
+        rect.x = (i % cols) * cellW + cellW / 8;
+        rect.y = (i / cols) * cellH + cellH / 8;
+        rect.w = cellW / 2;
+        rect.h = cellH / 2;
+        regions->mosaics.push_back(rect);
+    }
+    for (INT32 i = 0; i < lines; i++) {
+        RTRect line;
+        line.x = width / 2;
+        line.y = height - 1;
+        line.w = width * i / RT_MAX(lines - 1, 1);
+        line.h = 0;
+        regions->lines.push_back(line);
+    }
+}
+
+static void bench_add_region(RTImageDrawer *drawer, const DrawBenchRegions &regions, size_t index) {
+    const RTDrawColor color = rt_draw_color_rgb(DRAW_BENCH_COLOR);
+    if (index < regions.mosaics.size()) {
+        drawer->addMosaic(regions.mosaics[index], regions.blkSize);
+    } else {
+        const RTRect &l = regions.lines[index - regions.mosaics.size()];
+        drawer->addLine(l.x, l.y, l.w, l.h, DRAW_BENCH_LINE_THICK, color);
+    }
+}
+
+static RTScaleImage bench_image(std::vector<UINT8> *frame, INT32 width, INT32 height) {
+    RTScaleImage image;
+    memset(&image, 0, sizeof(image));
+    image.data      = &(*frame)[0];
+    image.format    = RT_FMT_YUV420SP;
+    image.width     = width;
+    image.height    = height;
+    image.virWidth  = width;
+    image.virHeight = height;
+    return image;
+}
+
+/*
+ * the lines on a black frame: a chroma pair must be painted exactly when
+ * any luma pixel of its 2x2 block is. returns the pairs that are wrong.
+ */
+static INT32 bench_check_chroma(const DrawBenchRegions &regions, INT32 width, INT32 height) {
+    const RTDrawColor color = rt_draw_color_rgb(DRAW_BENCH_COLOR);
+    RTImageDrawer drawer;
+    for (size_t i = 0; i < regions.lines.size(); i++) {
+        const RTRect &l = regions.lines[i];
+        drawer.addLine(l.x, l.y, l.w, l.h, DRAW_BENCH_LINE_THICK, color);
+    }
+    std::vector<UINT8> frame(width * height * 3 / 2, 0);
+    RTScaleImage image = bench_image(&frame, width, height);
+    drawer.draw(&image);
+    const UINT8 *luma = &frame[0];
+    const UINT8 *chroma = luma + width * height;
+    INT32 wrong = 0;
+    for (INT32 y = 0; y < height; y += 2) {
+        for (INT32 x = 0; x < width; x += 2) {
+            const RT_BOOL covered = (luma[y * width + x] | luma[y * width + x + 1]
+                                     | luma[(y + 1) * width + x] | luma[(y + 1) * width + x + 1]) ? RT_TRUE : RT_FALSE;
+            const UINT8 *pair = chroma + (y / 2) * width + x;
+            const RT_BOOL painted = (pair[0] == color.u && pair[1] == color.v) ? RT_TRUE : RT_FALSE;
+            const RT_BOOL black = (pair[0] == 0 && pair[1] == 0) ? RT_TRUE : RT_FALSE;
+            wrong += (covered ? painted : black) ? 0 : 1;
+        }
+    }
+    return wrong;
+}
+
+#if defined(DRAW_BENCH_LIB)
+// filter_image of librockit, one node per region as the opt_mosaic_* / opt_line_* keys describe one.
+static INT64 bench_lib(const DrawBenchRegions &regions, const RTScaleImage &src, const RTScaleImage &out,
+                       INT32 loops) {
+    std::vector<BenchGraphNode> nodes(regions.mosaics.size() + regions.lines.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        BenchGraphNode &node = nodes[i];
+        node.name       = NODE_NAME_FILTER_IMAGE;
+        node.bufferSize = static_cast<INT32>(bench_graph_nv12_size(src));
+        bench_graph_opt(&node, OPT_FILTER_WIDTH, src.width);
+        bench_graph_opt(&node, OPT_FILTER_HEIGHT, src.height);
+        bench_graph_opt(&node, OPT_FILTER_VIR_WIDTH, src.virWidth);
+        bench_graph_opt(&node, OPT_FILTER_VIR_HEIGHT, src.virHeight);
+        if (i < regions.mosaics.size()) {
+            const RTRect &m = regions.mosaics[i];
+            bench_graph_opt(&node, OPT_FILTER_MOSAIC, 1);
+            bench_graph_opt(&node, OPT_MOSAIC_X, m.x);
+            bench_graph_opt(&node, OPT_MOSAIC_Y, m.y);
+            bench_graph_opt(&node, OPT_MOSAIC_W, m.w);
+            bench_graph_opt(&node, OPT_MOSAIC_H, m.h);
+            bench_graph_opt(&node, OPT_MOSAIC_BLK_SIZE, regions.blkSize);
+        } else {
+            const RTRect &l = regions.lines[i - regions.mosaics.size()];
+            bench_graph_opt(&node, OPT_LINE_START_X, l.x);
+            bench_graph_opt(&node, OPT_LINE_START_Y, l.y);
+            bench_graph_opt(&node, OPT_LINE_END_X, l.w);
+            bench_graph_opt(&node, OPT_LINE_END_Y, l.h);
+            bench_graph_opt(&node, OPT_LINE_THICK, DRAW_BENCH_LINE_THICK);
+            bench_graph_opt(&node, OPT_VIDEO_COLOR, DRAW_BENCH_COLOR);
+        }
+    }
+    return bench_graph_run(nodes, src, out, loops);
+}
+#endif
+
+int main(int argc, char **argv) {
+    INT32 width = 3840, height = 2160, mosaics = 16, lines = 8, blkSize = 32, loops = 10;
+    RT_BOOL lib = RT_FALSE;
+    INT32 c;
+    while ((c = getopt(argc, argv, "w:h:m:l:b:n:g")) != -1) {
+        switch (c) {
+          case 'w': width   = atoi(optarg); break;
+          case 'h': height  = atoi(optarg); break;
+          case 'm': mosaics = atoi(optarg); break;
+          case 'l': lines   = atoi(optarg); break;
+          case 'b': blkSize = atoi(optarg); break;
+          case 'n': loops   = atoi(optarg); break;
+          case 'g': lib     = RT_TRUE; break;
+          default:
+            printf("usage: %s [-w width] [-h height] [-m mosaics] [-l lines] [-b blk_size] [-n loops] [-g]\n",
+                   argv[0]);
+            return -1;
+        }
+    }
+    if (width <= 0 || height <= 0 || mosaics < 0 || lines < 0 || loops <= 0 || ((width | height) & 1)
+            || mosaics + lines > RT_DRAW_MAX_REGIONS) {
+        return -1;
+    }
+#if !defined(DRAW_BENCH_LIB)
+    if (lib) {
+        printf("-g runs the filter_image node of librockit, arm only\n");
+        return -1;
+    }
+#endif
+
+    DrawBenchRegions regions;
+    bench_make_regions(&regions, width, height, mosaics, lines, blkSize);
+    const size_t total = regions.mosaics.size() + regions.lines.size();
+
+    std::vector<UINT8> frame(width * height * 3 / 2);
+    for (size_t i = 0; i < frame.size(); i++) {
+        frame[i] = static_cast<UINT8>(rand());
+    }
+    std::vector<UINT8> results[3];
+    INT64 costUs[3] = { 0, 0, 0 };
+    std::vector<RTImageDrawer *> single;
+    for (size_t i = 0; i < total; i++) {
+        single.push_back(new RTImageDrawer());
+        single[i]->setSimd(RT_FALSE);
+        bench_add_region(single[i], regions, i);
+    }
+    RTImageDrawer batched;
+    for (size_t i = 0; i < total; i++) {
+        bench_add_region(&batched, regions, i);
+    }
+
+    for (INT32 run = 0; run < 3; run++) {
+        batched.setSimd(run == 2 ? RT_TRUE : RT_FALSE);
+        for (INT32 loop = 0; loop < loops; loop++) {
+            results[run] = frame;
+            RTScaleImage image = bench_image(&results[run], width, height);
+            UINT64 start = RtTime::getRelativeTimeUs();
+            if (run == 0) {
+                for (size_t i = 0; i < total; i++) {
+                    single[i]->draw(&image);
+                }
+            } else {
+                batched.draw(&image);
+            }
+            costUs[run] += static_cast<INT64>(RtTime::getRelativeTimeUs() - start);
+        }
+    }
+    for (size_t i = 0; i < total; i++) {
+        delete single[i];
+    }
+
+    RT_BOOL exact = (results[0] == results[1] && results[0] == results[2]) ? RT_TRUE : RT_FALSE;
+    const INT32 wrongPairs = bench_check_chroma(regions, width, height);
+    printf("%dx%d, %d mosaics of %d, %d lines, %s kernels, us per frame\n",
+           width, height, mosaics, blkSize, lines, rt_simd_name());
+    printf("%12s %12s %12s %8s %12s\n", "drawer_each", "batched", "batched_simd", "exact", "chroma_wrong");
+    printf("%12lld %12lld %12lld %8s %12d\n", (long long)(costUs[0] / loops), (long long)(costUs[1] / loops),
+           (long long)(costUs[2] / loops), exact ? "yes" : "NO", wrongPairs);
+    RT_BOOL libOk = RT_TRUE;
+#if defined(DRAW_BENCH_LIB)
+    if (lib) {
+        std::vector<UINT8> libFrame(frame.size(), 0);
+        const RTScaleImage src = bench_image(&frame, width, height);
+        const RTScaleImage out = bench_image(&libFrame, width, height);
+        const INT64 libUs = bench_lib(regions, src, out, loops);
+        libOk = (libUs >= 0) ? RT_TRUE : RT_FALSE;
+        printf("%-24s %12lld\n", "filter_image chain", (long long)libUs);
+    }
+#endif
+    return (exact && wrongPairs == 0 && libOk) ? 0 : -1;
+}
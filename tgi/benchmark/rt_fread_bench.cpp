@@ -0,0 +1,217 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark of the fread chunk readers
+ *
+ * replays a raw file in frame sized chunks, looping it, three ways: stdio
+ * fread into a staging buffer copied into the output buffer as the fread
+ * node did, RTFileSource buffered, and RTFileSource mapped. the consumer
+ * touches every cache line and holds a few chunks like a downstream queue
+ * would. prints MB/s and frames/s and checks all ways read the same bytes
+ * at the same offsets.
+ *
+ * without -f a file of -m MB is made in /tmp and its page cache is dropped
+ * before each way (-c 0 keeps it warm).
+ *
+ * usage: rt_fread_bench [-f file] [-m file_mb] [-s chunk_size] [-p passes] [-a readahead] [-w window_mb] [-c cold]
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <deque>
+#include <vector>
+
+#include "rt_header.h"
+#include "RTFileSource.h"
+
+#define FREAD_BENCH_HOLD    4       // chunks held by the consumer
+
+typedef struct _FreadBenchResult {
+    INT64   costUs;
+    INT64   bytes;
+    INT32   chunks;
+    UINT64  checksum;
+    INT32   loops;
+} FreadBenchResult;
+
+static UINT64 bench_touch(const void *data, UINT32 size, INT64 offset) {
+    const UINT8 *bytes = reinterpret_cast<const UINT8 *>(data);
+    UINT64 sum = static_cast<UINT64>(offset) * 31 + size;
+    for (UINT32 i = 0; i < size; i += 64) {
+        sum = sum * 131 + bytes[i];
+    }
+    return sum;
+}
+
+static void bench_drop_cache(const char *path) {
+    INT32 fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static RT_BOOL bench_make_file(const char *path, INT64 bytes) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == RT_NULL) {
+        return RT_FALSE;
+    }
+    std::vector<UINT8> block(1 << 20);
+    for (INT64 done = 0; done < bytes; done += block.size()) {
+        for (size_t i = 0; i < block.size(); i++) {
+            block[i] = static_cast<UINT8>(rand());
+        }
+        fwrite(&block[0], 1, static_cast<size_t>(RT_MIN(static_cast<INT64>(block.size()), bytes - done)), fp);
+    }
+    fclose(fp);
+    return RT_TRUE;
+}
+
+// the old path: buffered stdio reads, then a copy into the output buffer.
+static RT_BOOL bench_stdio(const char *path, UINT32 chunkSize, INT32 passes, FreadBenchResult *result) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == RT_NULL) {
+        return RT_FALSE;
+    }
+    std::vector<UINT8> staging(chunkSize);
+    std::vector<UINT8> output(chunkSize);
+    UINT64 start = RtTime::getRelativeTimeUs();
+    for (INT32 pass = 0; pass < passes; pass++) {
+        fseek(fp, 0, SEEK_SET);
+        INT64 offset = 0;
+        size_t size = 0;
+        while ((size = fread(&staging[0], 1, chunkSize, fp)) > 0) {
+            memcpy(&output[0], &staging[0], size);
+            result->checksum ^= bench_touch(&output[0], static_cast<UINT32>(size), offset);
+            result->bytes += size;
+            result->chunks++;
+            offset += size;
+        }
+    }
+    result->costUs = static_cast<INT64>(RtTime::getRelativeTimeUs() - start);
+    result->loops  = passes - 1;
+    fclose(fp);
+    return RT_TRUE;
+}
+
+static RT_BOOL bench_source(const char *path, UINT32 chunkSize, INT32 passes, RTFileReadMode mode, INT32 readahead,
+                            UINT32 window, FreadBenchResult *result) {
+    RTFileSource source;
+    source.setReadahead(readahead);
+    source.setWindowSize(window);
+    if (source.open(path, chunkSize, mode, RT_TRUE) != RT_OK) {
+        return RT_FALSE;
+    }
+    if (source.isMapped() != (mode == RT_FILE_READ_MMAP ? RT_TRUE : RT_FALSE)) {
+        return RT_FALSE;
+    }
+    std::deque<RTFileChunk> held;
+    RTFileChunk chunk;
+    UINT64 start = RtTime::getRelativeTimeUs();
+    while (source.read(&chunk) == RT_OK) {
+        if (chunk.loop >= passes) {
+            RTFileSource::release(&chunk);
+            break;
+        }
+        result->checksum ^= bench_touch(chunk.data, chunk.size, chunk.offset);
+        result->bytes += chunk.size;
+        result->chunks++;
+        result->loops = chunk.loop;
+        held.push_back(chunk);
+        if (held.size() > FREAD_BENCH_HOLD) {
+            RTFileSource::release(&held.front());
+            held.pop_front();
+        }
+    }
+    while (!held.empty()) {
+        RTFileSource::release(&held.front());
+        held.pop_front();
+    }
+    result->costUs = static_cast<INT64>(RtTime::getRelativeTimeUs() - start);
+    return RT_TRUE;
+}
+
+int main(int argc, char **argv) {
+    const char *path = RT_NULL;
+    INT32 fileMb = 256, passes = 3, readahead = RT_FILE_READAHEAD, windowMb = RT_FILE_MAP_WINDOW >> 20, cold = 1;
+    UINT32 chunkSize = 1920 * 1080 * 3 / 2;
+    INT32 c;
+    while ((c = getopt(argc, argv, "f:m:s:p:a:w:c:")) != -1) {
+        switch (c) {
+          case 'f': path      = optarg; break;
+          case 'm': fileMb    = atoi(optarg); break;
+          case 's': chunkSize = static_cast<UINT32>(atoi(optarg)); break;
+          case 'p': passes    = atoi(optarg); break;
+          case 'a': readahead = atoi(optarg); break;
+          case 'w': windowMb  = atoi(optarg); break;
+          case 'c': cold      = atoi(optarg); break;
+          default:
+            printf("usage: %s [-f file] [-m file_mb] [-s chunk_size] [-p passes] [-a readahead] [-w window_mb]"
+                   " [-c cold]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (fileMb <= 0 || chunkSize == 0 || passes <= 0 || readahead < 0 || windowMb <= 0) {
+        return -1;
+    }
+
+    char tmpPath[64];
+    const RT_BOOL own = (path == RT_NULL) ? RT_TRUE : RT_FALSE;
+    if (own) {
+        snprintf(tmpPath, sizeof(tmpPath), "/tmp/rt_fread_bench_%d.yuv", static_cast<INT32>(getpid()));
+        path = tmpPath;
+        if (!bench_make_file(path, static_cast<INT64>(fileMb) << 20)) {
+            printf("can not write %s\n", path);
+            return -1;
+        }
+    }
+
+    static const char *names[3] = { "fread+copy", "buffered", "mmap" };
+    FreadBenchResult results[3];
+    RT_BOOL ok = RT_TRUE;
+    for (INT32 way = 0; way < 3; way++) {
+        memset(&results[way], 0, sizeof(results[way]));
+        if (cold) {
+            bench_drop_cache(path);
+        }
+        if (way == 0) {
+            ok = bench_stdio(path, chunkSize, passes, &results[way]) ? ok : RT_FALSE;
+        } else {
+            ok = bench_source(path, chunkSize, passes, way == 1 ? RT_FILE_READ_BUFFERED : RT_FILE_READ_MMAP,
+                              readahead, static_cast<UINT32>(windowMb) << 20, &results[way]) ? ok : RT_FALSE;
+        }
+    }
+    if (own) {
+        unlink(path);
+    }
+
+    printf("%s, chunks of %u bytes, %d passes, readahead %d, window %dMB, %s cache\n", path, chunkSize, passes,
+           readahead, windowMb, cold ? "cold" : "warm");
+    printf("%-12s %10s %10s %10s %8s\n", "way", "MB/s", "frames/s", "chunks", "same");
+    for (INT32 way = 0; way < 3; way++) {
+        const FreadBenchResult &r = results[way];
+        const RT_BOOL same = (r.checksum == results[0].checksum && r.chunks == results[0].chunks
+                              && r.loops == passes - 1) ? RT_TRUE : RT_FALSE;
+        const double seconds = RT_MAX(r.costUs, 1) / 1000000.0;
+        printf("%-12s %10.1f %10.1f %10d %8s\n", names[way], r.bytes / 1048576.0 / seconds, r.chunks / seconds,
+               r.chunks, same ? "yes" : "NO");
+        ok = same ? ok : RT_FALSE;
+    }
+    return ok ? 0 : -1;
+}
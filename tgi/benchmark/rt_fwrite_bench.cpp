@@ -0,0 +1,226 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark of the fwrite node writers
+ *
+ * a producer emits encoded-frame sized buffers, at a frame rate or as fast
+ * as it can, and writes them once synchronously on its own thread as the
+ * fwrite node did, and once through the write-behind RTFileWriter. prints
+ * the time the producer spends per frame, the writer statistics, and
+ * checks both files hold the same bytes.
+ *
+ * -y syncs every that many MB in both modes, which shows how a slow card
+ * backpressures a synchronous writer.
+ *
+ * usage: rt_fwrite_bench [-d dir] [-n frames] [-s frame_size] [-r fps] [-b budget_mb] [-y sync_mb]
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_histogram.h"
+#include "RTFileWriter.h"
+
+typedef struct _FwriteBenchFrame {
+    std::vector<UINT8>  data;
+    UINT32              size;
+    std::atomic<INT32>  busy;
+} FwriteBenchFrame;
+
+static void bench_frame_done(void *cookie) {
+    reinterpret_cast<FwriteBenchFrame *>(cookie)->busy.store(0);
+}
+
+// frame n is filled from n, so both modes write the same stream.
+static void bench_fill(FwriteBenchFrame *frame, INT32 n, UINT32 frameSize) {
+    UINT32 seed = static_cast<UINT32>(n) * 2654435761u;
+    frame->size = frameSize / 2 + (seed >> 8) % frameSize;
+    if (frame->data.size() < frame->size) {
+        frame->data.resize(frame->size);
+    }
+    for (UINT32 i = 0; i < frame->size; i += 4) {
+        seed = seed * 1103515245u + 12345u;
+        memcpy(&frame->data[i], &seed, RT_MIN(4u, frame->size - i));
+    }
+}
+
+static UINT64 bench_file_hash(const char *path, UINT64 *bytes) {
+    UINT64 hash = 1469598103934665603ull;
+    std::vector<UINT8> block(1 << 20);
+    *bytes = 0;
+    INT32 fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    ssize_t ret;
+    while ((ret = read(fd, &block[0], block.size())) > 0) {
+        for (ssize_t i = 0; i < ret; i++) {
+            hash = (hash ^ block[i]) * 1099511628211ull;
+        }
+        *bytes += ret;
+    }
+    close(fd);
+    return hash;
+}
+
+static void bench_pace(UINT64 start, INT32 n, INT32 fps) {
+    if (fps <= 0) {
+        return;
+    }
+    UINT64 due = start + static_cast<UINT64>(n) * 1000000 / fps;
+    UINT64 now = RtTime::getRelativeTimeUs();
+    if (due > now) {
+        RtTime::sleepUs(due - now);
+    }
+}
+
+static INT64 bench_sync(const char *path, INT32 frames, UINT32 frameSize, INT32 fps, UINT64 syncBytes,
+                        RtHistogram *frameUs) {
+    INT32 fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    FwriteBenchFrame frame;
+    UINT64 sinceSync = 0;
+    UINT64 start = RtTime::getRelativeTimeUs();
+    for (INT32 n = 0; n < frames; n++) {
+        bench_pace(start, n, fps);
+        bench_fill(&frame, n, frameSize);
+        UINT64 begin = RtTime::getRelativeTimeUs();
+        for (UINT32 done = 0; done < frame.size; ) {
+            ssize_t ret = write(fd, &frame.data[done], frame.size - done);
+            if (ret <= 0) {
+                close(fd);
+                return -1;
+            }
+            done += static_cast<UINT32>(ret);
+        }
+        sinceSync += frame.size;
+        if (syncBytes > 0 && sinceSync >= syncBytes) {
+            fdatasync(fd);
+            sinceSync = 0;
+        }
+        frameUs->record(RtTime::getRelativeTimeUs() - begin);
+    }
+    close(fd);
+    return static_cast<INT64>(RtTime::getRelativeTimeUs() - start);
+}
+
+static INT64 bench_async(const char *path, INT32 frames, UINT32 frameSize, INT32 fps, UINT64 syncBytes,
+                         UINT32 budget, RtHistogram *frameUs, RTFileWriterStats *stats) {
+    // frames are at least frameSize / 2, more than this never fit in the budget.
+    // the pool outlives the writer, whose thread still calls back into it at close.
+    std::vector<FwriteBenchFrame> pool(budget / (frameSize / 2) + 2);
+    for (size_t i = 0; i < pool.size(); i++) {
+        pool[i].busy.store(0);
+    }
+    RTFileWriter writer;
+    writer.setBudget(budget);
+    writer.setSyncPolicy(syncBytes > 0 ? RT_FILE_SYNC_PERIODIC : RT_FILE_SYNC_NONE, syncBytes);
+    if (writer.open(path, RT_FALSE) != RT_OK) {
+        return -1;
+    }
+    UINT64 start = RtTime::getRelativeTimeUs();
+    for (INT32 n = 0; n < frames; n++) {
+        FwriteBenchFrame *frame = &pool[n % pool.size()];
+        while (frame->busy.load()) {
+            RtTime::sleepUs(100);
+        }
+        bench_pace(start, n, fps);
+        bench_fill(frame, n, frameSize);
+        frame->busy.store(1);
+        UINT64 begin = RtTime::getRelativeTimeUs();
+        if (writer.write(&frame->data[0], frame->size, bench_frame_done, frame) != RT_OK) {
+            return -1;
+        }
+        frameUs->record(RtTime::getRelativeTimeUs() - begin);
+    }
+    if (writer.close() != RT_OK) {
+        return -1;
+    }
+    writer.getStats(stats);
+    return static_cast<INT64>(RtTime::getRelativeTimeUs() - start);
+}
+
+static void bench_print(const char *name, INT64 costUs, const RtHistogram &frameUs, UINT64 bytes) {
+    RtHistogramSummary sum;
+    frameUs.summary(&sum);
+    printf("%-6s %10.1f %10lld %10lld %10lld\n", name, bytes / 1048576.0 / (RT_MAX(costUs, 1) / 1000000.0),
+           (long long)sum.p50, (long long)sum.p99, (long long)sum.max);
+}
+
+int main(int argc, char **argv) {
+    const char *dir = "/tmp";
+    INT32 frames = 600, fps = 0, budgetMb = RT_FILE_WRITE_BUDGET >> 20, syncMb = 0;
+    UINT32 frameSize = 256 << 10;
+    INT32 c;
+    while ((c = getopt(argc, argv, "d:n:s:r:b:y:")) != -1) {
+        switch (c) {
+          case 'd': dir       = optarg; break;
+          case 'n': frames    = atoi(optarg); break;
+          case 's': frameSize = static_cast<UINT32>(atoi(optarg)); break;
+          case 'r': fps       = atoi(optarg); break;
+          case 'b': budgetMb  = atoi(optarg); break;
+          case 'y': syncMb    = atoi(optarg); break;
+          default:
+            printf("usage: %s [-d dir] [-n frames] [-s frame_size] [-r fps] [-b budget_mb] [-y sync_mb]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (frames <= 0 || frameSize < 16 || budgetMb <= 0 || syncMb < 0) {
+        return -1;
+    }
+
+    const std::string syncPath  = std::string(dir) + "/rt_fwrite_bench_sync.bin";
+    const std::string asyncPath = std::string(dir) + "/rt_fwrite_bench_async.bin";
+    const UINT64 syncBytes = static_cast<UINT64>(syncMb) << 20;
+    RtHistogram syncFrameUs, asyncFrameUs;
+    RTFileWriterStats stats;
+    memset(&stats, 0, sizeof(stats));
+    INT64 syncUs  = bench_sync(syncPath.c_str(), frames, frameSize, fps, syncBytes, &syncFrameUs);
+    INT64 asyncUs = bench_async(asyncPath.c_str(), frames, frameSize, fps, syncBytes,
+                                static_cast<UINT32>(budgetMb) << 20, &asyncFrameUs, &stats);
+    UINT64 syncFileBytes = 0, asyncFileBytes = 0;
+    const UINT64 syncHash  = bench_file_hash(syncPath.c_str(), &syncFileBytes);
+    const UINT64 asyncHash = bench_file_hash(asyncPath.c_str(), &asyncFileBytes);
+    unlink(syncPath.c_str());
+    unlink(asyncPath.c_str());
+    if (syncUs < 0 || asyncUs < 0) {
+        printf("write to %s failed\n", dir);
+        return -1;
+    }
+
+    const RT_BOOL same = (syncHash == asyncHash && syncFileBytes == asyncFileBytes
+                          && stats.writtenBytes == asyncFileBytes) ? RT_TRUE : RT_FALSE;
+    printf("%d frames of ~%u bytes to %s, %d fps, budget %dMB, sync every %dMB\n", frames, frameSize, dir, fps,
+           budgetMb, syncMb);
+    printf("%-6s %10s %10s %10s %10s   (producer us per frame)\n", "mode", "MB/s", "p50", "p99", "max");
+    bench_print("sync", syncUs, syncFrameUs, syncFileBytes);
+    bench_print("async", asyncUs, asyncFrameUs, asyncFileBytes);
+    printf("writer: max queued %lld bytes, blocked %lld us, %lld writes p50 %lld us p99 %lld us, "
+           "%lld syncs p99 %lld us\n", (long long)stats.maxQueuedBytes, (long long)stats.blockedUs,
+           (long long)stats.writeUs.count, (long long)stats.writeUs.p50, (long long)stats.writeUs.p99,
+           (long long)stats.syncUs.count, (long long)stats.syncUs.p99);
+    printf("same file: %s\n", same ? "yes" : "NO");
+    return same ? 0 : -1;
+}
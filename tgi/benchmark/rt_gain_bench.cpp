@@ -0,0 +1,197 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark and ramp test of the volume gain
+ *
+ * for s16, s32 and float:
+ *  - applies a steady gain, a volume changed every 100ms and per-channel
+ *    gains with one muted channel, in blocks of 10ms, with the scalar and
+ *    the simd kernels. prints ns per sample and checks the outputs are
+ *    bit-exact;
+ *  - toggles full volume and mute on a dc input and checks that every
+ *    change ramps: no frame moves by more than one ramp step and the
+ *    target is reached exactly after the ramp length.
+ *
+ * usage: rt_gain_bench [-c channels] [-s seconds] [-r ramp_ms]
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "RTAudioGain.h"
+
+#define GAIN_BENCH_RATE     48000
+
+typedef enum _GainBenchCase {
+    GAIN_BENCH_STEADY = 0,
+    GAIN_BENCH_CHANGING,
+    GAIN_BENCH_CHANNELS,
+    GAIN_BENCH_MAX,
+} GainBenchCase;
+
+template <typename T>
+static T bench_sample(double value);
+
+template <>
+INT16 bench_sample<INT16>(double value) {
+    return static_cast<INT16>(floor(value * 32767.0 + 0.5));
+}
+
+template <>
+INT32 bench_sample<INT32>(double value) {
+    return static_cast<INT32>(floor(value * 2147483647.0 + 0.5));
+}
+
+template <>
+float bench_sample<float>(double value) {
+    return static_cast<float>(value);
+}
+
+static double bench_value(INT16 sample) { return sample / 32767.0; }
+static double bench_value(INT32 sample) { return sample / 2147483647.0; }
+static double bench_value(float sample) { return sample; }
+
+template <typename T>
+static RTAudioFormat bench_format();
+template <> RTAudioFormat bench_format<INT16>() { return RT_AUDIO_FMT_PCM_S16; }
+template <> RTAudioFormat bench_format<INT32>() { return RT_AUDIO_FMT_PCM_S32; }
+template <> RTAudioFormat bench_format<float>() { return RT_AUDIO_FMT_PCM_FLT; }
+
+template <typename T>
+static INT64 bench_run(std::vector<T> *pcm, INT32 channels, GainBenchCase test, RT_BOOL simd) {
+    RTAudioGain gain;
+    gain.init(GAIN_BENCH_RATE, channels, bench_format<T>());
+    gain.setSimd(simd);
+    if (test == GAIN_BENCH_STEADY) {
+        gain.setVolume(-1, 70);
+    } else if (test == GAIN_BENCH_CHANNELS) {
+        for (INT32 c = 0; c < channels; c++) {
+            gain.setVolume(c, 40 + 20 * c);
+        }
+        gain.setChannelMute(channels - 1, RT_TRUE);
+    }
+    const INT32 block  = GAIN_BENCH_RATE / 100;
+    const INT32 frames = static_cast<INT32>(pcm->size()) / channels;
+    UINT64 start = RtTime::getRelativeTimeUs();
+    for (INT32 pos = 0, n = 0; pos < frames; pos += block, n++) {
+        if (test == GAIN_BENCH_CHANGING && n % 10 == 0) {
+            gain.setVolume(-1, (n * 37) % 150);
+        }
+        gain.process(&(*pcm)[pos * channels], RT_MIN(block, frames - pos));
+    }
+    return static_cast<INT64>(RtTime::getRelativeTimeUs() - start);
+}
+
+template <typename T>
+static RT_BOOL bench_format_cases(INT32 channels, INT32 seconds, const char *format) {
+    static const char *names[GAIN_BENCH_MAX] = { "steady", "changing", "channels" };
+    std::vector<T> in(static_cast<size_t>(GAIN_BENCH_RATE) * seconds * channels);
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = bench_sample<T>((rand() / static_cast<double>(RAND_MAX) - 0.5) * 1.8);
+    }
+    RT_BOOL pass = RT_TRUE;
+    for (INT32 t = 0; t < GAIN_BENCH_MAX; t++) {
+        std::vector<T> out[2] = { in, in };
+        INT64 costUs[2];
+        for (INT32 run = 0; run < 2; run++) {
+            costUs[run] = bench_run(&out[run], channels, static_cast<GainBenchCase>(t), run ? RT_TRUE : RT_FALSE);
+        }
+        const RT_BOOL exact = (memcmp(&out[0][0], &out[1][0], in.size() * sizeof(T)) == 0) ? RT_TRUE : RT_FALSE;
+        printf("%-4s %-9s %9.3f %9.3f %6s\n", format, names[t], costUs[0] * 1000.0 / in.size(),
+               costUs[1] * 1000.0 / in.size(), exact ? "yes" : "NO");
+        pass = exact ? pass : RT_FALSE;
+    }
+    return pass;
+}
+
+/*
+ * dc at half scale on every channel, volume toggled between 100% and mute
+ * every 100ms. the largest move between two frames must stay within one
+ * ramp step, and the frame the ramp ends on must hold the target.
+ */
+template <typename T>
+static RT_BOOL bench_ramp(INT32 channels, INT32 rampMs, const char *format) {
+    const INT32 rampFrames = GAIN_BENCH_RATE * rampMs / 1000;
+    const INT32 period = GAIN_BENCH_RATE / 10;
+    const INT32 frames = period * 10;
+    std::vector<T> pcm(static_cast<size_t>(frames) * channels, bench_sample<T>(0.5));
+    RTAudioGain gain;
+    gain.init(GAIN_BENCH_RATE, channels, bench_format<T>());
+    gain.setRamp(rampMs);
+    // odd blocks so ramps start and end inside them.
+    const INT32 block = 441;
+    INT32 next = 0;
+    for (INT32 pos = 0; pos < frames; ) {
+        if (pos == next) {
+            gain.setMute((pos / period) % 2 ? RT_FALSE : RT_TRUE);
+            next += period;
+        }
+        INT32 n = RT_MIN(RT_MIN(block, frames - pos), next - pos);
+        gain.process(&pcm[pos * channels], n);
+        pos += n;
+    }
+
+    double maxMove = 0.0;
+    RT_BOOL landed = RT_TRUE;
+    for (INT32 i = 1; i < frames; i++) {
+        for (INT32 c = 0; c < channels; c++) {
+            const double move = bench_value(pcm[i * channels + c]) - bench_value(pcm[(i - 1) * channels + c]);
+            maxMove = RT_MAX(maxMove, fabs(move));
+        }
+        if (rampFrames > 0 && i % period == rampFrames - 1) {
+            const double target = ((i / period) % 2) ? 0.5 : 0.0;
+            landed = (fabs(bench_value(pcm[i * channels]) - target) < 1e-4) ? landed : RT_FALSE;
+        }
+    }
+    const double limit = (rampFrames > 0) ? 0.5 / rampFrames + 2e-4 : 0.5 + 2e-4;
+    const RT_BOOL pass = (maxMove <= limit && landed) ? RT_TRUE : RT_FALSE;
+    printf("%-4s ramp %dms: max move per frame %.5f, limit %.5f, target on time %s, %s\n", format, rampMs,
+           maxMove, limit, landed ? "yes" : "NO", pass ? "yes" : "NO");
+    return pass;
+}
+
+int main(int argc, char **argv) {
+    INT32 channels = 2, seconds = 10, rampMs = RT_AUDIO_GAIN_RAMP_MS;
+    INT32 c;
+    while ((c = getopt(argc, argv, "c:s:r:")) != -1) {
+        switch (c) {
+          case 'c': channels = atoi(optarg); break;
+          case 's': seconds  = atoi(optarg); break;
+          case 'r': rampMs   = atoi(optarg); break;
+          default:
+            printf("usage: %s [-c channels] [-s seconds] [-r ramp_ms]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (channels <= 0 || channels > RT_AUDIO_GAIN_MAX_CHANNELS || seconds <= 0 || rampMs < 0 || rampMs >= 100) {
+        return -1;
+    }
+
+    INT32 failed = 0;
+    printf("%d channels at %d, %s kernels, ns per sample\n", channels, GAIN_BENCH_RATE, rt_simd_name());
+    printf("%-4s %-9s %9s %9s %6s\n", "fmt", "case", "scalar", "simd", "exact");
+    failed += bench_format_cases<INT16>(channels, seconds, "s16") ? 0 : 1;
+    failed += bench_format_cases<INT32>(channels, seconds, "s32") ? 0 : 1;
+    failed += bench_format_cases<float>(channels, seconds, "flt") ? 0 : 1;
+    failed += bench_ramp<INT16>(channels, rampMs, "s16") ? 0 : 1;
+    failed += bench_ramp<INT32>(channels, rampMs, "s32") ? 0 : 1;
+    failed += bench_ramp<float>(channels, rampMs, "flt") ? 0 : 1;
+    return failed ? -1 : 0;
+}
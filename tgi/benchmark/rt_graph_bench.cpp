@@ -0,0 +1,655 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: synthetic node benchmark of task graph
+ *
+ * builds graphs of synthetic nodes only, so the numbers are the cost of the
+ * scheduler, the buffer pools and the stream queues themselves:
+ *
+ *   bench_source  emits opt_bench_frames buffers stamped with kKeyFrameCaptureUs
+ *   bench_pass    forwards every buffer into a buffer of its own pool
+ *   bench_burn    like bench_pass, but spins opt_bench_burn_us before forwarding
+ *   bench_sink    joins opt_bench_inputs streams and records the frame latency
+ *
+ * the scheduler under test is the one of librockit, which ships for arm
+ * only: the benchmark runs on the board, there is no host build of it.
+ *
+ * with rt_stats_server=PATH set, the run in progress is served as the
+ * graph_bench section of RTStatsServer next to the built-in ones.
+ *
+ * usage: rt_graph_bench [-t chain|diamond|fanout|many|all] [-e default|pool|single|all]
+ *                       [-n frames] [-l length] [-g graphs] [-b burn_us]
+ *                       [-j threads] [-c buffers] [-s size] [-d dir]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_histogram.h"
+#include "rt_metadata.h"
+#include "RTMediaBuffer.h"
+#include "RTMediaMetaKeys.h"
+#include "RTNodeCommon.h"
+#include "RTStatsServer.h"
+#include "RTTaskGraph.h"
+#include "RTTaskNode.h"
+#include "RTTaskNodeFactory.h"
+
+#define BENCH_NODE_SOURCE           "bench_source"
+#define BENCH_NODE_PASS             "bench_pass"
+#define BENCH_NODE_BURN             "bench_burn"
+#define BENCH_NODE_SINK             "bench_sink"
+
+#define OPT_BENCH_FRAMES            "opt_bench_frames"
+#define OPT_BENCH_BURN_US           "opt_bench_burn_us"
+#define OPT_BENCH_INPUTS            "opt_bench_inputs"
+
+#define BENCH_FMT                   "bench:frame"
+#define BENCH_EXEC_NAME             "bench_exec"
+#define BENCH_EOS_TIMEOUT_US        (30 * 1000 * 1000)
+
+typedef enum _BenchExecMode {
+    BENCH_EXEC_DEFAULT = 0,     // executor of the graph itself
+    BENCH_EXEC_POOL,            // shared thread pool of -j threads
+    BENCH_EXEC_SINGLE,          // every node on one thread
+    BENCH_EXEC_MAX,
+} BenchExecMode;
+
+typedef enum _BenchTopology {
+    BENCH_TOPO_CHAIN = 0,       // source -> pass x length -> sink
+    BENCH_TOPO_DIAMOND,         // source -> length branches of one pass -> joining sink
+    BENCH_TOPO_FANOUT,          // source -> length sinks
+    BENCH_TOPO_MANY,            // graphs chains running concurrently
+    BENCH_TOPO_MAX,
+} BenchTopology;
+
+typedef struct _BenchOptions {
+    INT32 topology;             // BENCH_TOPO_MAX runs all
+    INT32 execMode;             // BENCH_EXEC_MAX runs all
+    INT32 frames;
+    INT32 length;
+    INT32 graphs;
+    INT32 burnUs;
+    INT32 threads;
+    INT32 buffers;
+    INT32 bufferSize;
+    const char *configDir;      // keeps the generated configs when set
+} BenchOptions;
+
+typedef struct _BenchNodeConfig {
+    const char              *name;
+    std::vector<std::string> inputs;
+    std::vector<std::string> fmtIns;
+    std::string              output;
+    std::string              fmtOut;
+    INT32                    burnUs;
+} BenchNodeConfig;
+
+typedef struct _BenchResult {
+    UINT64              frames;
+    INT64               elapsedUs;
+    RtHistogramSummary  latency;
+} BenchResult;
+
+/*
+ * shared by all sinks of a run, the nodes are created by the factory and
+ * can not be handed a context.
+ */
+static RtHistogram          gBenchLatency;
+static std::atomic<UINT64>  gBenchFrames(0);
+
+static const char* bench_exec_name(INT32 mode) {
+    static const char *names[BENCH_EXEC_MAX] = { "default", "pool", "single" };
+    return (mode >= 0 && mode < BENCH_EXEC_MAX) ? names[mode] : "unknown";
+}
+
+static const char* bench_topo_name(INT32 topo) {
+    static const char *names[BENCH_TOPO_MAX] = { "chain", "diamond", "fanout", "many" };
+    return (topo >= 0 && topo < BENCH_TOPO_MAX) ? names[topo] : "unknown";
+}
+
+static INT32 bench_find_opt(RTTaskNodeContext *context, const char *key, INT32 def) {
+    INT32 value = def;
+    if (context->options() != RT_NULL) {
+        context->options()->findInt32(key, &value);
+    }
+    return value;
+}
+
+static void bench_burn(INT32 us) {
+    if (us <= 0) {
+        return;
+    }
+    volatile UINT32 spin = 0;
+    UINT64 end = RtTime::getRelativeTimeUs() + us;
+    while (RtTime::getRelativeTimeUs() < end) {
+        spin = spin * 1664525 + 1013904223;
+    }
+}
+
+/*
+ * copies the bench meta of src into the recycled dst.
+ */
+static void bench_copy_meta(RTMediaBuffer *src, RTMediaBuffer *dst) {
+    RtMetaData *srcMeta = src->getMetaData();
+    RtMetaData *dstMeta = dst->getMetaData();
+    INT64 captureUs = 0;
+    INT32 eos = 0;
+    srcMeta->findInt64(kKeyFrameCaptureUs, &captureUs);
+    dstMeta->setInt64(kKeyFrameCaptureUs, captureUs);
+    if (srcMeta->findInt32(kKeyFrameEOS, &eos) && eos) {
+        dstMeta->setInt32(kKeyFrameEOS, 1);
+    } else {
+        dstMeta->remove(kKeyFrameEOS);
+    }
+}
+
+class RTBenchSource : public RTTaskNode {
+ public:
+    RTBenchSource() : mFrames(0), mSent(0) {}
+    virtual ~RTBenchSource() {}
+
+    virtual RT_RET open(RTTaskNodeContext *context) {
+        mFrames = bench_find_opt(context, OPT_BENCH_FRAMES, 1000);
+        mSent   = 0;
+        return RT_OK;
+    }
+
+    virtual RT_RET process(RTTaskNodeContext *context) {
+        if (mSent >= mFrames) {
+            return RT_ERR_END_OF_STREAM;
+        }
+        RTMediaBuffer *buffer = context->dequeOutputBuffer(RT_TRUE);
+        if (buffer == RT_NULL) {
+            return RT_ERR_NO_BUFFER;
+        }
+        RtMetaData *meta = buffer->getMetaData();
+        meta->setInt64(kKeyFrameCaptureUs, RtTime::getRelativeTimeUs());
+        if (++mSent == mFrames) {
+            meta->setInt32(kKeyFrameEOS, 1);
+        } else {
+            meta->remove(kKeyFrameEOS);
+        }
+        return context->queueOutputBuffer(buffer);
+    }
+
+    virtual RT_RET close(RTTaskNodeContext *context) { return RT_OK; }
+
+ private:
+    INT32 mFrames;
+    INT32 mSent;
+};
+
+class RTBenchPass : public RTTaskNode {
+ public:
+    RTBenchPass() : mBurnUs(0) {}
+    virtual ~RTBenchPass() {}
+
+    virtual RT_RET open(RTTaskNodeContext *context) {
+        mBurnUs = bench_find_opt(context, OPT_BENCH_BURN_US, 0);
+        return RT_OK;
+    }
+
+    virtual RT_RET process(RTTaskNodeContext *context) {
+        RTMediaBuffer *input = context->dequeInputBuffer();
+        if (input == RT_NULL) {
+            return RT_OK;
+        }
+        RTMediaBuffer *output = context->dequeOutputBuffer(RT_TRUE);
+        if (output == RT_NULL) {
+            input->release();
+            return RT_ERR_NO_BUFFER;
+        }
+        bench_burn(mBurnUs);
+        bench_copy_meta(input, output);
+        input->release();
+        return context->queueOutputBuffer(output);
+    }
+
+    virtual RT_RET close(RTTaskNodeContext *context) { return RT_OK; }
+
+ private:
+    INT32 mBurnUs;
+};
+
+class RTBenchSink : public RTTaskNode {
+ public:
+    RTBenchSink() : mInputs(1) {}
+    virtual ~RTBenchSink() {}
+
+    virtual RT_RET open(RTTaskNodeContext *context) {
+        mInputs = bench_find_opt(context, OPT_BENCH_INPUTS, 1);
+        mStreams.clear();
+        if (mInputs <= 1) {
+            mStreams.push_back("none");
+            return RT_OK;
+        }
+        for (INT32 i = 0; i < mInputs; i++) {
+            mStreams.push_back(std::string(BENCH_FMT) + "_" + util_to_string(i));
+        }
+        return RT_OK;
+    }
+
+    /*
+     * a frame is done when every input delivered it, its latency is taken
+     * from the earliest capture time of the joined buffers.
+     */
+    virtual RT_RET process(RTTaskNodeContext *context) {
+        for (size_t i = 0; i < mStreams.size(); i++) {
+            if (context->inputIsEmpty(mStreams[i])) {
+                return RT_OK;
+            }
+        }
+        INT64 captureUs = 0;
+        for (size_t i = 0; i < mStreams.size(); i++) {
+            RTMediaBuffer *buffer = context->dequeInputBuffer(mStreams[i]);
+            if (buffer == RT_NULL) {
+                continue;
+            }
+            INT64 us = 0;
+            buffer->getMetaData()->findInt64(kKeyFrameCaptureUs, &us);
+            captureUs = (captureUs == 0) ? us : RT_MIN(captureUs, us);
+            buffer->release();
+        }
+        if (captureUs > 0) {
+            INT64 now = static_cast<INT64>(RtTime::getRelativeTimeUs());
+            gBenchLatency.record(now > captureUs ? now - captureUs : 0);
+        }
+        gBenchFrames.fetch_add(1, std::memory_order_relaxed);
+        return RT_OK;
+    }
+
+    virtual RT_RET close(RTTaskNodeContext *context) { return RT_OK; }
+
+ private:
+    INT32                    mInputs;
+    std::vector<std::string> mStreams;
+};
+
+static RTTaskNode* createBenchSource() { return new RTBenchSource(); }
+static RTTaskNode* createBenchPass() { return new RTBenchPass(); }
+static RTTaskNode* createBenchSink() { return new RTBenchSink(); }
+
+static RTNodeStub node_stub_bench_source {
+    .mUid          = MKTAG('b', 's', 'r', 'c'),
+    .mName         = BENCH_NODE_SOURCE,
+    .mVersion      = "v1.0",
+    .mCreateObj    = createBenchSource,
+    .mCapsSrc      = { BENCH_FMT, RT_PAD_SRC, RT_MB_TYPE_BASE, {RT_NULL, RT_NULL} },
+    .mCapsSink     = { BENCH_FMT, RT_PAD_SINK, RT_MB_TYPE_BASE, {RT_NULL, RT_NULL} },
+};
+
+static RTNodeStub node_stub_bench_pass {
+    .mUid          = MKTAG('b', 'p', 's', 's'),
+    .mName         = BENCH_NODE_PASS,
+    .mVersion      = "v1.0",
+    .mCreateObj    = createBenchPass,
+    .mCapsSrc      = { BENCH_FMT, RT_PAD_SRC, RT_MB_TYPE_BASE, {RT_NULL, RT_NULL} },
+    .mCapsSink     = { BENCH_FMT, RT_PAD_SINK, RT_MB_TYPE_BASE, {RT_NULL, RT_NULL} },
+};
+
+// same node as bench_pass, registered apart so burning nodes are told apart in traces.
+static RTNodeStub node_stub_bench_burn {
+    .mUid          = MKTAG('b', 'b', 'r', 'n'),
+    .mName         = BENCH_NODE_BURN,
+    .mVersion      = "v1.0",
+    .mCreateObj    = createBenchPass,
+    .mCapsSrc      = { BENCH_FMT, RT_PAD_SRC, RT_MB_TYPE_BASE, {RT_NULL, RT_NULL} },
+    .mCapsSink     = { BENCH_FMT, RT_PAD_SINK, RT_MB_TYPE_BASE, {RT_NULL, RT_NULL} },
+};
+
+static RTNodeStub node_stub_bench_sink {
+    .mUid          = MKTAG('b', 's', 'n', 'k'),
+    .mName         = BENCH_NODE_SINK,
+    .mVersion      = "v1.0",
+    .mCreateObj    = createBenchSink,
+    .mCapsSrc      = { BENCH_FMT, RT_PAD_SRC, RT_MB_TYPE_BASE, {RT_NULL, RT_NULL} },
+    .mCapsSink     = { BENCH_FMT, RT_PAD_SINK, RT_MB_TYPE_BASE, {RT_NULL, RT_NULL} },
+};
+
+RT_NODE_FACTORY_REGISTER_STUB(node_stub_bench_source);
+RT_NODE_FACTORY_REGISTER_STUB(node_stub_bench_pass);
+RT_NODE_FACTORY_REGISTER_STUB(node_stub_bench_burn);
+RT_NODE_FACTORY_REGISTER_STUB(node_stub_bench_sink);
+
+static std::string bench_stream_name(INT32 nodeId) {
+    return std::string("bench_") + util_to_string(nodeId) + "_out";
+}
+
+static void bench_append_node(std::string *s, const BenchOptions &opts, BenchExecMode mode,
+                              INT32 nodeId, const BenchNodeConfig &node, RT_BOOL last) {
+    RT_BOOL sink = node.output.empty() ? RT_TRUE : RT_FALSE;
+    RT_NODE_TAG_APPEND((*s), nodeId);
+
+    RT_NODE_OPTS_APPEND((*s));
+    RT_NODE_CONFIG_STRING_LAST_APPEND((*s), OPT_NODE_NAME, node.name);
+    RT_TAG_END((*s));
+
+    s->append("\"").append(KEY_ROOT_NODE_OPTS_EXTRA).append("\": {\n");
+    if (mode != BENCH_EXEC_DEFAULT) {
+        RT_NODE_CONFIG_STRING_APPEND((*s), OPT_NODE_DISPATCH_EXEC, BENCH_EXEC_NAME);
+    }
+    RT_NODE_CONFIG_NUMBER_APPEND((*s), OPT_NODE_BUFFER_TYPE, sink ? 1 : 0);
+    RT_NODE_CONFIG_NUMBER_APPEND((*s), OPT_NODE_BUFFER_COUNT, sink ? 0 : opts.buffers);
+    RT_NODE_CONFIG_NUMBER_LAST_APPEND((*s), OPT_NODE_BUFFER_SIZE, sink ? 0 : opts.bufferSize);
+    RT_TAG_END((*s));
+
+    RT_STREAM_OPTS_APPEND((*s));
+    if (node.inputs.size() == 1) {
+        RT_NODE_CONFIG_STRING_APPEND((*s), "stream_input", node.inputs[0]);
+        RT_NODE_CONFIG_STRING_APPEND((*s), "stream_fmt_in", node.fmtIns[0]);
+    } else {
+        for (size_t i = 0; i < node.inputs.size(); i++) {
+            std::string index = util_to_string(static_cast<INT32>(i));
+            RT_NODE_CONFIG_STRING_APPEND((*s), KEY_ROOT_INPUT_STREAM_ID + index, node.inputs[i]);
+            RT_NODE_CONFIG_STRING_APPEND((*s), "stream_fmt_in_" + index, node.fmtIns[i]);
+        }
+    }
+    if (node.inputs.empty()) {
+        RT_NODE_CONFIG_STRING_APPEND((*s), "stream_fmt_in", BENCH_FMT);
+    }
+    if (!sink) {
+        RT_NODE_CONFIG_STRING_APPEND((*s), "stream_output", node.output);
+    }
+    RT_NODE_CONFIG_STRING_LAST_APPEND((*s), "stream_fmt_out", sink ? BENCH_FMT : node.fmtOut);
+    RT_TAG_END((*s));
+
+    s->append("\"").append(KEY_ROOT_STREAM_OPTS_EXTRA).append("\": {\n");
+    RT_NODE_CONFIG_NUMBER_APPEND((*s), OPT_BENCH_FRAMES, opts.frames);
+    RT_NODE_CONFIG_NUMBER_APPEND((*s), OPT_BENCH_INPUTS, static_cast<INT32>(node.inputs.size()));
+    RT_NODE_CONFIG_NUMBER_LAST_APPEND((*s), OPT_BENCH_BURN_US, node.burnUs);
+    RT_TAG_LAST_END((*s));
+
+    if (last) {
+        RT_TAG_LAST_END((*s));
+    } else {
+        RT_TAG_END((*s));
+    }
+}
+
+static BenchNodeConfig bench_node(const char *name, INT32 burnUs) {
+    BenchNodeConfig node;
+    node.name   = name;
+    node.fmtOut = BENCH_FMT;
+    node.burnUs = burnUs;
+    return node;
+}
+
+static void bench_link(BenchNodeConfig *node, INT32 upNodeId, const std::string &fmt) {
+    node->inputs.push_back(bench_stream_name(upNodeId));
+    node->fmtIns.push_back(fmt);
+}
+
+/*
+ * node ids follow the vector index, the source is node 0 and the sinks come last.
+ */
+static std::vector<BenchNodeConfig> bench_build_nodes(const BenchOptions &opts, BenchTopology topo,
+                                                      INT32 length) {
+    std::vector<BenchNodeConfig> nodes;
+    const char *passName = opts.burnUs > 0 ? BENCH_NODE_BURN : BENCH_NODE_PASS;
+    nodes.push_back(bench_node(BENCH_NODE_SOURCE, 0));
+
+    if (topo == BENCH_TOPO_CHAIN || topo == BENCH_TOPO_MANY) {
+        for (INT32 i = 1; i <= length; i++) {
+            nodes.push_back(bench_node(passName, opts.burnUs));
+            bench_link(&nodes.back(), i - 1, BENCH_FMT);
+        }
+        nodes.push_back(bench_node(BENCH_NODE_SINK, 0));
+        bench_link(&nodes.back(), length, BENCH_FMT);
+    } else if (topo == BENCH_TOPO_DIAMOND) {
+        BenchNodeConfig sink = bench_node(BENCH_NODE_SINK, 0);
+        for (INT32 i = 1; i <= length; i++) {
+            std::string fmt = std::string(BENCH_FMT) + "_" + util_to_string(i - 1);
+            nodes.push_back(bench_node(passName, opts.burnUs));
+            nodes.back().fmtOut = fmt;
+            bench_link(&nodes.back(), 0, BENCH_FMT);
+            bench_link(&sink, i, fmt);
+        }
+        nodes.push_back(sink);
+    } else if (topo == BENCH_TOPO_FANOUT) {
+        for (INT32 i = 1; i <= length; i++) {
+            nodes.push_back(bench_node(BENCH_NODE_SINK, 0));
+            bench_link(&nodes.back(), 0, BENCH_FMT);
+        }
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        BenchNodeConfig &node = nodes[i];
+        if (strcmp(node.name, BENCH_NODE_SINK) != 0) {
+            node.output = bench_stream_name(static_cast<INT32>(i));
+        }
+    }
+    return nodes;
+}
+
+static std::string bench_build_config(const BenchOptions &opts, BenchExecMode mode,
+                                      BenchTopology topo, INT32 length) {
+    std::vector<BenchNodeConfig> nodes = bench_build_nodes(opts, topo, length);
+    std::string config("{\n");
+    if (mode != BENCH_EXEC_DEFAULT) {
+        config.append("\"").append(KEY_ROOT_EXEC_ID).append("0\": {\n");
+        config.append("\"").append(KEY_ROOT_EXEC_OPTS).append("\": {\n");
+        RT_NODE_CONFIG_STRING_APPEND(config, OPT_EXEC_THREAD_NAME, BENCH_EXEC_NAME);
+        RT_NODE_CONFIG_NUMBER_LAST_APPEND(config, OPT_EXEC_THREAD_NUM,
+                                          mode == BENCH_EXEC_SINGLE ? 1 : opts.threads);
+        RT_TAG_LAST_END(config);
+        RT_TAG_END(config);
+    }
+    RT_PIPE_TAG_APPEND(config, 0);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        bench_append_node(&config, opts, mode, static_cast<INT32>(i), nodes[i],
+                          i + 1 == nodes.size() ? RT_TRUE : RT_FALSE);
+    }
+    RT_TAG_LAST_END(config);
+    RT_TAG_LAST_END(config);
+    return config;
+}
+
+static void bench_save_config(const BenchOptions &opts, const char *tag, const std::string &config) {
+    if (opts.configDir == RT_NULL) {
+        return;
+    }
+    std::string path = std::string(opts.configDir) + "/" + tag + ".json";
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == RT_NULL) {
+        RT_LOGE("open %s failed", path.c_str());
+        return;
+    }
+    fwrite(config.data(), 1, config.size(), fp);
+    fclose(fp);
+}
+
+/*
+ * runs graphs copies of one config concurrently until every sink saw EOS.
+ */
+static RT_RET bench_run(const BenchOptions &opts, const std::string &config, INT32 graphs,
+                        BenchResult *result) {
+    RT_RET ret = RT_OK;
+    std::vector<RTTaskGraph *> taskGraphs;
+    gBenchLatency.reset();
+    gBenchFrames.store(0, std::memory_order_relaxed);
+
+    for (INT32 i = 0; i < graphs && ret == RT_OK; i++) {
+        RTTaskGraph *graph = new RTTaskGraph("rt_graph_bench");
+        taskGraphs.push_back(graph);
+        ret = graph->autoBuild(config.c_str(), RT_FALSE);
+        if (ret == RT_OK) {
+            ret = graph->prepare();
+        }
+    }
+
+    UINT64 startUs = RtTime::getRelativeTimeUs();
+    for (size_t i = 0; i < taskGraphs.size() && ret == RT_OK; i++) {
+        ret = taskGraphs[i]->start();
+    }
+    for (size_t i = 0; i < taskGraphs.size() && ret == RT_OK; i++) {
+        ret = taskGraphs[i]->waitUntilEos(BENCH_EOS_TIMEOUT_US);
+        if (ret != RT_OK) {
+            RT_LOGE("graph %d did not reach eos, ret %d", static_cast<INT32>(i), ret);
+        }
+    }
+    result->elapsedUs = static_cast<INT64>(RtTime::getRelativeTimeUs() - startUs);
+    result->frames    = gBenchFrames.load(std::memory_order_relaxed);
+    gBenchLatency.summary(&result->latency);
+
+    for (size_t i = 0; i < taskGraphs.size(); i++) {
+        taskGraphs[i]->stop();
+        taskGraphs[i]->release();
+        delete taskGraphs[i];
+    }
+    return ret;
+}
+
+static void bench_report(const char *topo, const char *exec, INT32 length, INT32 graphs,
+                         const BenchResult &result, INT64 hopUs) {
+    double fps = result.elapsedUs > 0 ? result.frames * 1000000.0 / result.elapsedUs : 0.0;
+    printf("%-8s %-8s %6d %6d %8lld %10.1f %8lld %8lld %8lld %8lld",
+           topo, exec, length, graphs, (long long)result.frames, fps,
+           (long long)result.latency.p50, (long long)result.latency.p90,
+           (long long)result.latency.p99, (long long)result.latency.max);
+    if (hopUs >= 0) {
+        printf(" %8lld", (long long)hopUs);
+    }
+    printf("\n");
+}
+
+static RT_RET bench_topology(const BenchOptions &opts, BenchExecMode mode, BenchTopology topo) {
+    std::string tag = std::string(bench_topo_name(topo)) + "_" + bench_exec_name(mode);
+    INT32 graphs = (topo == BENCH_TOPO_MANY) ? opts.graphs : 1;
+    std::string config = bench_build_config(opts, mode, topo, opts.length);
+    bench_save_config(opts, tag.c_str(), config);
+
+    BenchResult result;
+    RT_RET ret = bench_run(opts, config, graphs, &result);
+    if (ret != RT_OK) {
+        RT_LOGE("%s failed, ret %d", tag.c_str(), ret);
+        return ret;
+    }
+
+    /*
+     * per-hop overhead of a chain: the median latency over a chain without
+     * pass nodes, divided by the pass nodes in between. burn time is excluded.
+     */
+    INT64 hopUs = -1;
+    if (topo == BENCH_TOPO_CHAIN && opts.length > 0) {
+        BenchResult base;
+        std::string baseConfig = bench_build_config(opts, mode, topo, 0);
+        if (bench_run(opts, baseConfig, 1, &base) == RT_OK) {
+            INT64 extra = static_cast<INT64>(result.latency.p50) - static_cast<INT64>(base.latency.p50)
+                            - static_cast<INT64>(opts.burnUs) * opts.length;
+            hopUs = RT_MAX(extra, 0) / opts.length;
+        }
+    }
+    bench_report(bench_topo_name(topo), bench_exec_name(mode), opts.length, graphs, result, hopUs);
+    return RT_OK;
+}
+
+static void bench_usage(const char *name) {
+    printf("usage: %s [options]\n", name);
+    printf("  -t topology   chain, diamond, fanout, many or all(default)\n");
+    printf("  -e executor   default, pool, single or all(default)\n");
+    printf("  -n frames     frames emitted by every source, default 1000\n");
+    printf("  -l length     pass nodes of a chain, branches of diamond/fanout, default 4\n");
+    printf("  -g graphs     concurrent graphs of topology many, default 4\n");
+    printf("  -b burn_us    cpu time spent by every pass node, default 0\n");
+    printf("  -j threads    threads of the pool executor, default 4\n");
+    printf("  -c buffers    buffers of every node pool, default 4\n");
+    printf("  -s size       bytes of every buffer, default 4096\n");
+    printf("  -d dir        write the generated graph configs into dir\n");
+}
+
+static INT32 bench_parse_name(const char *arg, const char *(*nameOf)(INT32), INT32 max) {
+    if (!strcmp(arg, "all")) {
+        return max;
+    }
+    for (INT32 i = 0; i < max; i++) {
+        if (!strcmp(arg, nameOf(i))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.topology   = BENCH_TOPO_MAX;
+    opts.execMode   = BENCH_EXEC_MAX;
+    opts.frames     = 1000;
+    opts.length     = 4;
+    opts.graphs     = 4;
+    opts.threads    = 4;
+    opts.buffers    = 4;
+    opts.bufferSize = 4096;
+
+    INT32 c;
+    while ((c = getopt(argc, argv, "t:e:n:l:g:b:j:c:s:d:h")) != -1) {
+        switch (c) {
+          case 't': opts.topology   = bench_parse_name(optarg, bench_topo_name, BENCH_TOPO_MAX); break;
+          case 'e': opts.execMode   = bench_parse_name(optarg, bench_exec_name, BENCH_EXEC_MAX); break;
+          case 'n': opts.frames     = atoi(optarg); break;
+          case 'l': opts.length     = atoi(optarg); break;
+          case 'g': opts.graphs     = atoi(optarg); break;
+          case 'b': opts.burnUs     = atoi(optarg); break;
+          case 'j': opts.threads    = atoi(optarg); break;
+          case 'c': opts.buffers    = atoi(optarg); break;
+          case 's': opts.bufferSize = atoi(optarg); break;
+          case 'd': opts.configDir  = optarg; break;
+          default:
+            bench_usage(argv[0]);
+            return 0;
+        }
+    }
+    if (opts.topology < 0 || opts.execMode < 0 || opts.frames <= 0 || opts.length < 1
+            || opts.graphs < 1 || opts.threads < 1 || opts.buffers < 1) {
+        bench_usage(argv[0]);
+        return -1;
+    }
+
+    RTStatsServer *server = RTStatsServer::instance();
+    server->registerProvider("graph_bench", [](RTJsonWriter *json) {
+        RtHistogramSummary latency;
+        gBenchLatency.summary(&latency);
+        json->value("frames", gBenchFrames.load(std::memory_order_relaxed)).histogram("latency_us", latency);
+    });
+    server->startFromEnv();
+
+    printf("%-8s %-8s %6s %6s %8s %10s %8s %8s %8s %8s %8s\n", "topology", "executor", "length",
+           "graphs", "frames", "fps", "p50(us)", "p90(us)", "p99(us)", "max(us)", "hop(us)");
+    INT32 failed = 0;
+    for (INT32 mode = 0; mode < BENCH_EXEC_MAX; mode++) {
+        if (opts.execMode != BENCH_EXEC_MAX && opts.execMode != mode) {
+            continue;
+        }
+        for (INT32 topo = 0; topo < BENCH_TOPO_MAX; topo++) {
+            if (opts.topology != BENCH_TOPO_MAX && opts.topology != topo) {
+                continue;
+            }
+            if (bench_topology(opts, static_cast<BenchExecMode>(mode),
+                               static_cast<BenchTopology>(topo)) != RT_OK) {
+                failed++;
+            }
+        }
+    }
+    server->stop();
+    server->unregisterProvider("graph_bench");
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark of the md filter motion detection
+ *
+ * feeds -c channels of nv12 frames, a noisy still scene with a square
+ * bouncing inside one quadrant, through one detector per channel on one
+ * thread, with the scalar and the simd kernels. the four quadrants are the
+ * rois, given as opt_md_roi_rect in source coordinates. prints us per
+ * frame and channel, the share of one core all channels take at -r fps,
+ * and checks that:
+ *  - scalar and simd give the same maps and roi masks;
+ *  - after a few frames the quadrant of the square moves on every frame,
+ *    the others never;
+ *  - a roi added once the background is primed is not flagged on a still
+ *    scene;
+ *  - the blocks of rows no roi covers any more are cleared from the map.
+ *
+ * without an a55 at hand the neon row kernel is also modeled: its
+ * instructions per 16 pixels at one 128 bit op per cycle, see
+ * MD_BENCH_A55_CYCLES. it is an estimate of the kernel alone, the board
+ * run of this bench is the number that counts.
+ *
+ * -W/-H detect on luma scaled down from the source size.
+ *
+ * usage: rt_md_bench [-c channels] [-w width] [-h height] [-W ds_width] [-H ds_height] [-b blk_size]
+ *                    [-n frames] [-r fps]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "RTMotionDetect.h"
+
+#define MD_BENCH_NOISES     4       // noise fields cycled through the frames
+#define MD_BENCH_WARMUP     8       // the square is in the first background, frames until it stands out
+#define MD_BENCH_A55_CYCLES 24      // rt_md_row neon, 16 pixels: 21 q ops plus the sad adds, dual issued
+#define MD_BENCH_A55_MHZ    1800
+
+typedef struct _MdBenchChannel {
+    std::vector<UINT8>  scene;                  // still luma
+    INT32               x, y, dx, dy;           // square, in source pixels
+    INT32               size;
+    INT32               quadrant;
+} MdBenchChannel;
+
+static void bench_frame(const MdBenchChannel &ch, const std::vector<UINT8> &noise, INT32 width, INT32 height,
+                        std::vector<UINT8> *frame) {
+    for (INT32 i = 0; i < width * height; i++) {
+        (*frame)[i] = static_cast<UINT8>(RT_CLIP(ch.scene[i] + noise[i] - 3, 0, 255));
+    }
+    for (INT32 y = ch.y; y < ch.y + ch.size; y++) {
+        memset(&(*frame)[y * width + ch.x], 235, ch.size);
+    }
+}
+
+// the square bounces inside its quadrant.
+static void bench_move(MdBenchChannel *ch, INT32 width, INT32 height) {
+    const INT32 x0 = (ch->quadrant % 2) * width / 2;
+    const INT32 y0 = (ch->quadrant / 2) * height / 2;
+    if (ch->x + ch->dx < x0 || ch->x + ch->dx + ch->size > x0 + width / 2) {
+        ch->dx = -ch->dx;
+    }
+    if (ch->y + ch->dy < y0 || ch->y + ch->dy + ch->size > y0 + height / 2) {
+        ch->dy = -ch->dy;
+    }
+    ch->x += ch->dx;
+    ch->y += ch->dy;
+}
+
+/*
+ * one roi on the left half primes on a still scene, then the right half is
+ * added. its columns were never differenced, their background is empty.
+ */
+static RT_BOOL bench_late_roi(const MdBenchChannel &ch, const std::vector<UINT8> &noise, INT32 width,
+                              INT32 height) {
+    MdBenchChannel still = ch;
+    still.size = 0;
+    std::vector<UINT8> frame(width * height * 3 / 2, 128);
+    RTScaleImage image;
+    memset(&image, 0, sizeof(image));
+    image.data   = &frame[0];
+    image.format = RT_FMT_YUV420SP;
+    image.width  = width;
+    image.height = height;
+    RTMotionDetector detector;
+    RTRect left = { 0, 0, width / 2, height };
+    RTRect right = { width / 2, 0, width / 2, height };
+    if (detector.init(width, height) != RT_OK || detector.addRoi(left) != RT_OK) {
+        return RT_FALSE;
+    }
+    bench_frame(still, noise, width, height, &frame);
+    UINT32 flagged = 0;
+    for (INT32 f = 0; f < 4; f++) {
+        if (f == 2) {
+            detector.addRoi(right);
+        }
+        detector.process(&image);
+        flagged |= detector.getRoiMask();
+    }
+    return flagged ? RT_FALSE : RT_TRUE;
+}
+
+/*
+ * the square moves under a roi of the whole frame, then the roi shrinks to
+ * the half without the square. the rows the roi left must read still.
+ */
+static RT_BOOL bench_shrunk_roi(const MdBenchChannel &ch, const std::vector<UINT8> &noise, INT32 width,
+                                INT32 height) {
+    MdBenchChannel moving = ch;
+    std::vector<UINT8> frame(width * height * 3 / 2, 128);
+    RTScaleImage image;
+    memset(&image, 0, sizeof(image));
+    image.data   = &frame[0];
+    image.format = RT_FMT_YUV420SP;
+    image.width  = width;
+    image.height = height;
+    RTMotionDetector detector;
+    const INT32 half = (moving.y < height / 2) ? height / 2 : 0;
+    RTRect whole = { 0, 0, width, height };
+    RTRect other = { 0, half, width, height / 2 };
+    if (detector.init(width, height) != RT_OK || detector.addRoi(whole) != RT_OK) {
+        return RT_FALSE;
+    }
+    for (INT32 f = 0; f < MD_BENCH_WARMUP; f++) {
+        bench_frame(moving, noise, width, height, &frame);
+        detector.process(&image);
+        bench_move(&moving, width, height);
+    }
+    const INT32 blocks = (width / RT_MD_BLOCK) * (height / RT_MD_BLOCK);
+    const INT32 left   = (half ? 0 : height / 2 / RT_MD_BLOCK) * (width / RT_MD_BLOCK);
+    const INT32 count  = (height / 2 / RT_MD_BLOCK) * (width / RT_MD_BLOCK);
+    INT32 before = 0, after = 0;
+    for (INT32 i = 0; i < blocks; i++) {
+        before += detector.getMap()[i] ? 1 : 0;
+    }
+    detector.clearRois();
+    detector.addRoi(other);
+    bench_frame(moving, noise, width, height, &frame);
+    detector.process(&image);
+    for (INT32 i = left; i < left + count; i++) {
+        after += detector.getMap()[i] ? 1 : 0;
+    }
+    return (before > 0 && after == 0) ? RT_TRUE : RT_FALSE;
+}
+
+static void bench_print(const char *name, RTMotionDetector *detectors, INT32 channels, INT32 fps) {
+    double sumUs = 0.0;
+    UINT64 p99 = 0;
+    for (INT32 i = 0; i < channels; i++) {
+        RtHistogramSummary sum;
+        detectors[i].getFrameUs(&sum);
+        sumUs += sum.count ? sum.sum / static_cast<double>(sum.count) : 0.0;
+        p99 = RT_MAX(p99, sum.p99);
+    }
+    const double avgUs = sumUs / channels;
+    printf("%-7s %10.1f %10lld %12.1f %9.1f%%\n", name, avgUs, (long long)p99, sumUs,
+           sumUs * fps / 10000.0);
+}
+
+int main(int argc, char **argv) {
+    INT32 channels = 8, width = 640, height = 360, dsWidth = 0, dsHeight = 0, blkSize = RT_MD_BLOCK;
+    INT32 frames = 300, fps = 30;
+    INT32 c;
+    while ((c = getopt(argc, argv, "c:w:h:W:H:b:n:r:")) != -1) {
+        switch (c) {
+          case 'c': channels = atoi(optarg); break;
+          case 'w': width    = atoi(optarg); break;
+          case 'h': height   = atoi(optarg); break;
+          case 'W': dsWidth  = atoi(optarg); break;
+          case 'H': dsHeight = atoi(optarg); break;
+          case 'b': blkSize  = atoi(optarg); break;
+          case 'n': frames   = atoi(optarg); break;
+          case 'r': fps      = atoi(optarg); break;
+          default:
+            printf("usage: %s [-c channels] [-w width] [-h height] [-W ds_width] [-H ds_height] [-b blk_size]"
+                   " [-n frames] [-r fps]\n", argv[0]);
+            return -1;
+        }
+    }
+    dsWidth  = (dsWidth > 0) ? dsWidth : width;
+    dsHeight = (dsHeight > 0) ? dsHeight : height;
+    if (channels <= 0 || width < 128 || height < 128 || (width | height) & 3
+            || frames <= MD_BENCH_WARMUP || fps <= 0) {
+        return -1;
+    }
+
+    char rects[160];
+    snprintf(rects, sizeof(rects), "(0,0,%d,%d)(%d,0,%d,%d)(0,%d,%d,%d)(%d,%d,%d,%d)", width / 2, height / 2,
+             width / 2, width / 2, height / 2, height / 2, width / 2, height / 2, width / 2, height / 2, width / 2,
+             height / 2);
+    RtMetaData options;
+    options.setInt32(OPT_FILTER_MD_DS_WIDTH, dsWidth);
+    options.setInt32(OPT_FILTER_MD_DS_HEIGHT, dsHeight);
+    options.setInt32(OPT_FILTER_MD_ORI_WIDTH, width);
+    options.setInt32(OPT_FILTER_MD_ORI_HEIGHT, height);
+    options.setInt32(OPT_FILTER_MD_BLK_SIZE, blkSize);
+    options.setInt32(OPT_FILTER_MD_ROI_CNT, 4);
+    options.setCString(OPT_FILTER_MD_ROI_RECT, rects);
+
+    std::vector<MdBenchChannel> chs(channels);
+    std::vector<RTMotionDetector> scalar(channels), simd(channels);
+    for (INT32 i = 0; i < channels; i++) {
+        MdBenchChannel &ch = chs[i];
+        ch.scene.resize(width * height);
+        for (INT32 p = 0; p < width * height; p++) {
+            ch.scene[p] = static_cast<UINT8>(40 + ((p % width) / 16 + (p / width) / 16 + i) % 2 * 60 + rand() % 8);
+        }
+        ch.size = width / 10;     // a tenth of the frame, whatever the scale
+        ch.quadrant = i % 4;
+        ch.x  = (ch.quadrant % 2) * width / 2 + 8 + i;
+        ch.y  = (ch.quadrant / 2) * height / 2 + 8;
+        ch.dx = (3 + i % 3) * width / 640;
+        ch.dy = (2 + i % 2) * width / 640;
+        for (INT32 k = 0; k < 2; k++) {
+            RTMotionDetector &detector = k ? simd[i] : scalar[i];
+            if (detector.loadOptions(&options) != RT_OK || detector.getRoiNum() != 4) {
+                printf("bad md options, %dx%d block %d\n", dsWidth, dsHeight, blkSize);
+                return -1;
+            }
+            detector.setSimd(k ? RT_TRUE : RT_FALSE);
+        }
+    }
+    std::vector<UINT8> noises[MD_BENCH_NOISES];
+    for (INT32 n = 0; n < MD_BENCH_NOISES; n++) {
+        noises[n].resize(width * height);
+        for (INT32 p = 0; p < width * height; p++) {
+            noises[n][p] = static_cast<UINT8>(rand() % 7);
+        }
+    }
+
+    std::vector<UINT8> frame(width * height * 3 / 2, 128);
+    RTScaleImage image;
+    memset(&image, 0, sizeof(image));
+    image.data   = &frame[0];
+    image.format = RT_FMT_YUV420SP;
+    image.width  = width;
+    image.height = height;
+    INT32 mismatches = 0, missed = 0, falses = 0;
+    for (INT32 f = 0; f < frames; f++) {
+        for (INT32 i = 0; i < channels; i++) {
+            MdBenchChannel &ch = chs[i];
+            bench_frame(ch, noises[f % MD_BENCH_NOISES], width, height, &frame);
+            scalar[i].process(&image);
+            simd[i].process(&image);
+            const INT32 blocks = scalar[i].getMapWidth() * scalar[i].getMapHeight();
+            if (scalar[i].getRoiMask() != simd[i].getRoiMask()
+                    || memcmp(scalar[i].getMap(), simd[i].getMap(), blocks) != 0) {
+                mismatches++;
+            }
+            if (f >= MD_BENCH_WARMUP) {
+                const UINT32 mask = simd[i].getRoiMask();
+                missed += (mask & (1u << ch.quadrant)) ? 0 : 1;
+                falses += (mask & ~(1u << ch.quadrant)) ? 1 : 0;
+            }
+            bench_move(&ch, width, height);
+        }
+    }
+
+    const RT_BOOL lateRoi = bench_late_roi(chs[0], noises[0], width, height);
+    const RT_BOOL shrunkRoi = bench_shrunk_roi(chs[0], noises[0], width, height);
+    const INT32 checked = RT_MAX(frames - MD_BENCH_WARMUP, 0) * channels;
+    // the four quadrants cover every whole block.
+    const double pixels = static_cast<double>(dsWidth / blkSize * blkSize) * (dsHeight / blkSize * blkSize);
+    const double a55Us = pixels * MD_BENCH_A55_CYCLES / 16 / MD_BENCH_A55_MHZ;
+    printf("%d channels of %dx%d, md at %dx%d, %dx%d blocks, %d frames, %s kernels\n", channels, width, height,
+           dsWidth, dsHeight, blkSize, blkSize, frames, rt_simd_name());
+    printf("%-7s %10s %10s %12s %10s\n", "kernel", "avg us", "p99 us", "us/frame all", "core@fps");
+    bench_print("scalar", &scalar[0], channels, fps);
+    bench_print("simd", &simd[0], channels, fps);
+    printf("core@fps is the share of one core all channels take at %d fps\n", fps);
+    printf("a55 model of the neon row kernel at %dMHz: %.1f us per frame, %.1f%% of one core, not measured%s\n",
+           MD_BENCH_A55_MHZ, a55Us, a55Us * channels * fps / 10000.0,
+           (dsWidth != width || dsHeight != height) ? ", without the scaling" : "");
+    printf("exact: %s, moving roi missed %d/%d, still roi flagged %d/%d, roi added later quiet: %s, "
+           "rows left by a roi cleared: %s\n", mismatches ? "NO" : "yes", missed, checked, falses, checked,
+           lateRoi ? "yes" : "NO", shrunkRoi ? "yes" : "NO");
+    return (mismatches == 0 && missed == 0 && falses == 0 && lateRoi && shrunkRoi) ? 0 : -1;
+}
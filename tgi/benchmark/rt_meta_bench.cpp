@@ -0,0 +1,277 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark and chain check of the copy-on-write metadata handle
+ *
+ * passes the metadata of -n frames down a chain of 5 nodes, each node
+ * holding its copy until the frame leaves the chain, the way buffers
+ * carry their metadata from node to node. prints ns per frame with a
+ * RtMetaData copy per hop and with RtSharedMetaData, and checks that:
+ *  - a chain of readers makes no deep copy and every node sees the
+ *    storage of the source;
+ *  - a node editing while upstream nodes still hold the frame makes
+ *    exactly one copy, seen by the nodes after it only;
+ *  - a copy made while an editor lives does not see later writes.
+ * then encodes metadata of every blob type, prints ns per encode and
+ * decode, and checks that:
+ *  - every value comes back from the blob unchanged;
+ *  - a pointer fails the encode unless skipped, and then is dropped;
+ *  - parse refuses blobs patched to a pointer or an unknown type, a
+ *    wrong-size int32, a short header and a truncated blob.
+ *
+ * usage: rt_meta_bench [-n frames] [-k keys]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "rt_metadata_codec.h"
+#include "rt_shared_metadata.h"
+#include "rt_time.h"
+
+#define META_BENCH_NODES        5
+#define META_BENCH_EDIT_KEY     0x7fff0001ULL
+
+static RtMetaData* bench_meta(INT32 keys) {
+    RtMetaData *meta = new RtMetaData();
+    for (INT32 k = 0; k < keys; k++) {
+        meta->setInt32(static_cast<UINT64>(k + 1), k);
+    }
+    return meta;
+}
+
+// each node copies the handle of the node before; the editor node writes while all upstream copies live.
+static INT32 bench_chain(RtSharedMetaData *nodes, INT32 keys, INT32 editor) {
+    nodes[0] = RtSharedMetaData(bench_meta(keys));
+    for (INT32 i = 1; i < META_BENCH_NODES; i++) {
+        nodes[i] = nodes[i - 1];
+        if (i == editor) {
+            RtSharedMetaData::Editor edit(&nodes[i]);
+            edit->setInt32(META_BENCH_EDIT_KEY, i);
+        }
+    }
+    INT32 errors = 0;
+    for (INT32 i = 0; i < META_BENCH_NODES; i++) {
+        INT32 value = -1;
+        const RT_BOOL edited = nodes[i]->findInt32(META_BENCH_EDIT_KEY, &value);
+        const RT_BOOL expect = (editor > 0 && i >= editor) ? RT_TRUE : RT_FALSE;
+        const RtMetaData *owner = expect ? nodes[editor].get() : nodes[0].get();
+        errors += (edited != expect || (edited && value != editor)) ? 1 : 0;
+        errors += (nodes[i].get() != owner) ? 1 : 0;
+    }
+    return errors;
+}
+
+typedef struct _MetaBenchStruct {
+    INT32 x;
+    INT32 y;
+    INT64 pts;
+} MetaBenchStruct;
+
+static void bench_codec_meta(RtMetaData *meta) {
+    const INT8  i8  = -8;
+    const INT16 i16 = -1616;
+    const MetaBenchStruct st = { 3, 4, 1234567890123LL };
+    meta->setInt32(1, -32);
+    meta->setInt64(2, 0x123456789abcdefLL);
+    meta->setFloat(3, 0.25f);
+    meta->setData(4, RtMetaData::TYPE_INT8, &i8, sizeof(i8));
+    meta->setData(5, RtMetaData::TYPE_INT16, &i16, sizeof(i16));
+    meta->setCString(6, "rockit");
+    meta->setStructData(7, &st, sizeof(st));
+}
+
+// offset of the entry of key inside an encoded blob, the blob is known to be well formed.
+static UINT32 bench_entry_offset(const std::vector<UINT8> &blob, UINT64 key) {
+    RTMetaBlobHeader header;
+    memcpy(&header, blob.data(), sizeof(header));
+    UINT32 pos = header.headerSize;
+    for (UINT32 i = 0; i < header.count; i++) {
+        RTMetaBlobEntry entry;
+        memcpy(&entry, &blob[pos], sizeof(entry));
+        if (entry.key == key) {
+            return pos;
+        }
+        pos += RT_META_BLOB_ALIGN(sizeof(RTMetaBlobEntry)) + RT_META_BLOB_ALIGN(entry.size);
+    }
+    return 0;
+}
+
+// parses blob with the entry of key patched to type and size, which must be refused.
+static INT32 bench_corrupt_entry(const std::vector<UINT8> &blob, UINT64 key, UINT32 type, UINT32 size) {
+    std::vector<UINT8> bad(blob);
+    const UINT32 pos = bench_entry_offset(bad, key);
+    RTMetaBlobEntry entry;
+    memcpy(&entry, &bad[pos], sizeof(entry));
+    entry.type = type;
+    entry.size = size;
+    memcpy(&bad[pos], &entry, sizeof(entry));
+    RtMetaData meta;
+    RtMetaDataView view;
+    INT32 errors = (view.parse(bad.data(), bad.size()) == RT_OK) ? 1 : 0;
+    errors += (RtMetaDataCodec::decode(bad.data(), bad.size(), &meta) == RT_OK) ? 1 : 0;
+    return errors + (meta.hasData(key) ? 1 : 0);
+}
+
+static INT32 bench_codec(INT32 frames, double *encodeNs, double *decodeNs) {
+    RtMetaData source;
+    bench_codec_meta(&source);
+    std::vector<UINT8> blob;
+    INT32 errors = (RtMetaDataCodec::encode(&source, &blob) == RT_OK) ? 0 : 1;
+
+    RtMetaData meta;
+    errors += (RtMetaDataCodec::decode(blob.data(), blob.size(), &meta) == RT_OK) ? 0 : 1;
+    INT32 i32 = 0;
+    INT64 i64 = 0;
+    float flt = 0.0f;
+    const char *str = RT_NULL;
+    const void *data = RT_NULL;
+    UINT32 type = 0, size = 0;
+    errors += (meta.findInt32(1, &i32) && i32 == -32) ? 0 : 1;
+    errors += (meta.findInt64(2, &i64) && i64 == 0x123456789abcdefLL) ? 0 : 1;
+    errors += (meta.findFloat(3, &flt) && flt == 0.25f) ? 0 : 1;
+    errors += (meta.findData(4, &type, &data, &size) && type == RtMetaData::TYPE_INT8 &&
+               size == sizeof(INT8) && *reinterpret_cast<const INT8 *>(data) == -8) ? 0 : 1;
+    INT16 i16 = 0;
+    errors += (meta.findData(5, &type, &data, &size) && type == RtMetaData::TYPE_INT16 &&
+               size == sizeof(INT16)) ? 0 : 1;
+    memcpy(&i16, data, sizeof(i16));
+    errors += (i16 == -1616) ? 0 : 1;
+    errors += (meta.findCString(6, &str) && strcmp(str, "rockit") == 0) ? 0 : 1;
+    MetaBenchStruct st;
+    memset(&st, 0, sizeof(st));
+    errors += (meta.findData(7, &type, &data, &size) && type == RtMetaData::TYPE_STRUCT &&
+               size == sizeof(st)) ? 0 : 1;
+    memcpy(&st, data, RT_MIN(size, (UINT32)sizeof(st)));
+    errors += (st.x == 3 && st.y == 4 && st.pts == 1234567890123LL) ? 0 : 1;
+
+    // a pointer never leaves the process: refused, or dropped when asked to.
+    RtMetaData withPointer;
+    bench_codec_meta(&withPointer);
+    withPointer.setPointer(8, &source);
+    std::vector<UINT8> skipped;
+    errors += (RtMetaDataCodec::encode(&withPointer, &skipped) == RT_ERR_UNSUPPORT) ? 0 : 1;
+    errors += (RtMetaDataCodec::encode(&withPointer, &skipped, RT_META_BLOB_FLAG_SKIP_POINTER) == RT_OK) ? 0 : 1;
+    RtMetaDataView view;
+    errors += (view.parse(skipped.data(), skipped.size()) == RT_OK && view.size() == 7) ? 0 : 1;
+    errors += view.findData(8, &type, &data, &size) ? 1 : 0;
+
+    errors += bench_corrupt_entry(blob, 2, RtMetaData::TYPE_POINTER, sizeof(INT64));
+    errors += bench_corrupt_entry(blob, 1, MKTAG('b', 'a', 'd', '!'), sizeof(INT32));
+    errors += bench_corrupt_entry(blob, 2, RtMetaData::TYPE_INT32, sizeof(INT64));
+
+    std::vector<UINT8> bad(blob);
+    RTMetaBlobHeader header;
+    memcpy(&header, bad.data(), sizeof(header));
+    header.headerSize = sizeof(header) - 4;
+    memcpy(bad.data(), &header, sizeof(header));
+    errors += (view.parse(bad.data(), bad.size()) == RT_OK) ? 1 : 0;
+    errors += (view.parse(blob.data(), blob.size() - 8) == RT_OK) ? 1 : 0;
+    errors += (view.parse(blob.data(), sizeof(header) - 1) == RT_OK) ? 1 : 0;
+
+    UINT64 start = RtTime::getRelativeTimeUs();
+    for (INT32 f = 0; f < frames; f++) {
+        RtMetaDataCodec::encode(&source, &blob);
+    }
+    *encodeNs = (RtTime::getRelativeTimeUs() - start) * 1000.0 / frames;
+    start = RtTime::getRelativeTimeUs();
+    for (INT32 f = 0; f < frames; f++) {
+        RtMetaData decoded;
+        RtMetaDataCodec::decode(blob.data(), blob.size(), &decoded);
+    }
+    *decodeNs = (RtTime::getRelativeTimeUs() - start) * 1000.0 / frames;
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    INT32 frames = 100000, keys = 16;
+    INT32 c;
+    while ((c = getopt(argc, argv, "n:k:")) != -1) {
+        switch (c) {
+          case 'n': frames = atoi(optarg); break;
+          case 'k': keys   = atoi(optarg); break;
+          default:
+            printf("usage: %s [-n frames] [-k keys]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (frames <= 0 || keys <= 0) {
+        return -1;
+    }
+
+    INT32 errors = 0;
+    RtSharedMetaData nodes[META_BENCH_NODES];
+    UINT64 copies = RtSharedMetaData::deepCopyCount();
+    errors += bench_chain(nodes, keys, 0);
+    const UINT64 readCopies = RtSharedMetaData::deepCopyCount() - copies;
+    copies = RtSharedMetaData::deepCopyCount();
+    errors += bench_chain(nodes, keys, 2);
+    const UINT64 editCopies = RtSharedMetaData::deepCopyCount() - copies;
+
+    // a handle copied in the middle of an edit keeps the entries it was copied with.
+    RtSharedMetaData handle(bench_meta(keys));
+    RtSharedMetaData early;
+    {
+        RtSharedMetaData::Editor edit(&handle);
+        edit->setInt32(META_BENCH_EDIT_KEY, 1);
+        early = handle;
+        edit->setInt32(META_BENCH_EDIT_KEY, 2);
+    }
+    INT32 value = 0;
+    errors += (early->findInt32(META_BENCH_EDIT_KEY, &value) && value == 1) ? 0 : 1;
+    errors += (handle->findInt32(META_BENCH_EDIT_KEY, &value) && value == 2) ? 0 : 1;
+
+    RtMetaData *source = bench_meta(keys);
+    UINT64 start = RtTime::getRelativeTimeUs();
+    for (INT32 f = 0; f < frames; f++) {
+        RtMetaData *hops[META_BENCH_NODES];
+        hops[0] = new RtMetaData(*source);
+        for (INT32 i = 1; i < META_BENCH_NODES; i++) {
+            hops[i] = new RtMetaData(*hops[i - 1]);
+        }
+        for (INT32 i = 0; i < META_BENCH_NODES; i++) {
+            delete hops[i];
+        }
+    }
+    const double copyNs = (RtTime::getRelativeTimeUs() - start) * 1000.0 / frames;
+    start = RtTime::getRelativeTimeUs();
+    for (INT32 f = 0; f < frames; f++) {
+        nodes[0] = RtSharedMetaData(new RtMetaData(*source));
+        for (INT32 i = 1; i < META_BENCH_NODES; i++) {
+            nodes[i] = nodes[i - 1];
+        }
+    }
+    const double sharedNs = (RtTime::getRelativeTimeUs() - start) * 1000.0 / frames;
+    delete source;
+
+    double encodeNs = 0.0, decodeNs = 0.0;
+    const INT32 codecErrors = bench_codec(frames, &encodeNs, &decodeNs);
+
+    printf("%d frames through %d nodes, %d keys each\n", frames, META_BENCH_NODES, keys);
+    printf("%-12s %12s\n", "metadata", "ns/frame");
+    printf("%-12s %12.1f\n", "copied", copyNs);
+    printf("%-12s %12.1f\n", "shared", sharedNs);
+    printf("%-12s %12.1f\n", "encoded", encodeNs);
+    printf("%-12s %12.1f\n", "decoded", decodeNs);
+    printf("deep copies: readers %lld (want 0), one editor %lld (want 1), chain %s\n",
+           (long long)readCopies, (long long)editCopies, errors ? "WRONG" : "ok");
+    printf("blob round trip and corrupt blobs: %s\n", codecErrors ? "WRONG" : "ok");
+    return (errors == 0 && codecErrors == 0 && readCopies == 0 && editCopies == 1) ? 0 : -1;
+}
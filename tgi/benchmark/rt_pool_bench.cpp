@@ -0,0 +1,158 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: policy check of the adaptive buffer pool sizer
+ *
+ * drives two sizers sharing one budget with a simulated pool, one tick
+ * of 10ms at a time, prints ns per tick and checks that:
+ *  - a pool whose consumer holds -o buffers grows to one more than that
+ *    and stops at the budget, the second pool is denied;
+ *  - when the load goes away the pool shrinks back to its min count and
+ *    the budget of freed buffers only comes back with onFreed();
+ *  - a grow whose buffer fails to allocate is undone, and onAllocFailed()
+ *    without a pending grow (e.g. at the min count) changes nothing;
+ *  - the budget is back at 0 once every pool is gone.
+ *
+ * usage: rt_pool_bench [-o outstanding] [-n ticks]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rt_header.h"
+#include "rt_time.h"
+#include "RTBufferPoolSizer.h"
+
+#define POOL_BENCH_BUFFER_SIZE  (1920 * 1080 * 3 / 2)
+#define POOL_BENCH_TICK_US      (10 * 1000)
+
+typedef struct _PoolBenchState {
+    RTBufferPoolSizer *sizer;
+    INT32              allocated;   // buffers the simulated pool really holds
+} PoolBenchState;
+
+/*
+ * one tick of a consumer which wants to hold want buffers at once, then
+ * the pool applies the decision. failGrow makes the allocation of a grow
+ * fail; returns the delta of the tick.
+ */
+static INT32 bench_tick(PoolBenchState *pool, INT32 want, UINT64 nowUs, RT_BOOL failGrow) {
+    RTBufferPoolSizer *sizer = pool->sizer;
+    const INT32 held = RT_MIN(want, pool->allocated);
+    for (INT32 i = 0; i < held; i++) {
+        sizer->onAcquire();
+    }
+    if (want > pool->allocated) {
+        sizer->onBlocked(POOL_BENCH_TICK_US / 2);
+    }
+    for (INT32 i = 0; i < held; i++) {
+        sizer->onRelease();
+    }
+
+    const INT32 delta = sizer->evaluate(nowUs);
+    if (delta > 0) {
+        if (failGrow) {
+            sizer->onAllocFailed();
+        } else {
+            pool->allocated += delta;
+        }
+    } else if (delta < 0) {
+        // every buffer is idle after the tick, the pool frees them right away.
+        for (INT32 i = 0; i < -delta; i++) {
+            pool->allocated--;
+            sizer->onFreed();
+        }
+    }
+    return delta;
+}
+
+static UINT64 bench_used(const RTBufferMemBudget &budget) {
+    return budget.getUsed() / POOL_BENCH_BUFFER_SIZE;
+}
+
+int main(int argc, char **argv) {
+    INT32 outstanding = 4, ticks = 100000;
+    INT32 c;
+    while ((c = getopt(argc, argv, "o:n:")) != -1) {
+        switch (c) {
+          case 'o': outstanding = atoi(optarg); break;
+          case 'n': ticks       = atoi(optarg); break;
+          default:
+            printf("usage: %s [-o outstanding] [-n ticks]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (outstanding <= 1 || outstanding > 16 || ticks <= 0) {
+        return -1;
+    }
+
+    // room for the busy pool to reach outstanding + 1 buffers, the other one starts over it.
+    const INT32 limit = outstanding + 1;
+    RTBufferMemBudget budget(static_cast<UINT64>(limit) * POOL_BENCH_BUFFER_SIZE);
+    INT32 errors = 0;
+    UINT64 nowUs = 1;
+
+    PoolBenchState busy = { new RTBufferPoolSizer(&budget, POOL_BENCH_BUFFER_SIZE, 16, 2, 16), 2 };
+    for (INT32 t = 0; t < 500; t++, nowUs += POOL_BENCH_TICK_US) {
+        bench_tick(&busy, outstanding, nowUs, RT_FALSE);
+    }
+    const INT32 grown = busy.sizer->getCount();
+    errors += (grown == limit && busy.allocated == grown) ? 0 : 1;
+    PoolBenchState other = { new RTBufferPoolSizer(&budget, POOL_BENCH_BUFFER_SIZE, 4, 1, 4), 1 };
+    for (INT32 t = 0; t < 100; t++, nowUs += POOL_BENCH_TICK_US) {
+        bench_tick(&other, 3, nowUs, RT_FALSE);
+    }
+    RTBufferPoolSizerStat stat;
+    other.sizer->queryStat(&stat);
+    errors += (stat.count == 1 && stat.deniedTimes > 0) ? 0 : 1;
+    errors += (bench_used(budget) == static_cast<UINT64>(limit + 1)) ? 0 : 1;
+    delete other.sizer;
+
+    // quiet: one buffer in use, one shrink per RT_POOL_SIZER_QUIET_US.
+    for (INT32 t = 0; t < 5000; t++, nowUs += POOL_BENCH_TICK_US) {
+        bench_tick(&busy, 1, nowUs, RT_FALSE);
+    }
+    const INT32 shrunk = busy.sizer->getCount();
+    errors += (shrunk == 2 && busy.allocated == 2 && bench_used(budget) == 2) ? 0 : 1;
+
+    // no grow pending, at the min count: nothing was reserved, nothing goes back.
+    busy.sizer->onAllocFailed();
+    errors += (busy.sizer->getCount() == 2 && bench_used(budget) == 2) ? 0 : 1;
+    INT32 failed = 0;
+    for (INT32 t = 0; t < 100 && failed == 0; t++, nowUs += POOL_BENCH_TICK_US) {
+        failed = bench_tick(&busy, outstanding, nowUs, RT_TRUE);
+    }
+    busy.sizer->onAllocFailed();
+    errors += (failed == 1 && busy.sizer->getCount() == 2 && bench_used(budget) == 2) ? 0 : 1;
+
+    // the cost of the bookkeeping a real pool pays per buffer and window.
+    UINT64 start = RtTime::getRelativeTimeUs();
+    for (INT32 t = 0; t < ticks; t++, nowUs += POOL_BENCH_TICK_US) {
+        bench_tick(&busy, (t / 1000) % 2 ? outstanding : 1, nowUs, RT_FALSE);
+    }
+    const double tickNs = (RtTime::getRelativeTimeUs() - start) * 1000.0 / ticks;
+    errors += (bench_used(budget) == static_cast<UINT64>(busy.sizer->getCount())) ? 0 : 1;
+    delete busy.sizer;
+    const UINT64 leftBytes = budget.getUsed();
+    errors += (leftBytes == 0) ? 0 : 1;
+
+    printf("%d buffers held, budget of %d buffers, %d ticks\n", outstanding, limit, ticks);
+    printf("%-10s %8s %8s %12s\n", "pool", "grown", "shrunk", "ns/tick");
+    printf("%-10s %8d %8d %12.1f\n", "busy", grown, shrunk, tickNs);
+    printf("budget left after all pools are gone: %lld bytes (want 0), sizing %s\n",
+           (long long)leftBytes, errors ? "WRONG" : "ok");
+    return errors ? -1 : 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark and snr test of the polyphase resampler
+ *
+ * for every rate pair, format and quality tier:
+ *  - resamples noise in blocks of 10ms with the scalar and the simd
+ *    kernels, prints ns and cycles (when the pmu can be read) per output
+ *    sample of one channel, and checks s16 outputs are bit-exact;
+ *  - resamples sines inside the passband and prints the worst snr
+ *    against the ideal sine at the output rate, which must reach the
+ *    floor of the tier and, for s16, must not drop from low to high.
+ *
+ * usage: rt_resample_bench [-c channels] [-s seconds]
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "RTAudioResampler.h"
+#include "RTTaskNodePerf.h"
+
+typedef struct _ResampleBenchRates {
+    INT32 inRate;
+    INT32 outRate;
+} ResampleBenchRates;
+
+static const ResampleBenchRates gRates[] = {
+    { 48000, 16000 },
+    { 16000, 48000 },
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 48000,  8000 },
+};
+
+// passband edges of the tiers, of the lower nyquist, and their snr floors in dB.
+static const double gPassband[RT_RESAMPLE_QUALITY_MAX]  = { 0.4, 0.6, 0.75 };
+static const double gSnrFloor[RT_RESAMPLE_QUALITY_MAX]  = { 50.0, 70.0, 90.0 };
+// 16 bit input and output alone hold a 0.5 sine near 90dB, high runs q30 taps.
+static const double gSnrFloorS16[RT_RESAMPLE_QUALITY_MAX] = { 50.0, 70.0, 86.0 };
+
+template <typename T>
+static T bench_sample(double value);
+
+template <>
+INT16 bench_sample<INT16>(double value) {
+    return static_cast<INT16>(floor(value * 32767.0 + 0.5));
+}
+
+template <>
+float bench_sample<float>(double value) {
+    return static_cast<float>(value);
+}
+
+static double bench_value(INT16 sample) { return sample / 32767.0; }
+static double bench_value(float sample) { return sample; }
+
+template <typename T>
+static INT32 bench_run(RTAudioResampler *resampler, const std::vector<T> &in, INT32 channels, INT32 block,
+                       std::vector<T> *out) {
+    const INT32 frames = static_cast<INT32>(in.size()) / channels;
+    out->resize(static_cast<size_t>(resampler->getMaxOutFrames(block)) * channels * (frames / block + 1));
+    INT32 outFrames = 0;
+    for (INT32 pos = 0; pos < frames; pos += block) {
+        INT32 n = RT_MIN(block, frames - pos);
+        outFrames += resampler->process(&in[pos * channels], n, &(*out)[outFrames * channels]);
+    }
+    out->resize(outFrames * channels);
+    return outFrames;
+}
+
+/*
+ * worst snr over sines up to the passband edge of the tier, channel c carries the sine
+ * shifted by c radians so the channels are told apart.
+ */
+template <typename T>
+static double bench_snr(const ResampleBenchRates &rates, INT32 channels, RTResampleQuality quality) {
+    const double freqs[] = { 0.05, gPassband[quality] / 2, gPassband[quality] };
+    const double nyquist = RT_MIN(rates.inRate, rates.outRate) / 2.0;
+    const INT32 frames = rates.inRate / 2;
+    double worst = 1e9;
+    for (size_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++) {
+        const double w = 2.0 * M_PI * freqs[f] * nyquist;
+        std::vector<T> in(frames * channels);
+        std::vector<T> out;
+        for (INT32 i = 0; i < frames; i++) {
+            for (INT32 c = 0; c < channels; c++) {
+                in[i * channels + c] = bench_sample<T>(0.5 * sin(w * i / rates.inRate + c));
+            }
+        }
+        RTAudioResampler resampler;
+        resampler.init(rates.inRate, rates.outRate, channels, sizeof(T) == 2 ? RT_AUDIO_FMT_PCM_S16
+                       : RT_AUDIO_FMT_PCM_FLT, quality);
+        INT32 outFrames = bench_run(&resampler, in, channels, rates.inRate / 100, &out);
+        const double delay = resampler.getDelayFrames();
+        double signal = 0.0, noise = 0.0;
+        // skip the filter warm up at both ends.
+        for (INT32 n = outFrames / 8; n < outFrames * 7 / 8; n++) {
+            const double t = static_cast<double>(n) / rates.outRate - delay / rates.inRate;
+            for (INT32 c = 0; c < channels; c++) {
+                const double ideal = 0.5 * sin(w * t + c);
+                const double error = bench_value(out[n * channels + c]) - ideal;
+                signal += ideal * ideal;
+                noise  += error * error;
+            }
+        }
+        worst = RT_MIN(worst, 10.0 * log10(signal / RT_MAX(noise, 1e-30)));
+    }
+    return worst;
+}
+
+template <typename T>
+static RT_BOOL bench_rates(const ResampleBenchRates &rates, INT32 channels, INT32 seconds, RTResampleQuality quality,
+                           const char *format, double *snrOut) {
+    static const char *tiers[RT_RESAMPLE_QUALITY_MAX] = { "low", "medium", "high" };
+    const INT32 frames = rates.inRate * seconds;
+    std::vector<T> in(frames * channels);
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = bench_sample<T>((rand() / static_cast<double>(RAND_MAX) - 0.5) * 0.9);
+    }
+    std::vector<T> out[2];
+    double nsPerSample[2] = { 0.0, 0.0 };
+    double cyclesPerSample[2] = { -1.0, -1.0 };
+    INT32 taps = 0;
+    for (INT32 run = 0; run < 2; run++) {
+        RTAudioResampler resampler;
+        resampler.init(rates.inRate, rates.outRate, channels, sizeof(T) == 2 ? RT_AUDIO_FMT_PCM_S16
+                       : RT_AUDIO_FMT_PCM_FLT, quality);
+        resampler.setSimd(run ? RT_TRUE : RT_FALSE);
+        taps = resampler.getTaps();
+        RtPerfCounterGroup *perf = RtPerfCounterGroup::current();
+        RTNodePerfSample begin, end;
+        RT_BOOL counted = perf->read(&begin);
+        UINT64 start = RtTime::getRelativeTimeUs();
+        INT32 outFrames = bench_run(&resampler, in, channels, rates.inRate / 100, &out[run]);
+        UINT64 costUs = RtTime::getRelativeTimeUs() - start;
+        const double samples = static_cast<double>(RT_MAX(outFrames, 1)) * channels;
+        nsPerSample[run] = costUs * 1000.0 / samples;
+        if (counted && perf->read(&end) && perf->isValid(RT_NODE_PERF_CYCLES)) {
+            UINT64 delta[RT_NODE_PERF_MAX];
+            RtPerfCounterGroup::delta(begin, end, delta);
+            cyclesPerSample[run] = delta[RT_NODE_PERF_CYCLES] / samples;
+        }
+    }
+
+    RT_BOOL exact = RT_TRUE;
+    double maxDiff = 0.0;
+    if (out[0].size() != out[1].size()) {
+        exact = RT_FALSE;
+    } else {
+        for (size_t i = 0; i < out[0].size(); i++) {
+            maxDiff = RT_MAX(maxDiff, fabs(bench_value(out[0][i]) - bench_value(out[1][i])));
+        }
+        // s16 must match bit for bit, float only differs in the summing order.
+        exact = (sizeof(T) == 2) ? (maxDiff == 0.0 ? RT_TRUE : RT_FALSE) : (maxDiff < 1e-5 ? RT_TRUE : RT_FALSE);
+    }
+    const double snr = bench_snr<T>(rates, channels, quality);
+    const double floor = (sizeof(T) == 2) ? gSnrFloorS16[quality] : gSnrFloor[quality];
+    const RT_BOOL pass = (exact && snr >= floor) ? RT_TRUE : RT_FALSE;
+    char rate[32];
+    snprintf(rate, sizeof(rate), "%d->%d", rates.inRate, rates.outRate);
+    printf("%-12s %-4s %-7s %5d %9.2f %9.2f %9.1f %9.1f %7.1f %6s\n", rate, format, tiers[quality], taps,
+           nsPerSample[0], nsPerSample[1], cyclesPerSample[0], cyclesPerSample[1], snr, pass ? "yes" : "NO");
+    *snrOut = snr;
+    return pass;
+}
+
+int main(int argc, char **argv) {
+    INT32 channels = 2, seconds = 2;
+    INT32 c;
+    while ((c = getopt(argc, argv, "c:s:")) != -1) {
+        switch (c) {
+          case 'c': channels = atoi(optarg); break;
+          case 's': seconds  = atoi(optarg); break;
+          default:
+            printf("usage: %s [-c channels] [-s seconds]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (channels <= 0 || channels > RT_RESAMPLE_MAX_CHANNELS || seconds <= 0) {
+        return -1;
+    }
+
+    INT32 failed = 0;
+    RT_BOOL ordered = RT_TRUE;
+    printf("%d channels, %s kernels, per output sample of one channel, cycles -1: no pmu\n",
+           channels, rt_simd_name());
+    printf("%-12s %-4s %-7s %5s %9s %9s %9s %9s %7s %6s\n", "rates", "fmt", "quality", "taps",
+           "ns_scalar", "ns_simd", "cyc_scal", "cyc_simd", "snr_db", "pass");
+    for (size_t r = 0; r < sizeof(gRates) / sizeof(gRates[0]); r++) {
+        double snrS16[RT_RESAMPLE_QUALITY_MAX];
+        double snrFlt;
+        for (INT32 q = 0; q < RT_RESAMPLE_QUALITY_MAX; q++) {
+            RTResampleQuality quality = static_cast<RTResampleQuality>(q);
+            failed += bench_rates<INT16>(gRates[r], channels, seconds, quality, "s16", &snrS16[q]) ? 0 : 1;
+            failed += bench_rates<float>(gRates[r], channels, seconds, quality, "flt", &snrFlt) ? 0 : 1;
+            if (q > 0 && snrS16[q] < snrS16[q - 1]) {
+                ordered = RT_FALSE;
+            }
+        }
+    }
+    printf("s16 snr high >= medium >= low on every rate pair: %s\n", ordered ? "ok" : "WRONG");
+    return (failed || !ordered) ? -1 : 0;
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark of the software image scaler
+ *
+ * scales random images with the scalar kernels, then with the simd
+ * kernels on 1..N threads, and prints the time per frame. checks that:
+ *  - every output is bit-exact to the scalar kernels;
+ *  - the scalar output is within +-1 of a double precision reference,
+ *    computed apart from the fixed point code of the scaler.
+ *
+ * -g also runs the nv12 frame through the rkrga node of librockit, the
+ * path filter_scaler takes today, and prints its time per frame and how
+ * far it is from the reference. arm only, that node needs the rga.
+ *
+ * usage: rt_scale_bench [-w src_width] [-h src_height] [-W dst_width] [-H dst_height]
+ *                       [-j threads] [-n loops] [-g]
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_time.h"
+#include "RTImageScaler.h"
+
+#if !defined(SCALE_BENCH_RGA) && (defined(__aarch64__) || defined(__arm__))
+#define SCALE_BENCH_RGA             1
+#endif
+
+#if defined(SCALE_BENCH_RGA)
+#include "rt_bench_graph.h"
+#endif
+
+#define SCALE_BENCH_MAX_DIFF        1       // against the double precision reference
+
+typedef struct _ScaleBenchFormat {
+    RTPixelFormat   format;
+    const char     *name;
+    INT32           bytesNum;   // bytes of two pixels
+} ScaleBenchFormat;
+
+static const ScaleBenchFormat gFormats[] = {
+    { RT_FMT_YUV420SP,    "nv12",    3 },
+    { RT_FMT_YUV420SP_VU, "nv21",    3 },
+    { RT_FMT_YUV420P,     "yuv420p", 3 },
+    { RT_FMT_RGB888,      "rgb888",  6 },
+};
+
+static void bench_fill_image(RTScaleImage *image, std::vector<UINT8> *buffer, const ScaleBenchFormat &fmt,
+                             INT32 width, INT32 height, INT32 align) {
+    memset(image, 0, sizeof(*image));
+    image->format    = fmt.format;
+    image->width     = width;
+    image->height    = height;
+    image->virWidth  = (width + align - 1) / align * align;
+    image->virHeight = height;
+    buffer->resize(image->virWidth * image->virHeight * fmt.bytesNum / 2);
+    image->data = &(*buffer)[0];
+}
+
+/*
+ * one output sample in double precision: bilinear on aligned pixel centers,
+ * area as the mean of the source box the scaler maps the output pixel to.
+ */
+static double bench_ref_sample(const RTScalePlane &src, const RTScalePlane &dst, RTScaleMode mode,
+                               INT32 x, INT32 y, INT32 c) {
+    const INT32 ch = src.channels;
+    if (mode == RT_SCALE_BILINEAR) {
+        double sx = (x + 0.5) * src.width / dst.width - 0.5;
+        double sy = (y + 0.5) * src.height / dst.height - 0.5;
+        sx = RT_CLIP(sx, 0.0, static_cast<double>(src.width - 1));
+        sy = RT_CLIP(sy, 0.0, static_cast<double>(src.height - 1));
+        const INT32 x0 = static_cast<INT32>(sx);
+        const INT32 y0 = static_cast<INT32>(sy);
+        const INT32 x1 = RT_MIN(x0 + 1, src.width - 1);
+        const INT32 y1 = RT_MIN(y0 + 1, src.height - 1);
+        const double fx = sx - x0;
+        const double fy = sy - y0;
+        const UINT8 *r0 = src.data + y0 * src.stride;
+        const UINT8 *r1 = src.data + y1 * src.stride;
+        const double top = r0[x0 * ch + c] * (1.0 - fx) + r0[x1 * ch + c] * fx;
+        const double bottom = r1[x0 * ch + c] * (1.0 - fx) + r1[x1 * ch + c] * fx;
+        return top * (1.0 - fy) + bottom * fy;
+    }
+    const INT32 x0 = RT_MIN(static_cast<INT32>(static_cast<INT64>(x) * src.width / dst.width), src.width - 1);
+    const INT32 y0 = RT_MIN(static_cast<INT32>(static_cast<INT64>(y) * src.height / dst.height), src.height - 1);
+    const INT32 x1 = RT_MAX(static_cast<INT32>(static_cast<INT64>(x + 1) * src.width / dst.width), x0 + 1);
+    const INT32 y1 = RT_MAX(static_cast<INT32>(static_cast<INT64>(y + 1) * src.height / dst.height), y0 + 1);
+    double sum = 0.0;
+    for (INT32 sy = y0; sy < y1; sy++) {
+        for (INT32 sx = x0; sx < x1; sx++) {
+            sum += src.data[sy * src.stride + sx * ch + c];
+        }
+    }
+    return sum / ((x1 - x0) * (y1 - y0));
+}
+
+// largest distance of out from the reference, over every plane.
+static double bench_ref_diff(const RTScaleImage &src, const RTScaleImage &out, RTScaleMode mode) {
+    RTScalePlane srcPlanes[RT_SCALE_MAX_PLANES];
+    RTScalePlane outPlanes[RT_SCALE_MAX_PLANES];
+    const INT32 planes = RTImageScaler::getPlanes(&src, srcPlanes);
+    if (planes <= 0 || RTImageScaler::getPlanes(&out, outPlanes) != planes) {
+        return 256.0;
+    }
+    double maxDiff = 0.0;
+    for (INT32 i = 0; i < planes; i++) {
+        const RTScalePlane &dst = outPlanes[i];
+        for (INT32 y = 0; y < dst.height; y++) {
+            for (INT32 x = 0; x < dst.width; x++) {
+                for (INT32 c = 0; c < dst.channels; c++) {
+                    const double ref = bench_ref_sample(srcPlanes[i], dst, mode, x, y, c);
+                    maxDiff = RT_MAX(maxDiff, fabs(dst.data[y * dst.stride + x * dst.channels + c] - ref));
+                }
+            }
+        }
+    }
+    return maxDiff;
+}
+
+static INT64 bench_scale(RTImageScaler *scaler, const RTScaleImage &src, const RTScaleImage &dst,
+                         RTScaleMode mode, INT32 loops) {
+    UINT64 start = RtTime::getRelativeTimeUs();
+    for (INT32 i = 0; i < loops; i++) {
+        if (scaler->scale(&src, &dst, mode) != RT_OK) {
+            return -1;
+        }
+    }
+    return static_cast<INT64>(RtTime::getRelativeTimeUs() - start) / loops;
+}
+
+#if defined(SCALE_BENCH_RGA)
+// the rkrga node of librockit, set up as filter_scaler is in the aicamera configs.
+static INT64 bench_rga(const RTScaleImage &src, const RTScaleImage &out, INT32 loops) {
+    char rect[128];
+    snprintf(rect, sizeof(rect), "(0,0,%d,%d)->(0,0,%d,%d)", src.width, src.height, out.width, out.height);
+    std::vector<BenchGraphNode> nodes(1);
+    nodes[0].name       = NODE_NAME_RKRGA;
+    nodes[0].bufferSize = static_cast<INT32>(bench_graph_nv12_size(out));
+    bench_graph_opt(&nodes[0], OPT_FILTER_TRANS_RECT, std::string(rect));
+    return bench_graph_run(nodes, src, out, loops);
+}
+#endif
+
+int main(int argc, char **argv) {
+    INT32 srcW = 1920, srcH = 1080, dstW = 1280, dstH = 720;
+    INT32 threads = 4, loops = 20;
+    RT_BOOL rga = RT_FALSE;
+    INT32 c;
+    while ((c = getopt(argc, argv, "w:h:W:H:j:n:g")) != -1) {
+        switch (c) {
+          case 'w': srcW    = atoi(optarg); break;
+          case 'h': srcH    = atoi(optarg); break;
+          case 'W': dstW    = atoi(optarg); break;
+          case 'H': dstH    = atoi(optarg); break;
+          case 'j': threads = atoi(optarg); break;
+          case 'n': loops   = atoi(optarg); break;
+          case 'g': rga     = RT_TRUE; break;
+          default:
+            printf("usage: %s [-w src_width] [-h src_height] [-W dst_width] [-H dst_height]"
+                   " [-j threads] [-n loops] [-g]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (srcW <= 0 || srcH <= 0 || dstW <= 0 || dstH <= 0 || threads <= 0 || loops <= 0) {
+        return -1;
+    }
+#if !defined(SCALE_BENCH_RGA)
+    if (rga) {
+        printf("-g runs the rkrga node of librockit, arm only\n");
+        return -1;
+    }
+#endif
+
+    static const char *modes[RT_SCALE_MODE_MAX] = { "bilinear", "area" };
+    INT32 failed = 0;
+    printf("%dx%d -> %dx%d, %s kernels, us per frame\n", srcW, srcH, dstW, dstH, rt_simd_name());
+    printf("%-8s %-9s %10s %10s %10s %8s %8s\n", "format", "mode", "scalar", "simd", "simd_mt", "exact",
+           "ref_diff");
+    for (size_t f = 0; f < sizeof(gFormats) / sizeof(gFormats[0]); f++) {
+        std::vector<UINT8> srcBuf, refBuf, outBuf;
+        RTScaleImage src, ref, out;
+        // odd strides on purpose, the scaler must honor virWidth.
+        bench_fill_image(&src, &srcBuf, gFormats[f], srcW, srcH, 72);
+        bench_fill_image(&ref, &refBuf, gFormats[f], dstW, dstH, 16);
+        bench_fill_image(&out, &outBuf, gFormats[f], dstW, dstH, 16);
+        for (size_t i = 0; i < srcBuf.size(); i++) {
+            srcBuf[i] = static_cast<UINT8>(rand());
+        }
+
+        for (INT32 m = 0; m < RT_SCALE_MODE_MAX; m++) {
+            RTScaleMode mode = static_cast<RTScaleMode>(m);
+            RTImageScaler single(1);
+            RTImageScaler multi(threads);
+
+            single.setSimd(RT_FALSE);
+            INT64 scalarUs = bench_scale(&single, src, ref, mode, loops);
+            double refDiff = bench_ref_diff(src, ref, mode);
+            single.setSimd(RT_TRUE);
+            INT64 simdUs = bench_scale(&single, src, out, mode, loops);
+            RT_BOOL exact = (memcmp(&refBuf[0], &outBuf[0], refBuf.size()) == 0) ? RT_TRUE : RT_FALSE;
+            memset(&outBuf[0], 0, outBuf.size());
+            INT64 multiUs = bench_scale(&multi, src, out, mode, loops);
+            exact = (exact && memcmp(&refBuf[0], &outBuf[0], refBuf.size()) == 0) ? RT_TRUE : RT_FALSE;
+
+            // a centered crop of the source, as opt_trans_rect gives it.
+            RTScaleImage crop = src;
+            crop.rect.x = srcW / 8 * 2;
+            crop.rect.y = srcH / 8 * 2;
+            crop.rect.w = srcW / 4 * 2;
+            crop.rect.h = srcH / 4 * 2;
+            single.setSimd(RT_FALSE);
+            bench_scale(&single, crop, ref, mode, 1);
+            bench_scale(&multi, crop, out, mode, 1);
+            exact = (exact && memcmp(&refBuf[0], &outBuf[0], refBuf.size()) == 0) ? RT_TRUE : RT_FALSE;
+            refDiff = RT_MAX(refDiff, bench_ref_diff(crop, ref, mode));
+
+            const RT_BOOL close = (refDiff <= SCALE_BENCH_MAX_DIFF) ? RT_TRUE : RT_FALSE;
+            printf("%-8s %-9s %10lld %10lld %10lld %8s %7.2f%s\n", gFormats[f].name, modes[m],
+                   (long long)scalarUs, (long long)simdUs, (long long)multiUs, exact ? "yes" : "NO",
+                   refDiff, close ? "" : "!");
+            failed += (exact && close) ? 0 : 1;
+        }
+#if defined(SCALE_BENCH_RGA)
+        if (rga && gFormats[f].format == RT_FMT_YUV420SP) {
+            memset(&outBuf[0], 0, outBuf.size());
+            INT64 rgaUs = bench_rga(src, out, loops);
+            if (rgaUs < 0) {
+                failed++;
+                continue;
+            }
+            // the rga filter is not the one of the reference, its distance is printed, not checked.
+            printf("%-8s %-9s %10s %10s %10lld %8s %7.2f\n", gFormats[f].name, "rkrga", "-", "-",
+                   (long long)rgaUs, "-", bench_ref_diff(src, out, RT_SCALE_BILINEAR));
+        }
+#endif
+    }
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: memfd round trip of the shm buffer transport
+ *
+ * sends -n frames over -k memfd buffers from a RTShmSender to a
+ * RTShmReceiver in the same process, the receiver checks every frame
+ * reads the bytes written for it and releases it. prints us per round
+ * trip and checks that:
+ *  - every buffer comes back through the release callback;
+ *  - a unique id recycled with a new memfd is mapped again, not read
+ *    through the mapping of the old one, and a view of the old one still
+ *    held reads its own bytes;
+ *  - a buffer bigger than its fd, of size 0 or with a range outside of
+ *    it is refused and released;
+ *  - a sender whose peer stops reading gets RT_ERR_RETRY instead of
+ *    blocking, and a release the sink has no room for is delivered later.
+ *
+ * usage: rt_shm_bench [-n frames] [-k buffers] [-s size]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_time.h"
+#include "RTShmTransport.h"
+
+#define SHM_BENCH_PATH          "/tmp/rt_shm_bench.sock"
+#define SHM_BENCH_FLOOD         100000
+
+static INT32 bench_fill(INT32 fd, UINT32 size, UINT8 value) {
+    UINT8 *data = static_cast<UINT8 *>(mmap(RT_NULL, size, PROT_WRITE, MAP_SHARED, fd, 0));
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    memset(data, value, size);
+    munmap(data, size);
+    return 0;
+}
+
+static RTShmBufferDesc bench_desc(INT32 uniqueId, UINT32 size, INT32 seq) {
+    RTShmBufferDesc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.uniqueId = uniqueId;
+    desc.size     = size;
+    desc.length   = size;
+    desc.seq      = seq;
+    return desc;
+}
+
+// the receiver gets the next frame, checks its bytes and releases it.
+static INT32 bench_receive(RTShmReceiver *receiver, UINT8 value) {
+    RTShmBufferView view;
+    if (receiver->receive(&view, 1000) != RT_OK) {
+        return 1;
+    }
+    const UINT8 *data = static_cast<const UINT8 *>(view.data);
+    INT32 errors = (data[0] != value || data[view.desc.size - 1] != value) ? 1 : 0;
+    receiver->release(&view);
+    return errors;
+}
+
+// a desc the receiver must refuse, and release back to the sender.
+static INT32 bench_refuse(RTShmSender *sender, RTShmReceiver *receiver, const RTShmBufferDesc &desc, INT32 fd) {
+    RTShmBufferView view;
+    if (sender->send(desc, fd, RT_NULL) != RT_OK) {
+        return 1;
+    }
+    INT32 errors = (receiver->receive(&view, 1000) == RT_ERR_VALUE) ? 0 : 1;
+    return errors + (sender->pollRelease(1000) == 1 ? 0 : 1);
+}
+
+int main(int argc, char **argv) {
+    INT32 frames = 10000, buffers = 4, size = 1 << 20;
+    INT32 c;
+    while ((c = getopt(argc, argv, "n:k:s:")) != -1) {
+        switch (c) {
+          case 'n': frames  = atoi(optarg); break;
+          case 'k': buffers = atoi(optarg); break;
+          case 's': size    = atoi(optarg); break;
+          default:
+            printf("usage: %s [-n frames] [-k buffers] [-s size]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (frames <= 0 || buffers <= 0 || buffers > 200 || size < 16) {
+        return -1;
+    }
+
+    INT32 released = 0;
+    RTShmSender sender([&released](void *) { released++; });
+    RTShmReceiver receiver;
+    if (sender.open(SHM_BENCH_PATH) != RT_OK || receiver.connect(SHM_BENCH_PATH) != RT_OK
+            || sender.accept(1000) != RT_OK) {
+        printf("can not connect on %s\n", SHM_BENCH_PATH);
+        return -1;
+    }
+    std::vector<INT32> fds(buffers, -1);
+    for (INT32 i = 0; i < buffers; i++) {
+        fds[i] = rt_shm_memfd_alloc("rt_shm_bench", size);
+        if (fds[i] < 0 || bench_fill(fds[i], size, static_cast<UINT8>(i + 1)) != 0) {
+            printf("memfd is not available\n");
+            return -1;
+        }
+    }
+
+    INT32 errors = 0;
+    UINT64 start = RtTime::getRelativeTimeUs();
+    for (INT32 f = 0; f < frames; f++) {
+        const INT32 id = f % buffers;
+        errors += sender.send(bench_desc(id, size, f), fds[id], RT_NULL) == RT_OK ? 0 : 1;
+        errors += bench_receive(&receiver, static_cast<UINT8>(id + 1));
+        sender.pollRelease(0);
+    }
+    const double tripUs = static_cast<double>(RtTime::getRelativeTimeUs() - start) / frames;
+    while (sender.inFlight() > 0 && sender.pollRelease(100) > 0) {}
+    const RT_BOOL returned = (released == frames && sender.inFlight() == 0) ? RT_TRUE : RT_FALSE;
+
+    /*
+     * the buffer of id 0 is reallocated while a view of the old one is
+     * still held, the id comes back with another file.
+     */
+    RTShmBufferView held;
+    errors += sender.send(bench_desc(0, size, frames), fds[0], RT_NULL) == RT_OK ? 0 : 1;
+    errors += receiver.receive(&held, 1000) == RT_OK ? 0 : 1;
+    close(fds[0]);
+    fds[0] = rt_shm_memfd_alloc("rt_shm_bench", size);
+    bench_fill(fds[0], size, 0xee);
+    errors += sender.send(bench_desc(0, size, frames), fds[0], RT_NULL) == RT_OK ? 0 : 1;
+    RT_BOOL recycled = bench_receive(&receiver, 0xee) == 0 ? RT_TRUE : RT_FALSE;
+    const UINT8 *old = static_cast<const UINT8 *>(held.data);
+    recycled = (recycled && old != RT_NULL && old[0] == 1 && old[size - 1] == 1) ? RT_TRUE : RT_FALSE;
+    receiver.release(&held);
+    sender.pollRelease(100);
+    sender.pollRelease(100);
+
+    // descs which do not fit their fd.
+    INT32 bad = 0;
+    const INT32 badId = buffers + 1;
+    const INT32 badFd = rt_shm_memfd_alloc("rt_shm_bench", size);
+    RTShmBufferDesc desc = bench_desc(badId, size * 2, frames);
+    bad += bench_refuse(&sender, &receiver, desc, badFd);
+    desc = bench_desc(badId + 1, 0, frames);
+    bad += bench_refuse(&sender, &receiver, desc, badFd);
+    desc = bench_desc(1 % buffers, size, frames);
+    desc.offset = 16;
+    bad += bench_refuse(&sender, &receiver, desc, fds[1 % buffers]);
+    close(badFd);
+    const INT32 refusedFrames = 3;
+
+    /*
+     * the receiver stops reading: the sender has to give up, not block.
+     * the receiver then drains while the sender does not read releases,
+     * the second round finds the socket of the sender full of them.
+     */
+    INT32 queued = 0, maxPending = 0;
+    RT_BOOL refused = RT_TRUE;
+    for (INT32 round = 0; round < 2; round++) {
+        INT32 sent = 0;
+        RT_RET ret = RT_OK;
+        for (; sent < SHM_BENCH_FLOOD; sent++) {
+            ret = sender.send(bench_desc(1 % buffers, size, frames + 2 + queued + sent), fds[1 % buffers],
+                              RT_NULL);
+            if (ret != RT_OK) {
+                break;
+            }
+        }
+        refused = (refused && ret == RT_ERR_RETRY && sender.connected()) ? RT_TRUE : RT_FALSE;
+        for (INT32 i = 0; i < sent; i++) {
+            errors += bench_receive(&receiver, static_cast<UINT8>(1 % buffers + 1));
+            maxPending = RT_MAX(maxPending, receiver.pendingReleases());
+        }
+        queued += sent;
+    }
+    for (INT32 i = 0; i < 100 && (sender.inFlight() > 0 || receiver.pendingReleases() > 0); i++) {
+        sender.pollRelease(10);
+        receiver.flushReleases();
+    }
+    const RT_BOOL drained = (sender.inFlight() == 0 && receiver.pendingReleases() == 0 && maxPending > 0
+                             && released == frames + 2 + refusedFrames + queued) ? RT_TRUE : RT_FALSE;
+
+    printf("%d frames over %d memfd buffers of %d bytes\n", frames, buffers, size);
+    printf("%-24s %10.2f\n", "us per round trip", tripUs);
+    printf("%-24s %10s\n", "all released", returned ? "ok" : "WRONG");
+    printf("%-24s %10s\n", "recycled id remapped", recycled ? "ok" : "WRONG");
+    printf("%-24s %10s\n", "bad ranges refused", bad == 0 ? "ok" : "WRONG");
+    printf("%-24s %10d %s\n", "sent per flood", queued / 2, refused ? "ok" : "WRONG");
+    printf("%-24s %10d %s\n", "releases queued", maxPending, drained ? "ok" : "WRONG");
+
+    for (INT32 i = 0; i < buffers; i++) {
+        close(fds[i]);
+    }
+    receiver.close();
+    sender.close();
+    unlink(SHM_BENCH_PATH);
+    return (errors == 0 && bad == 0 && returned && recycled && refused && drained) ? 0 : -1;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: benchmark of the cpu filter strip pipeline
+ *
+ * runs a chain of cpu filters on a nv12 frame: a centered crop of the
+ * source zoomed back to full size, mosaics and lines drawn on it, then
+ * rgb888 out at full size and, in a second chain, resized to half by the
+ * convert stage. each chain runs frame at a time, the way separate nodes
+ * do, and band by band with -b rows per band (all of 16 to 256 if not
+ * given). prints ms per frame and the last level cache misses per frame
+ * times 64 bytes, -1 when the pmu can not be read, and checks every run
+ * gives the bits of the engines called one by one.
+ *
+ * the gain is in memory traffic: banding only pays where the frames of
+ * the chain do not fit the last level cache. a host whose cache holds them
+ * all, e.g. 105MB of L3, shows about the same time both ways; the numbers
+ * of the request are the ones of a board run.
+ *
+ * usage: rt_strip_bench [-w width] [-h height] [-c crop_percent] [-b band_rows] [-n frames]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_time.h"
+#include "RTStripPipeline.h"
+#include "RTTaskNodePerf.h"
+
+#define STRIP_BENCH_MOSAICS     4
+#define STRIP_BENCH_LINE        64      // bytes a cache miss moves
+
+static RTScaleImage bench_image(UINT8 *data, RTPixelFormat format, INT32 width, INT32 height) {
+    RTScaleImage image;
+    memset(&image, 0, sizeof(image));
+    image.data   = data;
+    image.format = format;
+    image.width  = width;
+    image.height = height;
+    return image;
+}
+
+/*
+ * the chain frame at a time then band by band, one row per run. returns
+ * the runs whose output is not ref.
+ */
+static INT32 bench_chain(const char *chain, RTStripPipeline *pipeline, const RTScaleImage &src,
+                         std::vector<UINT8> *out, const std::vector<UINT8> &ref, INT32 bandRows, INT32 frames) {
+    static const INT32 sweep[] = { 16, 32, 64, 128, 256 };
+    const INT32 runs = bandRows > 0 ? 2 : 1 + static_cast<INT32>(sizeof(sweep) / sizeof(sweep[0]));
+    INT32 mismatches = 0;
+    double frameMs = 0.0;
+    for (INT32 r = 0; r < runs; r++) {
+        const INT32 rows = (r == 0) ? 0 : (bandRows > 0 ? bandRows : sweep[r - 1]);
+        pipeline->setBandRows(rows);
+        memset(&(*out)[0], 0, out->size());
+        RtPerfCounterGroup *perf = RtPerfCounterGroup::current();
+        RTNodePerfSample begin, end;
+        const RT_BOOL counted = perf->read(&begin);
+        UINT64 start = RtTime::getRelativeTimeUs();
+        RT_RET ret = RT_OK;
+        for (INT32 f = 0; f < frames && ret == RT_OK; f++) {
+            ret = (rows == 0) ? pipeline->runFrames(&src) : pipeline->run(&src);
+        }
+        const double ms = (RtTime::getRelativeTimeUs() - start) / 1000.0 / frames;
+        double missMb = -1.0;
+        if (counted && perf->read(&end) && perf->isValid(RT_NODE_PERF_CACHE_MISSES)) {
+            UINT64 delta[RT_NODE_PERF_MAX];
+            RtPerfCounterGroup::delta(begin, end, delta);
+            missMb = static_cast<double>(delta[RT_NODE_PERF_CACHE_MISSES]) * STRIP_BENCH_LINE / frames / 1048576.0;
+        }
+        const RT_BOOL exact = (ret == RT_OK && *out == ref) ? RT_TRUE : RT_FALSE;
+        mismatches += exact ? 0 : 1;
+        frameMs = (rows == 0) ? ms : frameMs;
+
+        char name[16];
+        snprintf(name, sizeof(name), rows == 0 ? "frames" : "band %d", rows);
+        printf("%-9s %-8s %10.2f %9.2fx %11.1f %7s\n", chain, name, ms, frameMs / ms, missMb,
+               exact ? "yes" : "NO");
+    }
+    return mismatches;
+}
+
+int main(int argc, char **argv) {
+    INT32 width = 3840, height = 2160, crop = 90, bandRows = 0, frames = 20;
+    INT32 c;
+    while ((c = getopt(argc, argv, "w:h:c:b:n:")) != -1) {
+        switch (c) {
+          case 'w': width    = atoi(optarg); break;
+          case 'h': height   = atoi(optarg); break;
+          case 'c': crop     = atoi(optarg); break;
+          case 'b': bandRows = atoi(optarg); break;
+          case 'n': frames   = atoi(optarg); break;
+          default:
+            printf("usage: %s [-w width] [-h height] [-c crop_percent] [-b band_rows] [-n frames]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (width < 256 || height < 256 || (width | height) & 1 || crop < 10 || crop > 100 || frames <= 0) {
+        return -1;
+    }
+
+    const INT32 nv12Size = width * height * 3 / 2;
+    const INT32 rgbSize  = width * height * 3;
+    const INT32 halfWidth = (width / 2) & ~1, halfHeight = (height / 2) & ~1;
+    const INT32 halfSize = halfWidth * halfHeight * 3;
+    std::vector<UINT8> src(nv12Size), nv12(nv12Size), rgbRef(rgbSize), rgb(rgbSize);
+    std::vector<UINT8> halfRef(halfSize), half(halfSize);
+    for (INT32 y = 0; y < height; y++) {
+        for (INT32 x = 0; x < width; x++) {
+            src[y * width + x] = static_cast<UINT8>((x * 3 + y * 5 + ((x / 64 + y / 64) & 1) * 90) & 0xff);
+        }
+    }
+    for (INT32 i = width * height; i < nv12Size; i++) {
+        src[i] = static_cast<UINT8>(64 + rand() % 128);
+    }
+    RTScaleImage srcImage  = bench_image(&src[0], RT_FMT_YUV420SP, width, height);
+    RTScaleImage nv12Image = bench_image(&nv12[0], RT_FMT_YUV420SP, width, height);
+    RTScaleImage rgbImage  = bench_image(&rgb[0], RT_FMT_RGB888, width, height);
+    RTScaleImage halfImage = bench_image(&half[0], RT_FMT_RGB888, halfWidth, halfHeight);
+    srcImage.rect.w = (width * crop / 100) & ~1;
+    srcImage.rect.h = (height * crop / 100) & ~1;
+    srcImage.rect.x = ((width - srcImage.rect.w) / 2) & ~1;
+    srcImage.rect.y = ((height - srcImage.rect.h) / 2) & ~1;
+
+    RTImageDrawer drawer;
+    for (INT32 i = 0; i < STRIP_BENCH_MOSAICS; i++) {
+        RTRect rect;
+        rect.x = width / 8 + i * width / 5;
+        rect.y = height / 6 + i * height / 7;
+        rect.w = width / 8;
+        rect.h = height / 6;
+        drawer.addMosaic(rect, 16 << (i % 3));
+        drawer.addRect(rect, 4, rt_draw_color_rgb(0xff0000));
+    }
+    drawer.addLine(0, 0, width - 1, height - 1, 3, rt_draw_color_rgb(0x00ff00));
+    RTColorConverter converter;
+
+    // the engines one after the other, the reference bits.
+    RTImageScaler scaler;
+    RTScaleImage refImage = rgbImage;
+    refImage.data = &rgbRef[0];
+    RTScaleImage halfRefImage = halfImage;
+    halfRefImage.data = &halfRef[0];
+    if (scaler.scale(&srcImage, &nv12Image, RT_SCALE_BILINEAR) != RT_OK || drawer.draw(&nv12Image) != RT_OK
+            || converter.convert(&nv12Image, &refImage) != RT_OK
+            || converter.convert(&nv12Image, &halfRefImage) != RT_OK) {
+        printf("reference chain fails\n");
+        return -1;
+    }
+
+    RTStripScaleStage scale(RT_SCALE_BILINEAR);
+    RTStripDrawStage draw(&drawer);
+    RTStripConvertStage convert(&converter);
+    RTStripPipeline pipeline, halfPipeline;
+    pipeline.addStage(&scale, &nv12Image);
+    pipeline.addStage(&draw, &nv12Image);
+    pipeline.addStage(&convert, &rgbImage);
+    halfPipeline.addStage(&scale, &nv12Image);
+    halfPipeline.addStage(&draw, &nv12Image);
+    halfPipeline.addStage(&convert, &halfImage);
+
+    printf("%dx%d nv12, crop %dx%d zoomed back, %d outlined mosaics and a line, rgb888 out, %d frames, %s kernels\n",
+           width, height, srcImage.rect.w, srcImage.rect.h, STRIP_BENCH_MOSAICS, frames,
+           rt_simd_name());
+    printf("%-9s %-8s %10s %10s %11s %7s\n", "chain", "run", "ms/frame", "speedup", "llc_miss_MB", "exact");
+    INT32 mismatches = bench_chain("rgb", &pipeline, srcImage, &rgb, rgbRef, bandRows, frames);
+    mismatches += bench_chain("rgb 1/2", &halfPipeline, srcImage, &half, halfRef, bandRows, frames);
+    printf("llc_miss_MB is last level cache misses per frame times %d bytes, -1: no pmu\n", STRIP_BENCH_LINE);
+    return mismatches ? -1 : 0;
+}
+
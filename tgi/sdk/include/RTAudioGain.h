@@ -0,0 +1,390 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: per-channel gain with ramps of the volume filter
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTAUDIOGAIN_H_
+#define SRC_RT_MEDIA_INCLUDE_RTAUDIOGAIN_H_
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "rt_simd.h"
+#include "rt_string_utils.h"
+#include "RTMediaDef.h"
+#include "RTNodeCommon.h"
+
+#define RT_AUDIO_GAIN_MAX_CHANNELS  16
+#define RT_AUDIO_GAIN_BITS          13                          // gains are Q13, up to 4.0 (+12dB)
+#define RT_AUDIO_GAIN_UNITY         (1 << RT_AUDIO_GAIN_BITS)
+#define RT_AUDIO_GAIN_MAX           32767
+#define RT_AUDIO_GAIN_BLOCK         256                         // frames of one gain block
+#define RT_AUDIO_GAIN_RAMP_MS       10
+
+/*
+ * out = saturate((in * gain + round) >> 13), one gain per sample. the simd
+ * versions give the same bits as the scalar ones; s32 has no simd kernel on
+ * SSE2, which lacks a signed 32x32 multiply.
+ */
+static inline void rt_audio_gain_s16(INT16 *data, const INT16 *gain, INT32 count, RT_BOOL simd) {
+    INT32 i = 0;
+#if defined(RT_SIMD_NEON)
+    if (simd) {
+        for (; i + 8 <= count; i += 8) {
+            int16x8_t x = vld1q_s16(data + i);
+            int16x8_t g = vld1q_s16(gain + i);
+            int32x4_t lo = vmull_s16(vget_low_s16(x), vget_low_s16(g));
+            int32x4_t hi = vmull_s16(vget_high_s16(x), vget_high_s16(g));
+            vst1q_s16(data + i, vcombine_s16(vqrshrn_n_s32(lo, RT_AUDIO_GAIN_BITS),
+                                             vqrshrn_n_s32(hi, RT_AUDIO_GAIN_BITS)));
+        }
+    }
+#elif defined(RT_SIMD_SSE2)
+    if (simd) {
+        const __m128i round = _mm_set1_epi32(1 << (RT_AUDIO_GAIN_BITS - 1));
+        for (; i + 8 <= count; i += 8) {
+            __m128i x  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            __m128i g  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(gain + i));
+            __m128i pl = _mm_mullo_epi16(x, g);
+            __m128i ph = _mm_mulhi_epi16(x, g);
+            __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(pl, ph), round), RT_AUDIO_GAIN_BITS);
+            __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(pl, ph), round), RT_AUDIO_GAIN_BITS);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), _mm_packs_epi32(lo, hi));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        INT32 value = (data[i] * gain[i] + (1 << (RT_AUDIO_GAIN_BITS - 1))) >> RT_AUDIO_GAIN_BITS;
+        data[i] = static_cast<INT16>(RT_CLIP(value, -32768, 32767));
+    }
+}
+
+static inline void rt_audio_gain_s32(INT32 *data, const INT16 *gain, INT32 count, RT_BOOL simd) {
+    INT32 i = 0;
+#if defined(RT_SIMD_NEON)
+    if (simd) {
+        for (; i + 4 <= count; i += 4) {
+            int32x4_t x = vld1q_s32(data + i);
+            int32x4_t g = vmovl_s16(vld1_s16(gain + i));
+            int64x2_t lo = vmull_s32(vget_low_s32(x), vget_low_s32(g));
+            int64x2_t hi = vmull_s32(vget_high_s32(x), vget_high_s32(g));
+            vst1q_s32(data + i, vcombine_s32(vqrshrn_n_s64(lo, RT_AUDIO_GAIN_BITS),
+                                             vqrshrn_n_s64(hi, RT_AUDIO_GAIN_BITS)));
+        }
+    }
+#endif
+    (void)simd;
+    for (; i < count; i++) {
+        INT64 value = (static_cast<INT64>(data[i]) * gain[i] + (1 << (RT_AUDIO_GAIN_BITS - 1))) >> RT_AUDIO_GAIN_BITS;
+        data[i] = static_cast<INT32>(RT_CLIP(value, -2147483647LL - 1, 2147483647LL));
+    }
+}
+
+// float is not clipped, the sink or encoder downstream does that.
+static inline void rt_audio_gain_flt(float *data, const float *gain, INT32 count, RT_BOOL simd) {
+    INT32 i = 0;
+#if defined(RT_SIMD_NEON)
+    if (simd) {
+        for (; i + 4 <= count; i += 4) {
+            vst1q_f32(data + i, vmulq_f32(vld1q_f32(data + i), vld1q_f32(gain + i)));
+        }
+    }
+#elif defined(RT_SIMD_SSE2)
+    if (simd) {
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), _mm_loadu_ps(gain + i)));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        data[i] *= gain[i];
+    }
+}
+
+/*
+ * in-place gain of interleaved S16, S32 or FLT pcm, one gain per channel.
+ *
+ * a new volume or mute does not step: the gain of each channel moves
+ * linearly from where it is to its target over the ramp length, starting
+ * on the first frame of the next process(), so the ramp is sample-accurate
+ * wherever the caller splits the stream. a change during a ramp starts a
+ * new ramp from the current gain.
+ *
+ * gains are expanded to one per sample for a block of frames and applied
+ * with a single multiply pass; outside ramps the block is built once and
+ * reused. all unity gains skip the buffer, all zero gains clear it.
+ *
+ * per-channel gains and mutes cover the mute modes of track_mode (left,
+ * right, both) in the same pass.
+ *
+ *   RTAudioGain gain;
+ *   gain.init(48000, 2, RT_AUDIO_FMT_PCM_S16);
+ *   gain.setVolume(-1, 50);             // every channel to 50%
+ *   gain.setChannelMute(1, RT_TRUE);    // right channel ramps to silence
+ *   gain.process(pcm, frames);
+ */
+class RTAudioGain {
+ public:
+    RTAudioGain()
+            : mSampleRate(0), mChannels(0), mFormat(RT_AUDIO_FMT_NONE), mRampFrames(0),
+              mMute(RT_FALSE), mBlockValid(RT_FALSE), mSimd(RT_TRUE) {
+        memset(mVolume, 0, sizeof(mVolume));
+        memset(mChannelMute, 0, sizeof(mChannelMute));
+        memset(mCurrent, 0, sizeof(mCurrent));
+        memset(mStep, 0, sizeof(mStep));
+        memset(mLeft, 0, sizeof(mLeft));
+    }
+
+    // RT_FALSE runs the scalar reference kernels, e.g. to compare results.
+    void setSimd(RT_BOOL simd) { mSimd = simd; }
+
+    RT_RET init(INT32 sampleRate, INT32 channels, RTAudioFormat format) {
+        if (sampleRate <= 0 || channels <= 0 || channels > RT_AUDIO_GAIN_MAX_CHANNELS
+                || (format != RT_AUDIO_FMT_PCM_S16 && format != RT_AUDIO_FMT_PCM_S32
+                    && format != RT_AUDIO_FMT_PCM_FLT)) {
+            return RT_ERR_VALUE;
+        }
+        mSampleRate = sampleRate;
+        mChannels   = channels;
+        mFormat     = format;
+        mMute       = RT_FALSE;
+        for (INT32 c = 0; c < RT_AUDIO_GAIN_MAX_CHANNELS; c++) {
+            mVolume[c]      = RT_AUDIO_GAIN_UNITY;
+            mChannelMute[c] = RT_FALSE;
+            mCurrent[c]     = RT_AUDIO_GAIN_UNITY << 16;
+            mStep[c]        = 0;
+            mLeft[c]        = 0;
+        }
+        setRamp(RT_AUDIO_GAIN_RAMP_MS);
+        mGainS16.resize(RT_AUDIO_GAIN_BLOCK * channels);
+        mGainFlt.resize(RT_AUDIO_GAIN_BLOCK * channels);
+        mBlockValid = RT_FALSE;
+        return RT_OK;
+    }
+
+    // 0 steps at once, which clicks on loud content.
+    void setRamp(INT32 ms) {
+        mRampFrames = static_cast<INT32>(static_cast<INT64>(RT_MAX(ms, 0)) * mSampleRate / 1000);
+    }
+
+    // percent of the input level, 0 to 399; channel -1 sets every channel.
+    RT_RET setVolume(INT32 channel, INT32 percent) {
+        if (channel < -1 || channel >= mChannels || percent < 0) {
+            return RT_ERR_VALUE;
+        }
+        INT32 gain = static_cast<INT32>(RT_MIN(static_cast<INT64>(percent) * RT_AUDIO_GAIN_UNITY / 100,
+                                               static_cast<INT64>(RT_AUDIO_GAIN_MAX)));
+        for (INT32 c = RT_MAX(channel, 0); c < (channel < 0 ? mChannels : channel + 1); c++) {
+            mVolume[c] = gain;
+        }
+        retarget();
+        return RT_OK;
+    }
+
+    void setMute(RT_BOOL mute) {
+        mMute = mute;
+        retarget();
+    }
+
+    RT_RET setChannelMute(INT32 channel, RT_BOOL mute) {
+        if (channel < 0 || channel >= mChannels) {
+            return RT_ERR_VALUE;
+        }
+        mChannelMute[channel] = mute;
+        retarget();
+        return RT_OK;
+    }
+
+    /*
+     * OPT_AUDIO_VOLUME sets every channel, OPT_AUDIO_CHANNEL_VOLUME and its
+     * _1, _2.. keys override single channels, OPT_AUDIO_CHANNEL_MUTE(_n)
+     * mutes them.
+     */
+    RT_RET loadOptions(RtMetaData *options) {
+        INT32 value = 0;
+        if (options == RT_NULL || mChannels == 0) {
+            return RT_ERR_VALUE;
+        }
+        if (options->findInt32(OPT_AUDIO_VOLUME_RAMP, &value)) {
+            setRamp(value);
+        }
+        if (options->findInt32(OPT_AUDIO_VOLUME, &value)) {
+            setVolume(-1, value);
+        }
+        for (INT32 c = 0; c < mChannels; c++) {
+            if (options->findInt32(indexedKey(OPT_AUDIO_CHANNEL_VOLUME, c).c_str(), &value)) {
+                setVolume(c, value);
+            }
+            if (options->findInt32(indexedKey(OPT_AUDIO_CHANNEL_MUTE, c).c_str(), &value)) {
+                setChannelMute(c, value ? RT_TRUE : RT_FALSE);
+            }
+        }
+        if (options->findInt32(OPT_AUDIO_MUTE, &value)) {
+            setMute(value ? RT_TRUE : RT_FALSE);
+        }
+        return RT_OK;
+    }
+
+    RT_BOOL isRamping() const {
+        for (INT32 c = 0; c < mChannels; c++) {
+            if (mLeft[c] > 0) {
+                return RT_TRUE;
+            }
+        }
+        return RT_FALSE;
+    }
+
+    // current Q13 gain of a channel.
+    INT32 getGain(INT32 channel) const {
+        return (channel >= 0 && channel < mChannels) ? gainOf(mCurrent[channel]) : 0;
+    }
+
+    RT_RET process(void *data, INT32 frames) {
+        if (mChannels == 0 || data == RT_NULL || frames < 0) {
+            return RT_ERR_VALUE;
+        }
+        UINT8 *bytes = reinterpret_cast<UINT8 *>(data);
+        const INT32 frameBytes = mChannels * sampleBytes();
+        while (frames > 0) {
+            const INT32 block = RT_MIN(frames, RT_AUDIO_GAIN_BLOCK);
+            if (isRamping()) {
+                fillRamp(block);
+                apply(bytes, block);
+            } else if (allAt(RT_AUDIO_GAIN_UNITY)) {
+                return RT_OK;
+            } else if (allAt(0)) {
+                memset(bytes, 0, static_cast<size_t>(frames) * frameBytes);
+                return RT_OK;
+            } else {
+                if (!mBlockValid) {
+                    fillSteady();
+                }
+                apply(bytes, block);
+            }
+            bytes  += block * frameBytes;
+            frames -= block;
+        }
+        return RT_OK;
+    }
+
+ private:
+    static std::string indexedKey(const char *key, INT32 index) {
+        return index ? std::string(key) + "_" + util_to_string(index) : std::string(key);
+    }
+
+    // the ramp runs in Q13.16 so slow ramps still move every frame.
+    static INT32 gainOf(INT32 current) {
+        return (current + (1 << 15)) >> 16;
+    }
+
+    INT32 sampleBytes() const {
+        return (mFormat == RT_AUDIO_FMT_PCM_S16) ? 2 : 4;
+    }
+
+    INT32 targetOf(INT32 c) const {
+        return (mMute || mChannelMute[c]) ? 0 : mVolume[c];
+    }
+
+    void retarget() {
+        for (INT32 c = 0; c < mChannels; c++) {
+            const INT32 target = targetOf(c) << 16;
+            if (target == mCurrent[c]) {
+                mLeft[c] = 0;
+                continue;
+            }
+            if (mRampFrames == 0) {
+                mCurrent[c] = target;
+                mLeft[c]    = 0;
+            } else {
+                mStep[c] = (target - mCurrent[c]) / mRampFrames;
+                mLeft[c] = mRampFrames;
+            }
+        }
+        mBlockValid = RT_FALSE;
+    }
+
+    RT_BOOL allAt(INT32 gain) const {
+        for (INT32 c = 0; c < mChannels; c++) {
+            if (gainOf(mCurrent[c]) != gain) {
+                return RT_FALSE;
+            }
+        }
+        return RT_TRUE;
+    }
+
+    void store(INT32 index, INT32 current) {
+        mGainS16[index] = static_cast<INT16>(gainOf(current));
+        mGainFlt[index] = static_cast<float>(current) * (1.0f / (RT_AUDIO_GAIN_UNITY * 65536.0f));
+    }
+
+    // the last frame of a ramp lands exactly on the target.
+    void fillRamp(INT32 frames) {
+        for (INT32 c = 0; c < mChannels; c++) {
+            for (INT32 i = 0; i < frames; i++) {
+                if (mLeft[c] > 0) {
+                    mCurrent[c] = (--mLeft[c] == 0) ? (targetOf(c) << 16) : mCurrent[c] + mStep[c];
+                }
+                store(i * mChannels + c, mCurrent[c]);
+            }
+        }
+        mBlockValid = RT_FALSE;
+    }
+
+    void fillSteady() {
+        for (INT32 i = 0; i < RT_AUDIO_GAIN_BLOCK; i++) {
+            for (INT32 c = 0; c < mChannels; c++) {
+                store(i * mChannels + c, mCurrent[c]);
+            }
+        }
+        mBlockValid = RT_TRUE;
+    }
+
+    void apply(UINT8 *data, INT32 frames) {
+        const INT32 count = frames * mChannels;
+        switch (mFormat) {
+          case RT_AUDIO_FMT_PCM_S16:
+            rt_audio_gain_s16(reinterpret_cast<INT16 *>(data), &mGainS16[0], count, mSimd);
+            break;
+          case RT_AUDIO_FMT_PCM_S32:
+            rt_audio_gain_s32(reinterpret_cast<INT32 *>(data), &mGainS16[0], count, mSimd);
+            break;
+          default:
+            rt_audio_gain_flt(reinterpret_cast<float *>(data), &mGainFlt[0], count, mSimd);
+            break;
+        }
+    }
+
+ private:
+    INT32               mSampleRate;
+    INT32               mChannels;
+    RTAudioFormat       mFormat;
+    INT32               mRampFrames;
+    RT_BOOL             mMute;
+    RT_BOOL             mBlockValid;    // gain block holds the steady gains
+    RT_BOOL             mSimd;
+    INT32               mVolume[RT_AUDIO_GAIN_MAX_CHANNELS];        // Q13
+    RT_BOOL             mChannelMute[RT_AUDIO_GAIN_MAX_CHANNELS];
+    INT32               mCurrent[RT_AUDIO_GAIN_MAX_CHANNELS];       // Q13.16
+    INT32               mStep[RT_AUDIO_GAIN_MAX_CHANNELS];
+    INT32               mLeft[RT_AUDIO_GAIN_MAX_CHANNELS];          // frames left in the ramp
+    std::vector<INT16>  mGainS16;
+    std::vector<float>  mGainFlt;
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTAUDIOGAIN_H_
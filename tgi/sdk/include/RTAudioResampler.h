@@ -0,0 +1,413 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: polyphase fir resampler of the resample node
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTAUDIORESAMPLER_H_
+#define SRC_RT_MEDIA_INCLUDE_RTAUDIORESAMPLER_H_
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_simd.h"
+#include "RTMediaDef.h"
+
+#define RT_RESAMPLE_MAX_CHANNELS    16
+#define RT_RESAMPLE_MAX_PHASES      4096    // 44.1k <-> 48k needs 160
+#define RT_RESAMPLE_COEF_BITS       15      // s16 taps, 14 when the sum of |taps| * 32768 would pass 31 bits
+#define RT_RESAMPLE_WIDE_BITS       30      // s32 taps of the high tier, summed in 64 bits
+
+typedef enum _RTResampleQuality {
+    RT_RESAMPLE_QUALITY_LOW = 0,            // voice paths, shortest delay
+    RT_RESAMPLE_QUALITY_MEDIUM,
+    RT_RESAMPLE_QUALITY_HIGH,
+    RT_RESAMPLE_QUALITY_MAX,
+} RTResampleQuality;
+
+/*
+ * dot products of one output sample, the simd versions of the s16 one give
+ * the same bits as the scalar one. the float ones sum in another order and
+ * differ in the last bits.
+ */
+static inline INT32 rt_resample_dot_s16(const INT16 *x, const INT16 *h, INT32 taps, RT_BOOL simd) {
+    INT32 acc = 0;
+    INT32 i = 0;
+#if defined(RT_SIMD_NEON)
+    if (simd) {
+        int32x4_t sum = vdupq_n_s32(0);
+        for (; i + 8 <= taps; i += 8) {
+            int16x8_t a = vld1q_s16(x + i);
+            int16x8_t b = vld1q_s16(h + i);
+            sum = vmlal_s16(sum, vget_low_s16(a), vget_low_s16(b));
+            sum = vmlal_s16(sum, vget_high_s16(a), vget_high_s16(b));
+        }
+        int32x2_t half = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+        acc = vget_lane_s32(vpadd_s32(half, half), 0);
+    }
+#elif defined(RT_SIMD_SSE2)
+    if (simd) {
+        __m128i sum = _mm_setzero_si128();
+        for (; i + 8 <= taps; i += 8) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(a, b));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        acc = _mm_cvtsi128_si32(sum);
+    }
+#endif
+    for (; i < taps; i++) {
+        acc += x[i] * h[i];
+    }
+    return acc;
+}
+
+/*
+ * s16 samples against q30 taps, the rounding noise of 15 bit taps grows
+ * with the tap count and would put the high tier below the medium one.
+ * sse2 has no signed 32x32->64 multiply, it runs the scalar loop.
+ */
+static inline INT64 rt_resample_dot_s16_wide(const INT16 *x, const INT32 *h, INT32 taps, RT_BOOL simd) {
+    INT64 acc = 0;
+    INT32 i = 0;
+#if defined(RT_SIMD_NEON)
+    if (simd) {
+        int64x2_t sum = vdupq_n_s64(0);
+        for (; i + 4 <= taps; i += 4) {
+            int32x4_t a = vmovl_s16(vld1_s16(x + i));
+            int32x4_t b = vld1q_s32(h + i);
+            sum = vmlal_s32(sum, vget_low_s32(a), vget_low_s32(b));
+            sum = vmlal_s32(sum, vget_high_s32(a), vget_high_s32(b));
+        }
+        acc = vgetq_lane_s64(sum, 0) + vgetq_lane_s64(sum, 1);
+    }
+#endif
+    (void)simd;
+    for (; i < taps; i++) {
+        acc += static_cast<INT64>(x[i]) * h[i];
+    }
+    return acc;
+}
+
+static inline float rt_resample_dot_flt(const float *x, const float *h, INT32 taps, RT_BOOL simd) {
+    float acc = 0.0f;
+    INT32 i = 0;
+#if defined(RT_SIMD_NEON)
+    if (simd) {
+        float32x4_t sum0 = vdupq_n_f32(0.0f);
+        float32x4_t sum1 = vdupq_n_f32(0.0f);
+        for (; i + 8 <= taps; i += 8) {
+            sum0 = vmlaq_f32(sum0, vld1q_f32(x + i), vld1q_f32(h + i));
+            sum1 = vmlaq_f32(sum1, vld1q_f32(x + i + 4), vld1q_f32(h + i + 4));
+        }
+        float32x4_t sum = vaddq_f32(sum0, sum1);
+        float32x2_t half = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+        acc = vget_lane_f32(vpadd_f32(half, half), 0);
+    }
+#elif defined(RT_SIMD_SSE2)
+    if (simd) {
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        for (; i + 8 <= taps; i += 8) {
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(h + i + 4)));
+        }
+        __m128 sum = _mm_add_ps(sum0, sum1);
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        acc = _mm_cvtss_f32(sum);
+    }
+#endif
+    for (; i < taps; i++) {
+        acc += x[i] * h[i];
+    }
+    return acc;
+}
+
+/*
+ * polyphase fir resampler of interleaved S16 or FLT pcm for any rational
+ * ratio out/in = L/M.
+ *
+ * a windowed sinc (kaiser) is designed at L times the input rate, cut at
+ * the lower nyquist, and split into L phases of taps coefficients. output
+ * sample n sits at input position n * M / L; its phase picks the
+ * coefficients and one dot product over the last taps input samples gives
+ * it. downsampling widens the filter by M/L so the transition band keeps
+ * its width at the output rate.
+ *
+ * every call deinterleaves the input behind the kept history of each
+ * channel, then walks the output frames once and computes all channels of
+ * a frame together.
+ *
+ *   RTAudioResampler resampler;
+ *   resampler.init(48000, 16000, 2, RT_AUDIO_FMT_PCM_S16, RT_RESAMPLE_QUALITY_MEDIUM);
+ *   std::vector<INT16> out(resampler.getMaxOutFrames(frames) * 2);
+ *   INT32 outFrames = resampler.process(in, frames, &out[0]);
+ */
+class RTAudioResampler {
+ public:
+    RTAudioResampler()
+            : mInRate(0), mOutRate(0), mChannels(0), mFormat(RT_AUDIO_FMT_NONE),
+              mL(1), mM(1), mTaps(0), mCoefBits(RT_RESAMPLE_COEF_BITS), mWide(RT_FALSE),
+              mIndex(0), mPhase(0), mSimd(RT_TRUE) {}
+
+    // RT_FALSE runs the scalar reference kernels, e.g. to compare results.
+    void    setSimd(RT_BOOL simd) { mSimd = simd; }
+    INT32   getTaps() const { return mTaps; }
+    INT32   getPhases() const { return mL; }
+
+    // group delay of the filter in input frames.
+    double getDelayFrames() const {
+        return (static_cast<double>(mTaps) * mL - 1) / 2.0 / mL;
+    }
+
+    INT32 getMaxOutFrames(INT32 inFrames) const {
+        return static_cast<INT32>((static_cast<INT64>(inFrames) * mL + mM - 1) / mM) + 1;
+    }
+
+    RT_RET init(INT32 inRate, INT32 outRate, INT32 channels, RTAudioFormat format, RTResampleQuality quality) {
+        if (inRate <= 0 || outRate <= 0 || channels <= 0 || channels > RT_RESAMPLE_MAX_CHANNELS
+                || (format != RT_AUDIO_FMT_PCM_S16 && format != RT_AUDIO_FMT_PCM_FLT)
+                || quality < 0 || quality >= RT_RESAMPLE_QUALITY_MAX) {
+            return RT_ERR_VALUE;
+        }
+        INT32 g = gcd(inRate, outRate);
+        if (outRate / g > RT_RESAMPLE_MAX_PHASES) {
+            RT_LOGE("ratio %d/%d needs %d phases, max %d", outRate, inRate, outRate / g, RT_RESAMPLE_MAX_PHASES);
+            return RT_ERR_UNSUPPORT;
+        }
+        static const INT32  baseTaps[RT_RESAMPLE_QUALITY_MAX] = { 16, 32, 64 };
+        static const double rolloff[RT_RESAMPLE_QUALITY_MAX]  = { 0.80, 0.90, 0.95 };
+        static const double beta[RT_RESAMPLE_QUALITY_MAX]     = { 6.0, 8.0, 10.0 };
+
+        mInRate   = inRate;
+        mOutRate  = outRate;
+        mChannels = channels;
+        mFormat   = format;
+        mL        = outRate / g;
+        mM        = inRate / g;
+        mWide     = (quality == RT_RESAMPLE_QUALITY_HIGH) ? RT_TRUE : RT_FALSE;
+        double stretch = RT_MAX(1.0, static_cast<double>(mM) / mL);
+        mTaps = (static_cast<INT32>(ceil(baseTaps[quality] * stretch)) + 7) & ~7;
+        design(rolloff[quality] * RT_MIN(1.0, static_cast<double>(mL) / mM) / (2.0 * mL), beta[quality]);
+        reset();
+        return RT_OK;
+    }
+
+    void reset() {
+        mIndex = 0;
+        mPhase = 0;
+        mHistS16.assign(mChannels * (mTaps - 1), 0);
+        mHistFlt.assign(mChannels * (mTaps - 1), 0.0f);
+    }
+
+    // returns the number of output frames written, at most getMaxOutFrames(inFrames).
+    INT32 process(const void *in, INT32 inFrames, void *out) {
+        if (mTaps == 0 || in == RT_NULL || out == RT_NULL || inFrames < 0) {
+            return 0;
+        }
+        if (mFormat == RT_AUDIO_FMT_PCM_S16) {
+            return run(reinterpret_cast<const INT16 *>(in), inFrames, reinterpret_cast<INT16 *>(out),
+                       &mHistS16, &mWorkS16);
+        }
+        return run(reinterpret_cast<const float *>(in), inFrames, reinterpret_cast<float *>(out),
+                   &mHistFlt, &mWorkFlt);
+    }
+
+ private:
+    static INT32 gcd(INT32 a, INT32 b) {
+        while (b) {
+            INT32 t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    static double besselI0(double x) {
+        double sum = 1.0, term = 1.0;
+        for (INT32 k = 1; k < 64 && term > 1e-12 * sum; k++) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    /*
+     * cutoff is relative to the upsampled rate. each phase is normalized to
+     * a dc gain of 1 and stored reversed, so its dot product runs forward
+     * over the input.
+     */
+    void design(double cutoff, double beta) {
+        const INT32 length = mTaps * mL;
+        const double center = (length - 1) / 2.0;
+        std::vector<double> proto(length);
+        for (INT32 m = 0; m < length; m++) {
+            double t = m - center;
+            double sinc = (t == 0.0) ? 1.0 : sin(M_PI * 2.0 * cutoff * t) / (M_PI * 2.0 * cutoff * t);
+            double r = t / (center + 0.5);
+            proto[m] = sinc * besselI0(beta * sqrt(RT_MAX(0.0, 1.0 - r * r))) / besselI0(beta);
+        }
+        mCoefFlt.resize(length);
+        std::vector<double> phases(length);
+        double worst = 0.0;
+        double peak = 0.0;
+        for (INT32 p = 0; p < mL; p++) {
+            double sum = 0.0;
+            double sumAbs = 0.0;
+            for (INT32 k = 0; k < mTaps; k++) {
+                sum += proto[p + k * mL];
+            }
+            for (INT32 k = 0; k < mTaps; k++) {
+                double h = proto[p + k * mL] / sum;
+                phases[p * mTaps + mTaps - 1 - k] = h;
+                mCoefFlt[p * mTaps + mTaps - 1 - k] = static_cast<float>(h);
+                sumAbs += fabs(h);
+                peak = RT_MAX(peak, fabs(h));
+            }
+            worst = RT_MAX(worst, peak);
+            worst = RT_MAX(worst, sumAbs / 2);
+        }
+        // the accumulator sees at most 32768 * sum|taps|, a tap must also fit INT16.
+        mCoefBits = (worst * (1 << RT_RESAMPLE_COEF_BITS) < 32767.0) ? RT_RESAMPLE_COEF_BITS
+                                                                     : RT_RESAMPLE_COEF_BITS - 1;
+        // q30 taps must fit INT32, the 64 bit sum can not overflow.
+        mWide = (mWide && peak < 1.99) ? RT_TRUE : RT_FALSE;
+        mCoefS16.resize(mWide ? 0 : length);
+        mCoefS32.resize(mWide ? length : 0);
+        for (INT32 p = 0; p < mL; p++) {
+            if (mWide) {
+                quantize(&phases[p * mTaps], RT_RESAMPLE_WIDE_BITS, &mCoefS32[p * mTaps]);
+            } else {
+                quantize(&phases[p * mTaps], mCoefBits, &mCoefS16[p * mTaps]);
+            }
+        }
+    }
+
+    /*
+     * rounds one phase to bits keeping its sum at exactly 1, else the
+     * phases get slightly different gains, which images. the residual goes
+     * to the taps whose rounding was closest to the other way, one lsb each.
+     */
+    template <typename C>
+    void quantize(const double *h, INT32 bits, C *coef) const {
+        const double scale = static_cast<double>(1 << bits);
+        std::vector<double> error(mTaps);
+        INT64 residual = 1 << bits;
+        for (INT32 k = 0; k < mTaps; k++) {
+            double value = h[k] * scale;
+            coef[k]  = static_cast<C>(floor(value + 0.5));
+            error[k] = value - coef[k];
+            residual -= coef[k];
+        }
+        for (; residual != 0; residual += (residual > 0) ? -1 : 1) {
+            INT32 pick = -1;
+            for (INT32 k = 0; k < mTaps; k++) {
+                if ((residual > 0 && error[k] > 0 && (pick < 0 || error[k] > error[pick]))
+                        || (residual < 0 && error[k] < 0 && (pick < 0 || error[k] < error[pick]))) {
+                    pick = k;
+                }
+            }
+            if (pick < 0) {
+                break;
+            }
+            coef[pick]  = static_cast<C>(coef[pick] + ((residual > 0) ? 1 : -1));
+            error[pick] = 0.0;
+        }
+    }
+
+    INT16 output(INT64 acc, INT16) const {
+        const INT32 bits = mWide ? RT_RESAMPLE_WIDE_BITS : mCoefBits;
+        acc = (acc + (1LL << (bits - 1))) >> bits;
+        return static_cast<INT16>(RT_CLIP(acc, -32768, 32767));
+    }
+
+    float output(float acc, float) const { return acc; }
+
+    INT64 dot(const INT16 *x, INT32 phase) const {
+        if (mWide) {
+            return rt_resample_dot_s16_wide(x, &mCoefS32[phase * mTaps], mTaps, mSimd);
+        }
+        return rt_resample_dot_s16(x, &mCoefS16[phase * mTaps], mTaps, mSimd);
+    }
+
+    float dot(const float *x, INT32 phase) const {
+        return rt_resample_dot_flt(x, &mCoefFlt[phase * mTaps], mTaps, mSimd);
+    }
+
+    /*
+     * work holds one row per channel: taps - 1 samples of history, then
+     * the input of this call. mIndex is the newest input sample of the
+     * next output relative to this call, mPhase its phase.
+     */
+    template <typename T>
+    INT32 run(const T *in, INT32 inFrames, T *out, std::vector<T> *hist, std::vector<T> *work) {
+        const INT32 keep = mTaps - 1;
+        const INT32 row  = keep + inFrames;
+        work->resize(static_cast<size_t>(mChannels) * row);
+        for (INT32 c = 0; c < mChannels; c++) {
+            T *dst = &(*work)[c * row];
+            memcpy(dst, &(*hist)[c * keep], keep * sizeof(T));
+            for (INT32 i = 0; i < inFrames; i++) {
+                dst[keep + i] = in[i * mChannels + c];
+            }
+        }
+
+        INT32 outFrames = 0;
+        while (mIndex < inFrames) {
+            for (INT32 c = 0; c < mChannels; c++) {
+                const T *x = &(*work)[c * row + mIndex];
+                *out++ = output(dot(x, mPhase), T());
+            }
+            outFrames++;
+            mPhase += mM;
+            mIndex += mPhase / mL;
+            mPhase %= mL;
+        }
+        mIndex -= inFrames;
+
+        for (INT32 c = 0; c < mChannels; c++) {
+            memcpy(&(*hist)[c * keep], &(*work)[c * row + inFrames], keep * sizeof(T));
+        }
+        return outFrames;
+    }
+
+ private:
+    INT32               mInRate;
+    INT32               mOutRate;
+    INT32               mChannels;
+    RTAudioFormat       mFormat;
+    INT32               mL;         // out / gcd
+    INT32               mM;         // in / gcd
+    INT32               mTaps;      // per phase
+    INT32               mCoefBits;  // of mCoefS16
+    RT_BOOL             mWide;      // s16 runs the q30 taps of mCoefS32
+    INT32               mIndex;
+    INT32               mPhase;
+    RT_BOOL             mSimd;
+    std::vector<INT16>  mCoefS16;
+    std::vector<INT32>  mCoefS32;
+    std::vector<float>  mCoefFlt;
+    std::vector<INT16>  mHistS16;
+    std::vector<float>  mHistFlt;
+    std::vector<INT16>  mWorkS16;
+    std::vector<float>  mWorkFlt;
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTAUDIORESAMPLER_H_
@@ -0,0 +1,264 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: adaptive sizing policy of media buffer pools
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTBUFFERPOOLSIZER_H_
+#define SRC_RT_MEDIA_INCLUDE_RTBUFFERPOOLSIZER_H_
+
+#include <string.h>
+#include <atomic>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "RTNodeCommon.h"
+
+#define RT_POOL_SIZER_WINDOW_US        (200 * 1000)
+#define RT_POOL_SIZER_QUIET_US         (5 * 1000 * 1000)
+
+/*
+ * memory ceiling shared by all adaptive pools of one graph.
+ * limit 0 means unlimited.
+ */
+class RTBufferMemBudget {
+ public:
+    explicit RTBufferMemBudget(UINT64 limit = 0) : mLimit(limit), mUsed(0), mPeak(0) {}
+
+    RT_BOOL reserve(UINT64 bytes) {
+        UINT64 used = mUsed.load(std::memory_order_relaxed);
+        do {
+            if (mLimit != 0 && used + bytes > mLimit) {
+                return RT_FALSE;
+            }
+        } while (!mUsed.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+
+        UINT64 peak = mPeak.load(std::memory_order_relaxed);
+        while (used + bytes > peak &&
+               !mPeak.compare_exchange_weak(peak, used + bytes, std::memory_order_relaxed)) {}
+        return RT_TRUE;
+    }
+    // accounts bytes even over the limit, for buffers which must exist.
+    void    charge(UINT64 bytes) {
+        UINT64 used = mUsed.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        UINT64 peak = mPeak.load(std::memory_order_relaxed);
+        while (used > peak &&
+               !mPeak.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {}
+    }
+    void    unreserve(UINT64 bytes) { mUsed.fetch_sub(bytes, std::memory_order_relaxed); }
+    UINT64  getLimit() const { return mLimit; }
+    UINT64  getUsed() const { return mUsed.load(std::memory_order_relaxed); }
+    UINT64  getPeak() const { return mPeak.load(std::memory_order_relaxed); }
+
+ private:
+    UINT64              mLimit;
+    std::atomic<UINT64> mUsed;
+    std::atomic<UINT64> mPeak;
+};
+
+typedef struct _RTBufferPoolSizerStat {
+    INT32  count;           // buffers the pool should hold now
+    INT32  minCount;
+    INT32  maxCount;
+    INT32  highWater;       // max outstanding buffers of the last window
+    INT32  growTimes;
+    INT32  shrinkTimes;
+    INT32  deniedTimes;     // grow refused by the memory ceiling
+    INT32  blockedTimes;    // dequeOutputBuffer had to wait
+    UINT64 blockedUs;
+    INT32  lastDelta;
+    UINT64 lastDecisionUs;
+} RTBufferPoolSizerStat;
+
+/*
+ * decides how many buffers an adaptive pool should hold. the pool starts
+ * with minCount buffers, not with its fixed node_buff_count, and grows one
+ * buffer per window under pressure instead of allocating on every acquire:
+ *  - grow by one when every buffer was out at the same time or a consumer
+ *    blocked in dequeOutputBuffer() during the last window;
+ *  - shrink by one after RT_POOL_SIZER_QUIET_US in which at least two
+ *    buffers stayed unused;
+ *  - never go out of [minCount, maxCount] or over the graph budget.
+ *
+ * the pool reports events with onAcquire()/onRelease()/onBlocked() and
+ * applies the delta returned by evaluate(). a grow is charged to the
+ * budget before the pool allocates, onAllocFailed() before the next
+ * evaluate() takes it back; a
+ * shrink stays charged until the pool really frees the buffer and calls
+ * onFreed(). not thread safe, call it under the pool lock.
+ *
+ * the prebuilt RTMediaBufferPool does not drive a sizer or read the
+ * node_buff_adaptive keys, a pool owner has to.
+ */
+class RTBufferPoolSizer {
+ public:
+    // fixedCount is the count of the pool without sizing, the ceiling when maxCount <= 0.
+    RTBufferPoolSizer(RTBufferMemBudget *budget, UINT32 bufferSize,
+                      INT32 fixedCount, INT32 minCount, INT32 maxCount)
+            : mBudget(budget),
+              mBufferSize(bufferSize),
+              mOutstanding(0),
+              mPendingFree(0),
+              mGrowPending(RT_FALSE),
+              mBlockedInWindow(RT_FALSE),
+              mWindowStartUs(0),
+              mQuietSinceUs(0) {
+        memset(&mStat, 0, sizeof(mStat));
+        mStat.minCount = RT_MAX(minCount, 1);
+        mStat.maxCount = RT_MAX(maxCount > 0 ? maxCount : fixedCount, mStat.minCount);
+        mStat.count    = mStat.minCount;
+        if (mBudget != RT_NULL) {
+            // the first buffers are allocated anyway, only account them.
+            mBudget->charge((UINT64)mStat.count * mBufferSize);
+        }
+    }
+
+    ~RTBufferPoolSizer() {
+        if (mBudget != RT_NULL) {
+            mBudget->unreserve((UINT64)(mStat.count + mPendingFree) * mBufferSize);
+        }
+    }
+
+    /*
+     * a sizer for a pool with node_buff_adaptive set, RT_NULL otherwise.
+     * node_buff_min_count defaults to 1, node_buff_max_count to
+     * node_buff_count.
+     */
+    static RTBufferPoolSizer* createFromOptions(RtMetaData *options, RTBufferMemBudget *budget,
+                                                UINT32 bufferSize) {
+        INT32 adaptive = 0, fixedCount = 0, minCount = 1, maxCount = 0;
+        if (options == RT_NULL || !options->findInt32(OPT_NODE_BUFFER_ADAPTIVE, &adaptive) || !adaptive) {
+            return RT_NULL;
+        }
+        options->findInt32(OPT_NODE_BUFFER_COUNT, &fixedCount);
+        options->findInt32(OPT_NODE_BUFFER_MIN_COUNT, &minCount);
+        options->findInt32(OPT_NODE_BUFFER_MAX_COUNT, &maxCount);
+        return new RTBufferPoolSizer(budget, bufferSize, fixedCount, minCount, maxCount);
+    }
+
+    void onAcquire() {
+        mOutstanding++;
+        mStat.highWater = RT_MAX(mStat.highWater, mOutstanding);
+    }
+
+    void onRelease() {
+        if (mOutstanding > 0) {
+            mOutstanding--;
+        }
+    }
+
+    /*
+     * the buffer of the last grow could not be allocated, the grow is
+     * undone with its budget. without a grow pending nothing was reserved.
+     */
+    void onAllocFailed() {
+        if (!mGrowPending) {
+            return;
+        }
+        mGrowPending = RT_FALSE;
+        mStat.count--;
+        if (mBudget != RT_NULL) {
+            mBudget->unreserve(mBufferSize);
+        }
+    }
+
+    // an idle buffer of a shrink has been freed, only now its budget goes back.
+    void onFreed() {
+        if (mPendingFree <= 0) {
+            return;
+        }
+        mPendingFree--;
+        if (mBudget != RT_NULL) {
+            mBudget->unreserve(mBufferSize);
+        }
+    }
+
+    void onBlocked(UINT64 waitUs) {
+        mBlockedInWindow = RT_TRUE;
+        mStat.blockedTimes++;
+        mStat.blockedUs += waitUs;
+    }
+
+    /*
+     * returns the number of buffers to allocate (> 0) or to free (< 0).
+     * freeing only concerns idle buffers, the pool drops them when they
+     * come back and calls onFreed() for each.
+     */
+    INT32 evaluate(UINT64 nowUs) {
+        // the pool allocated the last grow, or reported it failed.
+        mGrowPending = RT_FALSE;
+        if (mWindowStartUs == 0) {
+            mWindowStartUs = nowUs;
+            mQuietSinceUs  = nowUs;
+            return 0;
+        }
+        if (nowUs - mWindowStartUs < RT_POOL_SIZER_WINDOW_US) {
+            return 0;
+        }
+
+        INT32 delta = 0;
+        if ((mBlockedInWindow || mStat.highWater >= mStat.count) && mStat.count < mStat.maxCount) {
+            if (mBudget == RT_NULL || mBudget->reserve(mBufferSize)) {
+                delta = 1;
+            } else {
+                mStat.deniedTimes++;
+            }
+            mQuietSinceUs = nowUs;
+        } else if (mStat.highWater + 2 <= mStat.count) {
+            if (nowUs - mQuietSinceUs >= RT_POOL_SIZER_QUIET_US && mStat.count > mStat.minCount) {
+                delta = -1;
+                mQuietSinceUs = nowUs;
+                mPendingFree++;
+            }
+        } else {
+            mQuietSinceUs = nowUs;
+        }
+
+        if (delta != 0) {
+            mStat.count += delta;
+            mStat.lastDelta = delta;
+            mStat.lastDecisionUs = nowUs;
+            if (delta > 0) {
+                mGrowPending = RT_TRUE;
+                mStat.growTimes++;
+            } else {
+                mStat.shrinkTimes++;
+            }
+            RT_LOGD("pool sizer %s to %d buffers (high water %d, blocked %d)",
+                     delta > 0 ? "grow" : "shrink", mStat.count, mStat.highWater, mBlockedInWindow);
+        }
+
+        mWindowStartUs   = nowUs;
+        mBlockedInWindow = RT_FALSE;
+        mStat.highWater  = mOutstanding;
+        return delta;
+    }
+
+    INT32 getCount() const { return mStat.count; }
+    void  queryStat(RTBufferPoolSizerStat *stat) const { *stat = mStat; }
+
+ private:
+    RTBufferMemBudget      *mBudget;
+    UINT32                  mBufferSize;
+    INT32                   mOutstanding;
+    INT32                   mPendingFree;       // shrunk, not freed yet
+    RT_BOOL                 mGrowPending;       // grown, reserved, not allocated yet
+    RT_BOOL                 mBlockedInWindow;
+    UINT64                  mWindowStartUs;
+    UINT64                  mQuietSinceUs;
+    RTBufferPoolSizerStat   mStat;
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTBUFFERPOOLSIZER_H_
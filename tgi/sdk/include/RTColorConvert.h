@@ -0,0 +1,880 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: software color conversion, prepares nn input from isp frames
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTCOLORCONVERT_H_
+#define SRC_RT_MEDIA_INCLUDE_RTCOLORCONVERT_H_
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "rt_simd.h"
+#include "RTImageScaler.h"
+#include "RTMediaBuffer.h"
+#include "RTMediaDef.h"
+#include "RTMediaMetaKeys.h"
+#include "RTMediaPixel.h"
+#include "RTNodeCommon.h"
+#include "RTTaskNode.h"
+#include "RTTaskNodeContext.h"
+#include "RTTaskNodeOptions.h"
+#include "RTVideoFrame.h"
+
+#define RT_COLOR_COEF_BITS          13
+#define RT_COLOR_COEF_ROUND         (1 << (RT_COLOR_COEF_BITS - 1))
+
+typedef enum _RTColorLayout {
+    RT_COLOR_LAYOUT_INTERLEAVED = 0,    // rgbrgb..., as RGB888
+    RT_COLOR_LAYOUT_PLANAR,             // rr..gg..bb.., the nchw input of most models
+    RT_COLOR_LAYOUT_MAX,
+} RTColorLayout;
+
+typedef enum _RTColorDataType {
+    RT_COLOR_DATA_UINT8 = 0,
+    RT_COLOR_DATA_INT8,                 // round((x - mean) / std / quantScale) + quantZp
+    RT_COLOR_DATA_FLOAT32,              // (x - mean) / std
+    RT_COLOR_DATA_MAX,
+} RTColorDataType;
+
+/*
+ * space and range pick the matrix: RTCOL_SPC_BT709 is BT.709, anything
+ * else BT.601; RTCOL_RANGE_JPEG is full range, anything else limited.
+ * mean and std are given in r, g, b order whatever the destination order.
+ */
+typedef struct _RTColorParams {
+    RTColorSpace    space;
+    RTColorRange    range;
+    RTColorLayout   layout;
+    RTColorDataType dataType;
+    float           mean[3];
+    float           std[3];
+    float           quantScale;
+    INT32           quantZp;
+} RTColorParams;
+
+static inline void rt_color_params_init(RTColorParams *params) {
+    params->space      = RTCOL_SPC_SMPTE170M;
+    params->range      = RTCOL_RANGE_MPEG;
+    params->layout     = RT_COLOR_LAYOUT_INTERLEAVED;
+    params->dataType   = RT_COLOR_DATA_UINT8;
+    params->quantScale = 1.0f;
+    params->quantZp    = 0;
+    for (INT32 c = 0; c < 3; c++) {
+        params->mean[c] = 0.0f;
+        params->std[c]  = 1.0f;
+    }
+}
+
+// fixed point matrices, RT_COLOR_COEF_BITS fraction bits.
+typedef struct _RTColorCoeffs {
+    INT16 yOffset;
+    INT16 yMul;                         // yuv -> rgb
+    INT16 crv;
+    INT16 cgu;
+    INT16 cgv;
+    INT16 cbu;
+    INT16 cyr, cyg, cyb;                // rgb -> yuv
+    INT16 cur, cug, cub;
+    INT16 cvr, cvg, cvb;
+} RTColorCoeffs;
+
+static inline INT16 rt_color_fixed(double value) {
+    return static_cast<INT16>(floor(value * (1 << RT_COLOR_COEF_BITS) + 0.5));
+}
+
+static inline void rt_color_coeffs(RTColorSpace space, RTColorRange range, RTColorCoeffs *coeffs) {
+    double kr = 0.299;
+    double kb = 0.114;
+    if (space == RTCOL_SPC_BT709) {
+        kr = 0.2126;
+        kb = 0.0722;
+    }
+    const double kg   = 1.0 - kr - kb;
+    const RT_BOOL full = (range == RTCOL_RANGE_JPEG) ? RT_TRUE : RT_FALSE;
+    const double ys   = full ? 1.0 : 255.0 / 219.0;
+    const double cs   = full ? 1.0 : 255.0 / 224.0;
+
+    coeffs->yOffset = full ? 0 : 16;
+    coeffs->yMul    = rt_color_fixed(ys);
+    coeffs->crv     = rt_color_fixed(2.0 * (1.0 - kr) * cs);
+    coeffs->cgu     = rt_color_fixed(-2.0 * (1.0 - kb) * kb / kg * cs);
+    coeffs->cgv     = rt_color_fixed(-2.0 * (1.0 - kr) * kr / kg * cs);
+    coeffs->cbu     = rt_color_fixed(2.0 * (1.0 - kb) * cs);
+
+    coeffs->cyr = rt_color_fixed(kr / ys);
+    coeffs->cyg = rt_color_fixed(kg / ys);
+    coeffs->cyb = rt_color_fixed(kb / ys);
+    coeffs->cur = rt_color_fixed(-kr / (2.0 * (1.0 - kb)) / cs);
+    coeffs->cug = rt_color_fixed(-kg / (2.0 * (1.0 - kb)) / cs);
+    coeffs->cub = rt_color_fixed(0.5 / cs);
+    coeffs->cvr = rt_color_fixed(0.5 / cs);
+    coeffs->cvg = rt_color_fixed(-kg / (2.0 * (1.0 - kr)) / cs);
+    coeffs->cvb = rt_color_fixed(-kb / (2.0 * (1.0 - kr)) / cs);
+}
+
+static inline UINT8 rt_color_clip(INT32 value) {
+    return static_cast<UINT8>(RT_CLIP(value, 0, 255));
+}
+
+#if defined(RT_SIMD_SSE2)
+// two INT16 coefficients side by side, the layout _mm_madd_epi16 pairs them with.
+static inline __m128i rt_color_sse2_pair(INT32 lo, INT32 hi) {
+    return _mm_set1_epi32(static_cast<INT32>((static_cast<UINT32>(static_cast<UINT16>(hi)) << 16)
+                                             | static_cast<UINT16>(lo)));
+}
+
+static inline void rt_color_sse2_madd(__m128i a, __m128i b, __m128i k, __m128i *lo, __m128i *hi) {
+    *lo = _mm_add_epi32(*lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), k));
+    *hi = _mm_add_epi32(*hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), k));
+}
+
+static inline __m128i rt_color_sse2_shift(__m128i lo, __m128i hi) {
+    return _mm_packs_epi32(_mm_srai_epi32(lo, RT_COLOR_COEF_BITS), _mm_srai_epi32(hi, RT_COLOR_COEF_BITS));
+}
+
+// one round of the 3-way byte deinterleave, four rounds turn 16 packed triples into three planes.
+static inline void rt_color_sse2_unzip3(__m128i *a, __m128i *b, __m128i *c) {
+    const __m128i t0 = _mm_unpacklo_epi8(*a, _mm_unpackhi_epi64(*b, *b));
+    const __m128i t1 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(*a, *a), *c);
+    const __m128i t2 = _mm_unpacklo_epi8(*b, _mm_unpackhi_epi64(*c, *c));
+    *a = t0;
+    *b = t1;
+    *c = t2;
+}
+
+// the sse2 counterpart of vld3q_u8, without the pshufb of ssse3.
+static inline void rt_color_sse2_load3(const UINT8 *src, __m128i *p0, __m128i *p1, __m128i *p2) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+    for (INT32 i = 0; i < 4; i++) {
+        rt_color_sse2_unzip3(&a, &b, &c);
+    }
+    *p0 = a;
+    *p1 = b;
+    *p2 = c;
+}
+#elif defined(RT_SIMD_NEON)
+static inline uint8x8_t rt_color_neon_dot(int16x8_t a, INT16 ka, int16x8_t b, INT16 kb,
+                                          int16x8_t c, INT16 kc, int32x4_t bias) {
+    int32x4_t lo = vmlal_n_s16(bias, vget_low_s16(a), ka);
+    int32x4_t hi = vmlal_n_s16(bias, vget_high_s16(a), ka);
+    lo = vmlal_n_s16(vmlal_n_s16(lo, vget_low_s16(b), kb), vget_low_s16(c), kc);
+    hi = vmlal_n_s16(vmlal_n_s16(hi, vget_high_s16(b), kb), vget_high_s16(c), kc);
+    return vqmovun_s16(vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, RT_COLOR_COEF_BITS)),
+                                    vqmovn_s32(vshrq_n_s32(hi, RT_COLOR_COEF_BITS))));
+}
+
+static inline int16x8_t rt_color_neon_widen(uint8x8_t v, INT16 offset) {
+    return vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v)), vdupq_n_s16(offset));
+}
+#endif
+
+/*
+ * one row of a 4:2:0 semi-planar image to rgb, width must be even. uv is
+ * the chroma row shared by two luma rows, vFirst is set for NV21. rows go
+ * to dst interleaved when planeStride is 0, else as three planes
+ * planeStride bytes apart. the simd versions give the same bits as the
+ * scalar one.
+ */
+static inline void rt_color_yuv_to_rgb_row(const UINT8 *y, const UINT8 *uv, RT_BOOL vFirst, UINT8 *dst,
+                                           INT32 planeStride, RT_BOOL bgr, INT32 width,
+                                           const RTColorCoeffs &k, RT_BOOL simd) {
+    const INT32 step = planeStride ? 1 : 3;
+    const INT32 span = planeStride ? planeStride : 1;
+    UINT8 *outR = dst + (bgr ? 2 : 0) * span;
+    UINT8 *outG = dst + span;
+    UINT8 *outB = dst + (bgr ? 0 : 2) * span;
+    INT32 x = 0;
+#if defined(RT_SIMD_SSE2)
+    if (simd) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i mask = _mm_set1_epi16(0xff);
+        const __m128i c128 = _mm_set1_epi16(128);
+        const __m128i yOff = _mm_set1_epi16(k.yOffset);
+        const __m128i rnd  = _mm_set1_epi32(RT_COLOR_COEF_ROUND);
+        const __m128i kR   = rt_color_sse2_pair(k.yMul, k.crv);
+        const __m128i kGu  = rt_color_sse2_pair(k.yMul, k.cgu);
+        const __m128i kGv  = rt_color_sse2_pair(k.cgv, 0);
+        const __m128i kB   = rt_color_sse2_pair(k.yMul, k.cbu);
+        UINT8 rgb[3][16];
+        for (; x + 16 <= width; x += 16) {
+            __m128i luma = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+            __m128i pair = _mm_loadu_si128(reinterpret_cast<const __m128i *>(uv + x));
+            __m128i cu   = _mm_sub_epi16(_mm_and_si128(pair, mask), c128);
+            __m128i cv   = _mm_sub_epi16(_mm_srli_epi16(pair, 8), c128);
+            if (vFirst) {
+                __m128i swap = cu;
+                cu = cv;
+                cv = swap;
+            }
+            __m128i ys[2] = { _mm_sub_epi16(_mm_unpacklo_epi8(luma, zero), yOff),
+                              _mm_sub_epi16(_mm_unpackhi_epi8(luma, zero), yOff) };
+            __m128i us[2] = { _mm_unpacklo_epi16(cu, cu), _mm_unpackhi_epi16(cu, cu) };
+            __m128i vs[2] = { _mm_unpacklo_epi16(cv, cv), _mm_unpackhi_epi16(cv, cv) };
+            __m128i r[2], g[2], b[2];
+            for (INT32 h = 0; h < 2; h++) {
+                __m128i lo = rnd, hi = rnd;
+                rt_color_sse2_madd(ys[h], vs[h], kR, &lo, &hi);
+                r[h] = rt_color_sse2_shift(lo, hi);
+                lo = hi = rnd;
+                rt_color_sse2_madd(ys[h], us[h], kGu, &lo, &hi);
+                rt_color_sse2_madd(vs[h], zero, kGv, &lo, &hi);
+                g[h] = rt_color_sse2_shift(lo, hi);
+                lo = hi = rnd;
+                rt_color_sse2_madd(ys[h], us[h], kB, &lo, &hi);
+                b[h] = rt_color_sse2_shift(lo, hi);
+            }
+            __m128i r8 = _mm_packus_epi16(r[0], r[1]);
+            __m128i g8 = _mm_packus_epi16(g[0], g[1]);
+            __m128i b8 = _mm_packus_epi16(b[0], b[1]);
+            if (planeStride) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(outR + x), r8);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(outG + x), g8);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(outB + x), b8);
+                continue;
+            }
+            // no 3-way byte shuffle in SSE2, interleave through the stack.
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(rgb[0]), r8);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(rgb[1]), g8);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(rgb[2]), b8);
+            for (INT32 i = 0; i < 16; i++) {
+                outR[(x + i) * 3] = rgb[0][i];
+                outG[(x + i) * 3] = rgb[1][i];
+                outB[(x + i) * 3] = rgb[2][i];
+            }
+        }
+    }
+#elif defined(RT_SIMD_NEON)
+    if (simd) {
+        const int32x4_t rnd = vdupq_n_s32(RT_COLOR_COEF_ROUND);
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t luma = vld1q_u8(y + x);
+            uint8x8x2_t pair = vld2_u8(uv + x);
+            int16x8_t cu = rt_color_neon_widen(pair.val[vFirst ? 1 : 0], 128);
+            int16x8_t cv = rt_color_neon_widen(pair.val[vFirst ? 0 : 1], 128);
+            int16x8x2_t us = vzipq_s16(cu, cu);
+            int16x8x2_t vs = vzipq_s16(cv, cv);
+            int16x8_t ys[2] = { rt_color_neon_widen(vget_low_u8(luma), k.yOffset),
+                                rt_color_neon_widen(vget_high_u8(luma), k.yOffset) };
+            uint8x8_t r[2], g[2], b[2];
+            for (INT32 h = 0; h < 2; h++) {
+                r[h] = rt_color_neon_dot(ys[h], k.yMul, vs.val[h], k.crv, vs.val[h], 0, rnd);
+                g[h] = rt_color_neon_dot(ys[h], k.yMul, us.val[h], k.cgu, vs.val[h], k.cgv, rnd);
+                b[h] = rt_color_neon_dot(ys[h], k.yMul, us.val[h], k.cbu, us.val[h], 0, rnd);
+            }
+            uint8x16_t r8 = vcombine_u8(r[0], r[1]);
+            uint8x16_t g8 = vcombine_u8(g[0], g[1]);
+            uint8x16_t b8 = vcombine_u8(b[0], b[1]);
+            if (planeStride) {
+                vst1q_u8(outR + x, r8);
+                vst1q_u8(outG + x, g8);
+                vst1q_u8(outB + x, b8);
+            } else {
+                uint8x16x3_t rgb;
+                rgb.val[0] = bgr ? b8 : r8;
+                rgb.val[1] = g8;
+                rgb.val[2] = bgr ? r8 : b8;
+                vst3q_u8(dst + x * 3, rgb);
+            }
+        }
+    }
+#endif
+    const INT32 uIdx = vFirst ? 1 : 0;
+    for (; x < width; x += 2) {
+        const INT32 u = uv[x + uIdx] - 128;
+        const INT32 v = uv[x + 1 - uIdx] - 128;
+        for (INT32 i = x; i < x + 2; i++) {
+            const INT32 luma = (y[i] - k.yOffset) * k.yMul + RT_COLOR_COEF_ROUND;
+            outR[i * step] = rt_color_clip((luma + k.crv * v) >> RT_COLOR_COEF_BITS);
+            outG[i * step] = rt_color_clip((luma + k.cgu * u + k.cgv * v) >> RT_COLOR_COEF_BITS);
+            outB[i * step] = rt_color_clip((luma + k.cbu * u) >> RT_COLOR_COEF_BITS);
+        }
+    }
+}
+
+// luma of one interleaved rgb row.
+static inline void rt_color_rgb_to_luma_row(const UINT8 *rgb, RT_BOOL bgr, UINT8 *y, INT32 width,
+                                            const RTColorCoeffs &k, RT_BOOL simd) {
+    const INT32 ri = bgr ? 2 : 0;
+    const INT32 bi = bgr ? 0 : 2;
+    const INT32 bias = (k.yOffset << RT_COLOR_COEF_BITS) + RT_COLOR_COEF_ROUND;
+    INT32 x = 0;
+#if defined(RT_SIMD_SSE2)
+    if (simd) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rnd  = _mm_set1_epi32(bias);
+        const __m128i kRG  = rt_color_sse2_pair(k.cyr, k.cyg);
+        const __m128i kB   = rt_color_sse2_pair(k.cyb, 0);
+        for (; x + 16 <= width; x += 16) {
+            __m128i v[3];
+            rt_color_sse2_load3(rgb + x * 3, &v[0], &v[1], &v[2]);
+            const __m128i r = v[ri];
+            const __m128i g = v[1];
+            const __m128i b = v[bi];
+            __m128i lo = rnd, hi = rnd;
+            rt_color_sse2_madd(_mm_unpacklo_epi8(r, zero), _mm_unpacklo_epi8(g, zero), kRG, &lo, &hi);
+            rt_color_sse2_madd(_mm_unpacklo_epi8(b, zero), zero, kB, &lo, &hi);
+            __m128i y0 = rt_color_sse2_shift(lo, hi);
+            lo = hi = rnd;
+            rt_color_sse2_madd(_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero), kRG, &lo, &hi);
+            rt_color_sse2_madd(_mm_unpackhi_epi8(b, zero), zero, kB, &lo, &hi);
+            __m128i y1 = rt_color_sse2_shift(lo, hi);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(y + x), _mm_packus_epi16(y0, y1));
+        }
+    }
+#elif defined(RT_SIMD_NEON)
+    if (simd) {
+        const int32x4_t rnd = vdupq_n_s32(bias);
+        for (; x + 16 <= width; x += 16) {
+            uint8x16x3_t v = vld3q_u8(rgb + x * 3);
+            uint8x16_t r = v.val[ri];
+            uint8x16_t g = v.val[1];
+            uint8x16_t b = v.val[bi];
+            uint8x8_t y0 = rt_color_neon_dot(rt_color_neon_widen(vget_low_u8(r), 0), k.cyr,
+                                             rt_color_neon_widen(vget_low_u8(g), 0), k.cyg,
+                                             rt_color_neon_widen(vget_low_u8(b), 0), k.cyb, rnd);
+            uint8x8_t y1 = rt_color_neon_dot(rt_color_neon_widen(vget_high_u8(r), 0), k.cyr,
+                                             rt_color_neon_widen(vget_high_u8(g), 0), k.cyg,
+                                             rt_color_neon_widen(vget_high_u8(b), 0), k.cyb, rnd);
+            vst1q_u8(y + x, vcombine_u8(y0, y1));
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        const UINT8 *p = rgb + x * 3;
+        y[x] = rt_color_clip((k.cyr * p[ri] + k.cyg * p[1] + k.cyb * p[bi] + bias) >> RT_COLOR_COEF_BITS);
+    }
+}
+
+/*
+ * interleaved chroma of two rgb rows, each sample from the sum of a 2x2
+ * block. it is a quarter of the samples and stays scalar.
+ */
+static inline void rt_color_rgb_to_chroma_row(const UINT8 *rgb0, const UINT8 *rgb1, RT_BOOL bgr,
+                                              UINT8 *uv, RT_BOOL vFirst, INT32 width,
+                                              const RTColorCoeffs &k) {
+    const INT32 ri = bgr ? 2 : 0;
+    const INT32 bi = bgr ? 0 : 2;
+    const INT32 shift = RT_COLOR_COEF_BITS + 2;
+    const INT32 bias = (128 << shift) + (1 << (shift - 1));
+    UINT8 *outU = uv + (vFirst ? 1 : 0);
+    UINT8 *outV = uv + (vFirst ? 0 : 1);
+    for (INT32 x = 0; x + 1 < width; x += 2) {
+        const UINT8 *p0 = rgb0 + x * 3;
+        const UINT8 *p1 = rgb1 + x * 3;
+        const INT32 r = p0[ri] + p0[ri + 3] + p1[ri] + p1[ri + 3];
+        const INT32 g = p0[1] + p0[4] + p1[1] + p1[4];
+        const INT32 b = p0[bi] + p0[bi + 3] + p1[bi] + p1[bi + 3];
+        outU[x] = rt_color_clip((k.cur * r + k.cug * g + k.cub * b + bias) >> shift);
+        outV[x] = rt_color_clip((k.cvr * r + k.cvg * g + k.cvb * b + bias) >> shift);
+    }
+}
+
+/*
+ * NV12/NV21 -> RGB888/BGR888 with an optional resize in the same pass, and
+ * RGB888/BGR888 -> NV12/NV21 at the same size.
+ *
+ * rgb destinations may be planar and float or int8: the frame is resized
+ * two luma rows and one chroma row at a time into row buffers, converted
+ * and normalized from there, so the full size rgb image never exists. a
+ * u8 only has 256 values, normalization is a table per channel.
+ *
+ * the destination is written whole, virWidth is its row pitch in pixels
+ * and virHeight the rows per plane.
+ *
+ *   RTColorConverter converter;
+ *   converter.setParams(params);
+ *   converter.convert(&nv12, &rgb, RT_SCALE_BILINEAR);
+ */
+class RTColorConverter {
+ public:
+    RTColorConverter() : mSimd(RT_TRUE) {
+        RTColorParams params;
+        rt_color_params_init(&params);
+        setParams(params);
+    }
+
+    // RT_FALSE runs the scalar reference kernels, e.g. to compare results.
+    void setSimd(RT_BOOL simd) { mSimd = simd; }
+    const RTColorParams& getParams() const { return mParams; }
+
+    RT_RET setParams(const RTColorParams &params) {
+        if (params.layout < 0 || params.layout >= RT_COLOR_LAYOUT_MAX
+                || params.dataType < 0 || params.dataType >= RT_COLOR_DATA_MAX
+                || params.quantScale == 0.0f) {
+            return RT_ERR_VALUE;
+        }
+        for (INT32 c = 0; c < 3; c++) {
+            if (params.std[c] == 0.0f) {
+                return RT_ERR_VALUE;
+            }
+        }
+        mParams = params;
+        rt_color_coeffs(params.space, params.range, &mCoeffs);
+        mLutFloat.resize(3 * 256);
+        mLutInt8.resize(3 * 256);
+        for (INT32 c = 0; c < 3; c++) {
+            for (INT32 v = 0; v < 256; v++) {
+                float value = (static_cast<float>(v) - params.mean[c]) / params.std[c];
+                INT32 quant = static_cast<INT32>(floorf(value / params.quantScale + 0.5f)) + params.quantZp;
+                mLutFloat[c * 256 + v] = value;
+                mLutInt8[c * 256 + v]  = static_cast<INT8>(RT_CLIP(quant, -128, 127));
+            }
+        }
+        return RT_OK;
+    }
+
+    // bytes the destination needs with the current parameters.
+    UINT32 getBufferSize(const RTScaleImage *dst) const {
+        INT32 virW = dst->virWidth > 0 ? dst->virWidth : dst->width;
+        INT32 virH = dst->virHeight > 0 ? dst->virHeight : dst->height;
+        if (isRgb(dst->format)) {
+            return static_cast<UINT32>(virW * virH * 3 * getElemSize());
+        }
+        return static_cast<UINT32>(virW * virH * 3 / 2);
+    }
+
+    RT_RET convert(const RTScaleImage *src, const RTScaleImage *dst, RTScaleMode mode = RT_SCALE_BILINEAR) {
+        if (src == RT_NULL || dst == RT_NULL || dst->data == RT_NULL || mode < 0 || mode >= RT_SCALE_MODE_MAX) {
+            return RT_ERR_VALUE;
+        }
+        if (isSemiPlanar(src->format) && isRgb(dst->format)) {
+            return yuvToRgb(src, dst, mode, 0, dst->height);
+        }
+        if (isRgb(src->format) && isSemiPlanar(dst->format)) {
+            return rgbToYuv(src, dst);
+        }
+        RT_LOGE("color conversion %d -> %d is not supported", src->format, dst->format);
+        return RT_ERR_UNSUPPORT;
+    }
+
+    /*
+     * destination rows [rowBegin, rowEnd) of a NV12/NV21 -> rgb convert(),
+     * e.g. one band of a strip pipeline. both are even, the rows are whole
+     * chroma rows. without a resize they only read the same source rows.
+     */
+    RT_RET convertRows(const RTScaleImage *src, const RTScaleImage *dst, RTScaleMode mode,
+                       INT32 rowBegin, INT32 rowEnd) {
+        if (src == RT_NULL || dst == RT_NULL || dst->data == RT_NULL || mode < 0 || mode >= RT_SCALE_MODE_MAX
+                || rowBegin < 0 || ((rowBegin | rowEnd) & 1) || rowEnd > dst->height) {
+            return RT_ERR_VALUE;
+        }
+        if (!isSemiPlanar(src->format) || !isRgb(dst->format)) {
+            RT_LOGE("color conversion %d -> %d is not supported in rows", src->format, dst->format);
+            return RT_ERR_UNSUPPORT;
+        }
+        return yuvToRgb(src, dst, mode, rowBegin, rowEnd);
+    }
+
+ private:
+    static RT_BOOL isRgb(RTPixelFormat format) {
+        return (format == RT_FMT_RGB888 || format == RT_FMT_BGR888) ? RT_TRUE : RT_FALSE;
+    }
+
+    static RT_BOOL isSemiPlanar(RTPixelFormat format) {
+        return (format == RT_FMT_YUV420SP || format == RT_FMT_YUV420SP_VU) ? RT_TRUE : RT_FALSE;
+    }
+
+    INT32 getElemSize() const {
+        return (mParams.dataType == RT_COLOR_DATA_FLOAT32) ? sizeof(float) : 1;
+    }
+
+    RT_RET yuvToRgb(const RTScaleImage *src, const RTScaleImage *dst, RTScaleMode mode, INT32 rowBegin,
+                    INT32 rowEnd) {
+        RTScalePlane planes[RT_SCALE_MAX_PLANES];
+        const INT32 width  = dst->width;
+        const INT32 height = dst->height;
+        const INT32 virW   = dst->virWidth > 0 ? dst->virWidth : width;
+        const INT32 virH   = dst->virHeight > 0 ? dst->virHeight : height;
+        if (RTImageScaler::getPlanes(src, planes) != 2 || width <= 0 || height <= 0
+                || ((width | height) & 1) || virW < width || virH < height) {
+            RT_LOGE("bad geometry, %dx%d -> %dx%d", src->width, src->height, width, height);
+            return RT_ERR_VALUE;
+        }
+
+        const RT_BOOL vFirst  = (src->format == RT_FMT_YUV420SP_VU) ? RT_TRUE : RT_FALSE;
+        const RT_BOOL bgr     = (dst->format == RT_FMT_BGR888) ? RT_TRUE : RT_FALSE;
+        const RT_BOOL planar  = (mParams.layout == RT_COLOR_LAYOUT_PLANAR) ? RT_TRUE : RT_FALSE;
+        const RT_BOOL direct  = (mParams.dataType == RT_COLOR_DATA_UINT8) ? RT_TRUE : RT_FALSE;
+        const RT_BOOL resize  = (planes[0].width != width || planes[0].height != height) ? RT_TRUE : RT_FALSE;
+        const RTScalePlane dstY  = { RT_NULL, width, width, height, 1 };
+        const RTScalePlane dstUV = { RT_NULL, width, width / 2, height / 2, 2 };
+        if (resize) {
+            prepareScalers(planes, dstY, dstUV, mode);
+        }
+        mLuma.resize(width * 2);
+        mChroma.resize(width);
+        mRgb.resize(width * 3);
+
+        for (INT32 row = rowBegin; row < rowEnd; row += 2) {
+            const UINT8 *luma[2];
+            const UINT8 *chroma;
+            if (resize) {
+                mScalers[1].scaleRow(row / 2, &mChroma[0], &mScratch, mSimd);
+                mScalers[0].scaleRow(row, &mLuma[0], &mScratch, mSimd);
+                mScalers[0].scaleRow(row + 1, &mLuma[width], &mScratch, mSimd);
+                luma[0] = &mLuma[0];
+                luma[1] = &mLuma[width];
+                chroma  = &mChroma[0];
+            } else {
+                luma[0] = planes[0].data + row * planes[0].stride;
+                luma[1] = luma[0] + planes[0].stride;
+                chroma  = planes[1].data + (row / 2) * planes[1].stride;
+            }
+            for (INT32 i = 0; i < 2; i++) {
+                const INT32 y = row + i;
+                if (direct) {
+                    UINT8 *out = dst->data + (planar ? y * virW : y * virW * 3);
+                    rt_color_yuv_to_rgb_row(luma[i], chroma, vFirst, out, planar ? virW * virH : 0, bgr,
+                                            width, mCoeffs, mSimd);
+                } else {
+                    rt_color_yuv_to_rgb_row(luma[i], chroma, vFirst, &mRgb[0], width, RT_FALSE,
+                                            width, mCoeffs, mSimd);
+                    normalizeRow(y, width, virW, virH, planar, bgr, dst->data);
+                }
+            }
+        }
+        return RT_OK;
+    }
+
+    // the tables only depend on the sizes, the scalers of y and uv are kept from band to band and frame to frame.
+    void prepareScalers(const RTScalePlane *planes, const RTScalePlane &dstY, const RTScalePlane &dstUV,
+                        RTScaleMode mode) {
+        if (mScalers.size() == 2 && mScalers[0].isSameGeometry(planes[0], dstY, mode)
+                && mScalers[1].isSameGeometry(planes[1], dstUV, mode)) {
+            mScalers[0].rebind(planes[0], dstY);
+            mScalers[1].rebind(planes[1], dstUV);
+            return;
+        }
+        mScalers.clear();
+        mScalers.push_back(RTPlaneScaler(planes[0], dstY, mode));
+        mScalers.push_back(RTPlaneScaler(planes[1], dstUV, mode));
+        // new scalers may sit where the old ones did, the scratch must not take their columns for its own.
+        mScratch = RTPlaneScaler::Scratch();
+    }
+
+    // mRgb holds one planar row in r, g, b order.
+    void normalizeRow(INT32 y, INT32 width, INT32 virW, INT32 virH, RT_BOOL planar, RT_BOOL bgr,
+                      UINT8 *dst) const {
+        for (INT32 c = 0; c < 3; c++) {
+            const INT32 oc = bgr ? 2 - c : c;
+            const INT32 offset = planar ? oc * virW * virH + y * virW : y * virW * 3 + oc;
+            const INT32 step   = planar ? 1 : 3;
+            const UINT8 *in = &mRgb[c * width];
+            if (mParams.dataType == RT_COLOR_DATA_FLOAT32) {
+                const float *lut = &mLutFloat[c * 256];
+                float *out = reinterpret_cast<float *>(dst) + offset;
+                for (INT32 x = 0; x < width; x++) {
+                    out[x * step] = lut[in[x]];
+                }
+            } else {
+                const INT8 *lut = &mLutInt8[c * 256];
+                INT8 *out = reinterpret_cast<INT8 *>(dst) + offset;
+                for (INT32 x = 0; x < width; x++) {
+                    out[x * step] = lut[in[x]];
+                }
+            }
+        }
+    }
+
+    RT_RET rgbToYuv(const RTScaleImage *src, const RTScaleImage *dst) {
+        RTScalePlane in[RT_SCALE_MAX_PLANES];
+        RTScalePlane out[RT_SCALE_MAX_PLANES];
+        if (RTImageScaler::getPlanes(src, in) != 1 || RTImageScaler::getPlanes(dst, out) != 2) {
+            RT_LOGE("bad geometry, %dx%d -> %dx%d", src->width, src->height, dst->width, dst->height);
+            return RT_ERR_VALUE;
+        }
+        if (in[0].width != out[0].width || in[0].height != out[0].height) {
+            RT_LOGE("rgb -> yuv does not scale, %dx%d -> %dx%d",
+                     in[0].width, in[0].height, out[0].width, out[0].height);
+            return RT_ERR_UNSUPPORT;
+        }
+        if (mParams.layout != RT_COLOR_LAYOUT_INTERLEAVED || mParams.dataType != RT_COLOR_DATA_UINT8) {
+            RT_LOGE("rgb -> yuv takes interleaved uint8 only");
+            return RT_ERR_UNSUPPORT;
+        }
+
+        const RT_BOOL bgr    = (src->format == RT_FMT_BGR888) ? RT_TRUE : RT_FALSE;
+        const RT_BOOL vFirst = (dst->format == RT_FMT_YUV420SP_VU) ? RT_TRUE : RT_FALSE;
+        const INT32 width = out[0].width;
+        for (INT32 row = 0; row < out[0].height; row += 2) {
+            const UINT8 *rgb0 = in[0].data + row * in[0].stride;
+            const UINT8 *rgb1 = rgb0 + in[0].stride;
+            UINT8 *y0 = out[0].data + row * out[0].stride;
+            rt_color_rgb_to_luma_row(rgb0, bgr, y0, width, mCoeffs, mSimd);
+            rt_color_rgb_to_luma_row(rgb1, bgr, y0 + out[0].stride, width, mCoeffs, mSimd);
+            rt_color_rgb_to_chroma_row(rgb0, rgb1, bgr, out[1].data + (row / 2) * out[1].stride, vFirst,
+                                       width, mCoeffs);
+        }
+        return RT_OK;
+    }
+
+ private:
+    RT_BOOL             mSimd;
+    RTColorParams       mParams;
+    RTColorCoeffs       mCoeffs;
+    std::vector<float>  mLutFloat;
+    std::vector<INT8>   mLutInt8;
+    std::vector<UINT8>  mLuma;
+    std::vector<UINT8>  mChroma;
+    std::vector<UINT8>  mRgb;
+    std::vector<RTPlaneScaler>  mScalers;   // none, or y and uv of the last resize
+    RTPlaneScaler::Scratch      mScratch;
+};
+
+/*
+ * filter_color_convert, NV12/NV21 in, RGB888/BGR888 (or NV12/NV21 from
+ * rgb) out. options:
+ *
+ *   opt_width / opt_height     output size, 0 keeps the input size
+ *   opt_dst_pix_format         RTPixelFormat of the output, RGB888 by default
+ *   opt_scale_mode             "bilinear" or "area"
+ *   opt_color_space            RTColorSpace, taken from kKeyVCodecColorSpace when unset
+ *   opt_color_range            RTColorRange, taken from kKeyVCodecColorRange when unset
+ *   opt_dst_layout             "interleaved" or "planar"
+ *   opt_dst_data_type          "uint8", "int8" or "float32"
+ *   opt_norm_mean / _std       "r,g,b", e.g. "123.675,116.28,103.53"
+ *   opt_quant_scale / _zp      int8 quantization of the normalized values
+ *
+ * the node is not built into the library, an application registers it
+ * with its own stub:
+ *
+ *   static RTNodeStub node_stub_filter_color_convert {
+ *       .mUid       = kStubFilterColorConvert,
+ *       .mName      = NODE_NAME_FILTER_COLOR_CONVERT,
+ *       .mVersion   = "v1.0",
+ *       .mCreateObj = createColorConvertNode,
+ *       ...
+ *   };
+ *   RT_NODE_FACTORY_REGISTER_STUB(node_stub_filter_color_convert);
+ */
+class RTColorConvertNode : public RTTaskNode {
+ public:
+    RTColorConvertNode()
+            : mWidth(0), mHeight(0), mFormat(RT_FMT_RGB888), mMode(RT_SCALE_BILINEAR),
+              mSpace(-1), mRange(-1) {}
+    virtual ~RTColorConvertNode() {}
+
+    virtual RT_RET open(RTTaskNodeContext *context) {
+        RtMetaData *options = context->options();
+        RTColorParams params;
+        rt_color_params_init(&params);
+        Config cfg;
+        const char *value = RT_NULL;
+        RT_RET ret = RTTaskNodeOptionBinder::bind(getOptions(), options, &cfg);
+        if (ret != RT_OK) {
+            return ret;
+        }
+        mWidth  = cfg.width;
+        mHeight = cfg.height;
+        mFormat = static_cast<RTPixelFormat>(cfg.format);
+        mSpace  = cfg.space;
+        mRange  = cfg.range;
+        mMode   = RT_SCALE_BILINEAR;
+        params.quantZp = cfg.quantZp;
+        if (options != RT_NULL) {
+            if (options->findCString(OPT_FILTER_SCALE_MODE, &value) && !strcmp(value, "area")) {
+                mMode = RT_SCALE_AREA;
+            }
+            if (options->findCString(OPT_FILTER_DST_LAYOUT, &value) && !strcmp(value, "planar")) {
+                params.layout = RT_COLOR_LAYOUT_PLANAR;
+            }
+            if (options->findCString(OPT_FILTER_DST_DATA_TYPE, &value)) {
+                params.dataType = !strcmp(value, "float32") ? RT_COLOR_DATA_FLOAT32
+                                : !strcmp(value, "int8") ? RT_COLOR_DATA_INT8 : RT_COLOR_DATA_UINT8;
+            }
+            if (options->findCString(OPT_FILTER_NORM_MEAN, &value)) {
+                parseTriple(value, params.mean);
+            }
+            if (options->findCString(OPT_FILTER_NORM_STD, &value)) {
+                parseTriple(value, params.std);
+            }
+            if (options->findCString(OPT_FILTER_QUANT_SCALE, &value)) {
+                params.quantScale = strtof(value, RT_NULL);
+            }
+        }
+        if (mSpace >= 0) {
+            params.space = static_cast<RTColorSpace>(mSpace);
+        }
+        if (mRange >= 0) {
+            params.range = static_cast<RTColorRange>(mRange);
+        }
+        if ((mWidth | mHeight) & 1) {
+            RT_LOGE("output size %dx%d must be even", mWidth, mHeight);
+            return RT_ERR_VALUE;
+        }
+        return mConverter.setParams(params);
+    }
+
+    virtual RT_RET process(RTTaskNodeContext *context) {
+        RTMediaBuffer *input = context->dequeInputBuffer();
+        if (input == RT_NULL) {
+            return RT_OK;
+        }
+        RTVideoFrame *frame = reinterpret_vframe(input);
+        if (frame == RT_NULL) {
+            RT_LOGE("input is not a video frame");
+            input->release();
+            return RT_ERR_VALUE;
+        }
+        followStream(input->getMetaData());
+
+        RTScaleImage src;
+        RTScaleImage dst;
+        memset(&src, 0, sizeof(src));
+        memset(&dst, 0, sizeof(dst));
+        src.data      = reinterpret_cast<UINT8 *>(input->getData());
+        src.format    = frame->getPixelFormat();
+        src.width     = frame->getWidth();
+        src.height    = frame->getHeight();
+        src.virWidth  = frame->getVirWidth();
+        src.virHeight = frame->getVirHeight();
+        src.rect      = frame->getOpRect();
+        dst.format    = mFormat;
+        dst.width     = mWidth > 0 ? mWidth : (src.rect.w > 0 ? src.rect.w : src.width) & ~1;
+        dst.height    = mHeight > 0 ? mHeight : (src.rect.h > 0 ? src.rect.h : src.height) & ~1;
+        dst.virWidth  = dst.width;
+        dst.virHeight = dst.height;
+
+        UINT32 size = mConverter.getBufferSize(&dst);
+        RTMediaBuffer *output = context->dequeOutputBuffer(RT_TRUE, size);
+        if (output == RT_NULL) {
+            input->release();
+            return RT_ERR_NO_BUFFER;
+        }
+        RT_RET ret = RT_ERR_NO_BUFFER;
+        if (output->getSize() >= size) {
+            dst.data = reinterpret_cast<UINT8 *>(output->getData());
+            ret = mConverter.convert(&src, &dst, mMode);
+        }
+        if (ret != RT_OK) {
+            RT_LOGE("convert %dx%d -> %dx%d failed, ret %d", src.width, src.height, dst.width, dst.height, ret);
+            output->release();
+            input->release();
+            return ret;
+        }
+
+        output->setRange(0, size);
+        output->getMetaData()->setInt32(kKeyFrameW, dst.width);
+        output->getMetaData()->setInt32(kKeyFrameH, dst.height);
+        RTVideoFrame *outFrame = reinterpret_vframe(output);
+        if (outFrame != RT_NULL) {
+            outFrame->setWidth(dst.width);
+            outFrame->setHeight(dst.height);
+            outFrame->setVirWidth(dst.virWidth);
+            outFrame->setVirHeight(dst.virHeight);
+            outFrame->setPixelFormat(dst.format);
+            outFrame->setPts(frame->getPts());
+            outFrame->setSeq(frame->getSeq());
+        }
+        input->release();
+        return context->queueOutputBuffer(output);
+    }
+
+    virtual RT_RET close(RTTaskNodeContext *) { return RT_OK; }
+
+ private:
+    // the integer options, bound and range checked in open().
+    typedef struct _Config {
+        INT32   width;
+        INT32   height;
+        INT32   format;
+        INT32   space;
+        INT32   range;
+        INT8    quantZp;
+    } Config;
+
+    static void addOption(std::map<std::string, RTTaskNodeOption> *options, const char *name, INT32 offset,
+                          enum RtMetaData::Type type, INT32 def, double min, double max) {
+        RTTaskNodeOption opt;
+        memset(&opt, 0, sizeof(opt));
+        opt.name           = name;
+        opt.offset         = offset;
+        opt.type           = type;
+        opt.defaultVal.i64 = def;
+        opt.min            = min;
+        opt.max            = max;
+        (*options)[name] = opt;
+    }
+
+    static std::map<std::string, RTTaskNodeOption> buildOptions() {
+        std::map<std::string, RTTaskNodeOption> options;
+        addOption(&options, OPT_FILTER_WIDTH, RT_NODE_OPT_OFFSET(Config, width), RtMetaData::TYPE_INT32,
+                  0, 0, 8192);
+        addOption(&options, OPT_FILTER_HEIGHT, RT_NODE_OPT_OFFSET(Config, height), RtMetaData::TYPE_INT32,
+                  0, 0, 8192);
+        addOption(&options, OPT_FILTER_DST_PIX_FORMAT, RT_NODE_OPT_OFFSET(Config, format), RtMetaData::TYPE_INT32,
+                  RT_FMT_RGB888, 0, 0);
+        addOption(&options, OPT_FILTER_COLOR_SPACE, RT_NODE_OPT_OFFSET(Config, space), RtMetaData::TYPE_INT32,
+                  -1, -1, RTCOL_SPC_MAX - 1);
+        addOption(&options, OPT_VIDEO_COLOR_RANGE, RT_NODE_OPT_OFFSET(Config, range), RtMetaData::TYPE_INT32,
+                  -1, -1, RTCOL_RANGE_MAX - 1);
+        addOption(&options, OPT_FILTER_QUANT_ZP, RT_NODE_OPT_OFFSET(Config, quantZp), RtMetaData::TYPE_INT8,
+                  0, 0, 0);
+        return options;
+    }
+
+    static const std::map<std::string, RTTaskNodeOption>& getOptions() {
+        static const std::map<std::string, RTTaskNodeOption> options = buildOptions();
+        return options;
+    }
+
+    static void parseTriple(const char *value, float *out) {
+        char *end = RT_NULL;
+        for (INT32 c = 0; c < 3 && value != RT_NULL && *value; c++) {
+            out[c] = strtof(value, &end);
+            value = (*end == ',') ? end + 1 : end;
+        }
+    }
+
+    // without opt_color_space / opt_color_range the matrix follows the stream.
+    void followStream(RtMetaData *meta) {
+        RTColorParams params = mConverter.getParams();
+        INT32 value = 0;
+        if (mSpace < 0 && meta->findInt32(kKeyVCodecColorSpace, &value)) {
+            params.space = static_cast<RTColorSpace>(value);
+        }
+        if (mRange < 0 && meta->findInt32(kKeyVCodecColorRange, &value)) {
+            params.range = static_cast<RTColorRange>(value);
+        }
+        if (params.space != mConverter.getParams().space || params.range != mConverter.getParams().range) {
+            mConverter.setParams(params);
+        }
+    }
+
+ private:
+    INT32               mWidth;
+    INT32               mHeight;
+    RTPixelFormat       mFormat;
+    RTScaleMode         mMode;
+    INT32               mSpace;         // < 0: follow the stream
+    INT32               mRange;
+    RTColorConverter    mConverter;
+};
+
+static inline RTTaskNode* createColorConvertNode() {
+    return new RTColorConvertNode();
+}
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTCOLORCONVERT_H_
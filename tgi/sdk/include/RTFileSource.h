@@ -0,0 +1,351 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: mmap and buffered chunk reader of the fread node
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTFILESOURCE_H_
+#define SRC_RT_MEDIA_INCLUDE_RTFILESOURCE_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <atomic>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "RTMediaBuffer.h"
+#include "RTNodeCommon.h"
+
+#define RT_FILE_MAP_WINDOW      (256 << 20)     // bytes mapped at once, 32 bit processes cannot map GB files
+#define RT_FILE_READAHEAD       4               // chunks advised ahead of the reader
+
+typedef enum _RTFileReadMode {
+    RT_FILE_READ_AUTO = 0,          // mmap regular files, buffered reads for pipes and devices
+    RT_FILE_READ_MMAP,
+    RT_FILE_READ_BUFFERED,
+} RTFileReadMode;
+
+/*
+ * one chunk handed out by RTFileSource. data stays valid until release(),
+ * it is read only when mapped. a chunk can be shorter than the read size
+ * at the end of the file.
+ */
+typedef struct _RTFileChunk {
+    const void *data;
+    UINT32      size;
+    INT64       offset;     // in the file
+    INT32       loop;       // times the file wrapped before this chunk
+    void       *cookie;     // keeps the backing memory alive
+} RTFileChunk;
+
+/*
+ * reads a file as a sequence of fixed size chunks, e.g. frames of a raw
+ * yuv capture.
+ *
+ * regular files are mapped in windows of RT_FILE_MAP_WINDOW and chunks
+ * point straight into the page cache, so nothing is copied in user space.
+ * every window is refcounted by the chunks inside it and unmapped when the
+ * reader has moved on and the last chunk is released, buffers may be held
+ * downstream as long as needed. the window is advised MADV_SEQUENTIAL and
+ * the next chunks MADV_WILLNEED as the reader goes, so the kernel reads
+ * ahead of the graph; ranges outside the current window (the start of the
+ * file when looping) are advised through posix_fadvise.
+ *
+ * pipes, devices and RT_FILE_READ_BUFFERED read() each chunk into its own
+ * heap block, which is handed out the same way without a second copy.
+ *
+ *   RTFileSource source;
+ *   source.open("/data/capture.yuv", 1920 * 1080 * 3 / 2, RT_FILE_READ_AUTO, RT_TRUE);
+ *   RTFileChunk chunk;
+ *   while (source.read(&chunk) == RT_OK) {
+ *       RTMediaBuffer *buffer = RTFileSource::wrap(&chunk);    // owns the chunk from here
+ *       ...
+ *   }
+ */
+class RTFileSource {
+ public:
+    RTFileSource()
+            : mFd(-1), mFileSize(0), mChunkSize(0), mReadahead(RT_FILE_READAHEAD), mWindowSize(RT_FILE_MAP_WINDOW),
+              mLoop(RT_FALSE), mMapped(RT_FALSE), mOffset(0), mLoops(0), mWindow(RT_NULL) {}
+    ~RTFileSource() { close(); }
+
+    RT_RET open(const char *path, UINT32 chunkSize, RTFileReadMode mode, RT_BOOL loop) {
+        struct stat st;
+        close();
+        if (path == RT_NULL || chunkSize == 0) {
+            return RT_ERR_VALUE;
+        }
+        mFd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (mFd < 0) {
+            RT_LOGE("open %s failed, %s", path, strerror(errno));
+            return RT_ERR_OPEN_FILE;
+        }
+        if (fstat(mFd, &st) != 0) {
+            close();
+            return RT_ERR_OPEN_FILE;
+        }
+        mChunkSize = chunkSize;
+        mLoop      = loop;
+        mFileSize  = st.st_size;
+        mMapped    = (S_ISREG(st.st_mode) && mFileSize > 0 && mode != RT_FILE_READ_BUFFERED) ? RT_TRUE : RT_FALSE;
+        if (mode == RT_FILE_READ_MMAP && !mMapped) {
+            RT_LOGE("%s can not be mapped, read it buffered", path);
+        }
+        if (!mMapped && loop && lseek(mFd, 0, SEEK_CUR) < 0) {
+            RT_LOGE("%s is not seekable, it plays once", path);
+            mLoop = RT_FALSE;
+        }
+        if (mMapped) {
+            advise(0, static_cast<INT64>(mChunkSize) * mReadahead);
+        }
+        return RT_OK;
+    }
+
+    // node_source_uri, opt_read_size, opt_read_mode, opt_read_ahead and opt_read_loop.
+    RT_RET open(RtMetaData *options) {
+        const char *uri = RT_NULL;
+        INT32 size = 0, mode = RT_FILE_READ_AUTO, loop = 0;
+        if (options == RT_NULL || !options->findCString(OPT_NODE_SOURCE_URI, &uri)
+                || !options->findInt32(OPT_FILE_READ_SIZE, &size) || size <= 0) {
+            return RT_ERR_VALUE;
+        }
+        options->findInt32(OPT_FILE_READ_MODE, &mode);
+        options->findInt32(OPT_FILE_READ_LOOP, &loop);
+        options->findInt32(OPT_FILE_READ_AHEAD, &mReadahead);
+        return open(uri, static_cast<UINT32>(size), static_cast<RTFileReadMode>(mode), loop ? RT_TRUE : RT_FALSE);
+    }
+
+    // chunks advised ahead of the reader, 0 leaves readahead to the kernel.
+    void setReadahead(INT32 chunks) { mReadahead = RT_MAX(chunks, 0); }
+    // bytes of the next mappings, a window always holds at least one chunk.
+    void setWindowSize(UINT32 bytes) { mWindowSize = RT_MAX(bytes, 1u); }
+    RT_BOOL isMapped() const { return mMapped; }
+    INT64 getFileSize() const { return mFileSize; }
+
+    // RT_ERR_END_OF_STREAM once the file is done and loop is off.
+    RT_RET read(RTFileChunk *chunk) {
+        if (mFd < 0 || chunk == RT_NULL) {
+            return RT_ERR_NULL_PTR;
+        }
+        return mMapped ? readMapped(chunk) : readBuffered(chunk);
+    }
+
+    static void release(RTFileChunk *chunk) {
+        if (chunk != RT_NULL && chunk->cookie != RT_NULL) {
+            unref(reinterpret_cast<Window *>(chunk->cookie));
+            chunk->cookie = RT_NULL;
+            chunk->data   = RT_NULL;
+        }
+    }
+
+    /*
+     * a read only RTMediaBuffer on the chunk, which releases the chunk when
+     * the buffer is freed.
+     */
+    static RTMediaBuffer *wrap(RTFileChunk *chunk) {
+        RTMediaBuffer *buffer = rt_media_buffer_wrap(const_cast<void *>(chunk->data), chunk->size, onBufferFree,
+                                                     chunk->cookie);
+        chunk->cookie = RT_NULL;
+        return buffer;
+    }
+
+    void close() {
+        if (mWindow != RT_NULL) {
+            unref(mWindow);
+            mWindow = RT_NULL;
+        }
+        if (mFd >= 0) {
+            ::close(mFd);
+            mFd = -1;
+        }
+        mFileSize = 0;
+        mOffset   = 0;
+        mLoops    = 0;
+    }
+
+ private:
+    struct Window {
+        std::atomic<INT32>  refs;
+        UINT8              *base;
+        size_t              size;
+        INT64               start;      // file offset of base
+        RT_BOOL             mapped;
+    };
+
+    static void unref(Window *window) {
+        if (window->refs.fetch_sub(1) != 1) {
+            return;
+        }
+        if (window->mapped) {
+            munmap(window->base, window->size);
+        } else {
+            free(window->base);
+        }
+        delete window;
+    }
+
+    static RT_RET onBufferFree(void *cookie) {
+        if (cookie != RT_NULL) {
+            unref(reinterpret_cast<Window *>(cookie));
+        }
+        return RT_OK;
+    }
+
+    static size_t pageSize() {
+        static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return page;
+    }
+
+    RT_BOOL wrapAround() {
+        if (!mLoop) {
+            return RT_FALSE;
+        }
+        mOffset = 0;
+        mLoops++;
+        return RT_TRUE;
+    }
+
+    // hints the kernel to read [offset, offset + length) of the file.
+    void advise(INT64 offset, INT64 length) {
+        if (length <= 0) {
+            return;
+        }
+        if (mLoop && offset + length > mFileSize) {
+            advise(0, offset + length - mFileSize);
+        }
+        length = RT_MIN(length, mFileSize - offset);
+        if (length <= 0) {
+            return;
+        }
+        if (mWindow != RT_NULL && offset >= mWindow->start
+                && offset + length <= mWindow->start + static_cast<INT64>(mWindow->size)) {
+            INT64 begin = offset & ~static_cast<INT64>(pageSize() - 1);
+            madvise(mWindow->base + (begin - mWindow->start), static_cast<size_t>(offset + length - begin),
+                    MADV_WILLNEED);
+        } else {
+            posix_fadvise(mFd, offset, length, POSIX_FADV_WILLNEED);
+        }
+    }
+
+    RT_RET mapWindow(INT64 offset, UINT32 length) {
+        const INT64 start = offset & ~static_cast<INT64>(pageSize() - 1);
+        const INT64 want  = RT_MAX(static_cast<INT64>(mWindowSize), offset + length - start);
+        const size_t size = static_cast<size_t>(RT_MIN(want, mFileSize - start));
+        void *base = mmap(RT_NULL, size, PROT_READ, MAP_SHARED, mFd, start);
+        if (base == MAP_FAILED) {
+            RT_LOGE("mmap %lld bytes at %lld failed, %s", (long long)size, (long long)start, strerror(errno));
+            return RT_ERR_MALLOC;
+        }
+        madvise(base, size, MADV_SEQUENTIAL);
+        if (mWindow != RT_NULL) {
+            unref(mWindow);
+        }
+        mWindow = new Window();
+        mWindow->refs   = 1;            // the reader's reference
+        mWindow->base   = reinterpret_cast<UINT8 *>(base);
+        mWindow->size   = size;
+        mWindow->start  = start;
+        mWindow->mapped = RT_TRUE;
+        return RT_OK;
+    }
+
+    RT_RET readMapped(RTFileChunk *chunk) {
+        if (mOffset >= mFileSize && !wrapAround()) {
+            return RT_ERR_END_OF_STREAM;
+        }
+        const UINT32 size = static_cast<UINT32>(RT_MIN(static_cast<INT64>(mChunkSize), mFileSize - mOffset));
+        if (mWindow == RT_NULL || mOffset < mWindow->start
+                || mOffset + size > mWindow->start + static_cast<INT64>(mWindow->size)) {
+            RT_RET ret = mapWindow(mOffset, size);
+            if (ret != RT_OK) {
+                return ret;
+            }
+        }
+        mWindow->refs.fetch_add(1);
+        chunk->data   = mWindow->base + (mOffset - mWindow->start);
+        chunk->size   = size;
+        chunk->offset = mOffset;
+        chunk->loop   = mLoops;
+        chunk->cookie = mWindow;
+        mOffset += size;
+        if (mReadahead > 0) {
+            // the chunk at the far end of the readahead, the ones before were advised already.
+            const INT64 ahead = static_cast<INT64>(mChunkSize) * (mReadahead - 1);
+            advise(mOffset + ahead, mChunkSize);
+        }
+        return RT_OK;
+    }
+
+    RT_RET readBuffered(RTFileChunk *chunk) {
+        Window *window = new Window();
+        window->base = reinterpret_cast<UINT8 *>(malloc(mChunkSize));
+        if (window->base == RT_NULL) {
+            delete window;
+            return RT_ERR_MALLOC;
+        }
+        window->refs   = 1;
+        window->size   = mChunkSize;
+        window->mapped = RT_FALSE;
+        UINT32 filled = 0;
+        RT_BOOL wrapped = RT_FALSE;
+        while (filled < mChunkSize) {
+            ssize_t ret = ::read(mFd, window->base + filled, mChunkSize - filled);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret > 0) {
+                filled += static_cast<UINT32>(ret);
+                continue;
+            }
+            // a short chunk ends the pass, the next read starts from the top.
+            if (ret < 0 || filled > 0 || wrapped || !mLoop || lseek(mFd, 0, SEEK_SET) != 0) {
+                break;
+            }
+            wrapped = wrapAround();
+        }
+        if (filled == 0) {
+            unref(window);
+            return RT_ERR_END_OF_STREAM;
+        }
+        window->start = mOffset;
+        chunk->data   = window->base;
+        chunk->size   = filled;
+        chunk->offset = mOffset;
+        chunk->loop   = mLoops;
+        chunk->cookie = window;
+        mOffset += filled;
+        return RT_OK;
+    }
+
+ private:
+    INT32           mFd;
+    INT64           mFileSize;
+    UINT32          mChunkSize;
+    INT32           mReadahead;
+    UINT32          mWindowSize;
+    RT_BOOL         mLoop;
+    RT_BOOL         mMapped;
+    INT64           mOffset;        // of the next chunk
+    INT32           mLoops;
+    Window         *mWindow;        // current mapping, the reader holds one reference
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTFILESOURCE_H_
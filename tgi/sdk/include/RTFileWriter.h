@@ -0,0 +1,464 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: write-behind file writer of the fwrite node
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTFILEWRITER_H_
+#define SRC_RT_MEDIA_INCLUDE_RTFILEWRITER_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include <deque>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_histogram.h"
+#include "rt_metadata.h"
+#include "rt_mutex.h"
+#include "rt_thread.h"
+#include "RTNodeCommon.h"
+#include "RTStatsServer.h"
+
+#define RT_FILE_WRITE_BATCH         (4 << 20)   // bytes of one pwritev at most
+#define RT_FILE_WRITE_ALIGN         (64 << 10)  // batches end on multiples of this file offset
+#define RT_FILE_WRITE_BUDGET        (32 << 20)  // bytes queued at most
+#define RT_FILE_WRITE_DELAY_US      200000      // queued data waits at most this long for a batch
+#define RT_FILE_WRITE_MAX_IOV       64
+
+typedef enum _RTFileSyncPolicy {
+    RT_FILE_SYNC_NONE = 0,          // leave it to the kernel writeback
+    RT_FILE_SYNC_CLOSE,             // fdatasync once at close
+    RT_FILE_SYNC_PERIODIC,          // fdatasync every opt_sync_bytes, and at close
+} RTFileSyncPolicy;
+
+// called on the io thread once the data is in the file, or dropped on an error.
+typedef void (*RTFileWriteDone)(void *cookie);
+
+typedef struct _RTFileWriterStats {
+    UINT64              queuedBytes;
+    UINT64              maxQueuedBytes;
+    UINT64              writtenBytes;
+    UINT64              droppedBytes;   // over budget in drop mode, or after an io error
+    UINT64              blockedUs;      // the producer waited for budget
+    RtHistogramSummary  writeUs;        // per pwritev
+    RtHistogramSummary  syncUs;         // per fdatasync
+} RTFileWriterStats;
+
+/*
+ * write-behind of the fwrite node (opt_write_async): write() only queues
+ * a reference to the data and returns, a dedicated io thread coalesces the
+ * queue into pwritev calls of up to RT_FILE_WRITE_BATCH that end on
+ * RT_FILE_WRITE_ALIGN file offsets, so a slow card sees few large aligned
+ * writes and the graph thread never waits on it.
+ *
+ * the queue is bounded by a byte budget. when it is full write() waits for
+ * room, or drops the data when setDropWhenFull() is on, which keeps the
+ * encoder running and loses the file data instead. data younger than
+ * RT_FILE_WRITE_DELAY_US may wait for a batch to fill; flush() and close()
+ * write everything out.
+ *
+ * io_uring is not used, a batch already costs one syscall and pwritev
+ * works on every kernel the sdk runs on.
+ *
+ *   RTFileWriter writer;
+ *   writer.open("/mnt/sdcard/out.h264", RT_FALSE);
+ *   buffer->addRefs();
+ *   writer.write(buffer->getData(), buffer->getLength(), onWritten, buffer);
+ *   ...
+ *   writer.close();
+ */
+class RTFileWriter {
+ public:
+    RTFileWriter()
+            : mFd(-1), mThread(RT_NULL), mRunning(RT_FALSE), mFlushing(0), mWaiting(0), mDropWhenFull(RT_FALSE),
+              mBudget(RT_FILE_WRITE_BUDGET), mBatch(RT_FILE_WRITE_BATCH), mSyncPolicy(RT_FILE_SYNC_NONE),
+              mSyncBytes(0), mOffset(0), mSinceSync(0), mError(0), mQueuedBytes(0), mMaxQueuedBytes(0),
+              mWrittenBytes(0), mDroppedBytes(0), mBlockedUs(0) {}
+    ~RTFileWriter() { close(); }
+
+    // set before open().
+    void setBudget(UINT32 bytes) { mBudget = RT_MAX(bytes, 1u); }
+    void setBatch(UINT32 bytes) { mBatch = RT_MAX(bytes, static_cast<UINT32>(RT_FILE_WRITE_ALIGN)); }
+    void setDropWhenFull(RT_BOOL drop) { mDropWhenFull = drop; }
+    void setSyncPolicy(RTFileSyncPolicy policy, UINT64 bytes) {
+        mSyncPolicy = policy;
+        mSyncBytes  = bytes;
+    }
+
+    // opt_write_budget, opt_write_batch, opt_write_drop, opt_sync_policy and opt_sync_bytes.
+    void loadOptions(RtMetaData *options) {
+        INT32 value = 0, bytes = 0;
+        if (options == RT_NULL) {
+            return;
+        }
+        if (options->findInt32(OPT_FILE_WRITE_BUDGET, &value) && value > 0) {
+            setBudget(static_cast<UINT32>(value));
+        }
+        if (options->findInt32(OPT_FILE_WRITE_BATCH, &value) && value > 0) {
+            setBatch(static_cast<UINT32>(value));
+        }
+        if (options->findInt32(OPT_FILE_WRITE_DROP, &value)) {
+            setDropWhenFull(value ? RT_TRUE : RT_FALSE);
+        }
+        if (options->findInt32(OPT_FILE_SYNC_POLICY, &value)) {
+            options->findInt32(OPT_FILE_SYNC_BYTES, &bytes);
+            setSyncPolicy(static_cast<RTFileSyncPolicy>(value), static_cast<UINT64>(RT_MAX(bytes, 0)));
+        }
+    }
+
+    RT_RET open(const char *path, RT_BOOL append) {
+        close();
+        if (path == RT_NULL) {
+            return RT_ERR_VALUE;
+        }
+        mFd = ::open(path, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+        if (mFd < 0) {
+            RT_LOGE("open %s failed, %s", path, strerror(errno));
+            return RT_ERR_OPEN_FILE;
+        }
+        mOffset    = append ? lseek(mFd, 0, SEEK_END) : 0;
+        mSinceSync = 0;
+        mError     = 0;
+        mRunning   = RT_TRUE;
+        mThread    = new RtThread(threadLoop, this);
+        mThread->setName("rt_fwrite");
+        if (!mThread->start()) {
+            RT_LOGE("fwrite thread start failed");
+            mRunning = RT_FALSE;
+            rt_safe_delete(mThread);
+            ::close(mFd);
+            mFd = -1;
+            return RT_ERR_BAD;
+        }
+        return RT_OK;
+    }
+
+    /*
+     * queues size bytes at data, which must stay valid until done(cookie)
+     * is called. RT_ERR_NO_BUFFER when the data was dropped for the budget
+     * and RT_ERR_BAD after an io error; done is not called in both cases,
+     * the caller still owns the data.
+     */
+    RT_RET write(const void *data, UINT32 size, RTFileWriteDone done, void *cookie) {
+        if (data == RT_NULL || size == 0) {
+            return RT_ERR_VALUE;
+        }
+        RtMutex::RtAutolock autoLock(mLock);
+        if (!mRunning || mError != 0) {
+            return RT_ERR_BAD;
+        }
+        if (mQueuedBytes > 0 && mQueuedBytes + size > mBudget) {
+            if (mDropWhenFull) {
+                mDroppedBytes += size;
+                return RT_ERR_NO_BUFFER;
+            }
+            UINT64 start = RtTime::getRelativeTimeUs();
+            mWaiting++;
+            mWorkCond.signal();
+            while (mQueuedBytes > 0 && mQueuedBytes + size > mBudget && mError == 0) {
+                mSpaceCond.wait(mLock);
+            }
+            mWaiting--;
+            mBlockedUs += RtTime::getRelativeTimeUs() - start;
+            if (mError != 0) {
+                return RT_ERR_BAD;
+            }
+        }
+        Entry entry;
+        entry.data     = reinterpret_cast<const UINT8 *>(data);
+        entry.size     = size;
+        entry.done     = done;
+        entry.cookie   = cookie;
+        entry.queuedUs = RtTime::getRelativeTimeUs();
+        mQueue.push_back(entry);
+        mQueuedBytes += size;
+        mMaxQueuedBytes = RT_MAX(mMaxQueuedBytes, mQueuedBytes);
+        if (mQueuedBytes >= batchSize()) {
+            mWorkCond.signal();
+        }
+        return RT_OK;
+    }
+
+    // queues a copy of the data, for callers which can not keep it alive.
+    RT_RET writeCopy(const void *data, UINT32 size) {
+        void *copy = malloc(size);
+        if (copy == RT_NULL) {
+            return RT_ERR_MALLOC;
+        }
+        memcpy(copy, data, size);
+        RT_RET ret = write(copy, size, free, copy);
+        if (ret != RT_OK) {
+            free(copy);
+        }
+        return ret;
+    }
+
+    // waits until everything queued so far is in the file.
+    RT_RET flush() {
+        RtMutex::RtAutolock autoLock(mLock);
+        mFlushing++;
+        mWorkCond.signal();
+        while (mQueuedBytes > 0 && mError == 0) {
+            mSpaceCond.wait(mLock);
+        }
+        mFlushing--;
+        return mError ? RT_ERR_BAD : RT_OK;
+    }
+
+    RT_RET close() {
+        RtThread *thread = RT_NULL;
+        {
+            RtMutex::RtAutolock autoLock(mLock);
+            if (mThread == RT_NULL) {
+                return RT_OK;
+            }
+            thread   = mThread;
+            mThread  = RT_NULL;
+            mRunning = RT_FALSE;
+            mWorkCond.signal();
+        }
+        // the io thread drains the queue before it leaves.
+        thread->join();
+        delete thread;
+        if (mSyncPolicy != RT_FILE_SYNC_NONE && mError == 0) {
+            sync();
+        }
+        ::close(mFd);
+        mFd = -1;
+        return mError ? RT_ERR_BAD : RT_OK;
+    }
+
+    void getStats(RTFileWriterStats *stats) {
+        RtMutex::RtAutolock autoLock(mLock);
+        stats->queuedBytes    = mQueuedBytes;
+        stats->maxQueuedBytes = mMaxQueuedBytes;
+        stats->writtenBytes   = mWrittenBytes;
+        stats->droppedBytes   = mDroppedBytes;
+        stats->blockedUs      = mBlockedUs;
+        mWriteUs.summary(&stats->writeUs);
+        mSyncUs.summary(&stats->syncUs);
+    }
+
+    // for RTStatsServer::registerProvider().
+    void writeStats(RTJsonWriter *json) {
+        RTFileWriterStats stats;
+        getStats(&stats);
+        json->value("queued_bytes", stats.queuedBytes)
+             .value("max_queued_bytes", stats.maxQueuedBytes)
+             .value("written_bytes", stats.writtenBytes)
+             .value("dropped_bytes", stats.droppedBytes)
+             .value("blocked_us", stats.blockedUs)
+             .histogram("write_us", stats.writeUs)
+             .histogram("sync_us", stats.syncUs);
+    }
+
+ private:
+    struct Entry {
+        const UINT8        *data;
+        UINT32              size;       // left to write, data moves along
+        RTFileWriteDone     done;
+        void               *cookie;
+        UINT64              queuedUs;
+    };
+
+    // a batch fills at most half the budget, so producers can queue the next one meanwhile.
+    UINT32 batchSize() const {
+        return RT_MAX(RT_MIN(mBatch, mBudget / 2), 1u);
+    }
+
+    static void* threadLoop(void *arg) {
+        reinterpret_cast<RTFileWriter *>(arg)->run();
+        return RT_NULL;
+    }
+
+    /*
+     * a batch is cut where the file offset reaches a multiple of the
+     * alignment, unless it is a flush or the queue ends before that.
+     */
+    UINT32 collect(std::vector<struct iovec> *iov, RT_BOOL all) {
+        iov->clear();
+        UINT64 total = 0;
+        const UINT32 batch = batchSize();
+        for (size_t i = 0; i < mQueue.size() && iov->size() < RT_FILE_WRITE_MAX_IOV && total < batch; i++) {
+            struct iovec vec;
+            vec.iov_base = const_cast<UINT8 *>(mQueue[i].data);
+            vec.iov_len  = static_cast<size_t>(RT_MIN(static_cast<UINT64>(mQueue[i].size), batch - total));
+            iov->push_back(vec);
+            total += vec.iov_len;
+        }
+        UINT64 cut = (mOffset + total) % RT_FILE_WRITE_ALIGN;
+        if (!all && cut < total) {
+            total -= cut;
+            while (cut > 0) {
+                struct iovec &last = iov->back();
+                if (last.iov_len > cut) {
+                    last.iov_len -= cut;
+                    break;
+                }
+                cut -= last.iov_len;
+                iov->pop_back();
+            }
+        }
+        return static_cast<UINT32>(total);
+    }
+
+    // returns the bytes written, stops at the first error.
+    UINT32 writeOut(std::vector<struct iovec> *iov, UINT32 total, INT32 *error) {
+        UINT32 written = 0;
+        size_t first = 0;
+        while (written < total) {
+            ssize_t ret = pwritev(mFd, &(*iov)[first], static_cast<INT32>(iov->size() - first), mOffset + written);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret <= 0) {
+                *error = (ret < 0) ? errno : EIO;
+                RT_LOGE("fwrite at %lld failed, %s", (long long)(mOffset + written), strerror(*error));
+                break;
+            }
+            written += static_cast<UINT32>(ret);
+            // a short write, skip what went out.
+            size_t skip = static_cast<size_t>(ret);
+            while (first < iov->size() && skip >= (*iov)[first].iov_len) {
+                skip -= (*iov)[first].iov_len;
+                first++;
+            }
+            if (first < iov->size()) {
+                (*iov)[first].iov_base = reinterpret_cast<UINT8 *>((*iov)[first].iov_base) + skip;
+                (*iov)[first].iov_len -= skip;
+            }
+        }
+        return written;
+    }
+
+    void sync() {
+        UINT64 start = RtTime::getRelativeTimeUs();
+        if (fdatasync(mFd) != 0) {
+            RT_LOGE("fdatasync failed, %s", strerror(errno));
+        }
+        mSyncUs.record(RtTime::getRelativeTimeUs() - start);
+        mSinceSync = 0;
+    }
+
+    /*
+     * takes written bytes off the queue, fully written entries are returned
+     * in done. after an error everything left is dropped.
+     */
+    void complete(UINT32 written, std::vector<Entry> *done) {
+        mOffset       += written;
+        mQueuedBytes  -= written;
+        mWrittenBytes += written;
+        while (!mQueue.empty() && (written > 0 || mQueue.front().size == 0)) {
+            Entry &entry = mQueue.front();
+            const UINT32 step = RT_MIN(entry.size, written);
+            entry.data += step;
+            entry.size -= step;
+            written    -= step;
+            if (entry.size != 0) {
+                break;
+            }
+            done->push_back(entry);
+            mQueue.pop_front();
+        }
+        if (mError != 0) {
+            while (!mQueue.empty()) {
+                mDroppedBytes += mQueue.front().size;
+                mQueuedBytes  -= mQueue.front().size;
+                done->push_back(mQueue.front());
+                mQueue.pop_front();
+            }
+        }
+    }
+
+    void run() {
+        std::vector<struct iovec> iov;
+        std::vector<Entry> done;
+        mLock.lock();
+        while (RT_TRUE) {
+            const RT_BOOL all = (!mRunning || mFlushing > 0) ? RT_TRUE : RT_FALSE;
+            const RT_BOOL stale = (!mQueue.empty()
+                                   && RtTime::getRelativeTimeUs() - mQueue.front().queuedUs >= RT_FILE_WRITE_DELAY_US)
+                                   ? RT_TRUE : RT_FALSE;
+            UINT32 total = 0;
+            if (!mQueue.empty() && (all || stale || mWaiting > 0 || mQueuedBytes >= batchSize())) {
+                total = collect(&iov, (all || stale) ? RT_TRUE : RT_FALSE);
+            }
+            if (total == 0) {
+                if (!mRunning && mQueue.empty()) {
+                    break;
+                }
+                mWorkCond.timedwait(mLock, RT_FILE_WRITE_DELAY_US / 2);
+                continue;
+            }
+            mLock.unlock();
+            INT32 error = 0;
+            UINT64 start = RtTime::getRelativeTimeUs();
+            UINT32 written = writeOut(&iov, total, &error);
+            mWriteUs.record(RtTime::getRelativeTimeUs() - start);
+            mSinceSync += written;
+            if (mSyncPolicy == RT_FILE_SYNC_PERIODIC && mSyncBytes > 0 && mSinceSync >= mSyncBytes) {
+                sync();
+            }
+            mLock.lock();
+            mError = error ? error : mError;
+            complete(written, &done);
+            mSpaceCond.broadcast();
+            mLock.unlock();
+            for (size_t i = 0; i < done.size(); i++) {
+                if (done[i].done != RT_NULL) {
+                    done[i].done(done[i].cookie);
+                }
+            }
+            done.clear();
+            mLock.lock();
+        }
+        mSpaceCond.broadcast();
+        mLock.unlock();
+    }
+
+ private:
+    INT32               mFd;
+    RtThread           *mThread;
+    RtMutex             mLock;
+    RtCondition         mWorkCond;      // io thread waits for data
+    RtCondition         mSpaceCond;     // producers wait for budget, flush() for an empty queue
+    RT_BOOL             mRunning;
+    INT32               mFlushing;
+    INT32               mWaiting;       // producers blocked on the budget
+    RT_BOOL             mDropWhenFull;
+    UINT32              mBudget;
+    UINT32              mBatch;
+    RTFileSyncPolicy    mSyncPolicy;
+    UINT64              mSyncBytes;
+    UINT64              mOffset;        // file offset of the queue head
+    UINT64              mSinceSync;
+    INT32               mError;         // errno of the failed write
+    std::deque<Entry>   mQueue;
+    UINT64              mQueuedBytes;
+    UINT64              mMaxQueuedBytes;
+    UINT64              mWrittenBytes;
+    UINT64              mDroppedBytes;
+    UINT64              mBlockedUs;
+    RtHistogram         mWriteUs;
+    RtHistogram         mSyncUs;
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTFILEWRITER_H_
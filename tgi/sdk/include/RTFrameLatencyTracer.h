@@ -0,0 +1,239 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: end-to-end per-frame latency of task graph
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTFRAMELATENCYTRACER_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTFRAMELATENCYTRACER_H_
+
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "rt_histogram.h"
+#include "RTMediaMetaKeys.h"
+
+#define RT_FRAME_LATENCY_ENV_ENABLE     "rt_frame_latency"
+#define RT_FRAME_LATENCY_MAX_PATHS      128
+#define RT_FRAME_LATENCY_NAME_LEN       64
+
+typedef struct _RTFrameLatencyStat {
+    UINT64              graphUid;
+    INT32               sourceId;
+    INT32               sinkId;
+    std::string         path;       // name given to linkPath(), "source->sink"
+    RtHistogramSummary  latency;    // capture to sink, in us
+} RTFrameLatencyStat;
+
+/*
+ * follows every frame from its source to the sinks:
+ *   linkPath()   when the graph links a source to a sink, once per path
+ *   stamp()      at the source node, sets kKeyFrameCaptureUs, kKeyFrameTraceId,
+ *                kKeyFrameTraceGraph and kKeyFrameTraceSrc
+ *   propagate()  wherever a node creates a new buffer from an input one,
+ *                e.g. clone_vframe copies, converters and fan-out
+ *   complete()   at sink nodes and observed output streams
+ *
+ * paths are keyed by graph uid and node ids, so two graphs with nodes of
+ * the same names keep apart. names are only built at link time: a frame
+ * costs a few metadata lookups and a scan of the linked paths, no string
+ * and no lock. frames of a path that was never linked are only counted.
+ * queryStat() of the graph reads the latencies back with collect().
+ */
+class RTFrameLatencyTracer {
+ public:
+    static RTFrameLatencyTracer* instance() {
+        static RTFrameLatencyTracer tracer;
+        return &tracer;
+    }
+
+    RT_BOOL isEnable() const { return mEnable.load(std::memory_order_relaxed); }
+    void    setEnable(RT_BOOL enable) { mEnable.store(enable, std::memory_order_relaxed); }
+
+    /*
+     * interns the path, returns its id or -1 when RT_FRAME_LATENCY_MAX_PATHS
+     * paths are linked. linking a path again returns the same id; paths
+     * live as long as the process, their histograms are recorded unlocked.
+     */
+    INT32 linkPath(UINT64 graphUid, INT32 sourceId, INT32 sinkId, const char *name) {
+        RtMutex::RtAutolock autoLock(mLock);
+        INT32 count = mPathCount.load(std::memory_order_relaxed);
+        INT32 id = findPath(graphUid, sourceId, sinkId, count);
+        if (id >= 0 || count >= RT_FRAME_LATENCY_MAX_PATHS) {
+            return id;
+        }
+        Path &path = mPaths[count];
+        path.graphUid = graphUid;
+        path.sourceId = sourceId;
+        path.sinkId   = sinkId;
+        snprintf(path.name, sizeof(path.name), "%s", name ? name : "unknown");
+        path.histogram.reset(new RtHistogram());
+        mPathCount.store(count + 1, std::memory_order_release);
+        return count;
+    }
+
+    /*
+     * captureUs 0 takes the current time. a capture time which came with
+     * the frame, e.g. the v4l2 timestamp, must be on the same monotonic
+     * clock as RtTime::getRelativeTimeUs().
+     */
+    void stamp(RtMetaData *meta, UINT64 graphUid, INT32 sourceId, INT64 captureUs = 0) {
+        if (!isEnable() || meta == RT_NULL) {
+            return;
+        }
+        if (captureUs <= 0) {
+            captureUs = static_cast<INT64>(RtTime::getRelativeTimeUs());
+        }
+        meta->setInt64(kKeyFrameCaptureUs, captureUs);
+        meta->setInt64(kKeyFrameTraceId, mNextTraceId.fetch_add(1, std::memory_order_relaxed));
+        meta->setInt64(kKeyFrameTraceGraph, static_cast<INT64>(graphUid));
+        meta->setInt32(kKeyFrameTraceSrc, sourceId);
+    }
+
+    // copies the trace of src into dst, a no-op for untraced frames.
+    void propagate(const RtMetaData *src, RtMetaData *dst) {
+        if (!isEnable() || src == RT_NULL || dst == RT_NULL || src == dst) {
+            return;
+        }
+        INT64 captureUs = 0;
+        INT64 value64   = 0;
+        INT32 value     = 0;
+        if (!src->findInt64(kKeyFrameCaptureUs, &captureUs)) {
+            return;
+        }
+        dst->setInt64(kKeyFrameCaptureUs, captureUs);
+        if (src->findInt64(kKeyFrameTraceId, &value64)) {
+            dst->setInt64(kKeyFrameTraceId, value64);
+        }
+        if (src->findInt64(kKeyFrameTraceGraph, &value64)) {
+            dst->setInt64(kKeyFrameTraceGraph, value64);
+        }
+        if (src->findInt32(kKeyFrameTraceSrc, &value)) {
+            dst->setInt32(kKeyFrameTraceSrc, value);
+        }
+    }
+
+    // records the latency of the frame at the sink, returns it or -1 if untraced.
+    INT64 complete(const RtMetaData *meta, INT32 sinkId) {
+        if (!isEnable() || meta == RT_NULL) {
+            return -1;
+        }
+        INT64 captureUs = 0;
+        INT64 graphUid  = 0;
+        INT32 sourceId  = -1;
+        if (!meta->findInt64(kKeyFrameCaptureUs, &captureUs)) {
+            return -1;
+        }
+        meta->findInt64(kKeyFrameTraceGraph, &graphUid);
+        meta->findInt32(kKeyFrameTraceSrc, &sourceId);
+
+        INT64 now     = static_cast<INT64>(RtTime::getRelativeTimeUs());
+        INT64 latency = now > captureUs ? now - captureUs : 0;
+        INT32 id = findPath(static_cast<UINT64>(graphUid), sourceId, sinkId,
+                            mPathCount.load(std::memory_order_acquire));
+        if (id >= 0) {
+            mPaths[id].histogram->record(static_cast<UINT64>(latency));
+        } else {
+            mUnlinked.fetch_add(1, std::memory_order_relaxed);
+        }
+        return latency;
+    }
+
+    INT32 collect(std::vector<RTFrameLatencyStat> *stats) {
+        stats->clear();
+        INT32 count = mPathCount.load(std::memory_order_acquire);
+        for (INT32 i = 0; i < count; i++) {
+            RTFrameLatencyStat stat;
+            stat.graphUid = mPaths[i].graphUid;
+            stat.sourceId = mPaths[i].sourceId;
+            stat.sinkId   = mPaths[i].sinkId;
+            stat.path     = mPaths[i].name;
+            mPaths[i].histogram->summary(&stat.latency);
+            stats->push_back(stat);
+        }
+        return static_cast<INT32>(stats->size());
+    }
+
+    // frames which reached a sink on a path nobody linked.
+    INT64 getUnlinkedCount() const { return mUnlinked.load(std::memory_order_relaxed); }
+
+    void dump() {
+        std::vector<RTFrameLatencyStat> stats;
+        collect(&stats);
+        RT_LOGE("end-to-end frame latency(us) of %d paths, %lld frames unlinked:",
+                 (INT32)stats.size(), (long long)getUnlinkedCount());
+        for (size_t i = 0; i < stats.size(); i++) {
+            const RtHistogramSummary &sum = stats[i].latency;
+            if (sum.count == 0) {
+                continue;
+            }
+            RT_LOGE("  graph %lld %s count %lld avg %lld p50 %lld p90 %lld p99 %lld max %lld",
+                     (long long)stats[i].graphUid, stats[i].path.c_str(), (long long)sum.count,
+                     (long long)(sum.sum / sum.count), (long long)sum.p50, (long long)sum.p90,
+                     (long long)sum.p99, (long long)sum.max);
+        }
+    }
+
+    void reset() {
+        INT32 count = mPathCount.load(std::memory_order_acquire);
+        for (INT32 i = 0; i < count; i++) {
+            mPaths[i].histogram->reset();
+        }
+        mUnlinked.store(0, std::memory_order_relaxed);
+    }
+
+ private:
+    RTFrameLatencyTracer() : mEnable(RT_FALSE), mNextTraceId(1), mPathCount(0), mUnlinked(0) {
+        UINT32 value = 0;
+        rt_env_get_u32(RT_FRAME_LATENCY_ENV_ENABLE, &value, 0);
+        mEnable.store(value ? RT_TRUE : RT_FALSE, std::memory_order_relaxed);
+    }
+    RTFrameLatencyTracer(const RTFrameLatencyTracer&) = delete;
+    RTFrameLatencyTracer& operator=(const RTFrameLatencyTracer&) = delete;
+
+    // paths below count are written once and never move.
+    INT32 findPath(UINT64 graphUid, INT32 sourceId, INT32 sinkId, INT32 count) const {
+        for (INT32 i = 0; i < count; i++) {
+            const Path &path = mPaths[i];
+            if (path.sinkId == sinkId && path.sourceId == sourceId && path.graphUid == graphUid) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    typedef struct _Path {
+        UINT64                          graphUid;
+        INT32                           sourceId;
+        INT32                           sinkId;
+        char                            name[RT_FRAME_LATENCY_NAME_LEN];
+        std::unique_ptr<RtHistogram>    histogram;
+    } Path;
+
+ private:
+    std::atomic<RT_BOOL> mEnable;
+    std::atomic<INT64>   mNextTraceId;
+    RtMutex              mLock;         // serializes linkPath()
+    Path                 mPaths[RT_FRAME_LATENCY_MAX_PATHS];
+    std::atomic<INT32>   mPathCount;
+    std::atomic<INT64>   mUnlinked;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTFRAMELATENCYTRACER_H_
@@ -0,0 +1,316 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: timeline tracer of task graph, chrome trace json output
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTGRAPHTRACER_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTGRAPHTRACER_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "rt_header.h"
+
+/*
+ * rt_graph_trace=1             start recording at process start
+ * rt_graph_trace_events=N      ring size of every thread, default 16384
+ * rt_graph_trace_path=FILE     output of dump(), default below
+ *
+ * open the output in chrome://tracing or ui.perfetto.dev.
+ */
+#define RT_GRAPH_TRACE_ENV_ENABLE       "rt_graph_trace"
+#define RT_GRAPH_TRACE_ENV_EVENTS       "rt_graph_trace_events"
+#define RT_GRAPH_TRACE_ENV_PATH         "rt_graph_trace_path"
+#define RT_GRAPH_TRACE_DEFAULT_EVENTS   16384
+#define RT_GRAPH_TRACE_DEFAULT_PATH     "/tmp/rt_graph_trace.json"
+#define RT_GRAPH_TRACE_NAME_LEN         40
+#define RT_GRAPH_TRACE_RETIRED_RINGS    8           // rings of exited threads kept for dump()
+
+typedef enum _RTTraceEventType {
+    RT_TRACE_NODE_BEGIN = 0,        // process() of a node starts
+    RT_TRACE_NODE_END,
+    RT_TRACE_BUFFER_ENQUEUE,        // arg is the stream id
+    RT_TRACE_BUFFER_DEQUEUE,
+    RT_TRACE_THROTTLE,
+    RT_TRACE_UNTHROTTLE,
+    RT_TRACE_COUNTER,               // arg is the counter value
+} RTTraceEventType;
+
+typedef struct _RTTraceEvent {
+    UINT64 timeUs;
+    INT64  arg;
+    INT32  type;
+    char   name[RT_GRAPH_TRACE_NAME_LEN];
+} RTTraceEvent;
+
+/*
+ * single writer ring owned by one thread. the writer never blocks and
+ * overwrites the oldest events; a reader copies the slots and drops the
+ * ones the writer may have overwritten meanwhile.
+ */
+class RTTraceRing {
+ public:
+    RTTraceRing(UINT32 capacity, INT32 tid)
+            : mEvents(new RTTraceEvent[capacity]), mCapacity(capacity), mTid(tid), mHead(0) {}
+
+    void write(INT32 type, const char *name, INT64 arg) {
+        UINT64 head = mHead.load(std::memory_order_relaxed);
+        /*
+         * the slot writes must not become visible before the store of the
+         * head they follow: a reader which copied any of them then sees at
+         * least this head after its acquire fence, and drops the slot.
+         */
+        std::atomic_thread_fence(std::memory_order_release);
+        RTTraceEvent &event = mEvents[head % mCapacity];
+        event.timeUs = RtTime::getRelativeTimeUs();
+        event.arg    = arg;
+        event.type   = type;
+        strncpy(event.name, name ? name : "", RT_GRAPH_TRACE_NAME_LEN - 1);
+        event.name[RT_GRAPH_TRACE_NAME_LEN - 1] = '\0';
+        mHead.store(head + 1, std::memory_order_release);
+    }
+
+    void read(std::vector<RTTraceEvent> *events) const {
+        UINT64 end   = mHead.load(std::memory_order_acquire);
+        UINT64 begin = end > mCapacity ? end - mCapacity : 0;
+        std::vector<RTTraceEvent> copied;
+        for (UINT64 i = begin; i < end; i++) {
+            copied.push_back(mEvents[i % mCapacity]);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // slots up to the new head - capacity were reused during the copy, the
+        // one of the new head itself may be half written.
+        UINT64 now   = mHead.load(std::memory_order_relaxed);
+        UINT64 valid = now + 1 > mCapacity ? now + 1 - mCapacity : 0;
+        for (UINT64 i = begin; i < end; i++) {
+            if (i >= valid) {
+                events->push_back(copied[i - begin]);
+            }
+        }
+    }
+
+    void  clear() { mHead.store(0, std::memory_order_release); }
+    INT32 getTid() const { return mTid; }
+
+ private:
+    std::unique_ptr<RTTraceEvent[]> mEvents;
+    UINT32                          mCapacity;
+    INT32                           mTid;
+    std::atomic<UINT64>             mHead;
+};
+
+/*
+ * hooks:
+ *   RTScheduler        throttle()/unthrottle() of source nodes
+ *   RTTaskNodeBase     nodeBegin()/nodeEnd() around process()
+ *   stream managers    bufferEnqueue()/bufferDequeue()
+ * when disabled every hook is a single relaxed load.
+ */
+class RTGraphTracer {
+ public:
+    static RTGraphTracer* instance() {
+        static RTGraphTracer tracer;
+        return &tracer;
+    }
+
+    RT_BOOL isEnable() const { return mEnable.load(std::memory_order_relaxed); }
+    void    setEnable(RT_BOOL enable) { mEnable.store(enable, std::memory_order_relaxed); }
+
+    void trace(INT32 type, const char *name, INT64 arg = 0) {
+        if (!isEnable()) {
+            return;
+        }
+        threadRing()->write(type, name, arg);
+    }
+
+    void nodeBegin(const char *node) { trace(RT_TRACE_NODE_BEGIN, node); }
+    void nodeEnd(const char *node) { trace(RT_TRACE_NODE_END, node); }
+    void bufferEnqueue(const char *stream, INT32 streamId) { trace(RT_TRACE_BUFFER_ENQUEUE, stream, streamId); }
+    void bufferDequeue(const char *stream, INT32 streamId) { trace(RT_TRACE_BUFFER_DEQUEUE, stream, streamId); }
+    void throttle(const char *node) { trace(RT_TRACE_THROTTLE, node); }
+    void unthrottle(const char *node) { trace(RT_TRACE_UNTHROTTLE, node); }
+    void counter(const char *name, INT64 value) { trace(RT_TRACE_COUNTER, name, value); }
+
+    // writes the events of all threads as chrome trace json, RT_NULL uses rt_graph_trace_path.
+    RT_RET dump(const char *path = RT_NULL) {
+        if (path == RT_NULL) {
+            rt_env_get_str(RT_GRAPH_TRACE_ENV_PATH, &path, RT_GRAPH_TRACE_DEFAULT_PATH);
+        }
+        FILE *fp = fopen(path, "w");
+        if (fp == RT_NULL) {
+            RT_LOGE("failed to open trace file %s", path);
+            return RT_ERR_BAD;
+        }
+
+        // a thread may exit while its ring is read, the copies keep it alive.
+        std::vector<std::shared_ptr<RTTraceRing> > rings;
+        {
+            RtMutex::RtAutolock autoLock(mLock);
+            rings.assign(mRetired.begin(), mRetired.end());
+            rings.insert(rings.end(), mRings.begin(), mRings.end());
+        }
+
+        INT32 pid   = getpid();
+        INT32 count = 0;
+        fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        for (size_t i = 0; i < rings.size(); i++) {
+            std::vector<RTTraceEvent> events;
+            rings[i]->read(&events);
+            INT32 tid = rings[i]->getTid();
+            fprintf(fp, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,"
+                        "\"args\":{\"name\":\"executor-%d\"}}",
+                    count++ ? ",\n" : "", pid, tid, tid);
+            for (size_t j = 0; j < events.size(); j++) {
+                writeEvent(fp, events[j], pid, tid);
+            }
+        }
+        fprintf(fp, "\n]}\n");
+        fclose(fp);
+        RT_LOGD("graph trace of %d threads written to %s", (INT32)rings.size(), path);
+        return RT_OK;
+    }
+
+    // only call it while tracing is disabled, writers are not synchronized with it.
+    void clear() {
+        RtMutex::RtAutolock autoLock(mLock);
+        for (size_t i = 0; i < mRings.size(); i++) {
+            mRings[i]->clear();
+        }
+        mRetired.clear();
+    }
+
+    INT32 getRingCount() {
+        RtMutex::RtAutolock autoLock(mLock);
+        return static_cast<INT32>(mRings.size() + mRetired.size());
+    }
+
+ private:
+    RTGraphTracer() : mEnable(RT_FALSE), mCapacity(RT_GRAPH_TRACE_DEFAULT_EVENTS) {
+        UINT32 value = 0;
+        rt_env_get_u32(RT_GRAPH_TRACE_ENV_ENABLE, &value, 0);
+        mEnable.store(value ? RT_TRUE : RT_FALSE, std::memory_order_relaxed);
+        rt_env_get_u32(RT_GRAPH_TRACE_ENV_EVENTS, &value, RT_GRAPH_TRACE_DEFAULT_EVENTS);
+        mCapacity = value > 0 ? value : RT_GRAPH_TRACE_DEFAULT_EVENTS;
+    }
+    RTGraphTracer(const RTGraphTracer&) = delete;
+    RTGraphTracer& operator=(const RTGraphTracer&) = delete;
+
+    /*
+     * the ring of a thread is retired when the thread exits. the last
+     * RT_GRAPH_TRACE_RETIRED_RINGS of them are kept, so events of finished
+     * executors still get dumped, older ones are freed.
+     */
+    class ThreadRing {
+     public:
+        ~ThreadRing() {
+            if (mRing) {
+                RTGraphTracer::instance()->retire(mRing);
+            }
+        }
+        std::shared_ptr<RTTraceRing> mRing;
+    };
+
+    RTTraceRing* threadRing() {
+        static thread_local ThreadRing local;
+        if (!local.mRing) {
+            local.mRing = std::make_shared<RTTraceRing>(mCapacity, static_cast<INT32>(syscall(SYS_gettid)));
+            RtMutex::RtAutolock autoLock(mLock);
+            mRings.push_back(local.mRing);
+        }
+        return local.mRing.get();
+    }
+
+    void retire(const std::shared_ptr<RTTraceRing> &ring) {
+        RtMutex::RtAutolock autoLock(mLock);
+        for (size_t i = 0; i < mRings.size(); i++) {
+            if (mRings[i] == ring) {
+                mRings.erase(mRings.begin() + i);
+                break;
+            }
+        }
+        mRetired.push_back(ring);
+        while (mRetired.size() > RT_GRAPH_TRACE_RETIRED_RINGS) {
+            mRetired.pop_front();
+        }
+    }
+
+    static void writeEscaped(FILE *fp, const char *str) {
+        for (; *str; str++) {
+            if (*str == '"' || *str == '\\') {
+                fputc('\\', fp);
+            }
+            if ((UINT8)*str >= 0x20) {
+                fputc(*str, fp);
+            }
+        }
+    }
+
+    static void writeEvent(FILE *fp, const RTTraceEvent &event, INT32 pid, INT32 tid) {
+        const char *phase = "i";
+        const char *cat   = "graph";
+        switch (event.type) {
+          case RT_TRACE_NODE_BEGIN:     phase = "B"; cat = "node"; break;
+          case RT_TRACE_NODE_END:       phase = "E"; cat = "node"; break;
+          case RT_TRACE_BUFFER_ENQUEUE: cat = "enqueue"; break;
+          case RT_TRACE_BUFFER_DEQUEUE: cat = "dequeue"; break;
+          case RT_TRACE_THROTTLE:       cat = "throttle"; break;
+          case RT_TRACE_UNTHROTTLE:     cat = "unthrottle"; break;
+          case RT_TRACE_COUNTER:        phase = "C"; cat = "counter"; break;
+          default: break;
+        }
+        fprintf(fp, ",\n{\"ph\":\"%s\",\"cat\":\"%s\",\"name\":\"", phase, cat);
+        writeEscaped(fp, event.name);
+        fprintf(fp, "\",\"pid\":%d,\"tid\":%d,\"ts\":%lld", pid, tid, (long long)event.timeUs);
+        if (event.type == RT_TRACE_COUNTER) {
+            fprintf(fp, ",\"args\":{\"value\":%lld}}", (long long)event.arg);
+        } else if (phase[0] == 'i') {
+            fprintf(fp, ",\"s\":\"t\",\"args\":{\"arg\":%lld}}", (long long)event.arg);
+        } else {
+            fprintf(fp, "}");
+        }
+    }
+
+ private:
+    std::atomic<RT_BOOL>                        mEnable;
+    UINT32                                      mCapacity;
+    RtMutex                                     mLock;
+    std::vector<std::shared_ptr<RTTraceRing> >  mRings;     // of live threads
+    std::deque<std::shared_ptr<RTTraceRing> >   mRetired;
+};
+
+/*
+ * node begin/end pair for the lifetime of the scope, e.g. around process().
+ */
+class RTAutoNodeTrace {
+ public:
+    explicit RTAutoNodeTrace(const char *node) : mNode(node) {
+        RTGraphTracer::instance()->nodeBegin(mNode);
+    }
+    ~RTAutoNodeTrace() {
+        RTGraphTracer::instance()->nodeEnd(mNode);
+    }
+
+ private:
+    const char *mNode;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTGRAPHTRACER_H_
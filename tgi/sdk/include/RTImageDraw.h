@@ -0,0 +1,475 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: software mosaic and line overlays of filter_image
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTIMAGEDRAW_H_
+#define SRC_RT_MEDIA_INCLUDE_RTIMAGEDRAW_H_
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_metadata.h"
+#include "rt_simd.h"
+#include "rt_string_utils.h"
+#include "RTColorConvert.h"
+#include "RTImageScaler.h"
+#include "RTNodeCommon.h"
+
+#define RT_DRAW_BAND_ROWS           64      // rows finished together, the largest mosaic block
+#define RT_DRAW_MAX_REGIONS         64
+
+typedef struct _RTDrawColor {
+    UINT8 y;
+    UINT8 u;
+    UINT8 v;
+} RTDrawColor;
+
+typedef struct _RTDrawMosaic {
+    RTRect  rect;
+    INT32   blkSize;
+} RTDrawMosaic;
+
+// one run of pixels to paint, from the rasterized lines and rects.
+typedef struct _RTDrawSpan {
+    INT32   y;
+    INT32   x0;
+    INT32   x1;                     // exclusive
+    INT32   color;                  // index of the color table
+} RTDrawSpan;
+
+static inline RTDrawColor rt_draw_color_rgb(UINT32 rgb, RTColorSpace space = RTCOL_SPC_SMPTE170M,
+                                            RTColorRange range = RTCOL_RANGE_MPEG) {
+    UINT8 pixel[6] = { static_cast<UINT8>(rgb >> 16), static_cast<UINT8>(rgb >> 8), static_cast<UINT8>(rgb),
+                       static_cast<UINT8>(rgb >> 16), static_cast<UINT8>(rgb >> 8), static_cast<UINT8>(rgb) };
+    UINT8 yuv[4];
+    RTColorCoeffs coeffs;
+    rt_color_coeffs(space, range, &coeffs);
+    rt_color_rgb_to_luma_row(pixel, RT_FALSE, yuv, 1, coeffs, RT_FALSE);
+    rt_color_rgb_to_chroma_row(pixel, pixel, RT_FALSE, yuv + 2, RT_FALSE, 2, coeffs);
+    RTDrawColor color = { yuv[0], yuv[2], yuv[3] };
+    return color;
+}
+
+/*
+ * fills count interleaved chroma pairs with one pair, the same bits with
+ * or without simd.
+ */
+static inline void rt_draw_fill_pairs(UINT8 *dst, UINT8 first, UINT8 second, INT32 count, RT_BOOL simd) {
+    INT32 i = 0;
+    const UINT16 pair = static_cast<UINT16>(first | (second << 8));
+#if defined(RT_SIMD_NEON)
+    if (simd) {
+        uint16x8_t v = vdupq_n_u16(pair);
+        for (; i + 8 <= count; i += 8) {
+            vst1q_u16(reinterpret_cast<UINT16 *>(dst + i * 2), v);
+        }
+    }
+#elif defined(RT_SIMD_SSE2)
+    if (simd) {
+        __m128i v = _mm_set1_epi16(static_cast<INT16>(pair));
+        for (; i + 8 <= count; i += 8) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 2), v);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i * 2]     = first;
+        dst[i * 2 + 1] = second;
+    }
+}
+
+/*
+ * all mosaic and line regions of a NV12/NV21 frame in one pass.
+ *
+ * lines and rects are rasterized into spans once, when the regions are
+ * set, and sorted by pair of rows. a frame is then walked top to bottom
+ * in bands of RT_DRAW_BAND_ROWS: every mosaic block row starting in the
+ * band is averaged, then every span of the band is painted, so a band is
+ * still in cache when all regions touching it are done. overlays are
+ * drawn over the mosaics, a chroma pair takes the color of the last
+ * shape covering any pixel of its 2x2 block.
+ *
+ * mosaic blocks sum their rows with the simd kernel of the scaler and
+ * fill luma with memset and chroma with rt_draw_fill_pairs(), the results
+ * do not depend on the kernels used.
+ *
+ *   RTImageDrawer drawer;
+ *   drawer.addMosaic(rect, 16);
+ *   drawer.addLine(0, 0, 640, 360, 4, rt_draw_color_rgb(0xff0000));
+ *   drawer.draw(&image);
+ */
+class RTImageDrawer {
+ public:
+    RTImageDrawer() : mSimd(RT_TRUE), mDirty(RT_FALSE), mVFirst(RT_FALSE), mNextSpan(0), mBand(0) {
+        memset(mPlanes, 0, sizeof(mPlanes));
+    }
+
+    // RT_FALSE runs the scalar reference kernels, e.g. to compare results.
+    void    setSimd(RT_BOOL simd) { mSimd = simd; }
+    INT32   getRegionNum() const { return static_cast<INT32>(mMosaics.size() + mShapes.size()); }
+
+    void clear() {
+        mMosaics.clear();
+        mShapes.clear();
+        mColors.clear();
+        mSpans.clear();
+        mDirty = RT_FALSE;
+    }
+
+    // the rect is grown to even edges so luma and chroma blocks agree.
+    RT_RET addMosaic(const RTRect &rect, INT32 blkSize) {
+        if (rect.w <= 0 || rect.h <= 0 || blkSize < 2 || blkSize > RT_DRAW_BAND_ROWS
+                || getRegionNum() >= RT_DRAW_MAX_REGIONS) {
+            return RT_ERR_VALUE;
+        }
+        RTDrawMosaic mosaic;
+        mosaic.rect.x  = rect.x & ~1;
+        mosaic.rect.y  = rect.y & ~1;
+        mosaic.rect.w  = ((rect.x + rect.w + 1) & ~1) - mosaic.rect.x;
+        mosaic.rect.h  = ((rect.y + rect.h + 1) & ~1) - mosaic.rect.y;
+        mosaic.blkSize = blkSize & ~1;
+        mMosaics.push_back(mosaic);
+        return RT_OK;
+    }
+
+    RT_RET addLine(INT32 x0, INT32 y0, INT32 x1, INT32 y1, INT32 thick, const RTDrawColor &color) {
+        return addShape(SHAPE_LINE, x0, y0, x1, y1, thick, color);
+    }
+
+    // outline of a rect, thick pixels inside its edges.
+    RT_RET addRect(const RTRect &rect, INT32 thick, const RTDrawColor &color) {
+        return addShape(SHAPE_RECT, rect.x, rect.y, rect.x + rect.w, rect.y + rect.h, thick, color);
+    }
+
+    /*
+     * regions from the options of filter_image. opt_mosaic_num and
+     * opt_line_num give the number of regions, the keys of region i > 0
+     * carry a "_i" suffix and fall back to the plain keys of region 0, so
+     * e.g. one opt_line_thick serves every line.
+     */
+    RT_RET loadOptions(RtMetaData *options) {
+        INT32 mosaics = 0;
+        INT32 lines = 0;
+        INT32 rgb = 0xffffff;
+        clear();
+        if (options == RT_NULL) {
+            return RT_OK;
+        }
+        if (!options->findInt32(OPT_MOSAIC_NUM, &mosaics) && hasKey(options, OPT_MOSAIC_W, 0)) {
+            mosaics = 1;
+        }
+        if (!options->findInt32(OPT_LINE_NUM, &lines) && hasKey(options, OPT_LINE_END_X, 0)) {
+            lines = 1;
+        }
+        options->findInt32(OPT_VIDEO_COLOR, &rgb);
+        const RTDrawColor color = rt_draw_color_rgb(static_cast<UINT32>(rgb));
+        for (INT32 i = 0; i < mosaics; i++) {
+            RTRect rect;
+            rect.x = findKey(options, OPT_MOSAIC_X, i, 0);
+            rect.y = findKey(options, OPT_MOSAIC_Y, i, 0);
+            rect.w = findKey(options, OPT_MOSAIC_W, i, 0);
+            rect.h = findKey(options, OPT_MOSAIC_H, i, 0);
+            if (addMosaic(rect, findKey(options, OPT_MOSAIC_BLK_SIZE, i, 16)) != RT_OK) {
+                RT_LOGE("bad mosaic %d, [%d, %d, %d, %d]", i, rect.x, rect.y, rect.w, rect.h);
+                return RT_ERR_VALUE;
+            }
+        }
+        for (INT32 i = 0; i < lines; i++) {
+            RT_RET ret = addLine(findKey(options, OPT_LINE_START_X, i, 0), findKey(options, OPT_LINE_START_Y, i, 0),
+                                 findKey(options, OPT_LINE_END_X, i, 0), findKey(options, OPT_LINE_END_Y, i, 0),
+                                 findKey(options, OPT_LINE_THICK, i, 2), color);
+            if (ret != RT_OK) {
+                RT_LOGE("bad line %d", i);
+                return ret;
+            }
+        }
+        return RT_OK;
+    }
+
+    RT_RET draw(const RTScaleImage *image) {
+        RT_RET ret = begin(image);
+        if (ret != RT_OK) {
+            return ret;
+        }
+        drawRows(mPlanes[0].height);
+        return RT_OK;
+    }
+
+    /*
+     * draw() split for a frame still being written from the top, e.g. by a
+     * strip pipeline: begin() binds the frame, then every drawRows() call
+     * draws the bands whose mosaic blocks only read rows [0, ready) and
+     * returns the rows that are final. the bands run in the order of draw(),
+     * the result is the same.
+     */
+    RT_RET begin(const RTScaleImage *image) {
+        if (image == RT_NULL || (image->format != RT_FMT_YUV420SP && image->format != RT_FMT_YUV420SP_VU)) {
+            return RT_ERR_UNSUPPORT;
+        }
+        if (RTImageScaler::getPlanes(image, mPlanes) != 2) {
+            return RT_ERR_VALUE;
+        }
+        if (mDirty) {
+            rasterize();
+        }
+        mVFirst = (image->format == RT_FMT_YUV420SP_VU) ? RT_TRUE : RT_FALSE;
+        mCursor.resize(mMosaics.size());
+        for (size_t i = 0; i < mMosaics.size(); i++) {
+            mCursor[i] = mMosaics[i].rect.y;
+        }
+        mNextSpan = 0;
+        mBand = 0;
+        return RT_OK;
+    }
+
+    INT32 drawRows(INT32 ready) {
+        const INT32 height = mPlanes[0].height;
+        while (mBand < height) {
+            const INT32 bandEnd = RT_MIN(mBand + RT_DRAW_BAND_ROWS, height);
+            if (ready < height && bandNeeds(bandEnd) > ready) {
+                break;
+            }
+            for (size_t i = 0; i < mMosaics.size(); i++) {
+                const RTDrawMosaic &m = mMosaics[i];
+                const INT32 end = RT_MIN(m.rect.y + m.rect.h, height);
+                for (; mCursor[i] < bandEnd && mCursor[i] < end; mCursor[i] += m.blkSize) {
+                    mosaicRow(mPlanes, m, mCursor[i], RT_MIN(mCursor[i] + m.blkSize, end));
+                }
+            }
+            for (; mNextSpan < mSpans.size() && mSpans[mNextSpan].y < bandEnd; mNextSpan++) {
+                paintSpan(mPlanes, mSpans[mNextSpan], mVFirst);
+            }
+            mBand = bandEnd;
+        }
+        return mBand;
+    }
+
+ private:
+    typedef enum _ShapeType {
+        SHAPE_LINE = 0,
+        SHAPE_RECT,
+    } ShapeType;
+
+    typedef struct _Shape {
+        ShapeType   type;
+        INT32       x0, y0, x1, y1;
+        INT32       thick;
+        INT32       color;
+    } Shape;
+
+    static RT_BOOL hasKey(RtMetaData *options, const char *key, INT32 index) {
+        INT32 value = 0;
+        return options->findInt32(indexedKey(key, index).c_str(), &value);
+    }
+
+    static std::string indexedKey(const char *key, INT32 index) {
+        return index ? std::string(key) + "_" + util_to_string(index) : std::string(key);
+    }
+
+    static INT32 findKey(RtMetaData *options, const char *key, INT32 index, INT32 def) {
+        INT32 value = def;
+        if (!options->findInt32(indexedKey(key, index).c_str(), &value) && index > 0) {
+            options->findInt32(key, &value);
+        }
+        return value;
+    }
+
+    RT_RET addShape(ShapeType type, INT32 x0, INT32 y0, INT32 x1, INT32 y1, INT32 thick, const RTDrawColor &color) {
+        if (thick <= 0 || getRegionNum() >= RT_DRAW_MAX_REGIONS) {
+            return RT_ERR_VALUE;
+        }
+        Shape shape = { type, x0, y0, x1, y1, thick, static_cast<INT32>(mColors.size()) };
+        mColors.push_back(color);
+        mShapes.push_back(shape);
+        mDirty = RT_TRUE;
+        return RT_OK;
+    }
+
+    void addSpan(INT32 y, INT32 x0, INT32 x1, INT32 color) {
+        if (y >= 0 && x1 > x0 && x1 > 0) {
+            RTDrawSpan span = { y, RT_MAX(x0, 0), x1, color };
+            mSpans.push_back(span);
+        }
+    }
+
+    /*
+     * by pair of rows, then by shape: both rows of a pair paint the same
+     * chroma row, the later shape has to come last on either of them.
+     */
+    static bool spanLess(const RTDrawSpan &a, const RTDrawSpan &b) {
+        if ((a.y >> 1) != (b.y >> 1)) {
+            return (a.y >> 1) < (b.y >> 1);
+        }
+        return (a.color != b.color) ? a.color < b.color : a.y < b.y;
+    }
+
+    void rasterize() {
+        mSpans.clear();
+        for (size_t i = 0; i < mShapes.size(); i++) {
+            const Shape &s = mShapes[i];
+            if (s.type == SHAPE_RECT) {
+                rasterizeRect(s);
+            } else {
+                rasterizeLine(s);
+            }
+        }
+        // stable, later shapes stay on top of earlier ones on the same rows.
+        std::stable_sort(mSpans.begin(), mSpans.end(), spanLess);
+        mDirty = RT_FALSE;
+    }
+
+    void rasterizeRect(const Shape &s) {
+        const INT32 t = RT_MIN(s.thick, RT_MIN(s.x1 - s.x0, s.y1 - s.y0) / 2 + 1);
+        for (INT32 y = s.y0; y < s.y1; y++) {
+            if (y < s.y0 + t || y >= s.y1 - t) {
+                addSpan(y, s.x0, s.x1, s.color);
+            } else {
+                addSpan(y, s.x0, s.x0 + t, s.color);
+                addSpan(y, s.x1 - t, s.x1, s.color);
+            }
+        }
+    }
+
+    /*
+     * a thick line is the quad around its center line, every row takes the
+     * pixels whose centers fall inside the quad.
+     */
+    void rasterizeLine(const Shape &s) {
+        const double dx = s.x1 - s.x0;
+        const double dy = s.y1 - s.y0;
+        const double len = sqrt(dx * dx + dy * dy);
+        const double half = s.thick / 2.0;
+        const double nx = (len > 0) ? -dy / len * half : 0;
+        const double ny = (len > 0) ? dx / len * half : half;
+        const double ex = (len > 0) ? dx / len * 0.5 : half;   // round the ends to half a pixel
+        const double ey = (len > 0) ? dy / len * 0.5 : 0;
+        const double px[4] = { s.x0 + nx - ex, s.x1 + nx + ex, s.x1 - nx + ex, s.x0 - nx - ex };
+        const double py[4] = { s.y0 + ny - ey, s.y1 + ny + ey, s.y1 - ny + ey, s.y0 - ny - ey };
+        double top = py[0], bottom = py[0];
+        for (INT32 i = 1; i < 4; i++) {
+            top    = RT_MIN(top, py[i]);
+            bottom = RT_MAX(bottom, py[i]);
+        }
+        for (INT32 y = static_cast<INT32>(floor(top)); y <= static_cast<INT32>(ceil(bottom)); y++) {
+            const double cy = y + 0.5;
+            double left = 1e9, right = -1e9;
+            for (INT32 i = 0; i < 4; i++) {
+                const INT32 j = (i + 1) & 3;
+                if ((py[i] <= cy && py[j] > cy) || (py[j] <= cy && py[i] > cy)) {
+                    const double x = px[i] + (cy - py[i]) * (px[j] - px[i]) / (py[j] - py[i]);
+                    left  = RT_MIN(left, x);
+                    right = RT_MAX(right, x);
+                }
+            }
+            if (left <= right) {
+                addSpan(y, static_cast<INT32>(ceil(left - 0.5)), static_cast<INT32>(floor(right - 0.5)) + 1, s.color);
+            }
+        }
+    }
+
+    // rows the mosaic block rows starting above bandEnd read, exclusive.
+    INT32 bandNeeds(INT32 bandEnd) const {
+        INT32 need = bandEnd;
+        for (size_t i = 0; i < mMosaics.size(); i++) {
+            const RTDrawMosaic &m = mMosaics[i];
+            const INT32 end  = RT_MIN(m.rect.y + m.rect.h, mPlanes[0].height);
+            const INT32 stop = RT_MIN(bandEnd, end);
+            if (mCursor[i] < stop) {
+                const INT32 last = mCursor[i] + (stop - 1 - mCursor[i]) / m.blkSize * m.blkSize;
+                need = RT_MAX(need, RT_MIN(last + m.blkSize, end));
+            }
+        }
+        return need;
+    }
+
+    void paintSpan(const RTScalePlane *planes, const RTDrawSpan &span, RT_BOOL vFirst) const {
+        const INT32 x1 = RT_MIN(span.x1, planes[0].width);
+        if (span.y >= planes[0].height || span.x0 >= x1) {
+            return;
+        }
+        const RTDrawColor &color = mColors[span.color];
+        memset(planes[0].data + span.y * planes[0].stride + span.x0, color.y, x1 - span.x0);
+        // a chroma pair is painted when the span covers any pixel of its 2x2 block, from either row.
+        const INT32 c0 = span.x0 / 2;
+        const INT32 c1 = (x1 + 1) / 2;
+        UINT8 *chroma = planes[1].data + (span.y / 2) * planes[1].stride + c0 * 2;
+        rt_draw_fill_pairs(chroma, vFirst ? color.v : color.u, vFirst ? color.u : color.v, c1 - c0, mSimd);
+    }
+
+    // averages one row of mosaic blocks, luma rows [y0, y1).
+    void mosaicRow(const RTScalePlane *planes, const RTDrawMosaic &m, INT32 y0, INT32 y1) {
+        const INT32 x0 = RT_MAX(m.rect.x, 0);
+        const INT32 x1 = RT_MIN(m.rect.x + m.rect.w, planes[0].width);
+        y0 = RT_MAX(y0, 0);
+        if (x1 <= x0 || y1 <= y0) {
+            return;
+        }
+        mosaicPlane(planes[0], x0, x1, y0, y1, m.blkSize, 1);
+        mosaicPlane(planes[1], x0 / 2, (x1 + 1) / 2, y0 / 2, (y1 + 1) / 2, m.blkSize / 2, 2);
+    }
+
+    void mosaicPlane(const RTScalePlane &plane, INT32 x0, INT32 x1, INT32 y0, INT32 y1, INT32 blk,
+                     INT32 channels) {
+        const INT32 count = (x1 - x0) * channels;
+        UINT8 *base = plane.data + x0 * channels;
+        mAcc.assign(count, 0);
+        for (INT32 y = y0; y < y1; y++) {
+            rt_scale_accumulate_row(base + y * plane.stride, &mAcc[0], count, mSimd);
+        }
+        for (INT32 bx = x0; bx < x1; bx += blk) {
+            const INT32 bw = RT_MIN(blk, x1 - bx);
+            const UINT32 n = static_cast<UINT32>(bw * (y1 - y0));
+            UINT32 sum[2] = { 0, 0 };
+            for (INT32 x = 0; x < bw; x++) {
+                for (INT32 c = 0; c < channels; c++) {
+                    sum[c] += mAcc[(bx - x0 + x) * channels + c];
+                }
+            }
+            const UINT8 first  = static_cast<UINT8>((sum[0] + n / 2) / n);
+            const UINT8 second = static_cast<UINT8>((sum[1] + n / 2) / n);
+            for (INT32 y = y0; y < y1; y++) {
+                UINT8 *dst = base + y * plane.stride + (bx - x0) * channels;
+                if (channels == 1) {
+                    memset(dst, first, bw);
+                } else {
+                    rt_draw_fill_pairs(dst, first, second, bw, mSimd);
+                }
+            }
+        }
+    }
+
+ private:
+    RT_BOOL                     mSimd;
+    RT_BOOL                     mDirty;
+    std::vector<RTDrawMosaic>   mMosaics;
+    std::vector<Shape>          mShapes;
+    std::vector<RTDrawColor>    mColors;
+    std::vector<RTDrawSpan>     mSpans;
+    std::vector<UINT32>         mAcc;
+    // the frame of begin() and how far drawRows() got.
+    RTScalePlane                mPlanes[RT_SCALE_MAX_PLANES];
+    RT_BOOL                     mVFirst;
+    std::vector<INT32>          mCursor;
+    size_t                      mNextSpan;
+    INT32                       mBand;
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTIMAGEDRAW_H_
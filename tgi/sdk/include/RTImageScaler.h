@@ -0,0 +1,550 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: software image scaler, used when rga can not take the job
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTIMAGESCALER_H_
+#define SRC_RT_MEDIA_INCLUDE_RTIMAGESCALER_H_
+
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_simd.h"
+#include "rt_thread.h"
+#include "RTMediaDef.h"
+
+#define RT_SCALE_MAX_PLANES         3
+#define RT_SCALE_MAX_THREADS        8
+#define RT_SCALE_FRAC_BITS          8       // vertical bilinear weights are 0..256
+#define RT_SCALE_XFRAC_BITS         15      // horizontal ones, applied to the 16 bit blend
+
+typedef enum _RTScaleMode {
+    RT_SCALE_BILINEAR = 0,
+    RT_SCALE_AREA,                  // box average, the better choice for downscaling
+    RT_SCALE_MODE_MAX,
+} RTScaleMode;
+
+/*
+ * one image in memory. virWidth/virHeight are the allocated luma size
+ * (opt_vir_width/opt_vir_height), rect is the region to read or to write
+ * (opt_trans_rect) and covers the whole width x height when w or h is 0.
+ * yuv rects must be even.
+ */
+typedef struct _RTScaleImage {
+    UINT8          *data;
+    RTPixelFormat   format;
+    INT32           width;
+    INT32           height;
+    INT32           virWidth;
+    INT32           virHeight;
+    RTRect          rect;
+} RTScaleImage;
+
+typedef struct _RTScalePlane {
+    UINT8  *data;       // first pixel of the rect
+    INT32   stride;     // bytes
+    INT32   width;      // pixels of the rect
+    INT32   height;
+    INT32   channels;   // interleaved bytes per pixel
+} RTScalePlane;
+
+/*
+ * row kernels, the simd versions give the same bits as the scalar ones.
+ * a blend is row0 * (256 - frac) + row1 * frac, at most 0xff00.
+ */
+static inline void rt_scale_blend_rows(const UINT8 *row0, const UINT8 *row1, UINT16 *out,
+                                       INT32 count, INT32 frac, RT_BOOL simd) {
+    const INT32 w1 = frac;
+    const INT32 w0 = (1 << RT_SCALE_FRAC_BITS) - frac;
+    INT32 i = 0;
+#if defined(RT_SIMD_NEON)
+    if (simd) {
+        // w0 may be 256, out of u8: a << 8 - a * w1 + b * w1, exact in u16 as the result fits.
+        uint8x8_t v1 = vdup_n_u8(static_cast<UINT8>(w1));
+        for (; i + 16 <= count; i += 16) {
+            uint8x16_t a = vld1q_u8(row0 + i);
+            uint8x16_t b = vld1q_u8(row1 + i);
+            uint16x8_t lo = vmlsl_u8(vshll_n_u8(vget_low_u8(a), 8), vget_low_u8(a), v1);
+            uint16x8_t hi = vmlsl_u8(vshll_n_u8(vget_high_u8(a), 8), vget_high_u8(a), v1);
+            lo = vmlal_u8(lo, vget_low_u8(b), v1);
+            hi = vmlal_u8(hi, vget_high_u8(b), v1);
+            vst1q_u16(out + i, lo);
+            vst1q_u16(out + i + 8, hi);
+        }
+    }
+#elif defined(RT_SIMD_SSE2)
+    if (simd) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i v0 = _mm_set1_epi16(static_cast<INT16>(w0));
+        const __m128i v1 = _mm_set1_epi16(static_cast<INT16>(w1));
+        for (; i + 16 <= count; i += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + i));
+            __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), v0),
+                                       _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), v1));
+            __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), v0),
+                                       _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), v1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 8), hi);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = static_cast<UINT16>(row0[i] * w0 + row1[i] * w1);
+    }
+}
+
+static inline void rt_scale_accumulate_row(const UINT8 *row, UINT32 *acc, INT32 count, RT_BOOL simd) {
+    INT32 i = 0;
+#if defined(RT_SIMD_NEON)
+    if (simd) {
+        for (; i + 16 <= count; i += 16) {
+            uint8x16_t v = vld1q_u8(row + i);
+            uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+            uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+            vst1q_u32(acc + i,      vaddw_u16(vld1q_u32(acc + i),      vget_low_u16(lo)));
+            vst1q_u32(acc + i + 4,  vaddw_u16(vld1q_u32(acc + i + 4),  vget_high_u16(lo)));
+            vst1q_u32(acc + i + 8,  vaddw_u16(vld1q_u32(acc + i + 8),  vget_low_u16(hi)));
+            vst1q_u32(acc + i + 12, vaddw_u16(vld1q_u32(acc + i + 12), vget_high_u16(hi)));
+        }
+    }
+#elif defined(RT_SIMD_SSE2)
+    if (simd) {
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16) {
+            __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            __m128i *dst = reinterpret_cast<__m128i *>(acc + i);
+            _mm_storeu_si128(dst,     _mm_add_epi32(_mm_loadu_si128(dst),     _mm_unpacklo_epi16(lo, zero)));
+            _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), _mm_unpackhi_epi16(lo, zero)));
+            _mm_storeu_si128(dst + 2, _mm_add_epi32(_mm_loadu_si128(dst + 2), _mm_unpacklo_epi16(hi, zero)));
+            _mm_storeu_si128(dst + 3, _mm_add_epi32(_mm_loadu_si128(dst + 3), _mm_unpackhi_epi16(hi, zero)));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        acc[i] += row[i];
+    }
+}
+
+/*
+ * scales a band of destination rows of one plane. the vertical pass runs
+ * over whole rows with the simd kernels above, the horizontal pass walks
+ * precomputed source positions.
+ */
+class RTPlaneScaler {
+ public:
+    RTPlaneScaler(const RTScalePlane &src, const RTScalePlane &dst, RTScaleMode mode)
+            : mSrc(src), mDst(dst), mMode(mode) {
+        mX0.resize(dst.width);
+        mX1.resize(dst.width);
+        mFrac.resize(dst.width);
+        for (INT32 x = 0; x < dst.width; x++) {
+            if (mode == RT_SCALE_BILINEAR) {
+                INT32 frac = 0;
+                mX0[x]   = position(x, src.width, dst.width, RT_SCALE_XFRAC_BITS, &frac);
+                mX1[x]   = RT_MIN(mX0[x] + 1, src.width - 1);
+                mFrac[x] = frac;
+            } else {
+                area(x, src.width, dst.width, &mX0[x], &mX1[x]);
+            }
+        }
+    }
+
+    // the tables only depend on the sizes, a scaler is kept from frame to frame and rebound.
+    RT_BOOL isSameGeometry(const RTScalePlane &src, const RTScalePlane &dst, RTScaleMode mode) const {
+        return (mode == mMode && src.width == mSrc.width && src.height == mSrc.height
+                && src.channels == mSrc.channels && dst.width == mDst.width && dst.height == mDst.height
+                && dst.channels == mDst.channels) ? RT_TRUE : RT_FALSE;
+    }
+
+    void rebind(const RTScalePlane &src, const RTScalePlane &dst) {
+        mSrc = src;
+        mDst = dst;
+    }
+
+    // source rows [0, n) destination rows [0, rows) read, a consumer of a band can wait for them.
+    static INT32 sourceRows(INT32 rows, INT32 srcSize, INT32 dstSize, RTScaleMode mode) {
+        if (rows <= 0) {
+            return 0;
+        }
+        INT32 y0 = 0;
+        INT32 y1 = 0;
+        if (mode == RT_SCALE_BILINEAR) {
+            INT32 frac = 0;
+            y0 = position(rows - 1, srcSize, dstSize, RT_SCALE_FRAC_BITS, &frac);
+            return RT_MIN(y0 + 1, srcSize - 1) + 1;
+        }
+        area(rows - 1, srcSize, dstSize, &y0, &y1);
+        return y1;
+    }
+
+    // per thread buffers of scaleRow(), reused from row to row and by the scalers of the planes of a frame.
+    struct Scratch {
+        Scratch() : recipRows(0), recipOwner(RT_NULL) {}
+        std::vector<UINT16> blend;
+        std::vector<UINT32> acc;
+        std::vector<UINT32> recip;
+        INT32               recipRows;
+        const void         *recipOwner;     // the scaler whose columns recip holds
+    };
+
+    void scaleRows(INT32 rowBegin, INT32 rowEnd, RT_BOOL simd) const {
+        Scratch scratch;
+        for (INT32 y = rowBegin; y < rowEnd; y++) {
+            scaleRow(y, mDst.data + y * mDst.stride, &scratch, simd);
+        }
+    }
+
+    // destination row y into out, which may be any buffer of mDst.width pixels.
+    void scaleRow(INT32 y, UINT8 *out, Scratch *scratch, RT_BOOL simd) const {
+        const INT32 count = mSrc.width * mSrc.channels;
+        if (mMode == RT_SCALE_BILINEAR) {
+            INT32 frac = 0;
+            INT32 y0 = position(y, mSrc.height, mDst.height, RT_SCALE_FRAC_BITS, &frac);
+            INT32 y1 = RT_MIN(y0 + 1, mSrc.height - 1);
+            scratch->blend.resize(count);
+            rt_scale_blend_rows(row(y0), row(y1), &scratch->blend[0], count, frac, simd);
+            bilinearColumns(&scratch->blend[0], out);
+        } else {
+            INT32 y0 = 0;
+            INT32 y1 = 0;
+            area(y, mSrc.height, mDst.height, &y0, &y1);
+            scratch->acc.assign(count, 0);
+            for (INT32 sy = y0; sy < y1; sy++) {
+                rt_scale_accumulate_row(row(sy), &scratch->acc[0], count, simd);
+            }
+            areaColumns(&scratch->acc[0], y1 - y0, out, scratch);
+        }
+    }
+
+ private:
+    const UINT8* row(INT32 y) const { return mSrc.data + y * mSrc.stride; }
+
+    // pixel centers aligned: src = (dst + 0.5) * srcSize / dstSize - 0.5, frac rounded to bits.
+    static INT32 position(INT32 dst, INT32 srcSize, INT32 dstSize, INT32 bits, INT32 *frac) {
+        INT64 pos = ((2 * static_cast<INT64>(dst) + 1) * srcSize << 15) / dstSize - (1 << 15);
+        pos = RT_CLIP(pos, 0, static_cast<INT64>(srcSize - 1) << 16);
+        pos = (pos + (1 << (15 - bits))) >> (16 - bits);
+        *frac = static_cast<INT32>(pos & ((1 << bits) - 1));
+        return static_cast<INT32>(pos >> bits);
+    }
+
+    static void area(INT32 dst, INT32 srcSize, INT32 dstSize, INT32 *begin, INT32 *end) {
+        *begin = static_cast<INT32>(static_cast<INT64>(dst) * srcSize / dstSize);
+        *end   = static_cast<INT32>(static_cast<INT64>(dst + 1) * srcSize / dstSize);
+        *begin = RT_MIN(*begin, srcSize - 1);
+        *end   = RT_MAX(*end, *begin + 1);
+    }
+
+    void bilinearColumns(const UINT16 *blend, UINT8 *out) const {
+        switch (mSrc.channels) {
+          case 1: bilinearColumns<1>(blend, out); break;
+          case 2: bilinearColumns<2>(blend, out); break;
+          default: bilinearColumns<3>(blend, out); break;
+        }
+    }
+
+    // 0xff00 << RT_SCALE_XFRAC_BITS plus the rounding still fits in 32 bits.
+    template <INT32 CH>
+    void bilinearColumns(const UINT16 *blend, UINT8 *out) const {
+        const INT32 shift = RT_SCALE_FRAC_BITS + RT_SCALE_XFRAC_BITS;
+        const UINT32 round = 1u << (shift - 1);
+        for (INT32 x = 0; x < mDst.width; x++, out += CH) {
+            const UINT16 *p0 = blend + mX0[x] * CH;
+            const UINT16 *p1 = blend + mX1[x] * CH;
+            const UINT32 w1 = static_cast<UINT32>(mFrac[x]);
+            const UINT32 w0 = (1u << RT_SCALE_XFRAC_BITS) - w1;
+            for (INT32 c = 0; c < CH; c++) {
+                out[c] = static_cast<UINT8>((p0[c] * w0 + p1[c] * w1 + round) >> shift);
+            }
+        }
+    }
+
+    /*
+     * box sums are divided by a fixed point reciprocal of the box size,
+     * which is rebuilt only when the number of summed rows or the scaler
+     * using the scratch changes.
+     */
+    void areaColumns(const UINT32 *acc, INT32 rows, UINT8 *out, Scratch *scratch) const {
+        std::vector<UINT32> &recip = scratch->recip;
+        if (scratch->recipRows != rows || scratch->recipOwner != this) {
+            recip.resize(mDst.width);
+            for (INT32 x = 0; x < mDst.width; x++) {
+                UINT32 n = static_cast<UINT32>((mX1[x] - mX0[x]) * rows);
+                recip[x] = ((1u << 24) + n / 2) / n;
+            }
+            scratch->recipRows  = rows;
+            scratch->recipOwner = this;
+        }
+        switch (mSrc.channels) {
+          case 1: areaColumns<1>(acc, &recip[0], out); break;
+          case 2: areaColumns<2>(acc, &recip[0], out); break;
+          default: areaColumns<3>(acc, &recip[0], out); break;
+        }
+    }
+
+    template <INT32 CH>
+    void areaColumns(const UINT32 *acc, const UINT32 *recip, UINT8 *out) const {
+        for (INT32 x = 0; x < mDst.width; x++, out += CH) {
+            UINT32 sum[CH] = { 0 };
+            for (INT32 sx = mX0[x]; sx < mX1[x]; sx++) {
+                for (INT32 c = 0; c < CH; c++) {
+                    sum[c] += acc[sx * CH + c];
+                }
+            }
+            for (INT32 c = 0; c < CH; c++) {
+                UINT64 value = (static_cast<UINT64>(sum[c]) * recip[x] + (1u << 23)) >> 24;
+                out[c] = static_cast<UINT8>(RT_MIN(value, 255u));
+            }
+        }
+    }
+
+ private:
+    RTScalePlane        mSrc;
+    RTScalePlane        mDst;
+    RTScaleMode         mMode;
+    std::vector<INT32>  mX0;
+    std::vector<INT32>  mX1;
+    std::vector<INT32>  mFrac;
+};
+
+/*
+ * scales NV12/NV21/YUV420P/RGB888/BGR888 between two images of the same
+ * format. the destination rows are split into bands, one per thread; the
+ * workers are started once and reused for every frame.
+ *
+ *   RTImageScaler scaler(4);
+ *   scaler.scale(&src, &dst, RT_SCALE_BILINEAR);
+ */
+class RTImageScaler {
+ public:
+    explicit RTImageScaler(INT32 threads = 1)
+            : mThreadNum(RT_CLIP(threads, 1, RT_SCALE_MAX_THREADS)), mSimd(RT_TRUE),
+              mGeneration(0), mPending(0), mQuit(RT_FALSE) {
+        for (INT32 i = 1; i < mThreadNum; i++) {
+            Worker *worker = new Worker();
+            worker->scaler = this;
+            worker->band   = i;
+            worker->thread = new RtThread(workerLoop, worker);
+            worker->thread->setName("rt_scaler");
+            if (!worker->thread->start()) {
+                rt_safe_delete(worker->thread);
+                delete worker;
+                mThreadNum = i;
+                break;
+            }
+            mWorkers.push_back(worker);
+        }
+    }
+
+    ~RTImageScaler() {
+        {
+            RtMutex::RtAutolock autoLock(mLock);
+            mQuit = RT_TRUE;
+            mStartCond.broadcast();
+        }
+        for (size_t i = 0; i < mWorkers.size(); i++) {
+            mWorkers[i]->thread->join();
+            rt_safe_delete(mWorkers[i]->thread);
+            delete mWorkers[i];
+        }
+        clearScalers();
+    }
+
+    // RT_FALSE runs the scalar reference kernels, e.g. to compare results.
+    void    setSimd(RT_BOOL simd) { mSimd = simd; }
+    INT32   getThreadNum() const { return mThreadNum; }
+
+    RT_RET scale(const RTScaleImage *src, const RTScaleImage *dst, RTScaleMode mode) {
+        RTScalePlane srcPlanes[RT_SCALE_MAX_PLANES];
+        RTScalePlane dstPlanes[RT_SCALE_MAX_PLANES];
+        if (src == RT_NULL || dst == RT_NULL || mode < 0 || mode >= RT_SCALE_MODE_MAX) {
+            return RT_ERR_VALUE;
+        }
+        if (src->format != dst->format) {
+            RT_LOGE("format conversion %d -> %d is not supported", src->format, dst->format);
+            return RT_ERR_UNSUPPORT;
+        }
+        INT32 planes = getPlanes(src, srcPlanes);
+        if (planes <= 0 || getPlanes(dst, dstPlanes) != planes) {
+            RT_LOGE("unsupported image, format %d", src->format);
+            return RT_ERR_VALUE;
+        }
+
+        RtMutex::RtAutolock jobLock(mJobLock);
+        prepareScalers(srcPlanes, dstPlanes, planes, mode);
+        mJob.scalers = &mScalers;
+        mJob.planes  = dstPlanes;
+        if (mWorkers.empty()) {
+            runBand(0);
+        } else {
+            {
+                RtMutex::RtAutolock autoLock(mLock);
+                mPending = static_cast<INT32>(mWorkers.size());
+                mGeneration++;
+                mStartCond.broadcast();
+            }
+            runBand(0);
+            RtMutex::RtAutolock autoLock(mLock);
+            while (mPending > 0) {
+                mDoneCond.wait(mLock);
+            }
+        }
+        return RT_OK;
+    }
+
+    // splits an image into its planes, returns the number of planes or <= 0 on bad geometry.
+    static INT32 getPlanes(const RTScaleImage *image, RTScalePlane *planes) {
+        RTRect rect = image->rect;
+        if (rect.w <= 0 || rect.h <= 0) {
+            rect.x = 0;
+            rect.y = 0;
+            rect.w = image->width;
+            rect.h = image->height;
+        }
+        INT32 virW = image->virWidth > 0 ? image->virWidth : image->width;
+        INT32 virH = image->virHeight > 0 ? image->virHeight : image->height;
+        if (image->data == RT_NULL || rect.x < 0 || rect.y < 0 || rect.w <= 0 || rect.h <= 0
+                || rect.x + rect.w > virW || rect.y + rect.h > virH) {
+            return 0;
+        }
+
+        switch (image->format) {
+          case RT_FMT_RGB888:
+          case RT_FMT_BGR888:
+            setPlane(&planes[0], image->data, virW * 3, rect, 1, 3);
+            return 1;
+          case RT_FMT_YUV420SP:
+          case RT_FMT_YUV420SP_VU:
+          case RT_FMT_YUV420P: {
+            if ((rect.x | rect.y | rect.w | rect.h | virW | virH) & 1) {
+                return 0;
+            }
+            UINT8 *chroma = image->data + virW * virH;
+            setPlane(&planes[0], image->data, virW, rect, 1, 1);
+            if (image->format != RT_FMT_YUV420P) {
+                setPlane(&planes[1], chroma, virW, rect, 2, 2);
+                return 2;
+            }
+            setPlane(&planes[1], chroma, virW / 2, rect, 2, 1);
+            setPlane(&planes[2], chroma + (virW / 2) * (virH / 2), virW / 2, rect, 2, 1);
+            return 3;
+          }
+          default:
+            return 0;
+        }
+    }
+
+ private:
+    struct Worker {
+        RTImageScaler *scaler;
+        INT32          band;
+        RtThread      *thread;
+    };
+
+    struct Job {
+        std::vector<RTPlaneScaler *> *scalers;
+        const RTScalePlane           *planes;
+    };
+
+    static void setPlane(RTScalePlane *plane, UINT8 *base, INT32 stride, const RTRect &rect,
+                         INT32 subsample, INT32 channels) {
+        plane->stride   = stride;
+        plane->width    = rect.w / subsample;
+        plane->height   = rect.h / subsample;
+        plane->channels = channels;
+        plane->data     = base + (rect.y / subsample) * stride + (rect.x / subsample) * channels;
+    }
+
+    // the scalers of the last frame are rebound when the sizes did not change.
+    void prepareScalers(const RTScalePlane *srcPlanes, const RTScalePlane *dstPlanes, INT32 planes,
+                        RTScaleMode mode) {
+        RT_BOOL same = (static_cast<INT32>(mScalers.size()) == planes) ? RT_TRUE : RT_FALSE;
+        for (INT32 i = 0; i < planes && same; i++) {
+            same = mScalers[i]->isSameGeometry(srcPlanes[i], dstPlanes[i], mode);
+        }
+        if (!same) {
+            clearScalers();
+            for (INT32 i = 0; i < planes; i++) {
+                mScalers.push_back(new RTPlaneScaler(srcPlanes[i], dstPlanes[i], mode));
+            }
+            return;
+        }
+        for (INT32 i = 0; i < planes; i++) {
+            mScalers[i]->rebind(srcPlanes[i], dstPlanes[i]);
+        }
+    }
+
+    void clearScalers() {
+        for (size_t i = 0; i < mScalers.size(); i++) {
+            delete mScalers[i];
+        }
+        mScalers.clear();
+    }
+
+    // band i of every plane, rows split evenly so each thread gets the same share.
+    void runBand(INT32 band) {
+        for (size_t i = 0; i < mJob.scalers->size(); i++) {
+            INT32 rows  = mJob.planes[i].height;
+            INT32 begin = static_cast<INT32>(static_cast<INT64>(rows) * band / mThreadNum);
+            INT32 end   = static_cast<INT32>(static_cast<INT64>(rows) * (band + 1) / mThreadNum);
+            (*mJob.scalers)[i]->scaleRows(begin, end, mSimd);
+        }
+    }
+
+    static void* workerLoop(void *arg) {
+        Worker *worker = reinterpret_cast<Worker *>(arg);
+        RTImageScaler *scaler = worker->scaler;
+        UINT32 seen = 0;
+        while (1) {
+            {
+                RtMutex::RtAutolock autoLock(scaler->mLock);
+                while (!scaler->mQuit && scaler->mGeneration == seen) {
+                    scaler->mStartCond.wait(scaler->mLock);
+                }
+                if (scaler->mQuit) {
+                    break;
+                }
+                seen = scaler->mGeneration;
+            }
+            scaler->runBand(worker->band);
+            RtMutex::RtAutolock autoLock(scaler->mLock);
+            if (--scaler->mPending == 0) {
+                scaler->mDoneCond.signal();
+            }
+        }
+        return RT_NULL;
+    }
+
+ private:
+    INT32                   mThreadNum;
+    RT_BOOL                 mSimd;
+    std::vector<Worker *>   mWorkers;
+    RtMutex                 mJobLock;       // one scale() at a time
+    std::vector<RTPlaneScaler *> mScalers;  // of the last frame, under mJobLock
+    RtMutex                 mLock;
+    RtCondition             mStartCond;
+    RtCondition             mDoneCond;
+    UINT32                  mGeneration;
+    INT32                   mPending;
+    RT_BOOL                 mQuit;
+    Job                     mJob;
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTIMAGESCALER_H_
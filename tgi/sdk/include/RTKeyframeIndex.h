@@ -0,0 +1,589 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: persistent keyframe index for demuxer seeks
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTKEYFRAMEINDEX_H_
+#define SRC_RT_MEDIA_INCLUDE_RTKEYFRAMEINDEX_H_
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_mutex.h"
+#include "rt_string_utils.h"
+#include "RTFileSource.h"
+#include "RTMediaDef.h"
+
+#define RT_KEYFRAME_INDEX_MAGIC     MKTAG('r', 'k', 'f', 'i')
+#define RT_KEYFRAME_INDEX_VERSION   1
+#define RT_KEYFRAME_INDEX_SUFFIX    ".rtidx"        // the index is kept beside the media file
+#define RT_KEYFRAME_INDEX_CACHED    16              // files whose index stays in memory
+#define RT_KEYFRAME_INDEX_MAX       (1 << 24)       // entries, bounds what a damaged index can allocate
+#define RT_KEYFRAME_SCAN_CHUNK      (1 << 20)       // bytes fed to the scanner at once
+#define RT_TS_PACKET_SIZE           188
+#define RT_TS_PROBE_PACKETS         5               // sync bytes in a row at the file start that make it ts
+
+/*
+ * one random access point. the layout is the on-disk record, it must not
+ * change without a new RT_KEYFRAME_INDEX_VERSION.
+ */
+typedef struct _RTKeyframeEntry {
+    INT64   timeUs;     // presentation time from the first video pts of the file
+    INT64   offset;     // of the container packet the keyframe starts in
+    INT32   track;      // n-th video stream of the file
+    INT32   reserved;
+} RTKeyframeEntry;
+
+typedef struct _RTKeyframeIndexHeader {
+    UINT32  magic;
+    UINT32  version;
+    UINT32  count;
+    UINT32  reserved;
+    INT64   fileSize;   // of the media file the index was built from
+    INT64   mtimeNs;
+} RTKeyframeIndexHeader;
+
+/*
+ * sorted keyframe positions of a media file, so a seek jumps to the
+ * keyframe at or around the target instead of rescanning the file.
+ *
+ * the file format is the header, count entries and a fnv-1a checksum of
+ * both, in host byte order. an index is only used while the media file
+ * keeps the size and mtime it was built from, anything else rebuilds it.
+ */
+class RTKeyframeIndex {
+ public:
+    RTKeyframeIndex() : mFileSize(0), mMtimeNs(0) {}
+
+    void clear() {
+        mEntries.clear();
+        mFileSize = 0;
+        mMtimeNs  = 0;
+    }
+
+    void add(INT32 track, INT64 timeUs, INT64 offset) {
+        RTKeyframeEntry entry;
+        entry.timeUs   = timeUs;
+        entry.offset   = offset;
+        entry.track    = track;
+        entry.reserved = 0;
+        mEntries.push_back(entry);
+    }
+
+    // sorts by track and time, a keyframe repeated at the same time keeps its first offset.
+    void seal() {
+        std::stable_sort(mEntries.begin(), mEntries.end(), lessThan);
+        std::vector<RTKeyframeEntry>::iterator last = std::unique(mEntries.begin(), mEntries.end(), sameTime);
+        mEntries.erase(last, mEntries.end());
+    }
+
+    void setSource(INT64 fileSize, INT64 mtimeNs) {
+        mFileSize = fileSize;
+        mMtimeNs  = mtimeNs;
+    }
+
+    RT_BOOL matches(INT64 fileSize, INT64 mtimeNs) const {
+        return (mFileSize == fileSize && mMtimeNs == mtimeNs) ? RT_TRUE : RT_FALSE;
+    }
+
+    INT32 size() const { return static_cast<INT32>(mEntries.size()); }
+    const RTKeyframeEntry *entries() const { return mEntries.empty() ? RT_NULL : &mEntries[0]; }
+
+    /*
+     * RT_SEEK_PREVIOUS_SYNC (and unspecified) gives the last keyframe at or
+     * before timeUs, RT_SEEK_NEXT_SYNC the first one at or after it. a time
+     * outside the file clamps to its first or last keyframe.
+     */
+    RT_RET find(INT32 track, INT64 timeUs, RTSeekMode mode, RTKeyframeEntry *entry) const {
+        std::vector<RTKeyframeEntry>::const_iterator first = std::lower_bound(mEntries.begin(), mEntries.end(),
+                                                                               makeKey(track, INT64_MIN), lessThan);
+        std::vector<RTKeyframeEntry>::const_iterator end   = std::lower_bound(first, mEntries.end(),
+                                                                               makeKey(track + 1, INT64_MIN),
+                                                                               lessThan);
+        if (first == end) {
+            return RT_ERR_OUTOF_RANGE;
+        }
+        std::vector<RTKeyframeEntry>::const_iterator it = std::lower_bound(first, end, makeKey(track, timeUs),
+                                                                            lessThan);
+        if (mode == RT_SEEK_NEXT_SYNC) {
+            it = (it == end) ? end - 1 : it;
+        } else if (it == end || it->timeUs > timeUs) {
+            it = (it == first) ? first : it - 1;
+        }
+        *entry = *it;
+        return RT_OK;
+    }
+
+    // written to a temporary file renamed over path, readers never see half an index.
+    RT_RET save(const char *path) const {
+        RTKeyframeIndexHeader header;
+        header.magic    = RT_KEYFRAME_INDEX_MAGIC;
+        header.version  = RT_KEYFRAME_INDEX_VERSION;
+        header.count    = static_cast<UINT32>(mEntries.size());
+        header.reserved = 0;
+        header.fileSize = mFileSize;
+        header.mtimeNs  = mMtimeNs;
+        UINT64 checksum = fnv(&header, sizeof(header), kFnvBasis);
+        checksum = fnv(entries(), mEntries.size() * sizeof(RTKeyframeEntry), checksum);
+
+        const std::string tmpPath = std::string(path) + ".tmp" + util_to_string(static_cast<INT32>(getpid()));
+        FILE *fp = fopen(tmpPath.c_str(), "wb");
+        if (fp == RT_NULL) {
+            return RT_ERR_OPEN_FILE;
+        }
+        RT_BOOL done = (fwrite(&header, sizeof(header), 1, fp) == 1) ? RT_TRUE : RT_FALSE;
+        if (done && !mEntries.empty()) {
+            done = (fwrite(entries(), sizeof(RTKeyframeEntry), mEntries.size(), fp) == mEntries.size())
+                   ? RT_TRUE : RT_FALSE;
+        }
+        done = (done && fwrite(&checksum, sizeof(checksum), 1, fp) == 1) ? RT_TRUE : RT_FALSE;
+        done = (fclose(fp) == 0 && done) ? RT_TRUE : RT_FALSE;
+        if (!done || rename(tmpPath.c_str(), path) != 0) {
+            unlink(tmpPath.c_str());
+            return RT_ERR_BAD;
+        }
+        return RT_OK;
+    }
+
+    RT_RET load(const char *path, INT64 fileSize, INT64 mtimeNs) {
+        RTKeyframeIndexHeader header;
+        UINT64 checksum = 0;
+        clear();
+        FILE *fp = fopen(path, "rb");
+        if (fp == RT_NULL) {
+            return RT_ERR_OPEN_FILE;
+        }
+        RT_RET ret = RT_ERR_VALUE;
+        if (fread(&header, sizeof(header), 1, fp) == 1 && header.magic == RT_KEYFRAME_INDEX_MAGIC
+                && header.version == RT_KEYFRAME_INDEX_VERSION && header.fileSize == fileSize
+                && header.mtimeNs == mtimeNs && header.count <= RT_KEYFRAME_INDEX_MAX) {
+            mEntries.resize(header.count);
+            if ((header.count == 0 || fread(&mEntries[0], sizeof(RTKeyframeEntry), header.count, fp) == header.count)
+                    && fread(&checksum, sizeof(checksum), 1, fp) == 1
+                    && checksum == fnv(entries(), mEntries.size() * sizeof(RTKeyframeEntry),
+                                       fnv(&header, sizeof(header), kFnvBasis))) {
+                setSource(fileSize, mtimeNs);
+                ret = RT_OK;
+            }
+        }
+        fclose(fp);
+        if (ret != RT_OK) {
+            clear();
+        }
+        return ret;
+    }
+
+    static std::string pathFor(const char *media) {
+        return std::string(media) + RT_KEYFRAME_INDEX_SUFFIX;
+    }
+
+    static RT_RET identify(const char *path, INT64 *fileSize, INT64 *mtimeNs) {
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return RT_ERR_OPEN_FILE;
+        }
+        *fileSize = static_cast<INT64>(st.st_size);
+        *mtimeNs  = static_cast<INT64>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        return RT_OK;
+    }
+
+ private:
+    static const UINT64 kFnvBasis = 1469598103934665603ull;
+
+    static RTKeyframeEntry makeKey(INT32 track, INT64 timeUs) {
+        RTKeyframeEntry key;
+        key.timeUs = timeUs;
+        key.offset = 0;
+        key.track  = track;
+        return key;
+    }
+
+    static bool lessThan(const RTKeyframeEntry &a, const RTKeyframeEntry &b) {
+        return (a.track != b.track) ? a.track < b.track : a.timeUs < b.timeUs;
+    }
+
+    static bool sameTime(const RTKeyframeEntry &a, const RTKeyframeEntry &b) {
+        return a.track == b.track && a.timeUs == b.timeUs;
+    }
+
+    static UINT64 fnv(const void *data, size_t size, UINT64 hash) {
+        const UINT8 *bytes = reinterpret_cast<const UINT8 *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+ private:
+    std::vector<RTKeyframeEntry>    mEntries;
+    INT64                           mFileSize;
+    INT64                           mMtimeNs;
+};
+
+/*
+ * finds the keyframes of an mpeg-ts stream fed in arbitrary chunks. mp4 and
+ * mkv carry their own sample index (stss, cues), ts has none, which is why
+ * seeking in it rescanned the file.
+ *
+ * a keyframe is the ts packet starting a video pes (stream id 0xe0-0xef)
+ * with random_access_indicator set in its adaptation field. muxers that
+ * leave the flag out are covered when the codec is given: the first vcl
+ * nal unit of the pes must be h.264 idr or hevc irap. it is looked for
+ * through the following packets of the pid, as parameter sets and sei can
+ * push it out of the first one, until the next pes starts. pts wraps at 33
+ * bits are unwrapped per pid. 192 byte m2ts packets are not handled.
+ */
+class RTTsIndexScanner {
+ public:
+    explicit RTTsIndexScanner(RTKeyframeIndex *index, RTCodecID codec = RT_VIDEO_ID_Unused)
+            : mIndex(index), mCodec(codec), mCarry(0), mPackets(0), mTracks(0), mPending(0),
+              mHaveFirst(RT_FALSE), mFirstPts(0) {}
+
+    // chunks must follow each other in the file, offset is the file offset of data.
+    void feed(const void *data, UINT32 size, INT64 offset) {
+        const UINT8 *bytes = reinterpret_cast<const UINT8 *>(data);
+        if (mCarry > 0) {
+            const UINT32 need = RT_MIN(RT_TS_PACKET_SIZE - mCarry, size);
+            memcpy(mPacket + mCarry, bytes, need);
+            mCarry += need;
+            if (mCarry < RT_TS_PACKET_SIZE) {
+                return;
+            }
+            parsePacket(mPacket, offset - (RT_TS_PACKET_SIZE - need));
+            bytes  += need;
+            size   -= need;
+            offset += need;
+            mCarry  = 0;
+        }
+        UINT32 pos = 0;
+        while (size - pos >= RT_TS_PACKET_SIZE) {
+            // resync on a sync byte followed by another one a packet later.
+            if (bytes[pos] != 0x47 || (size - pos > RT_TS_PACKET_SIZE && bytes[pos + RT_TS_PACKET_SIZE] != 0x47)) {
+                pos++;
+                continue;
+            }
+            parsePacket(bytes + pos, offset + pos);
+            pos += RT_TS_PACKET_SIZE;
+        }
+        mCarry = size - pos;
+        memcpy(mPacket, bytes + pos, mCarry);
+    }
+
+    INT64 packets() const { return mPackets; }
+
+    // the file starts with RT_TS_PROBE_PACKETS sync bytes a packet apart, or all its packets when shorter.
+    static RT_BOOL probe(const void *data, UINT32 size) {
+        const UINT8 *bytes = reinterpret_cast<const UINT8 *>(data);
+        const UINT32 packets = RT_MIN(static_cast<UINT32>(RT_TS_PROBE_PACKETS), size / RT_TS_PACKET_SIZE);
+        for (UINT32 i = 0; i < packets; i++) {
+            if (bytes[i * RT_TS_PACKET_SIZE] != 0x47) {
+                return RT_FALSE;
+            }
+        }
+        return (packets > 0) ? RT_TRUE : RT_FALSE;
+    }
+
+ private:
+    typedef struct _PidState {
+        INT32   track;
+        RT_BOOL havePts;
+        INT64   lastPts;    // unwrapped
+        RT_BOOL pending;    // the pes started without a vcl nal unit yet
+        INT64   pendingUs;
+        INT64   pendingOffset;
+        UINT8   tail[3];    // last es bytes, a start code may span two packets
+        UINT32  tailSize;
+    } PidState;
+
+    void parsePacket(const UINT8 *packet, INT64 offset) {
+        if (packet[0] != 0x47) {
+            return;
+        }
+        mPackets++;
+        const RT_BOOL start = (packet[1] & 0x40) ? RT_TRUE : RT_FALSE;
+        const INT32 pid     = ((packet[1] & 0x1f) << 8) | packet[2];
+        const INT32 control = (packet[3] >> 4) & 0x3;
+        if (!(control & 0x1) || pid == 0x1fff) {
+            return;
+        }
+        UINT32 pos = 4;
+        RT_BOOL randomAccess = RT_FALSE;
+        if (control & 0x2) {
+            randomAccess = (packet[4] > 0 && (packet[5] & 0x40)) ? RT_TRUE : RT_FALSE;
+            pos += 1 + packet[4];
+        }
+        if (mPending > 0) {
+            std::map<INT32, PidState>::iterator it = mPids.find(pid);
+            if (it != mPids.end() && it->second.pending) {
+                if (start) {
+                    // the pes ended without a vcl nal unit.
+                    it->second.pending = RT_FALSE;
+                    mPending--;
+                } else if (pos < RT_TS_PACKET_SIZE) {
+                    resume(&it->second, packet + pos, RT_TS_PACKET_SIZE - pos);
+                }
+            }
+        }
+        if (!start) {
+            return;
+        }
+        // pes header up to the pts.
+        if (pos + 14 > RT_TS_PACKET_SIZE) {
+            return;
+        }
+        const UINT8 *pes = packet + pos;
+        if (pes[0] != 0 || pes[1] != 0 || pes[2] != 1 || (pes[3] & 0xf0) != 0xe0 || !(pes[7] & 0x80)) {
+            return;
+        }
+        const INT64 raw = (static_cast<INT64>((pes[9] >> 1) & 0x7) << 30) | (static_cast<INT64>(pes[10]) << 22)
+                        | (static_cast<INT64>(pes[11] >> 1) << 15) | (static_cast<INT64>(pes[12]) << 7)
+                        | (pes[13] >> 1);
+        std::map<INT32, PidState>::iterator it = mPids.find(pid);
+        if (it == mPids.end()) {
+            PidState state;
+            memset(&state, 0, sizeof(state));
+            state.track = mTracks++;
+            it = mPids.insert(std::make_pair(pid, state)).first;
+        }
+        const INT64 pts = unwrap(&it->second, raw);
+        if (!mHaveFirst) {
+            mHaveFirst = RT_TRUE;
+            mFirstPts  = pts;
+        }
+        const INT64 timeUs = (pts - mFirstPts) * 100 / 9;
+        if (randomAccess) {
+            mIndex->add(it->second.track, timeUs, offset);
+            return;
+        }
+        if (mCodec != RT_VIDEO_ID_AVC && mCodec != RT_VIDEO_ID_HEVC) {
+            return;
+        }
+        PidState *state = &it->second;
+        state->pending       = RT_TRUE;
+        state->pendingUs     = timeUs;
+        state->pendingOffset = offset;
+        state->tailSize      = 0;
+        mPending++;
+        const UINT32 esPos = pos + 9 + pes[8];
+        if (esPos < RT_TS_PACKET_SIZE) {
+            resume(state, packet + esPos, RT_TS_PACKET_SIZE - esPos);
+        }
+    }
+
+    // looks for the first vcl nal unit of a pending pes in the next es bytes.
+    void resume(PidState *state, const UINT8 *es, UINT32 size) {
+        UINT8 joined[3 + RT_TS_PACKET_SIZE];
+        memcpy(joined, state->tail, state->tailSize);
+        memcpy(joined + state->tailSize, es, size);
+        const UINT32 total = state->tailSize + size;
+        const INT32 key = startsKeyframe(joined, total);
+        if (key < 0) {
+            state->tailSize = RT_MIN(total, 3U);
+            memcpy(state->tail, joined + total - state->tailSize, state->tailSize);
+            return;
+        }
+        if (key > 0) {
+            mIndex->add(state->track, state->pendingUs, state->pendingOffset);
+        }
+        state->pending = RT_FALSE;
+        mPending--;
+    }
+
+    // nearest to the last pts of the pid, reordered frames may go back across a wrap.
+    static INT64 unwrap(PidState *state, INT64 raw) {
+        const INT64 period = 1LL << 33;
+        INT64 pts = raw;
+        if (state->havePts) {
+            const INT64 base = state->lastPts - (((state->lastPts % period) + period) % period);
+            pts = base + raw;
+            if (pts - state->lastPts > period / 2) {
+                pts -= period;
+            } else if (state->lastPts - pts > period / 2) {
+                pts += period;
+            }
+        }
+        state->havePts = RT_TRUE;
+        state->lastPts = pts;
+        return pts;
+    }
+
+    // 1 when the first vcl nal unit in es is a keyframe, 0 when it is not, -1 without one.
+    INT32 startsKeyframe(const UINT8 *es, UINT32 size) const {
+        for (UINT32 i = 0; i + 3 < size; i++) {
+            if (es[i] != 0 || es[i + 1] != 0 || es[i + 2] != 1) {
+                continue;
+            }
+            const UINT8 nal = es[i + 3];
+            if (mCodec == RT_VIDEO_ID_AVC) {
+                const INT32 type = nal & 0x1f;
+                if (type >= 1 && type <= 5) {
+                    return (type == 5) ? 1 : 0;
+                }
+            } else {
+                const INT32 type = (nal >> 1) & 0x3f;
+                if (type < 32) {
+                    return (type >= 16 && type <= 21) ? 1 : 0;
+                }
+            }
+            i += 2;
+        }
+        return -1;
+    }
+
+ private:
+    RTKeyframeIndex            *mIndex;
+    RTCodecID                   mCodec;
+    UINT8                       mPacket[RT_TS_PACKET_SIZE];
+    UINT32                      mCarry;
+    INT64                       mPackets;
+    INT32                       mTracks;
+    INT32                       mPending;   // pids with a pending pes
+    std::map<INT32, PidState>   mPids;
+    RT_BOOL                     mHaveFirst;
+    INT64                       mFirstPts;
+};
+
+/*
+ * keyframe indexes of recently opened files. open() takes the index from
+ * memory, else from the .rtidx file beside the media, else scans the file
+ * once through a mapped RTFileSource and saves the result beside it; a
+ * read-only directory keeps it in memory only. a file that does not start
+ * with ts packets, or has no video keyframe in them, gets RT_ERR_UNSUPPORT
+ * and no .rtidx. the demuxer opens the index with the file and seekTo()
+ * looks the target up in it:
+ *
+ *   RTKeyframeIndex index;
+ *   if (RTKeyframeIndexCache::instance()->open(uri, RT_VIDEO_ID_AVC, &index) == RT_OK
+ *           && index.find(0, seekUs, RT_SEEK_PREVIOUS_SYNC, &entry) == RT_OK) {
+ *       avio_seek(pb, entry.offset, SEEK_SET);
+ *   }
+ */
+class RTKeyframeIndexCache {
+ public:
+    static RTKeyframeIndexCache* instance() {
+        static RTKeyframeIndexCache cache;
+        return &cache;
+    }
+
+    RT_RET open(const char *path, RTCodecID codec, RTKeyframeIndex *index, RT_BOOL persist = RT_TRUE) {
+        INT64 fileSize = 0, mtimeNs = 0;
+        if (path == RT_NULL || RTKeyframeIndex::identify(path, &fileSize, &mtimeNs) != RT_OK) {
+            return RT_ERR_OPEN_FILE;
+        }
+        if (lookup(path, fileSize, mtimeNs, index)) {
+            return RT_OK;
+        }
+        const std::string indexPath = RTKeyframeIndex::pathFor(path);
+        if (!persist || index->load(indexPath.c_str(), fileSize, mtimeNs) != RT_OK) {
+            RT_RET ret = scan(path, codec, index);
+            if (ret != RT_OK) {
+                return ret;
+            }
+            index->setSource(fileSize, mtimeNs);
+            if (persist && index->save(indexPath.c_str()) != RT_OK) {
+                RT_LOGD("can not save %s, the index of %s stays in memory", indexPath.c_str(), path);
+            }
+        }
+        insert(path, *index);
+        return RT_OK;
+    }
+
+    // rebuilt from the file at the next open, e.g. once a recorder appended to it.
+    void drop(const char *path) {
+        RtMutex::RtAutolock autoLock(mLock);
+        for (std::list<CacheItem>::iterator it = mItems.begin(); it != mItems.end(); ++it) {
+            if (it->first == path) {
+                mItems.erase(it);
+                return;
+            }
+        }
+    }
+
+    static RT_RET scan(const char *path, RTCodecID codec, RTKeyframeIndex *index) {
+        RTFileSource source;
+        index->clear();
+        RT_RET ret = source.open(path, RT_KEYFRAME_SCAN_CHUNK, RT_FILE_READ_AUTO, RT_FALSE);
+        if (ret != RT_OK) {
+            return ret;
+        }
+        RTTsIndexScanner scanner(index, codec);
+        RTFileChunk chunk;
+        RT_BOOL first = RT_TRUE;
+        while (source.read(&chunk) == RT_OK) {
+            if (first && !RTTsIndexScanner::probe(chunk.data, chunk.size)) {
+                RTFileSource::release(&chunk);
+                RT_LOGE("%s is not mpeg-ts, it has no keyframe index", path);
+                return RT_ERR_UNSUPPORT;
+            }
+            first = RT_FALSE;
+            scanner.feed(chunk.data, chunk.size, chunk.offset);
+            RTFileSource::release(&chunk);
+        }
+        if (index->size() == 0) {
+            RT_LOGE("%s has no video keyframe, it gets no index", path);
+            return RT_ERR_UNSUPPORT;
+        }
+        index->seal();
+        return RT_OK;
+    }
+
+ private:
+    typedef std::pair<std::string, RTKeyframeIndex> CacheItem;
+
+    RTKeyframeIndexCache() {}
+
+    RT_BOOL lookup(const char *path, INT64 fileSize, INT64 mtimeNs, RTKeyframeIndex *index) {
+        RtMutex::RtAutolock autoLock(mLock);
+        for (std::list<CacheItem>::iterator it = mItems.begin(); it != mItems.end(); ++it) {
+            if (it->first == path && it->second.matches(fileSize, mtimeNs)) {
+                mItems.splice(mItems.begin(), mItems, it);
+                *index = mItems.front().second;
+                return RT_TRUE;
+            }
+        }
+        return RT_FALSE;
+    }
+
+    void insert(const char *path, const RTKeyframeIndex &index) {
+        RtMutex::RtAutolock autoLock(mLock);
+        for (std::list<CacheItem>::iterator it = mItems.begin(); it != mItems.end(); ++it) {
+            if (it->first == path) {
+                mItems.erase(it);
+                break;
+            }
+        }
+        mItems.push_front(CacheItem(path, index));
+        while (mItems.size() > RT_KEYFRAME_INDEX_CACHED) {
+            mItems.pop_back();
+        }
+    }
+
+ private:
+    RtMutex                 mLock;
+    std::list<CacheItem>    mItems;
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTKEYFRAMEINDEX_H_
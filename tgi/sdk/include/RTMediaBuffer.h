@@ -167,4 +167,15 @@ class RTMediaBuffer : public RTObject {
     std::map<INT32, RtMetaData *>   mExtraMetas;
 };
 
+/*
+ * hands out memory owned elsewhere, e.g. a demuxed AVPacket or a file
+ * mapping, without copying it: unref(ref) runs when the buffer is freed
+ * and drops the owner's reference.
+ */
+static inline RTMediaBuffer* rt_media_buffer_wrap(void *data, UINT32 size, UserDataFree unref, void *ref) {
+    RTMediaBuffer *buffer = new RTMediaBuffer(data, size);
+    buffer->setUserData(ref, unref);
+    return buffer;
+}
+
 #endif  // SRC_RT_MEDIA_INCLUDE_RTMEDIABUFFER_H_
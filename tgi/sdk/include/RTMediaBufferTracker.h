@@ -0,0 +1,237 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: lifetime tracker of outstanding media buffers
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTMEDIABUFFERTRACKER_H_
+#define SRC_RT_MEDIA_INCLUDE_RTMEDIABUFFERTRACKER_H_
+
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rt_header.h"
+
+#define RT_MB_TRACKER_SHARDS            16
+#define RT_MB_TRACKER_HOLD_WARN_MS      2000
+#define RT_MB_TRACKER_CHECK_MS          1000    // checkHeld() period of poll()
+#define RT_MB_TRACKER_NAME_LEN          32
+#define RT_MB_TRACKER_ENV_ENABLE        "rt_mb_tracker"
+#define RT_MB_TRACKER_ENV_HOLD_MS       "rt_mb_tracker_hold_ms"
+
+typedef struct _RTBufferTrackRecord {
+    const void  *buffer;
+    INT32        poolId;
+    INT32        ownerId;       // node id, RT_INVALID_NODE_ID(-1) for app/stream
+    char         ownerName[RT_MB_TRACKER_NAME_LEN];     // copied, the node may be gone by a leak report
+    UINT64       acquireUs;     // when the buffer left its pool
+    UINT64       transferUs;    // when the current owner got it
+    RT_BOOL      warned;        // checkHeld() reported the current owner already
+} RTBufferTrackRecord;
+
+/*
+ * records pool, owner and acquire time of every buffer which left its pool.
+ * the records are spread over RT_MB_TRACKER_SHARDS locks hashed by buffer
+ * address, so concurrent nodes rarely contend. disabled trackers return
+ * before taking any lock.
+ *
+ * typical hooks:
+ *   acquire()  after dequeOutputBuffer()/pool acquire
+ *   transfer() when a node takes an input buffer
+ *   release()  when the buffer goes back to its pool
+ *
+ * buffers held too long are reported by checkHeld(), run every
+ * RT_MB_TRACKER_CHECK_MS by poll() from acquire() and the stats server,
+ * once per owner of a buffer.
+ */
+class RTMediaBufferTracker {
+ public:
+    static RTMediaBufferTracker* instance() {
+        static RTMediaBufferTracker tracker;
+        return &tracker;
+    }
+
+    void    setEnable(RT_BOOL enable) { mEnable.store(enable, std::memory_order_relaxed); }
+    RT_BOOL isEnable() const { return mEnable.load(std::memory_order_relaxed); }
+    void    setHoldWarnMs(UINT32 ms) { mHoldWarnUs.store((UINT64)ms * 1000, std::memory_order_relaxed); }
+
+    void acquire(const void *buffer, INT32 poolId, INT32 ownerId, const char *ownerName) {
+        if (!isEnable() || buffer == RT_NULL) {
+            return;
+        }
+        RTBufferTrackRecord record;
+        record.buffer     = buffer;
+        record.poolId     = poolId;
+        record.ownerId    = ownerId;
+        record.acquireUs  = RtTime::getRelativeTimeUs();
+        record.transferUs = record.acquireUs;
+        record.warned     = RT_FALSE;
+        setOwnerName(&record, ownerName);
+        {
+            Shard &shard = shardOf(buffer);
+            RtMutex::RtAutolock autoLock(shard.mLock);
+            shard.mRecords[buffer] = record;
+        }
+        poll(record.acquireUs);
+    }
+
+    void transfer(const void *buffer, INT32 ownerId, const char *ownerName) {
+        if (!isEnable() || buffer == RT_NULL) {
+            return;
+        }
+        Shard &shard = shardOf(buffer);
+        RtMutex::RtAutolock autoLock(shard.mLock);
+        std::unordered_map<const void *, RTBufferTrackRecord>::iterator it = shard.mRecords.find(buffer);
+        if (it != shard.mRecords.end()) {
+            it->second.ownerId    = ownerId;
+            it->second.transferUs = RtTime::getRelativeTimeUs();
+            it->second.warned     = RT_FALSE;
+            setOwnerName(&it->second, ownerName);
+        }
+    }
+
+    void release(const void *buffer) {
+        if (!isEnable() || buffer == RT_NULL) {
+            return;
+        }
+        Shard &shard = shardOf(buffer);
+        RtMutex::RtAutolock autoLock(shard.mLock);
+        shard.mRecords.erase(buffer);
+    }
+
+    // snapshot of all outstanding buffers, poolId < 0 collects every pool.
+    INT32 collect(std::vector<RTBufferTrackRecord> *records, INT32 poolId = -1) {
+        records->clear();
+        for (INT32 i = 0; i < RT_MB_TRACKER_SHARDS; i++) {
+            RtMutex::RtAutolock autoLock(mShards[i].mLock);
+            std::unordered_map<const void *, RTBufferTrackRecord>::iterator it;
+            for (it = mShards[i].mRecords.begin(); it != mShards[i].mRecords.end(); ++it) {
+                if (poolId < 0 || it->second.poolId == poolId) {
+                    records->push_back(it->second);
+                }
+            }
+        }
+        return static_cast<INT32>(records->size());
+    }
+
+    // outstanding buffer count of every owner, for queryStat() style reports.
+    void countByOwner(std::map<std::string, INT32> *counts, INT32 poolId = -1) {
+        std::vector<RTBufferTrackRecord> records;
+        collect(&records, poolId);
+        counts->clear();
+        for (size_t i = 0; i < records.size(); i++) {
+            (*counts)[records[i].ownerName]++;
+        }
+    }
+
+    /*
+     * counts the buffers held by their owner longer than the threshold and
+     * warns about the ones not reported for that owner yet.
+     */
+    INT32 checkHeld() {
+        const UINT64 now   = RtTime::getRelativeTimeUs();
+        const UINT64 limit = mHoldWarnUs.load(std::memory_order_relaxed);
+        INT32 count = 0;
+        for (INT32 i = 0; i < RT_MB_TRACKER_SHARDS; i++) {
+            RtMutex::RtAutolock autoLock(mShards[i].mLock);
+            std::unordered_map<const void *, RTBufferTrackRecord>::iterator it;
+            for (it = mShards[i].mRecords.begin(); it != mShards[i].mRecords.end(); ++it) {
+                RTBufferTrackRecord &record = it->second;
+                const UINT64 held = now - record.transferUs;
+                if (held < limit) {
+                    continue;
+                }
+                if (!record.warned) {
+                    RT_LOGW("buffer %p of pool %d held by %s(%d) for %lld ms", record.buffer, record.poolId,
+                             record.ownerName, record.ownerId, (long long)(held / 1000));
+                    record.warned = RT_TRUE;
+                }
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // runs checkHeld() at most every RT_MB_TRACKER_CHECK_MS, from whichever thread comes first.
+    void poll(UINT64 nowUs) {
+        UINT64 next = mNextCheckUs.load(std::memory_order_relaxed);
+        if (!isEnable() || nowUs < next) {
+            return;
+        }
+        if (mNextCheckUs.compare_exchange_strong(next, nowUs + (UINT64)RT_MB_TRACKER_CHECK_MS * 1000,
+                                                 std::memory_order_relaxed)) {
+            checkHeld();
+        }
+    }
+
+    // leak report, called from dump() of graph and pools.
+    void dump(INT32 poolId = -1) {
+        std::vector<RTBufferTrackRecord> records;
+        collect(&records, poolId);
+        const UINT64 now   = RtTime::getRelativeTimeUs();
+        const UINT64 limit = mHoldWarnUs.load(std::memory_order_relaxed);
+        INT32 heldTooLong = 0;
+        RT_LOGE("outstanding buffers: %d", (INT32)records.size());
+        for (size_t i = 0; i < records.size(); i++) {
+            const UINT64 held = now - records[i].transferUs;
+            RT_LOGE("  buffer %p pool %d owner %s(%d) acquired %lld ms ago, held %lld ms%s",
+                     records[i].buffer, records[i].poolId, records[i].ownerName,
+                     records[i].ownerId, (long long)((now - records[i].acquireUs) / 1000),
+                     (long long)(held / 1000), held >= limit ? " (too long)" : "");
+            heldTooLong += (held >= limit) ? 1 : 0;
+        }
+        RT_LOGE("held longer than %lld ms: %d", (long long)(limit / 1000), heldTooLong);
+    }
+
+ private:
+    RTMediaBufferTracker()
+            : mEnable(RT_FALSE), mHoldWarnUs((UINT64)RT_MB_TRACKER_HOLD_WARN_MS * 1000), mNextCheckUs(0) {
+        UINT32 value = 0;
+        rt_env_get_u32(RT_MB_TRACKER_ENV_ENABLE, &value, 0);
+        mEnable.store(value ? RT_TRUE : RT_FALSE, std::memory_order_relaxed);
+        rt_env_get_u32(RT_MB_TRACKER_ENV_HOLD_MS, &value, RT_MB_TRACKER_HOLD_WARN_MS);
+        setHoldWarnMs(value);
+    }
+    RTMediaBufferTracker(const RTMediaBufferTracker&) = delete;
+    RTMediaBufferTracker& operator=(const RTMediaBufferTracker&) = delete;
+
+    struct Shard {
+        RtMutex mLock;
+        std::unordered_map<const void *, RTBufferTrackRecord> mRecords;
+    };
+
+    Shard& shardOf(const void *buffer) {
+        // buffers are at least 8 bytes aligned, skip the always-zero bits.
+        UINT64 key = reinterpret_cast<uintptr_t>(buffer) >> 4;
+        return mShards[(key ^ (key >> 7)) % RT_MB_TRACKER_SHARDS];
+    }
+
+    static void setOwnerName(RTBufferTrackRecord *record, const char *name) {
+        strncpy(record->ownerName, name ? name : "unknown", sizeof(record->ownerName) - 1);
+        record->ownerName[sizeof(record->ownerName) - 1] = '\0';
+    }
+
+ private:
+    std::atomic<RT_BOOL> mEnable;
+    std::atomic<UINT64>  mHoldWarnUs;
+    std::atomic<UINT64>  mNextCheckUs;
+    Shard                mShards[RT_MB_TRACKER_SHARDS];
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTMEDIABUFFERTRACKER_H_
@@ -105,6 +105,14 @@ enum {
     kKeyFrameSequence    = MKTAG('f', 's', 'e', 'q'),   // INT32 Frame Sequence
     kKeyDisplayW         = MKTAG('d', 'w', 'i', 'd'),   // INT32
     kKeyDisplayH         = MKTAG('d', 'h', 'e', 'i'),   // INT32
+    kKeyFrameCaptureUs   = MKTAG('f', 'c', 'u', 's'),   // INT64 monotonic capture time
+    kKeyFrameTraceId     = MKTAG('f', 't', 'i', 'd'),   // INT64 end-to-end trace id
+    kKeyFrameTraceSrc    = MKTAG('f', 't', 's', 'r'),   // INT32 node id of the source of the trace
+    kKeyFrameTraceGraph  = MKTAG('f', 't', 'g', 'u'),   // INT64 uid of the graph of the trace source
+    kKeyMotionMap        = MKTAG('m', 'd', 'm', 'p'),   // UINT8[] motion level per block, row major
+    kKeyMotionMapWidth   = MKTAG('m', 'd', 'm', 'w'),   // INT32 blocks per row of the motion map
+    kKeyMotionMapHeight  = MKTAG('m', 'd', 'm', 'h'),   // INT32 block rows of the motion map
+    kKeyMotionRoiMask    = MKTAG('m', 'd', 'r', 'm'),   // INT32 bit i set when roi i moved
 
     /* RTPacket */
     kKeyPacketPtr        = MKTAG('a', 'v', 'p', 't'),   // AVPacket
@@ -0,0 +1,446 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: block motion detection on downscaled luma
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTMOTIONDETECT_H_
+#define SRC_RT_MEDIA_INCLUDE_RTMOTIONDETECT_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_histogram.h"
+#include "rt_metadata.h"
+#include "rt_simd.h"
+#include "RTImageScaler.h"
+#include "RTMediaMetaKeys.h"
+#include "RTNodeCommon.h"
+
+#define RT_MD_BG_BITS           7       // background is luma << 7, its updates fit 16 bit lanes
+#define RT_MD_SEGMENT           8       // pixels summed together by the row kernel
+#define RT_MD_BLOCK             8       // default block size, a multiple of RT_MD_SEGMENT
+#define RT_MD_MAX_BLOCK         64
+#define RT_MD_MAX_ROIS          32      // bits of kKeyMotionRoiMask
+#define RT_MD_THRESHOLD         12      // mean absolute difference of a moving block
+#define RT_MD_LEARN_SHIFT       4       // the background moves 1/16 towards every frame
+#define RT_MD_ROI_RATIO         5       // percent of the blocks of a roi that must move
+
+/*
+ * one luma row against the background: adds |luma - background| of every
+ * RT_MD_SEGMENT pixels to sads[i / RT_MD_SEGMENT], then moves the
+ * background 1 / 2^shift towards the row. background pixels are luma
+ * << RT_MD_BG_BITS, shift 0 makes it the row itself. count is a multiple
+ * of RT_MD_SEGMENT, the simd versions give the same bits as the scalar one.
+ */
+static inline void rt_md_row(const UINT8 *luma, UINT16 *bg, INT32 count, INT32 shift, UINT32 *sads,
+                             RT_BOOL simd) {
+    INT32 i = 0;
+#if defined(RT_SIMD_NEON)
+    if (simd) {
+        const int16x8_t right = vdupq_n_s16(static_cast<INT16>(-shift));
+        for (; i + 16 <= count; i += 16) {
+            uint8x16_t cur  = vld1q_u8(luma + i);
+            uint16x8_t bgLo = vld1q_u16(bg + i);
+            uint16x8_t bgHi = vld1q_u16(bg + i + 8);
+            uint8x16_t ref  = vcombine_u8(vshrn_n_u16(bgLo, RT_MD_BG_BITS), vshrn_n_u16(bgHi, RT_MD_BG_BITS));
+            uint64x2_t sad  = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vabdq_u8(cur, ref))));
+            sads[i / RT_MD_SEGMENT]     += static_cast<UINT32>(vgetq_lane_u64(sad, 0));
+            sads[i / RT_MD_SEGMENT + 1] += static_cast<UINT32>(vgetq_lane_u64(sad, 1));
+            int16x8_t lo = vreinterpretq_s16_u16(vshll_n_u8(vget_low_u8(cur), RT_MD_BG_BITS));
+            int16x8_t hi = vreinterpretq_s16_u16(vshll_n_u8(vget_high_u8(cur), RT_MD_BG_BITS));
+            lo = vsubq_s16(lo, vreinterpretq_s16_u16(bgLo));
+            hi = vsubq_s16(hi, vreinterpretq_s16_u16(bgHi));
+            lo = vaddq_s16(vreinterpretq_s16_u16(bgLo), vshlq_s16(lo, right));
+            hi = vaddq_s16(vreinterpretq_s16_u16(bgHi), vshlq_s16(hi, right));
+            vst1q_u16(bg + i,     vreinterpretq_u16_s16(lo));
+            vst1q_u16(bg + i + 8, vreinterpretq_u16_s16(hi));
+        }
+    }
+#elif defined(RT_SIMD_SSE2)
+    if (simd) {
+        const __m128i zero  = _mm_setzero_si128();
+        const __m128i right = _mm_cvtsi32_si128(shift);
+        for (; i + 16 <= count; i += 16) {
+            __m128i cur  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(luma + i));
+            __m128i bgLo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bg + i));
+            __m128i bgHi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bg + i + 8));
+            __m128i ref  = _mm_packus_epi16(_mm_srli_epi16(bgLo, RT_MD_BG_BITS),
+                                            _mm_srli_epi16(bgHi, RT_MD_BG_BITS));
+            __m128i sad  = _mm_sad_epu8(cur, ref);
+            sads[i / RT_MD_SEGMENT]     += static_cast<UINT32>(_mm_cvtsi128_si32(sad));
+            sads[i / RT_MD_SEGMENT + 1] += static_cast<UINT32>(_mm_cvtsi128_si32(_mm_srli_si128(sad, 8)));
+            __m128i lo = _mm_sub_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(cur, zero), RT_MD_BG_BITS), bgLo);
+            __m128i hi = _mm_sub_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(cur, zero), RT_MD_BG_BITS), bgHi);
+            lo = _mm_add_epi16(bgLo, _mm_sra_epi16(lo, right));
+            hi = _mm_add_epi16(bgHi, _mm_sra_epi16(hi, right));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bg + i),     lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bg + i + 8), hi);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        const INT32 ref  = bg[i] >> RT_MD_BG_BITS;
+        const INT32 diff = (luma[i] << RT_MD_BG_BITS) - bg[i];
+        sads[i / RT_MD_SEGMENT] += static_cast<UINT32>(abs(luma[i] - ref));
+        bg[i] = static_cast<UINT16>(bg[i] + (diff >> shift));
+    }
+}
+
+/*
+ * motion detection of the md filter, on the luma of every frame scaled to
+ * opt_md_ds_width x opt_md_ds_height.
+ *
+ * the frame is cut in blocks of opt_md_blk_size pixels, a block moves when
+ * the mean absolute difference of its pixels to a running background
+ * reaches opt_md_threshold. the background follows every frame by
+ * 1 / 2^opt_md_learn_shift, opt_md_single compares against the previous
+ * frame instead. a roi moves when opt_md_roi_ratio percent of its blocks do.
+ *
+ * all rois are evaluated in one pass: every block row is scaled from the
+ * source luma when the sizes differ, differenced and folded into the
+ * background once, only over the columns some roi covers, and the block
+ * levels are then counted into every roi touching them. rois come from
+ * opt_md_roi_rect in opt_md_ori_width x opt_md_ori_height coordinates,
+ * without any the whole frame is one roi. blocks past the last whole one
+ * on the right and bottom edges are not looked at. rois changed so that
+ * columns nobody covered before are looked at prime the background again,
+ * the frame after reports no motion.
+ *
+ * attach() stores the map in the output buffer meta: kKeyMotionMap holds
+ * one byte per block, 0 when still or outside every roi, else the mean
+ * difference clipped to 1..255.
+ *
+ *   RTMotionDetector detector;
+ *   detector.loadOptions(options);
+ *   detector.process(&luma);
+ *   detector.attach(buffer->getMetaData());
+ */
+class RTMotionDetector {
+ public:
+    RTMotionDetector()
+            : mSimd(RT_TRUE), mWidth(0), mHeight(0), mBlkSize(RT_MD_BLOCK), mThreshold(RT_MD_THRESHOLD),
+              mShift(RT_MD_LEARN_SHIFT), mRatio(RT_MD_ROI_RATIO), mCols(0), mRows(0), mPrimed(RT_FALSE),
+              mRoiMask(0), mDirty(RT_TRUE) {}
+
+    // RT_FALSE runs the scalar reference kernel, e.g. to compare results.
+    void    setSimd(RT_BOOL simd) { mSimd = simd; }
+
+    // the size frames are detected at, blkSize a multiple of RT_MD_SEGMENT.
+    RT_RET init(INT32 width, INT32 height, INT32 blkSize = RT_MD_BLOCK) {
+        if (width < blkSize || height < blkSize || blkSize < RT_MD_SEGMENT || blkSize > RT_MD_MAX_BLOCK
+                || blkSize % RT_MD_SEGMENT) {
+            return RT_ERR_VALUE;
+        }
+        mWidth   = width;
+        mHeight  = height;
+        mBlkSize = blkSize;
+        mCols    = width / blkSize;
+        mRows    = height / blkSize;
+        mMap.assign(mCols * mRows, 0);
+        mBackground.assign(mCols * blkSize * mRows * blkSize, 0);
+        mSads.assign(mCols * blkSize / RT_MD_SEGMENT, 0);
+        mPrimed  = RT_FALSE;
+        mDirty   = RT_TRUE;
+        return RT_OK;
+    }
+
+    void setThreshold(INT32 meanDiff) { mThreshold = RT_CLIP(meanDiff, 1, 255); }
+    void setRoiRatio(INT32 percent) { mRatio = RT_CLIP(percent, 0, 100); }
+
+    // 0 compares every frame to the previous one.
+    void setLearnShift(INT32 shift) { mShift = RT_CLIP(shift, 0, RT_MD_BG_BITS); }
+
+    // in detection coordinates, clipped to the frame.
+    RT_RET addRoi(const RTRect &rect) {
+        if (rect.w <= 0 || rect.h <= 0 || mRois.size() >= RT_MD_MAX_ROIS) {
+            return RT_ERR_VALUE;
+        }
+        mRois.push_back(rect);
+        mDirty = RT_TRUE;
+        return RT_OK;
+    }
+
+    void clearRois() {
+        mRois.clear();
+        mDirty = RT_TRUE;
+    }
+
+    /*
+     * opt_md_roi_rect lists opt_md_roi_cnt rects as x,y,w,h groups, any
+     * other characters separate the numbers, e.g. "(0,0,960,540)(960,0,960,540)".
+     */
+    RT_RET loadOptions(RtMetaData *options) {
+        INT32 width = 0, height = 0, oriWidth = 0, oriHeight = 0, blkSize = RT_MD_BLOCK, single = 0;
+        INT32 count = -1;
+        const char *rects = RT_NULL;
+        if (options == RT_NULL || !options->findInt32(OPT_FILTER_MD_DS_WIDTH, &width)
+                || !options->findInt32(OPT_FILTER_MD_DS_HEIGHT, &height)) {
+            return RT_ERR_VALUE;
+        }
+        options->findInt32(OPT_FILTER_MD_BLK_SIZE, &blkSize);
+        RT_RET ret = init(width, height, blkSize);
+        if (ret != RT_OK) {
+            RT_LOGE("bad md size %dx%d, block %d", width, height, blkSize);
+            return ret;
+        }
+        options->findInt32(OPT_FILTER_MD_THRESHOLD, &mThreshold);
+        options->findInt32(OPT_FILTER_MD_LEARN_SHIFT, &mShift);
+        options->findInt32(OPT_FILTER_MD_ROI_RATIO, &mRatio);
+        options->findInt32(OPT_FILTER_MD_SINGLE_REF, &single);
+        setThreshold(mThreshold);
+        setLearnShift(single ? 0 : mShift);
+        setRoiRatio(mRatio);
+
+        clearRois();
+        options->findInt32(OPT_FILTER_MD_ORI_WIDTH, &oriWidth);
+        options->findInt32(OPT_FILTER_MD_ORI_HEIGHT, &oriHeight);
+        options->findInt32(OPT_FILTER_MD_ROI_CNT, &count);
+        if (!options->findCString(OPT_FILTER_MD_ROI_RECT, &rects)) {
+            return RT_OK;
+        }
+        oriWidth  = (oriWidth > 0) ? oriWidth : width;
+        oriHeight = (oriHeight > 0) ? oriHeight : height;
+        for (INT32 i = 0; (count < 0 || i < count) && rects != RT_NULL; i++) {
+            INT32 v[4];
+            INT32 found = 0;
+            for (; found < 4 && (rects = nextNumber(rects, &v[found])) != RT_NULL; found++) {}
+            if (found < 4) {
+                break;
+            }
+            RTRect rect;
+            rect.x = static_cast<INT32>(static_cast<INT64>(v[0]) * width / oriWidth);
+            rect.y = static_cast<INT32>(static_cast<INT64>(v[1]) * height / oriHeight);
+            rect.w = static_cast<INT32>(static_cast<INT64>(v[0] + v[2]) * width / oriWidth) - rect.x;
+            rect.h = static_cast<INT32>(static_cast<INT64>(v[1] + v[3]) * height / oriHeight) - rect.y;
+            if (addRoi(rect) != RT_OK) {
+                RT_LOGE("bad md roi %d, [%d, %d, %d, %d]", i, v[0], v[1], v[2], v[3]);
+                return RT_ERR_VALUE;
+            }
+        }
+        return RT_OK;
+    }
+
+    /*
+     * detects one frame, the luma plane of image is scaled to the detection
+     * size row by row when its rect has another size. the first frame after
+     * init() only primes the background.
+     */
+    RT_RET process(const RTScaleImage *image) {
+        RTScalePlane planes[RT_SCALE_MAX_PLANES];
+        if (mCols == 0 || image == RT_NULL || RTImageScaler::getPlanes(image, planes) <= 0
+                || planes[0].channels != 1) {
+            return RT_ERR_VALUE;
+        }
+        const UINT64 start = RtTime::getRelativeTimeUs();
+        if (mDirty) {
+            layout();
+        }
+        std::vector<INT32> moving(mBlockRois.size(), 0);
+        if (planes[0].width != mWidth || planes[0].height != mHeight) {
+            // the tables of the scaler only depend on the source size, it is kept while that stays.
+            RTScalePlane dst = { RT_NULL, mWidth, mWidth, mHeight, 1 };
+            if (mScaler.empty() || !mScaler[0].isSameGeometry(planes[0], dst, RT_SCALE_AREA)) {
+                mScaler.assign(1, RTPlaneScaler(planes[0], dst, RT_SCALE_AREA));
+            } else {
+                mScaler[0].rebind(planes[0], dst);
+            }
+            detect(planes[0], &mScaler[0], &moving);
+        } else {
+            detect(planes[0], RT_NULL, &moving);
+        }
+        mRoiMask = 0;
+        for (size_t i = 0; mPrimed && i < mBlockRois.size(); i++) {
+            if (moving[i] > 0 && moving[i] * 100 >= mRoiBlocks[i] * mRatio) {
+                mRoiMask |= 1u << i;
+            }
+        }
+        if (!mPrimed) {
+            memset(&mMap[0], 0, mMap.size());
+            mPrimed = RT_TRUE;
+        }
+        mFrameUs.record(RtTime::getRelativeTimeUs() - start);
+        return RT_OK;
+    }
+
+    RT_RET attach(RtMetaData *meta) const {
+        if (meta == RT_NULL || mMap.empty()) {
+            return RT_ERR_NULL_PTR;
+        }
+        meta->setInt32(kKeyMotionMapWidth, mCols);
+        meta->setInt32(kKeyMotionMapHeight, mRows);
+        meta->setInt32(kKeyMotionRoiMask, static_cast<INT32>(mRoiMask));
+        return meta->setStructData(kKeyMotionMap, &mMap[0], static_cast<UINT32>(mMap.size())) ? RT_OK : RT_ERR_BAD;
+    }
+
+    const UINT8 *getMap() const { return mMap.empty() ? RT_NULL : &mMap[0]; }
+    INT32   getMapWidth() const { return mCols; }
+    INT32   getMapHeight() const { return mRows; }
+    UINT32  getRoiMask() const { return mRoiMask; }
+    INT32   getRoiNum() const { return mRois.empty() ? 1 : static_cast<INT32>(mRois.size()); }
+    void    getFrameUs(RtHistogramSummary *summary) const { mFrameUs.summary(summary); }
+
+ private:
+    // block columns [begin, end) of a block row some roi covers.
+    typedef struct _Span {
+        INT32 begin;
+        INT32 end;
+    } Span;
+
+    typedef struct _BlockRoi {
+        INT32 x0, y0, x1, y1;   // blocks, exclusive ends
+    } BlockRoi;
+
+    static const char *nextNumber(const char *str, INT32 *value) {
+        while (*str && (*str < '0' || *str > '9')) {
+            str++;
+        }
+        if (!*str) {
+            return RT_NULL;
+        }
+        char *end = RT_NULL;
+        *value = static_cast<INT32>(strtol(str, &end, 10));
+        return end;
+    }
+
+    void detect(const RTScalePlane &plane, const RTPlaneScaler *scaler, std::vector<INT32> *moving) {
+        RTPlaneScaler::Scratch scratch;
+        const INT32 shift = mPrimed ? mShift : 0;
+        const INT32 rowPixels = mCols * mBlkSize;
+        mRow.resize(mWidth);
+        for (INT32 by = 0; by < mRows; by++) {
+            const Span &span = mSpans[by];
+            if (span.end <= span.begin) {
+                continue;
+            }
+            const INT32 x0 = span.begin * mBlkSize;
+            const INT32 count = (span.end - span.begin) * mBlkSize;
+            memset(&mSads[0], 0, mSads.size() * sizeof(UINT32));
+            for (INT32 y = by * mBlkSize; y < (by + 1) * mBlkSize; y++) {
+                const UINT8 *luma = plane.data + y * plane.stride;
+                if (scaler != RT_NULL) {
+                    scaler->scaleRow(y, &mRow[0], &scratch, mSimd);
+                    luma = &mRow[0];
+                }
+                UINT16 *bg = &mBackground[y * rowPixels + x0];
+                rt_md_row(luma + x0, bg, count, shift, &mSads[x0 / RT_MD_SEGMENT], mSimd);
+            }
+            scoreRow(by, span, moving);
+        }
+    }
+
+    /*
+     * a block belongs to a roi when its center is inside. columns the old
+     * spans did not cover have a stale or empty background, the next frame
+     * primes it again.
+     */
+    void layout() {
+        const std::vector<Span> old(mSpans);
+        std::vector<RTRect> rois(mRois);
+        if (rois.empty()) {
+            RTRect whole = { 0, 0, mWidth, mHeight };
+            rois.push_back(whole);
+        }
+        mBlockRois.clear();
+        mRoiBlocks.clear();
+        mSpans.assign(mRows, Span());
+        for (INT32 by = 0; by < mRows; by++) {
+            mSpans[by].begin = mCols;
+            mSpans[by].end   = 0;
+        }
+        for (size_t i = 0; i < rois.size(); i++) {
+            const RTRect &r = rois[i];
+            BlockRoi b;
+            b.x0 = RT_CLIP((r.x + mBlkSize / 2) / mBlkSize, 0, mCols);
+            b.y0 = RT_CLIP((r.y + mBlkSize / 2) / mBlkSize, 0, mRows);
+            b.x1 = RT_CLIP((r.x + r.w + mBlkSize / 2) / mBlkSize, b.x0, mCols);
+            b.y1 = RT_CLIP((r.y + r.h + mBlkSize / 2) / mBlkSize, b.y0, mRows);
+            mBlockRois.push_back(b);
+            mRoiBlocks.push_back((b.x1 - b.x0) * (b.y1 - b.y0));
+            for (INT32 by = b.y0; by < b.y1; by++) {
+                mSpans[by].begin = RT_MIN(mSpans[by].begin, b.x0);
+                mSpans[by].end   = RT_MAX(mSpans[by].end, b.x1);
+            }
+        }
+        for (INT32 by = 0; mPrimed && by < mRows; by++) {
+            const Span &span = mSpans[by];
+            if (span.end > span.begin && (old.size() != mSpans.size() || old[by].end <= old[by].begin
+                    || span.begin < old[by].begin || span.end > old[by].end)) {
+                mPrimed = RT_FALSE;
+            }
+        }
+        // detect() skips the rows no roi covers any more, their blocks of the old rois must not stay in the map.
+        for (INT32 by = 0; by < mRows; by++) {
+            if (mSpans[by].end <= mSpans[by].begin) {
+                memset(&mMap[by * mCols], 0, mCols);
+            }
+        }
+        mDirty = RT_FALSE;
+    }
+
+    void scoreRow(INT32 by, const Span &span, std::vector<INT32> *moving) {
+        const INT32 segments = mBlkSize / RT_MD_SEGMENT;
+        const UINT32 pixels = static_cast<UINT32>(mBlkSize * mBlkSize);
+        UINT8 *map = &mMap[by * mCols];
+        memset(map, 0, mCols);
+        for (INT32 bx = span.begin; bx < span.end; bx++) {
+            UINT32 sad = 0;
+            for (INT32 s = 0; s < segments; s++) {
+                sad += mSads[bx * segments + s];
+            }
+            const INT32 level = static_cast<INT32>(sad / pixels);
+            if (level < mThreshold) {
+                continue;
+            }
+            RT_BOOL inside = RT_FALSE;
+            for (size_t i = 0; i < mBlockRois.size(); i++) {
+                const BlockRoi &b = mBlockRois[i];
+                if (bx >= b.x0 && bx < b.x1 && by >= b.y0 && by < b.y1) {
+                    inside = RT_TRUE;
+                    (*moving)[i]++;
+                }
+            }
+            map[bx] = inside ? static_cast<UINT8>(RT_CLIP(level, 1, 255)) : 0;
+        }
+    }
+
+ private:
+    RT_BOOL                 mSimd;
+    INT32                   mWidth;
+    INT32                   mHeight;
+    INT32                   mBlkSize;
+    INT32                   mThreshold;
+    INT32                   mShift;
+    INT32                   mRatio;
+    INT32                   mCols;
+    INT32                   mRows;
+    RT_BOOL                 mPrimed;
+    UINT32                  mRoiMask;
+    RT_BOOL                 mDirty;
+    std::vector<RTRect>     mRois;
+    std::vector<BlockRoi>   mBlockRois;
+    std::vector<INT32>      mRoiBlocks;
+    std::vector<Span>       mSpans;
+    std::vector<UINT8>      mMap;
+    std::vector<UINT16>     mBackground;
+    std::vector<UINT32>     mSads;
+    std::vector<UINT8>      mRow;
+    std::vector<RTPlaneScaler> mScaler;     // none, or the one of the last source size
+    RtHistogram             mFrameUs;
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTMOTIONDETECT_H_
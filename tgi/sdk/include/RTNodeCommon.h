@@ -68,11 +68,14 @@
 #define NODE_NAME_VIDEO_SINK    "video_sink"
 #define NODE_NAME_FILTER_IMAGE  "filter_image"
 #define NODE_NAME_FILTER_SCALER "filter_scaler"
+#define NODE_NAME_FILTER_COLOR_CONVERT "filter_color_convert"
 #define NODE_NAME_VOLUME        "filter_volume"
 #define NODE_NAME_LINK_OUTPUT   "link_output"
 #define NODE_NAME_SOURCE_EXTERNAL  "external_source"
 #define NODE_NAME_AUDIO_DEC     "audio_dec"
 #define NODE_NAME_AUDIO_ENC     "audio_enc"
+#define NODE_NAME_SHM_SINK      "shm_sink"
+#define NODE_NAME_SHM_SOURCE    "shm_source"
 
 #define NODE_PORT_SOURCE  "source"
 #define NODE_PORT_DEVICE  "device"
@@ -124,8 +127,25 @@
 #define OPT_NODE_BATCH_SIZE              "node_batch_size"
 #define OPT_NODE_SRC_MB_TYPE             "node_src_mbtype"
 #define OPT_NODE_DST_MB_TYPE             "node_dst_mbtype"
+// read by RTBufferPoolSizer::createFromOptions(), the prebuilt pools ignore them
+#define OPT_NODE_BUFFER_ADAPTIVE         "node_buff_adaptive"
+#define OPT_NODE_BUFFER_MIN_COUNT        "node_buff_min_count"
+#define OPT_NODE_BUFFER_MAX_COUNT        "node_buff_max_count"
 
 #define OPT_FILE_READ_SIZE               "opt_read_size"
+#define OPT_FILE_READ_MODE               "opt_read_mode"      // RTFileReadMode, see RTFileSource.h
+#define OPT_FILE_READ_AHEAD              "opt_read_ahead"     // chunks advised ahead of the reader
+#define OPT_FILE_READ_LOOP               "opt_read_loop"
+#define OPT_FILE_WRITE_ASYNC             "opt_write_async"    // write-behind of fwrite, see RTFileWriter.h
+#define OPT_FILE_WRITE_BUDGET            "opt_write_budget"   // bytes queued at most
+#define OPT_FILE_WRITE_BATCH             "opt_write_batch"
+#define OPT_FILE_WRITE_DROP              "opt_write_drop"     // drop instead of waiting when the budget is used
+#define OPT_FILE_SYNC_POLICY             "opt_sync_policy"    // RTFileSyncPolicy
+#define OPT_FILE_SYNC_BYTES              "opt_sync_bytes"
+
+// options of shm_sink/shm_source, see RTShmTransport.h
+#define OPT_SHM_SOCKET_PATH              "opt_shm_path"
+#define OPT_SHM_MEMFD                    "opt_shm_memfd"      // host-only mode
 
 // common parameters for node stream. subnodes of KEY_ROOT_NODE_STREAM
 #define OPT_STREAM_UID                   "stream_uid"
@@ -185,6 +205,7 @@
 #define OPT_LINE_END_X                   "opt_line_endx"
 #define OPT_LINE_END_Y                   "opt_line_endy"
 #define OPT_LINE_THICK                   "opt_line_thick"
+#define OPT_LINE_NUM                     "opt_line_num"         // lines of RTImageDrawer
 
 /* mosaic in picture */
 #define OPT_MOSAIC_X                     "opt_mosaic_x"
@@ -192,6 +213,7 @@
 #define OPT_MOSAIC_W                     "opt_mosaic_w"
 #define OPT_MOSAIC_H                     "opt_mosaic_h"
 #define OPT_MOSAIC_BLK_SIZE              "opt_mosaic_blk_size"
+#define OPT_MOSAIC_NUM                   "opt_mosaic_num"       // mosaics of RTImageDrawer
 
 // common parameters for codec audio. subnodes of KEY_ROOT_NODE_STREAM_OPTS
 #define OPT_AUDIO_CHANNEL                "opt_channel"
@@ -223,6 +245,10 @@
 #define OPT_AUDIO_VOLUME                 "opt_volume"
 #define OPT_AUDIO_START_DELAY            "opt_start_delay"
 #define OPT_AUDIO_STOP_DELAY             "opt_stop_delay"
+#define OPT_AUDIO_RESAMPLE_QUALITY       "opt_resample_quality"  // RTResampleQuality, see RTAudioResampler.h
+#define OPT_AUDIO_VOLUME_RAMP            "opt_volume_ramp_ms"    // ramp of volume and mute changes, see RTAudioGain.h
+#define OPT_AUDIO_CHANNEL_VOLUME         "opt_channel_volume"    // percent of one channel, _1, _2.. for the next ones
+#define OPT_AUDIO_CHANNEL_MUTE           "opt_channel_mute"
 
 // define new option begin here
 #define OPT_NODE_ID                      "opt_node_id"
@@ -265,6 +291,10 @@
 #define OPT_FILTER_MD_ROI_CNT            "opt_md_roi_cnt"
 #define OPT_FILTER_MD_ROI_RECT           "opt_md_roi_rect"
 #define OPT_FILTER_MD_SINGLE_REF         "opt_md_single"
+#define OPT_FILTER_MD_BLK_SIZE           "opt_md_blk_size"
+#define OPT_FILTER_MD_THRESHOLD          "opt_md_threshold"
+#define OPT_FILTER_MD_LEARN_SHIFT        "opt_md_learn_shift"
+#define OPT_FILTER_MD_ROI_RATIO          "opt_md_roi_ratio"
 #define OPT_FILTER_RECT_X                "opt_rect_x"
 #define OPT_FILTER_RECT_Y                "opt_rect_y"
 #define OPT_FILTER_RECT_W                "opt_rect_w"
@@ -283,6 +313,18 @@
 #define OPT_FILTER_FADE_RATE             "opt_fade_rate"
 #define OPT_FILTER_FG_ALPHA              "opt_fg_alpha"
 #define OPT_FILTER_BG_ALPHA              "opt_bg_alpha"
+// software path of filter_scaler, see RTImageScaler.h
+#define OPT_FILTER_SCALE_MODE            "opt_scale_mode"       // "bilinear" or "area"
+#define OPT_FILTER_SCALE_THREADS         "opt_scale_threads"
+#define OPT_FILTER_SCALE_SOFTWARE        "opt_scale_software"   // 1: skip rga
+// filter_color_convert, see RTColorConvert.h
+#define OPT_FILTER_COLOR_SPACE           "opt_color_space"      // RTColorSpace
+#define OPT_FILTER_DST_LAYOUT            "opt_dst_layout"       // "interleaved" or "planar"
+#define OPT_FILTER_DST_DATA_TYPE         "opt_dst_data_type"    // "uint8", "int8" or "float32"
+#define OPT_FILTER_NORM_MEAN             "opt_norm_mean"        // "r,g,b"
+#define OPT_FILTER_NORM_STD              "opt_norm_std"         // "r,g,b"
+#define OPT_FILTER_QUANT_SCALE           "opt_quant_scale"
+#define OPT_FILTER_QUANT_ZP              "opt_quant_zp"
 
 #define OPT_V4L2_BUF_TYPE               "opt_buf_type"
 #define OPT_V4L2_MEM_TYPE               "opt_mem_type"
@@ -313,6 +355,8 @@
 #define OPT_EXEC_THREAD_NUM             "exec_thread_num"
 #define OPT_EXEC_THREAD_NAME            "exec_name"
 
+#define OPT_GRAPH_BUFFER_MEM_LIMIT      "graph_buff_mem_limit"
+
 #define OPT_RGA_BLEND                   "opt_rga_blend"
 #define OPT_MPP_MPI_TYPE                "opt_mpp_mpi_type"
 
@@ -0,0 +1,811 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: zero-copy buffer transport between processes
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTSHMTRANSPORT_H_
+#define SRC_RT_MEDIA_INCLUDE_RTSHMTRANSPORT_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_mutex.h"
+#include "rt_string_utils.h"
+#include "RTMediaBuffer.h"
+#include "RTMediaMetaKeys.h"
+#include "RTNodeCommon.h"
+#include "RTTaskNode.h"
+#include "RTTaskNodeContext.h"
+
+/*
+ * the sink (e.g. aiserver) hands out dma/memfd buffers by fd and
+ * RTMediaBuffer unique id over a SOCK_SEQPACKET unix socket:
+ *
+ *   sink   --- RT_SHM_CMD_BUFFER (+fd on first use of the id) ---> source
+ *   sink   <-- RT_SHM_CMD_RELEASE ---------------------------------  source
+ *
+ * the sink keeps one reference per buffer in flight and drops it when the
+ * source releases the id or the connection goes away. the source maps each
+ * fd once and reuses the mapping for later frames of the same id; the sink
+ * sends the fd again when the id comes with another file, e.g. a unique id
+ * recycled by a reallocated buffer. the mapping of the old file stays until
+ * the last view of it is released.
+ *
+ * no side blocks on a full socket: a buffer the peer has no room for is
+ * refused with RT_ERR_RETRY, a release is queued and sent later.
+ */
+#define RT_SHM_MAGIC            MKTAG('r', 's', 'h', 'm')
+#define RT_SHM_CMD_BUFFER       1
+#define RT_SHM_CMD_RELEASE      2
+
+typedef struct _RTShmBufferDesc {
+    UINT32 magic;
+    UINT32 cmd;
+    INT32  uniqueId;    // RTMediaBuffer::getUniqueID()
+    UINT32 size;        // size of the whole fd
+    UINT32 offset;      // valid range inside the fd
+    UINT32 length;
+    INT64  pts;
+    INT32  seq;
+    INT32  flags;       // RTMBFlags
+} RTShmBufferDesc;
+
+/*
+ * allocates an anonymous shareable buffer for host-only runs, where no
+ * dma heap exists. returns the fd or -1.
+ */
+static inline INT32 rt_shm_memfd_alloc(const char *name, UINT32 size) {
+#ifdef __NR_memfd_create
+    INT32 fd = static_cast<INT32>(syscall(__NR_memfd_create, name, 0));
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    (void)name;
+    (void)size;
+    return -1;
+#endif
+}
+
+class RTShmSocket {
+ public:
+    // RT_ERR_RETRY when the socket buffer of the peer is full.
+    static RT_RET sendMsg(INT32 sock, const RTShmBufferDesc &desc, INT32 fd) {
+        struct iovec  iov;
+        struct msghdr msg;
+        char          ctrl[CMSG_SPACE(sizeof(INT32))];
+
+        memset(&msg, 0, sizeof(msg));
+        iov.iov_base   = const_cast<RTShmBufferDesc *>(&desc);
+        iov.iov_len    = sizeof(desc);
+        msg.msg_iov    = &iov;
+        msg.msg_iovlen = 1;
+        if (fd >= 0) {
+            memset(ctrl, 0, sizeof(ctrl));
+            msg.msg_control    = ctrl;
+            msg.msg_controllen = sizeof(ctrl);
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type  = SCM_RIGHTS;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(INT32));
+            memcpy(CMSG_DATA(cmsg), &fd, sizeof(INT32));
+        }
+        ssize_t ret;
+        do {
+            ret = sendmsg(sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return RT_ERR_RETRY;
+        }
+        return ret == (ssize_t)sizeof(desc) ? RT_OK : RT_ERR_BAD;
+    }
+
+    // fd is -1 when the message carried none. RT_ERR_END_OF_STREAM on hang-up.
+    static RT_RET recvMsg(INT32 sock, RTShmBufferDesc *desc, INT32 *fd, INT32 timeoutMs) {
+        struct pollfd pfd;
+        pfd.fd      = sock;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        INT32 ready = poll(&pfd, 1, timeoutMs);
+        if (ready == 0) {
+            return RT_ERR_TIMEOUT;
+        } else if (ready < 0) {
+            return errno == EINTR ? RT_ERR_RETRY : RT_ERR_BAD;
+        }
+
+        struct iovec  iov;
+        struct msghdr msg;
+        char          ctrl[CMSG_SPACE(sizeof(INT32))];
+        memset(&msg, 0, sizeof(msg));
+        iov.iov_base       = desc;
+        iov.iov_len        = sizeof(*desc);
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        *fd = -1;
+        ssize_t ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (ret == 0) {
+            return RT_ERR_END_OF_STREAM;
+        }
+        struct cmsghdr *cmsg = ret > 0 ? CMSG_FIRSTHDR(&msg) : RT_NULL;
+        if (cmsg != RT_NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(INT32));
+        }
+        if (ret != (ssize_t)sizeof(*desc) || desc->magic != RT_SHM_MAGIC) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+            return RT_ERR_VALUE;
+        }
+        return RT_OK;
+    }
+
+    static void fillAddr(struct sockaddr_un *addr, const char *path) {
+        memset(addr, 0, sizeof(*addr));
+        addr->sun_family = AF_UNIX;
+        util_strlcpy(addr->sun_path, path, sizeof(addr->sun_path));
+    }
+};
+
+/*
+ * sink side, lives in the producing process. one peer at a time.
+ */
+class RTShmSender {
+ public:
+    // called once the source gave up its last reference of a buffer.
+    typedef std::function<void(void *cookie)> ReleaseCallback;
+
+    explicit RTShmSender(ReleaseCallback callback)
+            : mListenFd(-1), mPeerFd(-1), mCallback(callback) {}
+    ~RTShmSender() { close(); }
+
+    RT_RET open(const char *path) {
+        struct sockaddr_un addr;
+        RTShmSocket::fillAddr(&addr, path);
+        unlink(path);
+        mListenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (mListenFd < 0) {
+            return RT_ERR_OPEN_FILE;
+        }
+        if (bind(mListenFd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0
+                || listen(mListenFd, 1) != 0) {
+            RT_LOGE("shm sink listen on %s failed, %s", path, strerror(errno));
+            close();
+            return RT_ERR_OPEN_FILE;
+        }
+        return RT_OK;
+    }
+
+    RT_RET accept(INT32 timeoutMs) {
+        struct pollfd pfd;
+        pfd.fd      = mListenFd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeoutMs) <= 0) {
+            return RT_ERR_TIMEOUT;
+        }
+        INT32 fd = ::accept4(mListenFd, RT_NULL, RT_NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            return RT_ERR_BAD;
+        }
+        dropPeer();
+        mPeerFd = fd;
+        return RT_OK;
+    }
+
+    RT_BOOL connected() const { return mPeerFd >= 0; }
+
+    /*
+     * hands a buffer to the peer. cookie (usually the RTMediaBuffer, with a
+     * reference taken by the caller) comes back through the release callback.
+     * RT_ERR_RETRY when the peer is behind: nothing was sent and the caller
+     * keeps its reference, it drops the frame or tries again.
+     */
+    RT_RET send(const RTShmBufferDesc &info, INT32 fd, void *cookie) {
+        if (mPeerFd < 0) {
+            return RT_ERR_NULL_PTR;
+        }
+        RTShmBufferDesc desc = info;
+        desc.magic = RT_SHM_MAGIC;
+        desc.cmd   = RT_SHM_CMD_BUFFER;
+
+        FileKey key;
+        if (!getFileKey(fd, &key)) {
+            return RT_ERR_VALUE;
+        }
+        std::map<INT32, FileKey>::iterator it = mSentIds.find(desc.uniqueId);
+        RT_BOOL known = (it != mSentIds.end() && it->second == key) ? RT_TRUE : RT_FALSE;
+        RT_RET ret = RTShmSocket::sendMsg(mPeerFd, desc, known ? -1 : fd);
+        if (ret == RT_ERR_RETRY) {
+            return ret;
+        } else if (ret != RT_OK) {
+            dropPeer();
+            return ret;
+        }
+        mSentIds[desc.uniqueId] = key;
+        mInFlight.insert(std::make_pair(desc.uniqueId, cookie));
+        return RT_OK;
+    }
+
+    // handles release messages of the peer, returns the number handled.
+    INT32 pollRelease(INT32 timeoutMs) {
+        INT32 count = 0;
+        while (mPeerFd >= 0) {
+            RTShmBufferDesc desc;
+            INT32 fd = -1;
+            RT_RET ret = RTShmSocket::recvMsg(mPeerFd, &desc, &fd, count ? 0 : timeoutMs);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            if (ret == RT_ERR_TIMEOUT || ret == RT_ERR_RETRY) {
+                break;
+            } else if (ret != RT_OK) {
+                dropPeer();
+                break;
+            }
+            if (desc.cmd == RT_SHM_CMD_RELEASE) {
+                std::multimap<INT32, void *>::iterator it = mInFlight.find(desc.uniqueId);
+                if (it != mInFlight.end()) {
+                    void *cookie = it->second;
+                    mInFlight.erase(it);
+                    mCallback(cookie);
+                    count++;
+                }
+            }
+        }
+        return count;
+    }
+
+    INT32 inFlight() const { return static_cast<INT32>(mInFlight.size()); }
+
+    void close() {
+        dropPeer();
+        if (mListenFd >= 0) {
+            ::close(mListenFd);
+            mListenFd = -1;
+        }
+    }
+
+ private:
+    // the file behind an fd, a recycled unique id comes with another one.
+    struct FileKey {
+        dev_t   dev;
+        ino_t   ino;
+        off_t   size;
+        bool operator==(const FileKey &other) const {
+            return dev == other.dev && ino == other.ino && size == other.size;
+        }
+    };
+
+    static RT_BOOL getFileKey(INT32 fd, FileKey *key) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            RT_LOGE("shm sink can not stat fd %d, %s", fd, strerror(errno));
+            return RT_FALSE;
+        }
+        key->dev  = st.st_dev;
+        key->ino  = st.st_ino;
+        key->size = st.st_size;
+        return RT_TRUE;
+    }
+
+    // the peer can not release anything any more, give all buffers back.
+    void dropPeer() {
+        if (mPeerFd >= 0) {
+            ::close(mPeerFd);
+            mPeerFd = -1;
+        }
+        std::multimap<INT32, void *>::iterator it;
+        for (it = mInFlight.begin(); it != mInFlight.end(); ++it) {
+            mCallback(it->second);
+        }
+        mInFlight.clear();
+        mSentIds.clear();
+    }
+
+ private:
+    INT32                           mListenFd;
+    INT32                           mPeerFd;
+    ReleaseCallback                 mCallback;
+    std::map<INT32, FileKey>        mSentIds;
+    std::multimap<INT32, void *>    mInFlight;
+};
+
+// one mapped file of an id, a recycled id gets a new generation.
+typedef struct _RTShmMapping {
+    INT32   fd;
+    UINT32  size;
+    void   *data;
+    INT32   refs;               // the table of current mappings and every view
+} RTShmMapping;
+
+typedef struct _RTShmBufferView {
+    RTShmBufferDesc desc;
+    INT32           fd;         // owned by the receiver, do not close
+    void           *data;       // mapping of the whole fd, read only
+    RTShmMapping   *mapping;    // kept alive until release(view)
+} RTShmBufferView;
+
+/*
+ * source side, lives in the consuming process.
+ */
+class RTShmReceiver {
+ public:
+    RTShmReceiver() : mSock(-1) {}
+    ~RTShmReceiver() { close(); }
+
+    RT_RET connect(const char *path) {
+        struct sockaddr_un addr;
+        RTShmSocket::fillAddr(&addr, path);
+        mSock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (mSock < 0) {
+            return RT_ERR_OPEN_FILE;
+        }
+        if (::connect(mSock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+            close();
+            return RT_ERR_OPEN_FILE;
+        }
+        return RT_OK;
+    }
+
+    RT_RET receive(RTShmBufferView *view, INT32 timeoutMs) {
+        if (mSock < 0) {
+            return RT_ERR_NULL_PTR;
+        }
+        flushReleases();
+        INT32 fd = -1;
+        RT_RET ret = RTShmSocket::recvMsg(mSock, &view->desc, &fd, timeoutMs);
+        if (ret != RT_OK) {
+            return ret;
+        }
+
+        const INT32 id = view->desc.uniqueId;
+        view->mapping = RT_NULL;
+        std::map<INT32, RTShmMapping *>::iterator it = mMappings.find(id);
+        if (fd >= 0) {
+            RTShmMapping *mapping = map(fd, view->desc);
+            if (mapping == RT_NULL) {
+                return releaseId(id, RT_ERR_VALUE);
+            }
+            // a new fd for a known id means the sink reallocated the buffer, views of the old one stay valid.
+            if (it != mMappings.end()) {
+                retire(it->second);
+                it->second = mapping;
+            } else {
+                it = mMappings.insert(std::make_pair(id, mapping)).first;
+            }
+        } else if (it == mMappings.end()) {
+            RT_LOGE("shm source got unknown buffer id %d", id);
+            return releaseId(id, RT_ERR_VALUE);
+        }
+
+        RTShmMapping *mapping = it->second;
+        if ((UINT64)view->desc.offset + view->desc.length > mapping->size) {
+            RT_LOGE("shm source got range %u+%u outside of buffer %d of %u bytes",
+                     view->desc.offset, view->desc.length, id, mapping->size);
+            return releaseId(id, RT_ERR_VALUE);
+        }
+        mapping->refs++;
+        view->fd      = mapping->fd;
+        view->data    = mapping->data;
+        view->mapping = mapping;
+        return RT_OK;
+    }
+
+    /*
+     * gives a received buffer back to the sink and drops the view's hold
+     * on its mapping. a release the sink has no room for is queued and
+     * sent with the next call.
+     */
+    RT_RET release(RTShmBufferView *view) {
+        if (view->mapping != RT_NULL) {
+            unref(view->mapping);
+            view->mapping = RT_NULL;
+            view->data    = RT_NULL;
+        }
+        return releaseId(view->desc.uniqueId, RT_OK);
+    }
+
+    // sends the queued releases, receive() and release() do it too.
+    RT_RET flushReleases() {
+        size_t sent = 0;
+        RT_RET ret = RT_OK;
+        for (; sent < mPendingReleases.size() && mSock >= 0; sent++) {
+            RTShmBufferDesc desc;
+            memset(&desc, 0, sizeof(desc));
+            desc.magic    = RT_SHM_MAGIC;
+            desc.cmd      = RT_SHM_CMD_RELEASE;
+            desc.uniqueId = mPendingReleases[sent];
+            ret = RTShmSocket::sendMsg(mSock, desc, -1);
+            if (ret != RT_OK) {
+                break;
+            }
+        }
+        mPendingReleases.erase(mPendingReleases.begin(), mPendingReleases.begin() + sent);
+        // queued, not lost.
+        return ret == RT_ERR_RETRY ? RT_OK : ret;
+    }
+
+    INT32 pendingReleases() const { return static_cast<INT32>(mPendingReleases.size()); }
+
+    // unmaps everything, views not released yet are invalid afterwards.
+    void close() {
+        std::map<INT32, RTShmMapping *>::iterator it;
+        for (it = mMappings.begin(); it != mMappings.end(); ++it) {
+            unmap(it->second);
+        }
+        for (size_t i = 0; i < mRetired.size(); i++) {
+            unmap(mRetired[i]);
+        }
+        mMappings.clear();
+        mRetired.clear();
+        mPendingReleases.clear();
+        if (mSock >= 0) {
+            ::close(mSock);
+            mSock = -1;
+        }
+    }
+
+ private:
+    // maps desc.size bytes of fd, which must not be more than the file holds. takes fd.
+    static RTShmMapping* map(INT32 fd, const RTShmBufferDesc &desc) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            RT_LOGE("shm source can not stat fd of buffer %d, %s", desc.uniqueId, strerror(errno));
+            ::close(fd);
+            return RT_NULL;
+        }
+        if (desc.size == 0 || (off_t)desc.size > st.st_size) {
+            RT_LOGE("shm source got buffer %d of %u bytes, its fd holds %lld",
+                     desc.uniqueId, desc.size, (long long)st.st_size);
+            ::close(fd);
+            return RT_NULL;
+        }
+        void *data = mmap(RT_NULL, desc.size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            return RT_NULL;
+        }
+        RTShmMapping *mapping = new RTShmMapping;
+        mapping->fd   = fd;
+        mapping->size = desc.size;
+        mapping->data = data;
+        mapping->refs = 1;
+        return mapping;
+    }
+
+    static void unmap(RTShmMapping *mapping) {
+        munmap(mapping->data, mapping->size);
+        ::close(mapping->fd);
+        delete mapping;
+    }
+
+    // a mapping replaced in the table waits in mRetired for its last view.
+    void retire(RTShmMapping *mapping) {
+        if (--mapping->refs > 0) {
+            mRetired.push_back(mapping);
+        } else {
+            unmap(mapping);
+        }
+    }
+
+    // the table holds a ref of the current mappings, only a retired one can reach 0 here.
+    void unref(RTShmMapping *mapping) {
+        if (--mapping->refs > 0) {
+            return;
+        }
+        std::vector<RTShmMapping *>::iterator it = std::find(mRetired.begin(), mRetired.end(), mapping);
+        if (it != mRetired.end()) {
+            mRetired.erase(it);
+        }
+        unmap(mapping);
+    }
+
+    RT_RET releaseId(INT32 uniqueId, RT_RET result) {
+        if (mSock < 0) {
+            return RT_ERR_NULL_PTR;
+        }
+        mPendingReleases.push_back(uniqueId);
+        RT_RET ret = flushReleases();
+        return result != RT_OK ? result : ret;
+    }
+
+ private:
+    INT32                               mSock;
+    std::map<INT32, RTShmMapping *>     mMappings;
+    std::vector<RTShmMapping *>         mRetired;
+    std::vector<INT32>                  mPendingReleases;
+};
+
+#define RT_SHM_NODE_WAIT_MS     20
+
+/*
+ * shm_sink, hands every input buffer to the shm_source of another process
+ * and holds it until that process released it. options:
+ *
+ *   opt_shm_path       unix socket to listen on
+ *   opt_shm_memfd      1: copy buffers without an fd into memfd files,
+ *                      for host-only runs without a dma heap
+ *
+ * buffers which can not be shared (no fd and no memfd mode), and frames
+ * the peer is too far behind for, are dropped. like filter_color_convert
+ * the node is registered by the application:
+ *
+ *   static RTNodeStub node_stub_sink_shm {
+ *       .mUid       = kStubSinkShm,
+ *       .mName      = NODE_NAME_SHM_SINK,
+ *       .mVersion   = "v1.0",
+ *       .mCreateObj = createShmSinkNode,
+ *       ...
+ *   };
+ *   RT_NODE_FACTORY_REGISTER_STUB(node_stub_sink_shm);
+ */
+class RTShmSinkNode : public RTTaskNode {
+ public:
+    RTShmSinkNode()
+            : mSender([](void *cookie) { reinterpret_cast<RTMediaBuffer *>(cookie)->release(); }),
+              mMemfd(0),
+              mDropped(0) {}
+    virtual ~RTShmSinkNode() { closeMemfds(); }
+
+    virtual RT_RET open(RTTaskNodeContext *context) {
+        RtMetaData *options = context->options();
+        const char *path = RT_NULL;
+        if (options == RT_NULL || !options->findCString(OPT_SHM_SOCKET_PATH, &path)) {
+            RT_LOGE("shm sink needs %s", OPT_SHM_SOCKET_PATH);
+            return RT_ERR_VALUE;
+        }
+        mMemfd = 0;
+        options->findInt32(OPT_SHM_MEMFD, &mMemfd);
+        return mSender.open(path);
+    }
+
+    virtual RT_RET process(RTTaskNodeContext *context) {
+        mSender.pollRelease(0);
+        if (!mSender.connected()) {
+            mSender.accept(0);
+        }
+        RTMediaBuffer *input = context->dequeInputBuffer();
+        if (input == RT_NULL) {
+            return RT_OK;
+        }
+
+        RTShmBufferDesc desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.uniqueId = input->getUniqueID();
+        desc.size     = input->getSize();
+        desc.offset   = input->getOffset();
+        desc.length   = input->getLength();
+        desc.flags    = input->hasFlag(RT_MB_FLAG_EOS) ? RT_MB_FLAG_EOS : RT_MB_FLAG_NONE;
+        input->getMetaData()->findInt64(kKeyFramePts, &desc.pts);
+        input->getMetaData()->findInt32(kKeyFrameSequence, &desc.seq);
+        INT32 fd = input->getFd();
+        if (fd < 0 && mMemfd) {
+            fd = copyToMemfd(input);
+        }
+
+        // the input reference goes with the buffer and comes back through the release callback.
+        RT_RET ret = RT_ERR_NULL_PTR;
+        if (fd >= 0 && desc.size > 0 && mSender.connected()) {
+            ret = mSender.send(desc, fd, input);
+        }
+        if (ret != RT_OK) {
+            mDropped++;
+            input->release();
+        }
+        return RT_OK;
+    }
+
+    // gives every buffer still in the other process back.
+    virtual RT_RET close(RTTaskNodeContext *) {
+        mSender.close();
+        closeMemfds();
+        if (mDropped > 0) {
+            RT_LOGD("shm sink dropped %d buffers", mDropped);
+        }
+        return RT_OK;
+    }
+
+ private:
+    struct Memfd {
+        Memfd() : fd(-1), size(0), data(RT_NULL) {}
+        INT32   fd;
+        UINT32  size;
+        UINT8  *data;
+    };
+
+    /*
+     * one memfd per unique id: the input holding it is only released by
+     * the peer, so a file is never rewritten while the peer reads it.
+     */
+    INT32 copyToMemfd(RTMediaBuffer *input) {
+        const UINT32 size = input->getSize();
+        Memfd &file = mMemfds[input->getUniqueID()];
+        if (file.data != RT_NULL && file.size != size) {
+            munmap(file.data, file.size);
+            ::close(file.fd);
+            file.data = RT_NULL;
+        }
+        if (file.data == RT_NULL) {
+            file.fd   = rt_shm_memfd_alloc("shm_sink", size);
+            file.size = size;
+            void *data = file.fd >= 0 ? mmap(RT_NULL, size, PROT_WRITE, MAP_SHARED, file.fd, 0) : MAP_FAILED;
+            if (data == MAP_FAILED) {
+                if (file.fd >= 0) {
+                    ::close(file.fd);
+                }
+                mMemfds.erase(input->getUniqueID());
+                return -1;
+            }
+            file.data = reinterpret_cast<UINT8 *>(data);
+        }
+        const UINT32 offset = input->getOffset();
+        memcpy(file.data + offset, reinterpret_cast<UINT8 *>(input->getData()) + offset,
+               RT_MIN(input->getLength(), size - RT_MIN(offset, size)));
+        return file.fd;
+    }
+
+    void closeMemfds() {
+        std::map<INT32, Memfd>::iterator it;
+        for (it = mMemfds.begin(); it != mMemfds.end(); ++it) {
+            munmap(it->second.data, it->second.size);
+            ::close(it->second.fd);
+        }
+        mMemfds.clear();
+    }
+
+ private:
+    RTShmSender             mSender;
+    INT32                   mMemfd;
+    INT32                   mDropped;
+    std::map<INT32, Memfd>  mMemfds;
+};
+
+/*
+ * shm_source, outputs the buffers of the shm_sink of another process
+ * without copying them, opt_shm_path names its socket. outputs point into
+ * a read only mapping, a node writing into its input must not follow.
+ * freeing an output releases the buffer to the sink; the receiver lives
+ * until the last output is freed, also after close(). registered with
+ * kStubDeviceShm / NODE_NAME_SHM_SOURCE and createShmSourceNode, like
+ * shm_sink.
+ */
+class RTShmSourceNode : public RTTaskNode {
+ public:
+    RTShmSourceNode() {}
+    virtual ~RTShmSourceNode() {}
+
+    virtual RT_RET open(RTTaskNodeContext *context) {
+        RtMetaData *options = context->options();
+        const char *path = RT_NULL;
+        if (options == RT_NULL || !options->findCString(OPT_SHM_SOCKET_PATH, &path)) {
+            RT_LOGE("shm source needs %s", OPT_SHM_SOCKET_PATH);
+            return RT_ERR_VALUE;
+        }
+        mPath = path;
+        // the sink may come up later, process() connects then.
+        connect();
+        return RT_OK;
+    }
+
+    virtual RT_RET process(RTTaskNodeContext *context) {
+        if (mShared.get() == RT_NULL && connect() != RT_OK) {
+            usleep(RT_SHM_NODE_WAIT_MS * 1000);
+            return RT_OK;
+        }
+        std::shared_ptr<Shared> shared = mShared;
+        Output *output = new Output;
+        output->shared = shared;
+        RT_RET ret;
+        {
+            RtAutoMutex lock(&shared->lock);
+            ret = shared->receiver.receive(&output->view, RT_SHM_NODE_WAIT_MS);
+        }
+        if (ret != RT_OK) {
+            delete output;
+            if (ret == RT_ERR_END_OF_STREAM || ret == RT_ERR_BAD) {
+                RT_LOGD("shm source lost %s, reconnecting", mPath.c_str());
+                mShared.reset();
+            }
+            return RT_OK;
+        }
+
+        const RTShmBufferDesc &desc = output->view.desc;
+        RTMediaBuffer *buffer = rt_media_buffer_wrap(output->view.data, desc.size, releaseOutput, output);
+        buffer->setRange(desc.offset, desc.length);
+        buffer->getMetaData()->setInt64(kKeyFramePts, desc.pts);
+        buffer->getMetaData()->setInt32(kKeyFrameSequence, desc.seq);
+        if (desc.flags & RT_MB_FLAG_EOS) {
+            buffer->setFlag(RT_MB_FLAG_EOS, 1);
+        }
+        return context->queueOutputBuffer(buffer);
+    }
+
+    virtual RT_RET close(RTTaskNodeContext *) {
+        mShared.reset();
+        return RT_OK;
+    }
+
+ private:
+    // the receiver and its lock, shared by the node and every output in flight.
+    struct Shared {
+        RtMutex         lock;
+        RTShmReceiver   receiver;
+    };
+
+    struct Output {
+        std::shared_ptr<Shared> shared;
+        RTShmBufferView         view;
+    };
+
+    RT_RET connect() {
+        std::shared_ptr<Shared> shared(new Shared);
+        RT_RET ret = shared->receiver.connect(mPath.c_str());
+        if (ret == RT_OK) {
+            mShared = shared;
+        }
+        return ret;
+    }
+
+    // runs when the output buffer is freed, on whichever thread dropped it last.
+    static RT_RET releaseOutput(void *param) {
+        Output *output = reinterpret_cast<Output *>(param);
+        {
+            RtAutoMutex lock(&output->shared->lock);
+            output->shared->receiver.release(&output->view);
+        }
+        delete output;
+        return RT_OK;
+    }
+
+ private:
+    std::string             mPath;
+    std::shared_ptr<Shared> mShared;
+};
+
+static inline RTTaskNode* createShmSinkNode() {
+    return new RTShmSinkNode();
+}
+
+static inline RTTaskNode* createShmSourceNode() {
+    return new RTShmSourceNode();
+}
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTSHMTRANSPORT_H_
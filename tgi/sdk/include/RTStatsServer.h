@@ -0,0 +1,502 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: unix socket server of live json stats
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTSTATSSERVER_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTSTATSSERVER_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_thread.h"
+#include "rt_lock_profiler.h"
+#include "rt_mem_owner.h"
+#include "RTTaskNodeLatency.h"
+#include "RTTaskNodePerf.h"
+#include "RTFrameLatencyTracer.h"
+#include "RTMediaBufferTracker.h"
+
+/*
+ * rt_stats_server=PATH starts the server at the first startFromEnv().
+ * the library itself never calls it: the prebuilt RTTaskGraph neither
+ * starts the server nor registers its pools or scheduler, the application
+ * starts it and registers providers of its own (rt_graph_bench does both).
+ *
+ * protocol: connect, optionally send one line with the section names to
+ * return ("node_latency frame_latency\n"), read json until eof. an empty
+ * request or "all" returns every section.
+ *
+ *   echo all | socat - UNIX-CONNECT:/tmp/rt_stats.sock
+ */
+#define RT_STATS_SERVER_ENV_PATH        "rt_stats_server"
+#define RT_STATS_SERVER_REQUEST_MAX     256
+#define RT_STATS_SERVER_POLL_MS         500
+#define RT_STATS_SERVER_REQUEST_MS      100
+#define RT_STATS_SERVER_SEND_MS         1000
+
+/*
+ * minimal streaming json writer, commas are inserted automatically.
+ */
+class RTJsonWriter {
+ public:
+    RTJsonWriter() { mFirst.push_back(RT_TRUE); }
+
+    RTJsonWriter& beginObject(const char *key = RT_NULL) { return open(key, '{'); }
+    RTJsonWriter& endObject() { return close('}'); }
+    RTJsonWriter& beginArray(const char *key = RT_NULL) { return open(key, '['); }
+    RTJsonWriter& endArray() { return close(']'); }
+
+    RTJsonWriter& value(const char *key, const char *str) {
+        prefix(key);
+        quote(str ? str : "");
+        return *this;
+    }
+    RTJsonWriter& value(const char *key, const std::string &str) { return value(key, str.c_str()); }
+    RTJsonWriter& value(const char *key, INT64 number) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%lld", (long long)number);
+        prefix(key);
+        mOut += buf;
+        return *this;
+    }
+    RTJsonWriter& value(const char *key, UINT64 number) { return value(key, static_cast<INT64>(number)); }
+    RTJsonWriter& value(const char *key, INT32 number) { return value(key, static_cast<INT64>(number)); }
+    RTJsonWriter& value(const char *key, UINT32 number) { return value(key, static_cast<INT64>(number)); }
+    RTJsonWriter& value(const char *key, double number) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.3f", number);
+        prefix(key);
+        mOut += buf;
+        return *this;
+    }
+    RTJsonWriter& value(const char *key, bool flag) {
+        prefix(key);
+        mOut += flag ? "true" : "false";
+        return *this;
+    }
+
+    RTJsonWriter& histogram(const char *key, const RtHistogramSummary &sum) {
+        beginObject(key);
+        value("count", sum.count);
+        value("avg", sum.count ? sum.sum / sum.count : 0);
+        value("p50", sum.p50);
+        value("p90", sum.p90);
+        value("p99", sum.p99);
+        value("max", sum.max);
+        return endObject();
+    }
+
+    const std::string& str() const { return mOut; }
+
+ private:
+    RTJsonWriter& open(const char *key, char bracket) {
+        prefix(key);
+        mOut += bracket;
+        mFirst.push_back(RT_TRUE);
+        return *this;
+    }
+    RTJsonWriter& close(char bracket) {
+        if (mFirst.size() > 1) {
+            mFirst.pop_back();
+        }
+        mOut += bracket;
+        return *this;
+    }
+    void prefix(const char *key) {
+        if (!mFirst.back()) {
+            mOut += ',';
+        }
+        mFirst.back() = RT_FALSE;
+        if (key != RT_NULL) {
+            quote(key);
+            mOut += ':';
+        }
+    }
+    void quote(const char *str) {
+        mOut += '"';
+        for (; *str; str++) {
+            UINT8 c = static_cast<UINT8>(*str);
+            if (c == '"' || c == '\\') {
+                mOut += '\\';
+                mOut += static_cast<char>(c);
+            } else if (c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                mOut += buf;
+            } else {
+                mOut += static_cast<char>(c);
+            }
+        }
+        mOut += '"';
+    }
+
+ private:
+    std::string           mOut;
+    std::vector<RT_BOOL>  mFirst;
+};
+
+typedef std::function<void(RTJsonWriter *)> RTStatsProvider;
+
+/*
+ * serves json snapshots of the registered providers from its own thread.
+ * a snapshot only reads stats under their short locks, the pipeline keeps
+ * running. the built-in sections read the process wide registries, any
+ * other state only shows up once its owner registers a provider for it.
+ */
+class RTStatsServer {
+ public:
+    static RTStatsServer* instance() {
+        static RTStatsServer server;
+        return &server;
+    }
+
+    RT_RET start(const char *path) {
+        RtMutex::RtAutolock autoLock(mLock);
+        if (mThread != RT_NULL) {
+            return RT_OK;
+        }
+        if (path == RT_NULL || strlen(path) >= sizeof(((struct sockaddr_un *)0)->sun_path)) {
+            return RT_ERR_VALUE;
+        }
+
+        INT32 fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            RT_LOGE("stats server socket failed: %s", strerror(errno));
+            return RT_ERR_BAD;
+        }
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        unlink(path);
+        if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+            RT_LOGE("stats server bind %s failed: %s", path, strerror(errno));
+            ::close(fd);
+            return RT_ERR_BAD;
+        }
+        if (pipe(mWakeFds) < 0) {
+            ::close(fd);
+            return RT_ERR_BAD;
+        }
+
+        mListenFd = fd;
+        mPath     = path;
+        mThread   = new RtThread(threadLoop, this);
+        mThread->setName("rt_stats");
+        if (!mThread->start()) {
+            RT_LOGE("stats server thread start failed");
+            closeFds();
+            rt_safe_delete(mThread);
+            return RT_ERR_BAD;
+        }
+        RT_LOGD("stats server listening on %s", path);
+        return RT_OK;
+    }
+
+    // starts at the path of rt_stats_server, if set.
+    RT_RET startFromEnv() {
+        const char *path = RT_NULL;
+        rt_env_get_str(RT_STATS_SERVER_ENV_PATH, &path, RT_NULL);
+        if (path == RT_NULL || path[0] == '\0') {
+            return RT_OK;
+        }
+        return start(path);
+    }
+
+    void stop() {
+        RtThread *thread = RT_NULL;
+        {
+            RtMutex::RtAutolock autoLock(mLock);
+            if (mThread == RT_NULL) {
+                return;
+            }
+            thread  = mThread;
+            mThread = RT_NULL;
+            if (write(mWakeFds[1], "q", 1) < 0) {
+                RT_LOGW("stats server wake failed: %s", strerror(errno));
+            }
+        }
+        thread->join();
+        delete thread;
+        RtMutex::RtAutolock autoLock(mLock);
+        closeFds();
+        unlink(mPath.c_str());
+    }
+
+    void registerProvider(const std::string &section, RTStatsProvider provider) {
+        RtMutex::RtAutolock autoLock(mLock);
+        mProviders[section] = provider;
+    }
+
+    void unregisterProvider(const std::string &section) {
+        RtMutex::RtAutolock autoLock(mLock);
+        mProviders.erase(section);
+    }
+
+    // the json the server sends for the request, also usable without a socket.
+    std::string snapshot(const std::string &request) {
+        std::vector<std::string> wanted;
+        splitWords(request, &wanted);
+        RT_BOOL all = wanted.empty() ||
+                      std::find(wanted.begin(), wanted.end(), "all") != wanted.end();
+
+        std::map<std::string, RTStatsProvider> providers;
+        {
+            RtMutex::RtAutolock autoLock(mLock);
+            providers = mProviders;
+        }
+
+        RTJsonWriter json;
+        json.beginObject();
+        json.value("pid", static_cast<INT32>(getpid()));
+        json.value("timeUs", RtTime::getRelativeTimeUs());
+        std::map<std::string, RTStatsProvider>::iterator it;
+        for (it = providers.begin(); it != providers.end(); ++it) {
+            if (all || std::find(wanted.begin(), wanted.end(), it->first) != wanted.end()) {
+                json.beginObject(it->first.c_str());
+                it->second(&json);
+                json.endObject();
+            }
+        }
+        json.endObject();
+        return json.str();
+    }
+
+ private:
+    RTStatsServer() : mThread(RT_NULL), mListenFd(-1) {
+        mWakeFds[0] = mWakeFds[1] = -1;
+        registerBuiltinProviders();
+    }
+    ~RTStatsServer() { stop(); }
+    RTStatsServer(const RTStatsServer&) = delete;
+    RTStatsServer& operator=(const RTStatsServer&) = delete;
+
+    static void* threadLoop(void *arg) {
+        RTStatsServer *server = reinterpret_cast<RTStatsServer *>(arg);
+        struct pollfd fds[2];
+        fds[0].fd     = server->mListenFd;
+        fds[0].events = POLLIN;
+        fds[1].fd     = server->mWakeFds[0];
+        fds[1].events = POLLIN;
+        while (1) {
+            INT32 ret = poll(fds, 2, RT_STATS_SERVER_POLL_MS);
+            if (ret < 0 && errno != EINTR) {
+                RT_LOGE("stats server poll failed: %s", strerror(errno));
+                break;
+            }
+            if (fds[1].revents) {
+                break;
+            }
+            RTMediaBufferTracker::instance()->poll(RtTime::getRelativeTimeUs());
+            if (ret > 0 && (fds[0].revents & POLLIN)) {
+                INT32 client = accept4(server->mListenFd, RT_NULL, RT_NULL, SOCK_CLOEXEC);
+                if (client >= 0) {
+                    server->serve(client);
+                    ::close(client);
+                }
+            }
+        }
+        return RT_NULL;
+    }
+
+    void serve(INT32 client) {
+        char request[RT_STATS_SERVER_REQUEST_MAX] = {0};
+        struct pollfd pfd;
+        pfd.fd     = client;
+        pfd.events = POLLIN;
+        // a client which only reads gets everything after a short wait.
+        if (poll(&pfd, 1, RT_STATS_SERVER_REQUEST_MS) > 0 && (pfd.revents & POLLIN)) {
+            ssize_t len = recv(client, request, sizeof(request) - 1, 0);
+            request[len > 0 ? len : 0] = '\0';
+        }
+
+        std::string json = snapshot(request);
+        json += '\n';
+        // the thread serves one client at a time, a client which stops reading is dropped.
+        struct timeval timeout;
+        timeout.tv_sec  = RT_STATS_SERVER_SEND_MS / 1000;
+        timeout.tv_usec = (RT_STATS_SERVER_SEND_MS % 1000) * 1000;
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        const UINT64 deadlineUs = RtTime::getRelativeTimeUs() + RT_STATS_SERVER_SEND_MS * 1000ll;
+        size_t sent = 0;
+        while (sent < json.size() && RtTime::getRelativeTimeUs() < deadlineUs) {
+            ssize_t len = send(client, json.data() + sent, json.size() - sent, MSG_NOSIGNAL);
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            if (len <= 0) {
+                RT_LOGW("stats server drops a client: %s", len < 0 ? strerror(errno) : "closed");
+                break;
+            }
+            sent += len;
+        }
+    }
+
+    void closeFds() {
+        if (mListenFd >= 0) {
+            ::close(mListenFd);
+            mListenFd = -1;
+        }
+        for (INT32 i = 0; i < 2; i++) {
+            if (mWakeFds[i] >= 0) {
+                ::close(mWakeFds[i]);
+                mWakeFds[i] = -1;
+            }
+        }
+    }
+
+    static void splitWords(const std::string &line, std::vector<std::string> *words) {
+        std::string word;
+        for (size_t i = 0; i <= line.size(); i++) {
+            char c = i < line.size() ? line[i] : ' ';
+            if (c == ' ' || c == ',' || c == '\n' || c == '\r' || c == '\t') {
+                if (!word.empty()) {
+                    words->push_back(word);
+                    word.clear();
+                }
+            } else {
+                word += c;
+            }
+        }
+    }
+
+    void registerBuiltinProviders() {
+        mProviders["node_latency"] = [](RTJsonWriter *json) {
+            RTTaskNodeLatencyRegistry *registry = RTTaskNodeLatencyRegistry::instance();
+            std::vector<UINT64> uids;
+            registry->getGraphUids(&uids);
+            json->beginArray("graphs");
+            for (size_t i = 0; i < uids.size(); i++) {
+                std::vector<RTTaskNodeLatencyStat> stats;
+                registry->collect(uids[i], &stats);
+                json->beginObject().value("uid", uids[i]).beginArray("nodes");
+                for (size_t j = 0; j < stats.size(); j++) {
+                    json->beginObject().value("id", stats[j].nodeId).value("name", stats[j].nodeName);
+                    for (INT32 k = 0; k < RT_NODE_LATENCY_MAX; k++) {
+                        json->histogram(RTTaskNodeLatency::kindName(k), stats[j].kinds[k]);
+                    }
+                    json->endObject();
+                }
+                json->endArray().endObject();
+            }
+            json->endArray();
+        };
+        mProviders["node_perf"] = [](RTJsonWriter *json) {
+            RTTaskNodePerfRegistry *registry = RTTaskNodePerfRegistry::instance();
+            std::vector<UINT64> uids;
+            registry->getGraphUids(&uids);
+            json->beginArray("graphs");
+            for (size_t i = 0; i < uids.size(); i++) {
+                std::vector<RTTaskNodePerfStat> stats;
+                registry->collect(uids[i], &stats);
+                json->beginObject().value("uid", uids[i]).beginArray("nodes");
+                for (size_t j = 0; j < stats.size(); j++) {
+                    json->beginObject().value("id", stats[j].nodeId).value("name", stats[j].nodeName)
+                         .value("calls", stats[j].calls)
+                         .value("ipc", RTTaskNodePerf::ipc(stats[j]))
+                         .value("mpki", RTTaskNodePerf::mpki(stats[j]));
+                    for (INT32 k = 0; k < RT_NODE_PERF_MAX; k++) {
+                        if (stats[j].valid[k]) {
+                            json->value(RtPerfCounterGroup::counterName(k), stats[j].counters[k]);
+                        }
+                    }
+                    json->endObject();
+                }
+                json->endArray().endObject();
+            }
+            json->endArray();
+        };
+        mProviders["frame_latency"] = [](RTJsonWriter *json) {
+            std::vector<RTFrameLatencyStat> stats;
+            RTFrameLatencyTracer::instance()->collect(&stats);
+            json->beginArray("paths");
+            for (size_t i = 0; i < stats.size(); i++) {
+                json->beginObject().value("graph", static_cast<INT64>(stats[i].graphUid))
+                    .value("source", stats[i].sourceId).value("sink", stats[i].sinkId)
+                    .value("path", stats[i].path).histogram("latency", stats[i].latency).endObject();
+            }
+            json->endArray();
+            json->value("unlinked", RTFrameLatencyTracer::instance()->getUnlinkedCount());
+        };
+        mProviders["buffers"] = [](RTJsonWriter *json) {
+            std::map<std::string, INT32> counts;
+            RTMediaBufferTracker *tracker = RTMediaBufferTracker::instance();
+            tracker->countByOwner(&counts);
+            json->value("held_too_long", tracker->checkHeld());
+            json->beginObject("outstanding");
+            std::map<std::string, INT32>::iterator it;
+            for (it = counts.begin(); it != counts.end(); ++it) {
+                json->value(it->first.c_str(), it->second);
+            }
+            json->endObject();
+        };
+        mProviders["locks"] = [](RTJsonWriter *json) {
+            std::vector<RtLockSiteReport> reports;
+            RtLockProfiler::instance()->collect(&reports);
+            json->beginArray("top");
+            for (size_t i = 0; i < reports.size(); i++) {
+                json->beginObject()
+                     .value("name", reports[i].name).value("site", reports[i].site)
+                     .value("acquires", reports[i].acquires).value("contended", reports[i].contended)
+                     .value("waitUs", reports[i].waitUs).value("maxWaitUs", reports[i].maxWaitUs)
+                     .value("holdUs", reports[i].holdUs)
+                     .value("condWaits", reports[i].condWaits).value("condWaitUs", reports[i].condWaitUs)
+                     .endObject();
+            }
+            json->endArray();
+        };
+        mProviders["heap"] = [](RTJsonWriter *json) {
+            std::vector<RtMemOwnerStat> stats;
+            RtMemOwnerTracker::instance()->collect(&stats);
+            json->value("totalBytes", static_cast<UINT64>(rt_mem_get_total_size()));
+            json->value("totalCount", rt_mem_get_total_count());
+            json->beginArray("owners");
+            for (size_t i = 0; i < stats.size(); i++) {
+                json->beginObject()
+                     .value("graph", stats[i].graphUid).value("node", stats[i].nodeId)
+                     .value("name", stats[i].name)
+                     .value("liveBytes", stats[i].liveBytes).value("peakBytes", stats[i].peakBytes)
+                     .endObject();
+            }
+            json->endArray();
+        };
+    }
+
+ private:
+    RtMutex                                 mLock;
+    RtThread                               *mThread;
+    INT32                                   mListenFd;
+    INT32                                   mWakeFds[2];
+    std::string                             mPath;
+    std::map<std::string, RTStatsProvider>  mProviders;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTSTATSSERVER_H_
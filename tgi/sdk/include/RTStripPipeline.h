@@ -0,0 +1,320 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: cache-blocked strip pipeline of the cpu image filters
+ */
+
+#ifndef SRC_RT_MEDIA_INCLUDE_RTSTRIPPIPELINE_H_
+#define SRC_RT_MEDIA_INCLUDE_RTSTRIPPIPELINE_H_
+
+#include <string.h>
+#include <vector>
+
+#include "rt_header.h"
+#include "RTColorConvert.h"
+#include "RTImageDraw.h"
+#include "RTImageScaler.h"
+
+#define RT_STRIP_ROWS               64              // rows of a band, ~1MB of 4k nv12 and rgb888
+#define RT_STRIP_ALL_ROWS           0x7fffffff      // the input of the first stage is whole
+
+/*
+ * one cpu filter of a strip pipeline.
+ *
+ * begin() binds a frame and gives the rows of out. run() is then called
+ * band after band: rows [0, ready) of in are final, the stage writes out
+ * from where it stopped up to limit if it can and returns the rows of out
+ * that are final. it may return less, e.g. while a mosaic block needs rows
+ * below the band or a resize rows past ready, the stages after it then
+ * wait. once ready reaches the rows of in, a stage finishes up to limit.
+ */
+class RTStripStage {
+ public:
+    virtual ~RTStripStage() {}
+    virtual RT_RET begin(const RTScaleImage *in, const RTScaleImage *out, INT32 *rows) = 0;
+    virtual INT32  run(INT32 ready, INT32 limit) = 0;
+};
+
+/*
+ * crop and resize of filter_scale, the crop is the rect of in. a scaled
+ * row reads rows all over the source, so it only runs on a whole input:
+ * put it first.
+ */
+class RTStripScaleStage : public RTStripStage {
+ public:
+    explicit RTStripScaleStage(RTScaleMode mode = RT_SCALE_BILINEAR)
+            : mMode(mode), mSimd(RT_TRUE), mPlaneNum(0), mInRows(0), mRows(0), mDone(0) {}
+    ~RTStripScaleStage() { reset(); }
+
+    void setSimd(RT_BOOL simd) { mSimd = simd; }
+
+    RT_RET begin(const RTScaleImage *in, const RTScaleImage *out, INT32 *rows) {
+        RTScalePlane inPlanes[RT_SCALE_MAX_PLANES];
+        reset();
+        if (in == RT_NULL || out == RT_NULL || in->format != out->format) {
+            return RT_ERR_VALUE;
+        }
+        mPlaneNum = RTImageScaler::getPlanes(in, inPlanes);
+        if (mPlaneNum <= 0 || RTImageScaler::getPlanes(out, mPlanes) != mPlaneNum) {
+            RT_LOGE("unsupported image, format %d", in->format);
+            return RT_ERR_VALUE;
+        }
+        for (INT32 i = 0; i < mPlaneNum; i++) {
+            mScalers.push_back(new RTPlaneScaler(inPlanes[i], mPlanes[i], mMode));
+        }
+        mInRows = inPlanes[0].height;
+        mRows   = mPlanes[0].height;
+        *rows   = mRows;
+        return RT_OK;
+    }
+
+    INT32 run(INT32 ready, INT32 limit) {
+        if (ready < mInRows) {
+            return mDone;
+        }
+        // whole chroma rows, subsampled planes have half the rows.
+        const INT32 end = (limit < mRows) ? (limit & ~1) : mRows;
+        for (INT32 i = 0; i < mPlaneNum && end > mDone; i++) {
+            const RTScalePlane &plane = mPlanes[i];
+            const INT32 rowEnd = static_cast<INT32>(static_cast<INT64>(end) * plane.height / mRows);
+            for (INT32 y = static_cast<INT32>(static_cast<INT64>(mDone) * plane.height / mRows); y < rowEnd; y++) {
+                mScalers[i]->scaleRow(y, plane.data + y * plane.stride, &mScratch, mSimd);
+            }
+        }
+        mDone = RT_MAX(mDone, end);
+        return mDone;
+    }
+
+ private:
+    void reset() {
+        for (size_t i = 0; i < mScalers.size(); i++) {
+            delete mScalers[i];
+        }
+        mScalers.clear();
+        // a new scaler may get the address of an old one, its cached columns must not be reused.
+        mScratch  = RTPlaneScaler::Scratch();
+        mPlaneNum = 0;
+        mDone = 0;
+    }
+
+ private:
+    RTScaleMode                     mMode;
+    RT_BOOL                         mSimd;
+    RTScalePlane                    mPlanes[RT_SCALE_MAX_PLANES];
+    INT32                           mPlaneNum;
+    INT32                           mInRows;
+    INT32                           mRows;
+    INT32                           mDone;
+    std::vector<RTPlaneScaler *>    mScalers;
+    RTPlaneScaler::Scratch          mScratch;
+};
+
+// mosaics and overlays of filter_image, drawn in place: in and out are the same frame.
+class RTStripDrawStage : public RTStripStage {
+ public:
+    explicit RTStripDrawStage(RTImageDrawer *drawer) : mDrawer(drawer) {}
+
+    RT_RET begin(const RTScaleImage *in, const RTScaleImage *out, INT32 *rows) {
+        RTScalePlane planes[RT_SCALE_MAX_PLANES];
+        if (mDrawer == RT_NULL || in == RT_NULL || out == RT_NULL) {
+            return RT_ERR_VALUE;
+        }
+        if (in->data != out->data || in->format != out->format) {
+            RT_LOGE("the drawer works in place");
+            return RT_ERR_UNSUPPORT;
+        }
+        RT_RET ret = mDrawer->begin(out);
+        if (ret == RT_OK) {
+            RTImageScaler::getPlanes(out, planes);
+            *rows = planes[0].height;
+        }
+        return ret;
+    }
+
+    INT32 run(INT32 ready, INT32 limit) {
+        return mDrawer->drawRows(RT_MIN(ready, limit));
+    }
+
+ private:
+    RTImageDrawer  *mDrawer;
+};
+
+/*
+ * NV12/NV21 -> rgb of RTColorConverter, out may have another size than the
+ * rect of in. a band waits for the input rows its resize reads, luma and
+ * chroma, so it streams behind the stage before.
+ */
+class RTStripConvertStage : public RTStripStage {
+ public:
+    explicit RTStripConvertStage(RTColorConverter *converter, RTScaleMode mode = RT_SCALE_BILINEAR)
+            : mConverter(converter), mMode(mode), mInTop(0), mInRows(0), mRows(0), mDone(0),
+              mResize(RT_FALSE) {
+        memset(&mIn, 0, sizeof(mIn));
+        memset(&mOut, 0, sizeof(mOut));
+    }
+
+    RT_RET begin(const RTScaleImage *in, const RTScaleImage *out, INT32 *rows) {
+        RTScalePlane planes[RT_SCALE_MAX_PLANES];
+        if (mConverter == RT_NULL || in == RT_NULL || out == RT_NULL
+                || RTImageScaler::getPlanes(in, planes) != 2 || out->height <= 0 || (out->height & 1)) {
+            return RT_ERR_VALUE;
+        }
+        mIn     = *in;
+        mOut    = *out;
+        mInTop  = (in->rect.w > 0 && in->rect.h > 0) ? in->rect.y : 0;
+        mInRows = planes[0].height;
+        mRows   = out->height;
+        mResize = (planes[0].width != out->width || planes[0].height != out->height) ? RT_TRUE : RT_FALSE;
+        mDone   = 0;
+        *rows   = mRows;
+        return RT_OK;
+    }
+
+    INT32 run(INT32 ready, INT32 limit) {
+        INT32 end = RT_MIN(limit, mRows) & ~1;
+        while (end > mDone && mInTop + needRows(end) > ready) {
+            end -= 2;
+        }
+        if (end > mDone && mConverter->convertRows(&mIn, &mOut, mMode, mDone, end) == RT_OK) {
+            mDone = end;
+        }
+        return mDone;
+    }
+
+ private:
+    // rows of the rect of in that output rows [0, rows) read, a chroma row covers two.
+    INT32 needRows(INT32 rows) const {
+        if (!mResize) {
+            return rows;
+        }
+        const INT32 luma   = RTPlaneScaler::sourceRows(rows, mInRows, mRows, mMode);
+        const INT32 chroma = RTPlaneScaler::sourceRows(rows / 2, mInRows / 2, mRows / 2, mMode);
+        return RT_MAX(luma, chroma * 2);
+    }
+
+ private:
+    RTColorConverter   *mConverter;
+    RTScaleMode         mMode;
+    RTScaleImage        mIn;
+    RTScaleImage        mOut;
+    INT32               mInTop;
+    INT32               mInRows;
+    INT32               mRows;
+    INT32               mDone;
+    RT_BOOL             mResize;
+};
+
+/*
+ * runs a chain of cpu filters, e.g. crop -> mosaic -> rgb, band by band.
+ *
+ * frame at a time, every stage streams the whole frame through memory and
+ * the next one reads it back, a 4k frame being far larger than L2. here
+ * each stage does RT_STRIP_ROWS more rows before the next one picks them
+ * up, so the rows a stage writes are read back from cache: the source is
+ * read once, the output written once, and the frames in between are
+ * only written back, instead of written and read again per stage.
+ *
+ * stages keep their own output images, a node of the chain still has its
+ * frame. a stage may change the rows, e.g. a resizing convert: bands are
+ * counted in rows of the last stage and every stage before is given the
+ * same share of its own rows. the stages are not owned, run() and
+ * runFrames() give the same bits.
+ *
+ *   RTStripPipeline pipeline;
+ *   pipeline.addStage(&scale, &nv12);
+ *   pipeline.addStage(&draw, &nv12);
+ *   pipeline.addStage(&convert, &rgb);
+ *   pipeline.run(&src);
+ */
+class RTStripPipeline {
+ public:
+    RTStripPipeline() : mBandRows(RT_STRIP_ROWS) {}
+
+    // even, the rows of a chroma pair stay together.
+    void    setBandRows(INT32 rows) { mBandRows = RT_MAX(rows & ~1, 2); }
+    INT32   getBandRows() const { return mBandRows; }
+    void    clear() { mLinks.clear(); }
+
+    // the stage reads the output of the stage before, the first one the source.
+    RT_RET addStage(RTStripStage *stage, const RTScaleImage *out) {
+        if (stage == RT_NULL || out == RT_NULL) {
+            return RT_ERR_VALUE;
+        }
+        Link link;
+        link.stage = stage;
+        link.out   = *out;
+        mLinks.push_back(link);
+        return RT_OK;
+    }
+
+    RT_RET run(const RTScaleImage *src) {
+        return runBands(src, mBandRows);
+    }
+
+    // one stage after the other on whole frames, the way separate nodes run.
+    RT_RET runFrames(const RTScaleImage *src) {
+        return runBands(src, RT_STRIP_ALL_ROWS);
+    }
+
+ private:
+    typedef struct _Link {
+        RTStripStage   *stage;
+        RTScaleImage    out;
+        INT32           rows;
+    } Link;
+
+    // rows of a stage with own rows that band of the rows of the last stage needs, rounded up to even.
+    static INT32 share(INT32 band, INT32 rows, INT32 own) {
+        if (band >= rows || own == rows) {
+            return (band >= rows) ? own : band;
+        }
+        const INT64 scaled = (static_cast<INT64>(band) * own + rows - 1) / rows;
+        return RT_MIN(static_cast<INT32>(scaled + 1) & ~1, own);
+    }
+
+    RT_RET runBands(const RTScaleImage *src, INT32 bandRows) {
+        if (src == RT_NULL || mLinks.empty()) {
+            return RT_ERR_VALUE;
+        }
+        const RTScaleImage *in = src;
+        for (size_t i = 0; i < mLinks.size(); i++) {
+            RT_RET ret = mLinks[i].stage->begin(in, &mLinks[i].out, &mLinks[i].rows);
+            if (ret != RT_OK) {
+                RT_LOGE("strip stage %d fails to begin, ret %d", static_cast<INT32>(i), ret);
+                return ret;
+            }
+            in = &mLinks[i].out;
+        }
+        const INT32 rows = mLinks.back().rows;
+        for (INT32 band = 0; band < rows;) {
+            band = (rows - band > bandRows) ? band + bandRows : rows;
+            INT32 ready = RT_STRIP_ALL_ROWS;
+            for (size_t i = 0; i < mLinks.size(); i++) {
+                ready = mLinks[i].stage->run(ready, share(band, rows, mLinks[i].rows));
+            }
+            if (band == rows && ready < rows) {
+                RT_LOGE("strip pipeline stalls at row %d of %d", ready, rows);
+                return RT_ERR_UNKNOWN;
+            }
+        }
+        return RT_OK;
+    }
+
+ private:
+    INT32               mBandRows;
+    std::vector<Link>   mLinks;
+};
+
+#endif  // SRC_RT_MEDIA_INCLUDE_RTSTRIPPIPELINE_H_
@@ -139,6 +139,15 @@ class RTTaskNodeBase {
     virtual RT_RET      initSupportOptions() { return RT_OK; }
     virtual RT_RET      invokeInternal(RtMetaData *meta) { return RT_ERR_UNSUPPORT; }
 
+    /*
+     * resolves mOptions into cfg through a table the node builds with
+     * RT_NODE_OPT_OFFSET, call it from open(). mSupportOptions has no
+     * offsets and is never bound.
+     */
+    RT_RET              bindOptions(const std::map<std::string, RTTaskNodeOption> &bound, void *cfg) {
+        return RTTaskNodeOptionBinder::bind(bound, mOptions, cfg);
+    }
+
  private:
     RT_RET              addInputStreams(RTInputStreamManager *inputManager);
     RT_RET              addOutputStreams(RTOutputStreamManager *outputManager);
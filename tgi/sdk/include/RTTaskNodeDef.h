@@ -42,6 +42,7 @@ typedef enum _RTStubUid {
     kStubSinkAudio         = MKTAG('s', 'v', 'i', 'l'),
     kStubSinkFile          = MKTAG('s', 'f', 'i', 'l'),
     kStubLinkOutput        = MKTAG('l', 'k', 'o', 'p'),
+    kStubSinkShm           = MKTAG('s', 's', 'h', 'm'),
 
     /* node stubs for media filter */
     kStubFilterRKRga       = MKTAG('f', 'r', 'g', 'a'),
@@ -60,6 +61,7 @@ typedef enum _RTStubUid {
     kStubFilterAvs         = MKTAG('f', 'a', 'v', 's'),
     kStubFilterMpiVo       = MKTAG('f', 'm', 'v', 'o'),
     kStubFilterWbcVo       = MKTAG('f', 'w', 'v', 'o'),
+    kStubFilterColorConvert = MKTAG('f', 'c', 'v', 't'),
 
     kStubfilterSKV        = MKTAG('f', 's', 'k', 'v'),
     kStubfilterSKVAec     = MKTAG('f', 's', 'a', 'e'),
@@ -77,6 +79,7 @@ typedef enum _RTStubUid {
     kStubDeviceALSAPlay    = MKTAG('d', 'a', 'l', 'p'),
     kStubDeviceMultiCap    = MKTAG('m', 'l', 't', 'c'),
     kStubDeviceExternal    = MKTAG('d', 'e', 'x', 't'),
+    kStubDeviceShm         = MKTAG('d', 's', 'h', 'm'),
     kStubFilterAIMatting   = MKTAG('a', 'i', 'm', 't'),
 } RTStubUid;
 
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: per-node latency histograms of task graph
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTTASKNODELATENCY_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTTASKNODELATENCY_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+#include "rt_histogram.h"
+
+#define RT_NODE_LATENCY_ENV_ENABLE      "rt_node_latency"
+
+typedef enum _RTNodeLatencyKind {
+    RT_NODE_LATENCY_PROCESS = 0,    // one process() call
+    RT_NODE_LATENCY_QUEUE_WAIT,     // input buffer enqueued until taken by process()
+    RT_NODE_LATENCY_OPEN,
+    RT_NODE_LATENCY_CLOSE,
+    RT_NODE_LATENCY_MAX,
+} RTNodeLatencyKind;
+
+typedef struct _RTTaskNodeLatencyStat {
+    INT32               nodeId;
+    std::string         nodeName;
+    RtHistogramSummary  kinds[RT_NODE_LATENCY_MAX];     // all values in us
+} RTTaskNodeLatencyStat;
+
+/*
+ * histograms of one node. recording is lock-free and costs a few relaxed
+ * atomics, so it stays enabled in production; set rt_node_latency=0 to
+ * skip even that.
+ */
+class RTTaskNodeLatency {
+ public:
+    RTTaskNodeLatency(INT32 nodeId, const std::string &nodeName)
+            : mNodeId(nodeId), mNodeName(nodeName) {}
+
+    void record(RTNodeLatencyKind kind, UINT64 us) {
+        if (kind >= 0 && kind < RT_NODE_LATENCY_MAX) {
+            mHistograms[kind].record(us);
+        }
+    }
+
+    // enqueueUs must come from RtTime::getRelativeTimeUs().
+    void recordQueueWait(UINT64 enqueueUs) {
+        UINT64 now = RtTime::getRelativeTimeUs();
+        record(RT_NODE_LATENCY_QUEUE_WAIT, now > enqueueUs ? now - enqueueUs : 0);
+    }
+
+    RtHistogram* histogram(RTNodeLatencyKind kind) { return &mHistograms[kind]; }
+
+    void queryStat(RTTaskNodeLatencyStat *stat) const {
+        stat->nodeId   = mNodeId;
+        stat->nodeName = mNodeName;
+        for (INT32 i = 0; i < RT_NODE_LATENCY_MAX; i++) {
+            mHistograms[i].summary(&stat->kinds[i]);
+        }
+    }
+
+    void reset() {
+        for (INT32 i = 0; i < RT_NODE_LATENCY_MAX; i++) {
+            mHistograms[i].reset();
+        }
+    }
+
+    static const char* kindName(INT32 kind) {
+        static const char *names[RT_NODE_LATENCY_MAX] = { "process", "queue_wait", "open", "close" };
+        return (kind >= 0 && kind < RT_NODE_LATENCY_MAX) ? names[kind] : "unknown";
+    }
+
+    static void dumpStat(const RTTaskNodeLatencyStat &stat) {
+        RT_LOGE("node %s(%d) latency(us):", stat.nodeName.c_str(), stat.nodeId);
+        for (INT32 i = 0; i < RT_NODE_LATENCY_MAX; i++) {
+            const RtHistogramSummary &sum = stat.kinds[i];
+            if (sum.count == 0) {
+                continue;
+            }
+            RT_LOGE("  %-10s count %lld avg %lld p50 %lld p90 %lld p99 %lld max %lld",
+                     kindName(i), (INT64)sum.count, (INT64)(sum.sum / sum.count),
+                     (INT64)sum.p50, (INT64)sum.p90, (INT64)sum.p99, (INT64)sum.max);
+        }
+    }
+
+ private:
+    INT32        mNodeId;
+    std::string  mNodeName;
+    RtHistogram  mHistograms[RT_NODE_LATENCY_MAX];
+};
+
+/*
+ * records one kind for the lifetime of the scope, e.g. around process().
+ */
+class RTAutoNodeLatency {
+ public:
+    RTAutoNodeLatency(RTTaskNodeLatency *latency, RTNodeLatencyKind kind)
+            : mAuto(latency ? latency->histogram(kind) : RT_NULL) {}
+
+ private:
+    RtAutoHistogram mAuto;
+};
+
+/*
+ * owns the histograms of every node, grouped by graph uid. nodes fetch
+ * theirs once at initialize() and keep the pointer, which stays valid until
+ * the graph is removed. RTTaskGraph::queryStat()/dump() read them back with
+ * collect()/dump().
+ */
+class RTTaskNodeLatencyRegistry {
+ public:
+    static RTTaskNodeLatencyRegistry* instance() {
+        static RTTaskNodeLatencyRegistry registry;
+        return &registry;
+    }
+
+    RT_BOOL isEnable() const { return mEnable.load(std::memory_order_relaxed); }
+    void    setEnable(RT_BOOL enable) { mEnable.store(enable, std::memory_order_relaxed); }
+
+    // returns RT_NULL when disabled, callers skip recording then.
+    RTTaskNodeLatency* obtain(UINT64 graphUid, INT32 nodeId, const std::string &nodeName) {
+        if (!isEnable()) {
+            return RT_NULL;
+        }
+        RtMutex::RtAutolock autoLock(mLock);
+        std::unique_ptr<RTTaskNodeLatency> &latency = mGraphs[graphUid][nodeId];
+        if (!latency) {
+            latency.reset(new RTTaskNodeLatency(nodeId, nodeName));
+        }
+        return latency.get();
+    }
+
+    INT32 collect(UINT64 graphUid, std::vector<RTTaskNodeLatencyStat> *stats) {
+        stats->clear();
+        RtMutex::RtAutolock autoLock(mLock);
+        GraphMap::iterator graph = mGraphs.find(graphUid);
+        if (graph == mGraphs.end()) {
+            return 0;
+        }
+        NodeMap::iterator it;
+        for (it = graph->second.begin(); it != graph->second.end(); ++it) {
+            RTTaskNodeLatencyStat stat;
+            it->second->queryStat(&stat);
+            stats->push_back(stat);
+        }
+        return static_cast<INT32>(stats->size());
+    }
+
+    INT32 getGraphUids(std::vector<UINT64> *uids) {
+        uids->clear();
+        RtMutex::RtAutolock autoLock(mLock);
+        GraphMap::iterator it;
+        for (it = mGraphs.begin(); it != mGraphs.end(); ++it) {
+            uids->push_back(it->first);
+        }
+        return static_cast<INT32>(uids->size());
+    }
+
+    void dump(UINT64 graphUid) {
+        std::vector<RTTaskNodeLatencyStat> stats;
+        collect(graphUid, &stats);
+        for (size_t i = 0; i < stats.size(); i++) {
+            RTTaskNodeLatency::dumpStat(stats[i]);
+        }
+    }
+
+    void reset(UINT64 graphUid) {
+        RtMutex::RtAutolock autoLock(mLock);
+        GraphMap::iterator graph = mGraphs.find(graphUid);
+        if (graph == mGraphs.end()) {
+            return;
+        }
+        NodeMap::iterator it;
+        for (it = graph->second.begin(); it != graph->second.end(); ++it) {
+            it->second->reset();
+        }
+    }
+
+    // called on graph release, invalidates the pointers of its nodes.
+    void remove(UINT64 graphUid) {
+        RtMutex::RtAutolock autoLock(mLock);
+        mGraphs.erase(graphUid);
+    }
+
+ private:
+    RTTaskNodeLatencyRegistry() : mEnable(RT_TRUE) {
+        UINT32 value = 1;
+        rt_env_get_u32(RT_NODE_LATENCY_ENV_ENABLE, &value, 1);
+        mEnable.store(value ? RT_TRUE : RT_FALSE, std::memory_order_relaxed);
+    }
+    RTTaskNodeLatencyRegistry(const RTTaskNodeLatencyRegistry&) = delete;
+    RTTaskNodeLatencyRegistry& operator=(const RTTaskNodeLatencyRegistry&) = delete;
+
+    typedef std::map<INT32, std::unique_ptr<RTTaskNodeLatency> > NodeMap;
+    typedef std::map<UINT64, NodeMap> GraphMap;
+
+ private:
+    std::atomic<RT_BOOL> mEnable;
+    RtMutex              mLock;
+    GraphMap             mGraphs;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTTASKNODELATENCY_H_
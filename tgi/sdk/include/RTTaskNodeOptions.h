@@ -21,9 +21,23 @@
 #ifndef SRC_RT_TASK_TASK_GRAPH_RTTASKNODEOPTIONS_H_
 #define SRC_RT_TASK_TASK_GRAPH_RTTASKNODEOPTIONS_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <string>
+
 #include "rt_header.h"
 #include "rt_metadata.h"
 
+/*
+ * offset of the bound field in the node's option struct, -1 means unbound.
+ * only tables a node builds itself for binding carry offsets, the offset
+ * of the tables the library fills (mSupportOptions) is left at 0.
+ */
+#define RT_NODE_OPT_OFFSET(type, field)  static_cast<INT32>(offsetof(type, field))
+#define RT_NODE_OPT_UNBOUND              (-1)
+
 typedef struct RTTaskNodeOption {
     const char *cmd;
     const char *name;
@@ -44,4 +58,140 @@ typedef struct RTTaskNodeOption {
     double max;                 ///< maximum valid value for the option
 } RTTaskNodeOption;
 
+/*
+ * resolves all bound options once into a plain struct, so process() reads
+ * struct fields instead of looking up options by name for every buffer.
+ * values missing in options take their defaults. every value outside of
+ * [min, max] (checked when min < max) or of the range of an INT8/INT16
+ * field is reported, RT_ERR_VALUE is returned if any of them failed.
+ * C-string fields point into options and stay valid as long as options do.
+ * supports must be a table built with RT_NODE_OPT_OFFSET, two options on
+ * the same offset (a table never meant for binding) bind nothing.
+ */
+class RTTaskNodeOptionBinder {
+ public:
+    static RT_RET bind(const std::map<std::string, RTTaskNodeOption> &supports,
+                       RtMetaData *options, void *cfg) {
+        if (cfg == RT_NULL) {
+            return RT_ERR_NULL_PTR;
+        }
+
+        std::set<INT32> offsets;
+        std::map<std::string, RTTaskNodeOption>::const_iterator it;
+        for (it = supports.begin(); it != supports.end(); ++it) {
+            if (it->second.offset >= 0 && !offsets.insert(it->second.offset).second) {
+                RT_LOGE("option %s shares offset %d with another option, table is not bound",
+                         it->first.c_str(), it->second.offset);
+                return RT_ERR_VALUE;
+            }
+        }
+
+        RT_RET ret = RT_OK;
+        for (it = supports.begin(); it != supports.end(); ++it) {
+            const RTTaskNodeOption &opt = it->second;
+            if (opt.offset < 0) {
+                continue;
+            }
+            if (bindOne(it->first.c_str(), opt, options,
+                        reinterpret_cast<UINT8 *>(cfg) + opt.offset) != RT_OK) {
+                ret = RT_ERR_VALUE;
+            }
+        }
+        return ret;
+    }
+
+ private:
+    static RT_BOOL checkRange(const char *name, const RTTaskNodeOption &opt, double value) {
+        if (opt.min < opt.max && (value < opt.min || value > opt.max)) {
+            RT_LOGE("option %s value %f out of range [%f, %f]",
+                     name, value, opt.min, opt.max);
+            return RT_FALSE;
+        }
+        return RT_TRUE;
+    }
+
+    // INT8/INT16 fields are read as INT32, values they can not hold are rejected instead of truncated.
+    static RT_BOOL checkType(const char *name, enum RtMetaData::Type type, INT32 value) {
+        INT32 lo = 0, hi = 0;
+        if (type == RtMetaData::TYPE_INT8) {
+            lo = INT8_MIN;
+            hi = INT8_MAX;
+        } else if (type == RtMetaData::TYPE_INT16) {
+            lo = INT16_MIN;
+            hi = INT16_MAX;
+        } else {
+            return RT_TRUE;
+        }
+        if (value < lo || value > hi) {
+            RT_LOGE("option %s value %d does not fit the field, [%d, %d]", name, value, lo, hi);
+            return RT_FALSE;
+        }
+        return RT_TRUE;
+    }
+
+    static RT_RET bindOne(const char *name, const RTTaskNodeOption &opt,
+                          RtMetaData *options, UINT8 *field) {
+        switch (opt.type) {
+          case RtMetaData::TYPE_INT8:
+          case RtMetaData::TYPE_INT16:
+          case RtMetaData::TYPE_INT32: {
+            INT32 value = opt.defaultVal.i64;
+            if (options != RT_NULL) {
+                options->findInt32(name, &value);
+            }
+            if (!checkRange(name, opt, value) || !checkType(name, opt.type, value)) {
+                return RT_ERR_VALUE;
+            }
+            if (opt.type == RtMetaData::TYPE_INT8) {
+                *reinterpret_cast<INT8 *>(field) = static_cast<INT8>(value);
+            } else if (opt.type == RtMetaData::TYPE_INT16) {
+                *reinterpret_cast<INT16 *>(field) = static_cast<INT16>(value);
+            } else {
+                *reinterpret_cast<INT32 *>(field) = value;
+            }
+          } break;
+          case RtMetaData::TYPE_INT64: {
+            INT64 value = opt.defaultVal.i64;
+            INT32 value32 = 0;
+            if (options != RT_NULL && !options->findInt64(name, &value)
+                    && options->findInt32(name, &value32)) {
+                value = value32;
+            }
+            if (!checkRange(name, opt, static_cast<double>(value))) {
+                return RT_ERR_VALUE;
+            }
+            *reinterpret_cast<INT64 *>(field) = value;
+          } break;
+          case RtMetaData::TYPE_FLOAT: {
+            float value = static_cast<float>(opt.defaultVal.dbl);
+            if (options != RT_NULL) {
+                options->findFloat(name, &value);
+            }
+            if (!checkRange(name, opt, value)) {
+                return RT_ERR_VALUE;
+            }
+            *reinterpret_cast<float *>(field) = value;
+          } break;
+          case RtMetaData::TYPE_C_STRING: {
+            const char *value = reinterpret_cast<const char *>(opt.defaultVal.str);
+            if (options != RT_NULL) {
+                options->findCString(name, &value);
+            }
+            *reinterpret_cast<const char **>(field) = value;
+          } break;
+          case RtMetaData::TYPE_POINTER: {
+            RT_PTR value = RT_NULL;
+            if (options != RT_NULL) {
+                options->findPointer(name, &value);
+            }
+            *reinterpret_cast<RT_PTR *>(field) = value;
+          } break;
+          default:
+            RT_LOGE("option %s type 0x%x can not be bound to a field", name, opt.type);
+            return RT_ERR_UNSUPPORT;
+        }
+        return RT_OK;
+    }
+};
+
 #endif  // SRC_RT_TASK_TASK_GRAPH_RTTASKNODEOPTIONS_H_
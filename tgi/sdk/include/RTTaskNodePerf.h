@@ -0,0 +1,411 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: per-node hardware performance counters of task graph
+ */
+
+#ifndef SRC_RT_TASK_TASK_GRAPH_RTTASKNODEPERF_H_
+#define SRC_RT_TASK_TASK_GRAPH_RTTASKNODEPERF_H_
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rt_header.h"
+
+#define RT_NODE_PERF_ENV_ENABLE         "rt_node_perf"
+
+typedef enum _RTNodePerfCounter {
+    RT_NODE_PERF_CYCLES = 0,
+    RT_NODE_PERF_INSTRUCTIONS,
+    RT_NODE_PERF_CACHE_MISSES,
+    RT_NODE_PERF_CONTEXT_SWITCHES,
+    RT_NODE_PERF_MAX,
+} RTNodePerfCounter;
+
+typedef struct _RTNodePerfSample {
+    UINT64  values[RT_NODE_PERF_MAX];
+    UINT64  enabledNs;
+    UINT64  runningNs;
+} RTNodePerfSample;
+
+typedef struct _RTTaskNodePerfStat {
+    INT32       nodeId;
+    std::string nodeName;
+    UINT64      calls;
+    UINT64      counters[RT_NODE_PERF_MAX];
+    RT_BOOL     valid[RT_NODE_PERF_MAX];    // RT_FALSE if the counter is not available
+} RTTaskNodePerfStat;
+
+/*
+ * the counters of the calling thread, opened as one perf event group at
+ * the first use, so a sample is a single read(). user space only, which
+ * works with the default perf_event_paranoid=2. context switches happen in
+ * the kernel and would count 0 there, they come from getrusage() of the
+ * thread instead. counters the cpu or the kernel refuses are left out; if
+ * the pmu is multiplexed the deltas are scaled by the running time of the
+ * group.
+ */
+class RtPerfCounterGroup {
+ public:
+    static RtPerfCounterGroup* current() {
+        static thread_local RtPerfCounterGroup group;
+        return &group;
+    }
+
+    RT_BOOL isValid(INT32 counter) const {
+        if (counter == RT_NODE_PERF_CONTEXT_SWITCHES) {
+            return mRusage;
+        }
+        return mIndex[counter] >= 0 ? RT_TRUE : RT_FALSE;
+    }
+    RT_BOOL isOpened() const { return (mLeader >= 0 || mRusage) ? RT_TRUE : RT_FALSE; }
+
+    RT_BOOL read(RTNodePerfSample *sample) {
+        memset(sample, 0, sizeof(*sample));
+#if defined(__linux__)
+        struct rusage usage;
+        if (mRusage && getrusage(RUSAGE_THREAD, &usage) == 0) {
+            sample->values[RT_NODE_PERF_CONTEXT_SWITCHES] = static_cast<UINT64>(usage.ru_nvcsw)
+                                                          + static_cast<UINT64>(usage.ru_nivcsw);
+        }
+#endif
+        if (mLeader < 0) {
+            return mRusage;
+        }
+        // struct read_format of PERF_FORMAT_GROUP: nr, enabled, running, values[nr]
+        UINT64 buf[3 + RT_NODE_PERF_MAX];
+        ssize_t len = ::read(mLeader, buf, sizeof(buf));
+        if (len < static_cast<ssize_t>(3 * sizeof(UINT64))) {
+            return RT_FALSE;
+        }
+        sample->enabledNs = buf[1];
+        sample->runningNs = buf[2];
+        for (INT32 i = 0; i < RT_NODE_PERF_MAX; i++) {
+            if (mIndex[i] >= 0 && static_cast<UINT64>(mIndex[i]) < buf[0]) {
+                sample->values[i] = buf[3 + mIndex[i]];
+            }
+        }
+        return RT_TRUE;
+    }
+
+    // end - begin of each counter, scaled up if the group was not always on the pmu.
+    static void delta(const RTNodePerfSample &begin, const RTNodePerfSample &end, UINT64 *out) {
+        UINT64 enabled = end.enabledNs - begin.enabledNs;
+        UINT64 running = end.runningNs - begin.runningNs;
+        for (INT32 i = 0; i < RT_NODE_PERF_MAX; i++) {
+            UINT64 value = end.values[i] >= begin.values[i] ? end.values[i] - begin.values[i] : 0;
+            if (running > 0 && running < enabled && i != RT_NODE_PERF_CONTEXT_SWITCHES) {
+                value = static_cast<UINT64>(static_cast<double>(value) * enabled / running);
+            }
+            out[i] = value;
+        }
+    }
+
+    static const char* counterName(INT32 counter) {
+        static const char *names[RT_NODE_PERF_MAX] = {
+            "cycles", "instructions", "cache_misses", "context_switches" };
+        return (counter >= 0 && counter < RT_NODE_PERF_MAX) ? names[counter] : "unknown";
+    }
+
+ private:
+    RtPerfCounterGroup() : mLeader(-1), mOpened(0), mRusage(RT_FALSE) {
+        for (INT32 i = 0; i < RT_NODE_PERF_MAX; i++) {
+            mFds[i]   = -1;
+            mIndex[i] = -1;
+        }
+#if defined(__linux__)
+        struct rusage usage;
+        mRusage = (getrusage(RUSAGE_THREAD, &usage) == 0) ? RT_TRUE : RT_FALSE;
+        open(RT_NODE_PERF_CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        open(RT_NODE_PERF_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        open(RT_NODE_PERF_CACHE_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        if (mLeader >= 0) {
+            ioctl(mLeader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(mLeader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    ~RtPerfCounterGroup() {
+        for (INT32 i = 0; i < RT_NODE_PERF_MAX; i++) {
+            if (mFds[i] >= 0) {
+                ::close(mFds[i]);
+            }
+        }
+    }
+
+    RtPerfCounterGroup(const RtPerfCounterGroup&) = delete;
+    RtPerfCounterGroup& operator=(const RtPerfCounterGroup&) = delete;
+
+#if defined(__linux__)
+    void open(INT32 counter, UINT32 type, UINT64 config) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = type;
+        attr.config         = config;
+        attr.disabled       = (mLeader < 0) ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        INT32 fd = static_cast<INT32>(syscall(__NR_perf_event_open, &attr, 0, -1, mLeader,
+                                              PERF_FLAG_FD_CLOEXEC));
+        if (fd < 0) {
+            RT_LOGD("perf counter %s unavailable: %s", counterName(counter), strerror(errno));
+            return;
+        }
+        if (mLeader < 0) {
+            mLeader = fd;
+        }
+        mFds[counter]   = fd;
+        mIndex[counter] = mOpened++;
+    }
+#endif
+
+ private:
+    INT32 mLeader;
+    INT32 mOpened;
+    INT32 mFds[RT_NODE_PERF_MAX];
+    INT32 mIndex[RT_NODE_PERF_MAX];     // position in the group read, -1 if not opened
+    RT_BOOL mRusage;                    // context switches of getrusage()
+};
+
+/*
+ * counter totals of one node, summed over all of its process() calls on
+ * whatever thread the executor ran them.
+ */
+class RTTaskNodePerf {
+ public:
+    RTTaskNodePerf(INT32 nodeId, const std::string &nodeName)
+            : mNodeId(nodeId), mNodeName(nodeName), mCalls(0) {
+        for (INT32 i = 0; i < RT_NODE_PERF_MAX; i++) {
+            mCounters[i].store(0, std::memory_order_relaxed);
+            mValid[i].store(RT_FALSE, std::memory_order_relaxed);
+        }
+    }
+
+    void add(const UINT64 *deltas, const RtPerfCounterGroup *group) {
+        mCalls.fetch_add(1, std::memory_order_relaxed);
+        for (INT32 i = 0; i < RT_NODE_PERF_MAX; i++) {
+            if (group->isValid(i)) {
+                mCounters[i].fetch_add(deltas[i], std::memory_order_relaxed);
+                mValid[i].store(RT_TRUE, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void queryStat(RTTaskNodePerfStat *stat) const {
+        stat->nodeId   = mNodeId;
+        stat->nodeName = mNodeName;
+        stat->calls    = mCalls.load(std::memory_order_relaxed);
+        for (INT32 i = 0; i < RT_NODE_PERF_MAX; i++) {
+            stat->counters[i] = mCounters[i].load(std::memory_order_relaxed);
+            stat->valid[i]    = mValid[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    void reset() {
+        mCalls.store(0, std::memory_order_relaxed);
+        for (INT32 i = 0; i < RT_NODE_PERF_MAX; i++) {
+            mCounters[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // instructions per cycle, low values on a busy node point to memory stalls.
+    static double ipc(const RTTaskNodePerfStat &stat) {
+        if (!stat.valid[RT_NODE_PERF_CYCLES] || !stat.valid[RT_NODE_PERF_INSTRUCTIONS]
+                || stat.counters[RT_NODE_PERF_CYCLES] == 0) {
+            return 0.0;
+        }
+        return static_cast<double>(stat.counters[RT_NODE_PERF_INSTRUCTIONS])
+                / stat.counters[RT_NODE_PERF_CYCLES];
+    }
+
+    // cache misses per thousand instructions.
+    static double mpki(const RTTaskNodePerfStat &stat) {
+        if (!stat.valid[RT_NODE_PERF_CACHE_MISSES] || !stat.valid[RT_NODE_PERF_INSTRUCTIONS]
+                || stat.counters[RT_NODE_PERF_INSTRUCTIONS] == 0) {
+            return 0.0;
+        }
+        return stat.counters[RT_NODE_PERF_CACHE_MISSES] * 1000.0
+                / stat.counters[RT_NODE_PERF_INSTRUCTIONS];
+    }
+
+    static void dumpStat(const RTTaskNodePerfStat &stat) {
+        if (stat.calls == 0) {
+            return;
+        }
+        RT_LOGE("node %s(%d) perf over %lld process calls, ipc %.2f mpki %.2f:",
+                 stat.nodeName.c_str(), stat.nodeId, (long long)stat.calls, ipc(stat), mpki(stat));
+        for (INT32 i = 0; i < RT_NODE_PERF_MAX; i++) {
+            if (!stat.valid[i]) {
+                continue;
+            }
+            RT_LOGE("  %-16s total %lld per call %lld", RtPerfCounterGroup::counterName(i),
+                     (long long)stat.counters[i], (long long)(stat.counters[i] / stat.calls));
+        }
+    }
+
+ private:
+    INT32                 mNodeId;
+    std::string           mNodeName;
+    std::atomic<UINT64>   mCalls;
+    std::atomic<UINT64>   mCounters[RT_NODE_PERF_MAX];
+    std::atomic<RT_BOOL>  mValid[RT_NODE_PERF_MAX];
+};
+
+/*
+ * samples the counters of the executing thread around process().
+ */
+class RTAutoNodePerf {
+ public:
+    explicit RTAutoNodePerf(RTTaskNodePerf *perf) : mPerf(perf), mGroup(RT_NULL) {
+        if (mPerf != RT_NULL) {
+            mGroup = RtPerfCounterGroup::current();
+            if (!mGroup->read(&mBegin)) {
+                mGroup = RT_NULL;
+            }
+        }
+    }
+
+    ~RTAutoNodePerf() {
+        RTNodePerfSample end;
+        if (mGroup == RT_NULL || !mGroup->read(&end)) {
+            return;
+        }
+        UINT64 deltas[RT_NODE_PERF_MAX];
+        RtPerfCounterGroup::delta(mBegin, end, deltas);
+        mPerf->add(deltas, mGroup);
+    }
+
+ private:
+    RTTaskNodePerf     *mPerf;
+    RtPerfCounterGroup *mGroup;
+    RTNodePerfSample    mBegin;
+};
+
+/*
+ * owns the counters of every node, grouped by graph uid, the same way as
+ * RTTaskNodeLatencyRegistry. RTTaskNodeStat is opaque to this header and
+ * not filled: collect() is the way to read the totals, when rt_node_perf=1.
+ * off by default because every sample costs a few syscalls.
+ */
+class RTTaskNodePerfRegistry {
+ public:
+    static RTTaskNodePerfRegistry* instance() {
+        static RTTaskNodePerfRegistry registry;
+        return &registry;
+    }
+
+    RT_BOOL isEnable() const { return mEnable.load(std::memory_order_relaxed); }
+    void    setEnable(RT_BOOL enable) { mEnable.store(enable, std::memory_order_relaxed); }
+
+    // returns RT_NULL when disabled, RTAutoNodePerf does nothing then.
+    RTTaskNodePerf* obtain(UINT64 graphUid, INT32 nodeId, const std::string &nodeName) {
+        if (!isEnable()) {
+            return RT_NULL;
+        }
+        RtMutex::RtAutolock autoLock(mLock);
+        std::unique_ptr<RTTaskNodePerf> &perf = mGraphs[graphUid][nodeId];
+        if (!perf) {
+            perf.reset(new RTTaskNodePerf(nodeId, nodeName));
+        }
+        return perf.get();
+    }
+
+    INT32 collect(UINT64 graphUid, std::vector<RTTaskNodePerfStat> *stats) {
+        stats->clear();
+        RtMutex::RtAutolock autoLock(mLock);
+        GraphMap::iterator graph = mGraphs.find(graphUid);
+        if (graph == mGraphs.end()) {
+            return 0;
+        }
+        NodeMap::iterator it;
+        for (it = graph->second.begin(); it != graph->second.end(); ++it) {
+            RTTaskNodePerfStat stat;
+            it->second->queryStat(&stat);
+            stats->push_back(stat);
+        }
+        return static_cast<INT32>(stats->size());
+    }
+
+    INT32 getGraphUids(std::vector<UINT64> *uids) {
+        uids->clear();
+        RtMutex::RtAutolock autoLock(mLock);
+        GraphMap::iterator it;
+        for (it = mGraphs.begin(); it != mGraphs.end(); ++it) {
+            uids->push_back(it->first);
+        }
+        return static_cast<INT32>(uids->size());
+    }
+
+    void dump(UINT64 graphUid) {
+        std::vector<RTTaskNodePerfStat> stats;
+        collect(graphUid, &stats);
+        for (size_t i = 0; i < stats.size(); i++) {
+            RTTaskNodePerf::dumpStat(stats[i]);
+        }
+    }
+
+    void reset(UINT64 graphUid) {
+        RtMutex::RtAutolock autoLock(mLock);
+        GraphMap::iterator graph = mGraphs.find(graphUid);
+        if (graph == mGraphs.end()) {
+            return;
+        }
+        NodeMap::iterator it;
+        for (it = graph->second.begin(); it != graph->second.end(); ++it) {
+            it->second->reset();
+        }
+    }
+
+    // called on graph release, invalidates the pointers of its nodes.
+    void remove(UINT64 graphUid) {
+        RtMutex::RtAutolock autoLock(mLock);
+        mGraphs.erase(graphUid);
+    }
+
+ private:
+    RTTaskNodePerfRegistry() : mEnable(RT_FALSE) {
+        UINT32 value = 0;
+        rt_env_get_u32(RT_NODE_PERF_ENV_ENABLE, &value, 0);
+        mEnable.store(value ? RT_TRUE : RT_FALSE, std::memory_order_relaxed);
+    }
+    RTTaskNodePerfRegistry(const RTTaskNodePerfRegistry&) = delete;
+    RTTaskNodePerfRegistry& operator=(const RTTaskNodePerfRegistry&) = delete;
+
+    typedef std::map<INT32, std::unique_ptr<RTTaskNodePerf> > NodeMap;
+    typedef std::map<UINT64, NodeMap> GraphMap;
+
+ private:
+    std::atomic<RT_BOOL> mEnable;
+    RtMutex              mLock;
+    GraphMap             mGraphs;
+};
+
+#endif  // SRC_RT_TASK_TASK_GRAPH_RTTASKNODEPERF_H_
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: lock-free log-bucketed histogram
+ */
+
+#ifndef INCLUDE_RT_BASE_RT_HISTOGRAM_H_
+#define INCLUDE_RT_BASE_RT_HISTOGRAM_H_
+
+#include <atomic>
+
+#include "rt_type.h"  // NOLINT
+#include "rt_time.h"  // NOLINT
+
+/*
+ * values below 8 get a bucket each, above that every power of two is split
+ * into 8 linear sub-buckets, so a percentile is off by 12.5% at most.
+ * values from 2^40 on (~12 days in us) share the last bucket.
+ */
+#define RT_HISTOGRAM_SUB_BITS      3
+#define RT_HISTOGRAM_SUB_COUNT     (1 << RT_HISTOGRAM_SUB_BITS)
+#define RT_HISTOGRAM_MAX_BITS      40
+#define RT_HISTOGRAM_BUCKETS       ((RT_HISTOGRAM_MAX_BITS - 1) * RT_HISTOGRAM_SUB_COUNT)
+
+typedef struct _RtHistogramSummary {
+    UINT64 count;
+    UINT64 sum;
+    UINT64 max;
+    UINT64 p50;
+    UINT64 p90;
+    UINT64 p99;
+} RtHistogramSummary;
+
+/*
+ * record() is a handful of relaxed atomic adds and can be called from any
+ * thread. readers get a consistent enough view for statistics, without
+ * stopping the writers.
+ */
+class RtHistogram {
+ public:
+    RtHistogram() { reset(); }
+
+    void record(UINT64 value) {
+        mBuckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mSum.fetch_add(value, std::memory_order_relaxed);
+        UINT64 max = mMax.load(std::memory_order_relaxed);
+        while (value > max &&
+               !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+    }
+
+    void reset() {
+        for (INT32 i = 0; i < RT_HISTOGRAM_BUCKETS; i++) {
+            mBuckets[i].store(0, std::memory_order_relaxed);
+        }
+        mCount.store(0, std::memory_order_relaxed);
+        mSum.store(0, std::memory_order_relaxed);
+        mMax.store(0, std::memory_order_relaxed);
+    }
+
+    UINT64 count() const { return mCount.load(std::memory_order_relaxed); }
+
+    // value at or below which the given permille of the records are.
+    UINT64 percentile(UINT32 permille) const {
+        UINT64 counts[RT_HISTOGRAM_BUCKETS];
+        UINT64 total = snapshot(counts);
+        return percentileOf(counts, total, permille);
+    }
+
+    void summary(RtHistogramSummary *out) const {
+        UINT64 counts[RT_HISTOGRAM_BUCKETS];
+        UINT64 total = snapshot(counts);
+        out->count = total;
+        out->sum   = mSum.load(std::memory_order_relaxed);
+        out->max   = mMax.load(std::memory_order_relaxed);
+        out->p50   = percentileOf(counts, total, 500);
+        out->p90   = percentileOf(counts, total, 900);
+        out->p99   = percentileOf(counts, total, 990);
+    }
+
+    static INT32 bucketOf(UINT64 value) {
+        if (value < RT_HISTOGRAM_SUB_COUNT) {
+            return static_cast<INT32>(value);
+        }
+        INT32 msb = 63 - __builtin_clzll(value);
+        if (msb >= RT_HISTOGRAM_MAX_BITS) {
+            return RT_HISTOGRAM_BUCKETS - 1;
+        }
+        INT32 sub = static_cast<INT32>(value >> (msb - RT_HISTOGRAM_SUB_BITS)) & (RT_HISTOGRAM_SUB_COUNT - 1);
+        return (msb - RT_HISTOGRAM_SUB_BITS + 1) * RT_HISTOGRAM_SUB_COUNT + sub;
+    }
+
+    // largest value which falls into the bucket.
+    static UINT64 bucketUpper(INT32 bucket) {
+        if (bucket < RT_HISTOGRAM_SUB_COUNT) {
+            return bucket;
+        }
+        INT32  msb   = bucket / RT_HISTOGRAM_SUB_COUNT + RT_HISTOGRAM_SUB_BITS - 1;
+        UINT64 sub   = bucket % RT_HISTOGRAM_SUB_COUNT;
+        UINT64 shift = msb - RT_HISTOGRAM_SUB_BITS;
+        return ((RT_HISTOGRAM_SUB_COUNT + sub + 1) << shift) - 1;
+    }
+
+ private:
+    UINT64 snapshot(UINT64 *counts) const {
+        UINT64 total = 0;
+        for (INT32 i = 0; i < RT_HISTOGRAM_BUCKETS; i++) {
+            counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        return total;
+    }
+
+    UINT64 percentileOf(const UINT64 *counts, UINT64 total, UINT32 permille) const {
+        if (total == 0) {
+            return 0;
+        }
+        UINT64 rank = (total * permille + 999) / 1000;
+        UINT64 seen = 0;
+        UINT64 max  = mMax.load(std::memory_order_relaxed);
+        for (INT32 i = 0; i < RT_HISTOGRAM_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank && counts[i] > 0) {
+                UINT64 upper = bucketUpper(i);
+                return upper < max ? upper : max;
+            }
+        }
+        return max;
+    }
+
+ private:
+    std::atomic<UINT32> mBuckets[RT_HISTOGRAM_BUCKETS];
+    std::atomic<UINT64> mCount;
+    std::atomic<UINT64> mSum;
+    std::atomic<UINT64> mMax;
+};
+
+/*
+ * records the lifetime of the scope in us, like RtAutoTimeoutLog.
+ */
+class RtAutoHistogram {
+ public:
+    explicit inline RtAutoHistogram(RtHistogram *histogram)
+            : mHistogram(histogram),
+              mStart(histogram ? RtTime::getRelativeTimeUs() : 0) {}
+    inline ~RtAutoHistogram() {
+        if (mHistogram) {
+            mHistogram->record(RtTime::getRelativeTimeUs() - mStart);
+        }
+    }
+
+ private:
+    RtHistogram *mHistogram;
+    UINT64       mStart;
+};
+
+#endif  // INCLUDE_RT_BASE_RT_HISTOGRAM_H_
@@ -0,0 +1,380 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: contention profiler of RtMutex/RtCondition
+ */
+
+#ifndef INCLUDE_RT_BASE_RT_LOCK_PROFILER_H_
+#define INCLUDE_RT_BASE_RT_LOCK_PROFILER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "rt_header.h"   // NOLINT
+
+#define RT_LOCK_PROFILER_ENV_ENABLE     "rt_lock_profiler"
+#define RT_LOCK_PROFILER_TOP_N          20
+#define RT_LOCK_PROFILER_WAKE_US        200     // above the wake-up latency of the scheduler
+
+#define RT_LOCK_SITE_STR(x)             #x
+#define RT_LOCK_SITE_LINE(x)            RT_LOCK_SITE_STR(x)
+#define RT_LOCK_SITE                    __FILE__ ":" RT_LOCK_SITE_LINE(__LINE__)
+
+/*
+ * usage, name is the lock member and must be a literal:
+ *
+ *   RT_PROFILED_AUTOLOCK(autoLock, mThrottleMutex, "mThrottleMutex");
+ *   RT_PROFILED_WAIT(mCond, mStateMutex, "mStateMutex");
+ *
+ * every call site resolves its stat once, later calls touch only atomics.
+ * all instances of a lock member share the stat of their call site, e.g.
+ * the mLock of every buffer.
+ *
+ * the sleep in a condition wait is not contention, it goes to condWaitUs,
+ * and the mutex is not held during it: the hold time of the profiled
+ * autolock of the same mutex, if this thread has one, stops at the wait
+ * and starts again after it.
+ * the mutex re-acquire after the wake-up happens inside the wait, it can
+ * only be told apart when the condition is a RtProfiledCondition, which
+ * stamps the time of its signals: the re-acquire then counts as an acquire,
+ * and as contended when it took longer than RT_LOCK_PROFILER_WAKE_US: a
+ * quicker one is the wake-up itself, a slower one mostly waited for the
+ * signaler, or another thread, to unlock.
+ */
+#define RT_PROFILED_AUTOLOCK(var, mutex, name) \
+    static RtLockSiteStat *var##Site = RtLockProfiler::instance()->site(name, RT_LOCK_SITE); \
+    RtProfiledAutolock var(mutex, var##Site)
+
+#define RT_PROFILED_WAIT(cond, mutex, name) \
+    ([&]() -> INT32 { \
+        static RtLockSiteStat *site = RtLockProfiler::instance()->site(name, RT_LOCK_SITE); \
+        return RtLockProfiler::wait(cond, mutex, site); \
+    }())
+
+typedef struct _RtLockSiteStat {
+    const char          *name;
+    const char          *site;
+    std::atomic<UINT64>  acquires;
+    std::atomic<UINT64>  contended;     // lock() or a re-acquire after a wake-up had to block
+    std::atomic<UINT64>  waitUs;        // blocked on the mutex
+    std::atomic<UINT64>  maxWaitUs;
+    std::atomic<UINT64>  holdUs;
+    std::atomic<UINT64>  condWaits;
+    std::atomic<UINT64>  condWaitUs;    // slept in wait() until signaled
+} RtLockSiteStat;
+
+typedef struct _RtLockSiteReport {
+    const char *name;
+    const char *site;
+    UINT64      acquires;
+    UINT64      contended;
+    UINT64      waitUs;
+    UINT64      maxWaitUs;
+    UINT64      holdUs;
+    UINT64      condWaits;
+    UINT64      condWaitUs;
+} RtLockSiteReport;
+
+// one held profiled autolock, a thread keeps its held ones in a list.
+typedef struct _RtLockHold {
+    RtMutex            *mutex;
+    RtLockSiteStat     *stat;
+    UINT64              lockedUs;       // 0: not profiled
+    struct _RtLockHold *outer;
+} RtLockHold;
+
+/*
+ * RtCondition which stamps the time of its last signal, so a profiled
+ * wait can tell the sleep from the mutex re-acquire. signal while the
+ * mutex is held, as with RtCondition.
+ */
+class RtProfiledCondition {
+ public:
+    RtProfiledCondition() : mSignalUs(0) {}
+
+    INT32 signal() {
+        stamp();
+        return mCond.signal();
+    }
+    INT32 broadcast() {
+        stamp();
+        return mCond.broadcast();
+    }
+    INT32 wait(RtMutex *mutex) { return mCond.wait(mutex); }
+    INT32 timedwait(RtMutex *mutex, UINT64 timeoutUs) { return mCond.timedwait(mutex, timeoutUs); }
+
+    UINT64 getSignalUs() const { return mSignalUs.load(std::memory_order_relaxed); }
+
+ private:
+    void stamp();
+
+ private:
+    RtCondition         mCond;
+    std::atomic<UINT64> mSignalUs;
+};
+
+class RtLockProfiler {
+ public:
+    static RtLockProfiler* instance() {
+        static RtLockProfiler profiler;
+        return &profiler;
+    }
+
+    RT_BOOL isEnable() const { return mEnable.load(std::memory_order_relaxed); }
+    void    setEnable(RT_BOOL enable) { mEnable.store(enable, std::memory_order_relaxed); }
+
+    RtLockSiteStat* site(const char *name, const char *site) {
+        RtMutex::RtAutolock autoLock(mLock);
+        std::unique_ptr<RtLockSiteStat> stat(new RtLockSiteStat());
+        stat->name = name;
+        stat->site = site;
+        stat->acquires.store(0);
+        stat->contended.store(0);
+        stat->waitUs.store(0);
+        stat->maxWaitUs.store(0);
+        stat->holdUs.store(0);
+        stat->condWaits.store(0);
+        stat->condWaitUs.store(0);
+        mSites.push_back(std::move(stat));
+        return mSites.back().get();
+    }
+
+    // returns the acquire time for the hold time accounting, 0 when disabled.
+    static UINT64 lock(RtMutex *mutex, RtLockSiteStat *stat) {
+        if (!instance()->isEnable() || stat == RT_NULL) {
+            mutex->lock();
+            return 0;
+        }
+        stat->acquires.fetch_add(1, std::memory_order_relaxed);
+        if (mutex->trylock() == 0) {
+            return RtTime::getRelativeTimeUs();
+        }
+        UINT64 start = RtTime::getRelativeTimeUs();
+        mutex->lock();
+        UINT64 now = RtTime::getRelativeTimeUs();
+        stat->contended.fetch_add(1, std::memory_order_relaxed);
+        addWait(stat, now - start);
+        return now;
+    }
+
+    static void unlock(RtMutex *mutex, RtLockSiteStat *stat, UINT64 lockedUs) {
+        if (lockedUs != 0 && stat != RT_NULL) {
+            stat->holdUs.fetch_add(RtTime::getRelativeTimeUs() - lockedUs, std::memory_order_relaxed);
+        }
+        mutex->unlock();
+    }
+
+    // profiled holds only, the list is what a wait searches for the holder of its mutex.
+    static void pushHold(RtLockHold *hold) {
+        if (hold->lockedUs != 0) {
+            hold->outer = holds();
+            holds() = hold;
+        }
+    }
+    static void popHold(RtLockHold *hold) {
+        if (holds() == hold) {
+            holds() = hold->outer;
+        }
+    }
+
+    // the sleep and the re-acquire can not be told apart, all of it is a condition wait.
+    static INT32 wait(RtCondition *cond, RtMutex *mutex, RtLockSiteStat *stat) {
+        if (!instance()->isEnable() || stat == RT_NULL) {
+            return cond->wait(mutex);
+        }
+        UINT64 start = RtTime::getRelativeTimeUs();
+        RtLockHold *hold = pauseHold(mutex, start);
+        INT32  ret   = cond->wait(mutex);
+        UINT64 now   = RtTime::getRelativeTimeUs();
+        resumeHold(hold, now);
+        addCondWait(stat, now - start);
+        return ret;
+    }
+    static INT32 wait(RtCondition &cond, RtMutex &mutex, RtLockSiteStat *stat) {
+        return wait(&cond, &mutex, stat);
+    }
+
+    static INT32 wait(RtProfiledCondition *cond, RtMutex *mutex, RtLockSiteStat *stat) {
+        if (!instance()->isEnable() || stat == RT_NULL) {
+            return cond->wait(mutex);
+        }
+        UINT64 start  = RtTime::getRelativeTimeUs();
+        RtLockHold *hold = pauseHold(mutex, start);
+        INT32  ret    = cond->wait(mutex);
+        UINT64 now    = RtTime::getRelativeTimeUs();
+        UINT64 signal = cond->getSignalUs();
+        resumeHold(hold, now);
+        if (signal < start || signal > now) {
+            // a spurious wake-up, or the signal came before the profiler was on.
+            addCondWait(stat, now - start);
+            return ret;
+        }
+        addCondWait(stat, signal - start);
+        stat->acquires.fetch_add(1, std::memory_order_relaxed);
+        if (now - signal > RT_LOCK_PROFILER_WAKE_US) {
+            stat->contended.fetch_add(1, std::memory_order_relaxed);
+            addWait(stat, now - signal);
+        }
+        return ret;
+    }
+    static INT32 wait(RtProfiledCondition &cond, RtMutex &mutex, RtLockSiteStat *stat) {
+        return wait(&cond, &mutex, stat);
+    }
+
+    // sites sorted by wait time, topN <= 0 returns all.
+    INT32 collect(std::vector<RtLockSiteReport> *reports, INT32 topN = RT_LOCK_PROFILER_TOP_N) {
+        reports->clear();
+        {
+            RtMutex::RtAutolock autoLock(mLock);
+            for (size_t i = 0; i < mSites.size(); i++) {
+                const RtLockSiteStat *stat = mSites[i].get();
+                RtLockSiteReport report;
+                report.name      = stat->name;
+                report.site      = stat->site;
+                report.acquires  = stat->acquires.load(std::memory_order_relaxed);
+                report.contended = stat->contended.load(std::memory_order_relaxed);
+                report.waitUs    = stat->waitUs.load(std::memory_order_relaxed);
+                report.maxWaitUs = stat->maxWaitUs.load(std::memory_order_relaxed);
+                report.holdUs    = stat->holdUs.load(std::memory_order_relaxed);
+                report.condWaits  = stat->condWaits.load(std::memory_order_relaxed);
+                report.condWaitUs = stat->condWaitUs.load(std::memory_order_relaxed);
+                if (report.acquires > 0 || report.condWaits > 0) {
+                    reports->push_back(report);
+                }
+            }
+        }
+        std::sort(reports->begin(), reports->end(),
+                  [](const RtLockSiteReport &a, const RtLockSiteReport &b) { return a.waitUs > b.waitUs; });
+        if (topN > 0 && reports->size() > static_cast<size_t>(topN)) {
+            reports->resize(topN);
+        }
+        return static_cast<INT32>(reports->size());
+    }
+
+    void dump(INT32 topN = RT_LOCK_PROFILER_TOP_N) {
+        std::vector<RtLockSiteReport> reports;
+        collect(&reports, topN);
+        RT_LOGE("top %d contended locks:", (INT32)reports.size());
+        for (size_t i = 0; i < reports.size(); i++) {
+            const RtLockSiteReport &r = reports[i];
+            RT_LOGE("  %-20s %s acquires %lld contended %lld wait %lld us (max %lld) hold %lld us"
+                    " cond waits %lld %lld us",
+                     r.name, r.site, (INT64)r.acquires, (INT64)r.contended,
+                     (INT64)r.waitUs, (INT64)r.maxWaitUs, (INT64)r.holdUs,
+                     (INT64)r.condWaits, (INT64)r.condWaitUs);
+        }
+    }
+
+    void reset() {
+        RtMutex::RtAutolock autoLock(mLock);
+        for (size_t i = 0; i < mSites.size(); i++) {
+            mSites[i]->acquires.store(0, std::memory_order_relaxed);
+            mSites[i]->contended.store(0, std::memory_order_relaxed);
+            mSites[i]->waitUs.store(0, std::memory_order_relaxed);
+            mSites[i]->maxWaitUs.store(0, std::memory_order_relaxed);
+            mSites[i]->holdUs.store(0, std::memory_order_relaxed);
+            mSites[i]->condWaits.store(0, std::memory_order_relaxed);
+            mSites[i]->condWaitUs.store(0, std::memory_order_relaxed);
+        }
+    }
+
+ private:
+    RtLockProfiler() : mEnable(RT_FALSE) {
+        UINT32 value = 0;
+        rt_env_get_u32(RT_LOCK_PROFILER_ENV_ENABLE, &value, 0);
+        mEnable.store(value ? RT_TRUE : RT_FALSE, std::memory_order_relaxed);
+    }
+    RtLockProfiler(const RtLockProfiler&) = delete;
+    RtLockProfiler& operator=(const RtLockProfiler&) = delete;
+
+    static void addWait(RtLockSiteStat *stat, UINT64 us) {
+        stat->waitUs.fetch_add(us, std::memory_order_relaxed);
+        UINT64 max = stat->maxWaitUs.load(std::memory_order_relaxed);
+        while (us > max &&
+               !stat->maxWaitUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+    }
+
+    static void addCondWait(RtLockSiteStat *stat, UINT64 us) {
+        stat->condWaits.fetch_add(1, std::memory_order_relaxed);
+        stat->condWaitUs.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    static RtLockHold*& holds() {
+        static thread_local RtLockHold *top = RT_NULL;
+        return top;
+    }
+
+    // the wait releases mutex: the hold so far is accounted, the rest restarts after the wait.
+    static RtLockHold* pauseHold(RtMutex *mutex, UINT64 nowUs) {
+        RtLockHold *hold = holds();
+        for (; hold != RT_NULL && hold->mutex != mutex; hold = hold->outer) {}
+        if (hold != RT_NULL && hold->stat != RT_NULL) {
+            hold->stat->holdUs.fetch_add(nowUs - hold->lockedUs, std::memory_order_relaxed);
+        }
+        return hold;
+    }
+    static void resumeHold(RtLockHold *hold, UINT64 nowUs) {
+        if (hold != RT_NULL) {
+            hold->lockedUs = nowUs;
+        }
+    }
+
+ private:
+    std::atomic<RT_BOOL>                            mEnable;
+    RtMutex                                         mLock;
+    std::vector<std::unique_ptr<RtLockSiteStat> >   mSites;
+};
+
+inline void RtProfiledCondition::stamp() {
+    if (RtLockProfiler::instance()->isEnable()) {
+        mSignalUs.store(RtTime::getRelativeTimeUs(), std::memory_order_relaxed);
+    }
+}
+
+/*
+ * drop-in for RtMutex::RtAutolock, see RT_PROFILED_AUTOLOCK.
+ */
+class RtProfiledAutolock {
+ public:
+    inline RtProfiledAutolock(RtMutex& rtMutex, RtLockSiteStat *stat)     // NOLINT
+            : mLock(rtMutex) {
+        hold(stat);
+    }
+    inline RtProfiledAutolock(RtMutex* rtMutex, RtLockSiteStat *stat)
+            : mLock(*rtMutex) {
+        hold(stat);
+    }
+    inline ~RtProfiledAutolock() {
+        RtLockProfiler::popHold(&mHold);
+        RtLockProfiler::unlock(&mLock, mHold.stat, mHold.lockedUs);
+    }
+
+ private:
+    void hold(RtLockSiteStat *stat) {
+        mHold.mutex    = &mLock;
+        mHold.stat     = stat;
+        mHold.outer    = RT_NULL;
+        mHold.lockedUs = RtLockProfiler::lock(&mLock, stat);
+        RtLockProfiler::pushHold(&mHold);
+    }
+
+ private:
+    RtMutex        &mLock;
+    RtLockHold      mHold;
+};
+
+#endif  // INCLUDE_RT_BASE_RT_LOCK_PROFILER_H_
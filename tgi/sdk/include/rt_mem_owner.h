@@ -0,0 +1,315 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: sampled per-graph/per-node heap attribution
+ */
+
+#ifndef INCLUDE_RT_BASE_RT_MEM_OWNER_H_
+#define INCLUDE_RT_BASE_RT_MEM_OWNER_H_
+
+#include <string.h>
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+#include <atomic>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "rt_header.h"   // NOLINT
+
+#define RT_MEM_OWNER_ENV_ENABLE         "rt_mem_owner"
+#define RT_MEM_OWNER_ENV_SAMPLE         "rt_mem_owner_sample"
+#define RT_MEM_OWNER_DEFAULT_SAMPLE     (256 * 1024)    // bytes between two samples
+#define RT_MEM_OWNER_SHARDS             16
+#define RT_MEM_OWNER_STACK_DEPTH        8
+#define RT_MEM_OWNER_NONE               (-1)
+
+/*
+ * the owner of the allocations made by the current thread. the scheduler
+ * sets it around open()/process()/close() of every node with
+ * RtMemOwnerScope, anything else is attributed to RT_MEM_OWNER_NONE.
+ */
+typedef struct _RtMemOwner {
+    UINT64      graphUid;
+    INT32       nodeId;
+    const char *name;       // must outlive the scope, e.g. node name
+} RtMemOwner;
+
+typedef struct _RtMemOwnerStat {
+    UINT64      graphUid;
+    INT32       nodeId;
+    std::string name;
+    INT64       liveBytes;      // estimated from the samples
+    INT64       peakBytes;
+    UINT64      samples;
+} RtMemOwnerStat;
+
+/*
+ * heap attribution by sampling: about one allocation every sample bytes
+ * is recorded together with its call stack, and stands for sample bytes
+ * (or its own size if bigger). unsampled allocations only decrement a
+ * thread local counter, so it can stay on in long running devices.
+ * a sample size of 1 records every allocation exactly.
+ *
+ * the first countdown of a thread is a random draw in [1, sample], so
+ * threads which allocate in the same pattern do not all sample at the
+ * same point of it, e.g. the first buffer of every frame.
+ *
+ * rt_mem_malloc()/rt_mem_free() report to onAlloc()/onFree().
+ */
+class RtMemOwnerTracker {
+ public:
+    static RtMemOwnerTracker* instance() {
+        static RtMemOwnerTracker tracker;
+        return &tracker;
+    }
+
+    RT_BOOL isEnable() const { return mEnable.load(std::memory_order_relaxed); }
+    void    setEnable(RT_BOOL enable) { mEnable.store(enable, std::memory_order_relaxed); }
+    void    setSampleBytes(UINT32 bytes) { mSampleBytes.store(bytes > 0 ? bytes : 1, std::memory_order_relaxed); }
+
+    static RtMemOwner* current() {
+        static thread_local RtMemOwner owner = { 0, RT_MEM_OWNER_NONE, RT_NULL };
+        return &owner;
+    }
+
+    void onAlloc(const void *ptr, size_t size) {
+        if (!isEnable() || ptr == RT_NULL) {
+            return;
+        }
+        INT64 &untilSample = bytesUntilSample(mSampleBytes.load(std::memory_order_relaxed));
+        untilSample -= static_cast<INT64>(size);
+        if (untilSample > 0) {
+            return;
+        }
+        UINT32 sample = mSampleBytes.load(std::memory_order_relaxed);
+        untilSample   = sample;
+
+        const RtMemOwner *owner = current();
+        Sample record;
+        record.key    = OwnerKey(owner->graphUid, owner->nodeId);
+        record.weight = RT_MAX(static_cast<INT64>(size), static_cast<INT64>(sample));
+        record.depth  = captureStack(record.stack);
+        {
+            Shard &shard = shardOf(ptr);
+            RtMutex::RtAutolock autoLock(shard.mLock);
+            shard.mSamples[ptr] = record;
+            shard.mCount.store(static_cast<UINT32>(shard.mSamples.size()), std::memory_order_relaxed);
+        }
+
+        RtMutex::RtAutolock autoLock(mOwnerLock);
+        OwnerState &state = mOwners[record.key];
+        if (state.name.empty() && owner->name != RT_NULL) {
+            state.name = owner->name;
+        }
+        state.liveBytes += record.weight;
+        state.peakBytes  = RT_MAX(state.peakBytes, state.liveBytes);
+        state.samples++;
+    }
+
+    void onFree(const void *ptr) {
+        if (!isEnable() || ptr == RT_NULL) {
+            return;
+        }
+        Shard &shard = shardOf(ptr);
+        if (shard.mCount.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        Sample record;
+        {
+            RtMutex::RtAutolock autoLock(shard.mLock);
+            SampleMap::iterator it = shard.mSamples.find(ptr);
+            if (it == shard.mSamples.end()) {
+                return;
+            }
+            record = it->second;
+            shard.mSamples.erase(it);
+            shard.mCount.store(static_cast<UINT32>(shard.mSamples.size()), std::memory_order_relaxed);
+        }
+
+        RtMutex::RtAutolock autoLock(mOwnerLock);
+        mOwners[record.key].liveBytes -= record.weight;
+    }
+
+    // graphUid 0 collects every owner.
+    INT32 collect(std::vector<RtMemOwnerStat> *stats, UINT64 graphUid = 0) {
+        stats->clear();
+        RtMutex::RtAutolock autoLock(mOwnerLock);
+        std::map<OwnerKey, OwnerState>::iterator it;
+        for (it = mOwners.begin(); it != mOwners.end(); ++it) {
+            if (graphUid != 0 && it->first.first != graphUid) {
+                continue;
+            }
+            RtMemOwnerStat stat;
+            stat.graphUid  = it->first.first;
+            stat.nodeId    = it->first.second;
+            stat.name      = it->second.name;
+            stat.liveBytes = it->second.liveBytes;
+            stat.peakBytes = it->second.peakBytes;
+            stat.samples   = it->second.samples;
+            stats->push_back(stat);
+        }
+        return static_cast<INT32>(stats->size());
+    }
+
+    // owners with their live and peak bytes, plus the stacks of the live samples of nodeId.
+    void dump(UINT64 graphUid = 0, INT32 stackOfNode = RT_MEM_OWNER_NONE) {
+        std::vector<RtMemOwnerStat> stats;
+        collect(&stats, graphUid);
+        RT_LOGE("heap by owner (sampled every %d bytes):", mSampleBytes.load(std::memory_order_relaxed));
+        for (size_t i = 0; i < stats.size(); i++) {
+            RT_LOGE("  graph %lld node %s(%d) live %lld peak %lld samples %lld",
+                     (INT64)stats[i].graphUid, stats[i].name.empty() ? "none" : stats[i].name.c_str(),
+                     stats[i].nodeId, (INT64)stats[i].liveBytes, (INT64)stats[i].peakBytes,
+                     (INT64)stats[i].samples);
+        }
+        if (stackOfNode != RT_MEM_OWNER_NONE) {
+            dumpStacks(graphUid, stackOfNode);
+        }
+    }
+
+    void reset() {
+        for (INT32 i = 0; i < RT_MEM_OWNER_SHARDS; i++) {
+            RtMutex::RtAutolock autoLock(mShards[i].mLock);
+            mShards[i].mSamples.clear();
+            mShards[i].mCount.store(0, std::memory_order_relaxed);
+        }
+        RtMutex::RtAutolock autoLock(mOwnerLock);
+        mOwners.clear();
+    }
+
+ private:
+    RtMemOwnerTracker() : mEnable(RT_FALSE), mSampleBytes(RT_MEM_OWNER_DEFAULT_SAMPLE) {
+        UINT32 value = 0;
+        rt_env_get_u32(RT_MEM_OWNER_ENV_ENABLE, &value, 0);
+        mEnable.store(value ? RT_TRUE : RT_FALSE, std::memory_order_relaxed);
+        rt_env_get_u32(RT_MEM_OWNER_ENV_SAMPLE, &value, RT_MEM_OWNER_DEFAULT_SAMPLE);
+        setSampleBytes(value);
+    }
+    RtMemOwnerTracker(const RtMemOwnerTracker&) = delete;
+    RtMemOwnerTracker& operator=(const RtMemOwnerTracker&) = delete;
+
+    typedef std::pair<UINT64, INT32> OwnerKey;
+
+    struct Sample {
+        OwnerKey  key;
+        INT64     weight;
+        INT32     depth;
+        void     *stack[RT_MEM_OWNER_STACK_DEPTH];
+    };
+    typedef std::unordered_map<const void *, Sample> SampleMap;
+
+    struct Shard {
+        Shard() : mCount(0) {}
+        RtMutex              mLock;
+        std::atomic<UINT32>  mCount;
+        SampleMap            mSamples;
+    };
+
+    struct OwnerState {
+        OwnerState() : liveBytes(0), peakBytes(0), samples(0) {}
+        std::string name;
+        INT64       liveBytes;
+        INT64       peakBytes;
+        UINT64      samples;
+    };
+
+    static INT64& bytesUntilSample(UINT32 sample) {
+        static thread_local INT64   bytes  = 0;
+        static thread_local RT_BOOL seeded = RT_FALSE;
+        if (!seeded) {
+            seeded = RT_TRUE;
+            bytes  = 1 + static_cast<INT64>(randomDraw(&bytes) % sample);
+        }
+        return bytes;
+    }
+
+    // splitmix64 of the thread local address and the time, rand() is not thread safe.
+    static UINT64 randomDraw(const void *local) {
+        UINT64 x = reinterpret_cast<uintptr_t>(local) + RtTime::getRelativeTimeUs() * 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    static INT32 captureStack(void **stack) {
+#if defined(__GLIBC__)
+        return backtrace(stack, RT_MEM_OWNER_STACK_DEPTH);
+#else
+        return 0;
+#endif
+    }
+
+    Shard& shardOf(const void *ptr) {
+        UINT64 key = reinterpret_cast<uintptr_t>(ptr) >> 4;
+        return mShards[(key ^ (key >> 9)) % RT_MEM_OWNER_SHARDS];
+    }
+
+    void dumpStacks(UINT64 graphUid, INT32 nodeId) {
+        for (INT32 i = 0; i < RT_MEM_OWNER_SHARDS; i++) {
+            std::vector<Sample> samples;
+            {
+                RtMutex::RtAutolock autoLock(mShards[i].mLock);
+                SampleMap::iterator it;
+                for (it = mShards[i].mSamples.begin(); it != mShards[i].mSamples.end(); ++it) {
+                    if (it->second.key.second == nodeId &&
+                            (graphUid == 0 || it->second.key.first == graphUid)) {
+                        samples.push_back(it->second);
+                    }
+                }
+            }
+            for (size_t j = 0; j < samples.size(); j++) {
+                RT_LOGE("  sample of %lld bytes:", (INT64)samples[j].weight);
+#if defined(__GLIBC__)
+                char **symbols = backtrace_symbols(samples[j].stack, samples[j].depth);
+                for (INT32 k = 0; symbols != RT_NULL && k < samples[j].depth; k++) {
+                    RT_LOGE("    #%d %s", k, symbols[k]);
+                }
+                free(symbols);
+#endif
+            }
+        }
+    }
+
+ private:
+    std::atomic<RT_BOOL>            mEnable;
+    std::atomic<UINT32>             mSampleBytes;
+    Shard                           mShards[RT_MEM_OWNER_SHARDS];
+    RtMutex                         mOwnerLock;
+    std::map<OwnerKey, OwnerState>  mOwners;
+};
+
+/*
+ * tags the allocations of the current thread for the lifetime of the scope.
+ */
+class RtMemOwnerScope {
+ public:
+    RtMemOwnerScope(UINT64 graphUid, INT32 nodeId, const char *name) {
+        RtMemOwner *owner = RtMemOwnerTracker::current();
+        mSaved = *owner;
+        owner->graphUid = graphUid;
+        owner->nodeId   = nodeId;
+        owner->name     = name;
+    }
+    ~RtMemOwnerScope() { *RtMemOwnerTracker::current() = mSaved; }
+
+ private:
+    RtMemOwner mSaved;
+};
+
+#endif  // INCLUDE_RT_BASE_RT_MEM_OWNER_H_
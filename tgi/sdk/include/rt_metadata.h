@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <map>
+#include <vector>
 #include "rt_type.h"   // NOLINT
 #include "rt_error.h"  // NOLINT
 
@@ -90,6 +91,17 @@ class RtMetaData {
 
     virtual void dumpToLog() const;
 
+    // collects the keys of all entries, e.g. for walking them with findData().
+    INT32 getKeys(std::vector<UINT64> *keys) const {
+        keys->clear();
+        keys->reserve(mDataMaps.size());
+        for (std::map<UINT64, void *>::const_iterator it = mDataMaps.begin();
+                it != mDataMaps.end(); ++it) {
+            keys->push_back(it->first);
+        }
+        return static_cast<INT32>(keys->size());
+    }
+
  private:
     struct              typed_data;
     std::map<UINT64, void *> mDataMaps;
@@ -0,0 +1,333 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: binary encode/decode of RtMetaData
+ */
+
+#ifndef INCLUDE_RT_BASE_RT_METADATA_CODEC_H_
+#define INCLUDE_RT_BASE_RT_METADATA_CODEC_H_
+
+#include <string.h>
+#include <vector>
+
+#include "rt_type.h"      // NOLINT
+#include "rt_error.h"     // NOLINT
+#include "rt_metadata.h"  // NOLINT
+
+/*
+ * layout (the structs and values in host byte order, every block 8 bytes
+ * aligned), only for processes of the same machine:
+ *
+ *   RTMetaBlobHeader
+ *   RTMetaBlobEntry + payload(size bytes, padded to 8) ... x count
+ *
+ * TYPE_C_STRING payloads keep their '\0', so a decoded view can hand out
+ * pointers into the blob directly.
+ */
+#define RT_META_BLOB_MAGIC      MKTAG('r', 't', 'm', 'd')
+#define RT_META_BLOB_VERSION    1
+#define RT_META_BLOB_ALIGN(x)   (((x) + 7) & ~7U)
+
+typedef enum _RTMetaBlobFlag {
+    RT_META_BLOB_FLAG_NONE          = 0,
+    // drop TYPE_POINTER entries instead of failing, pointers can not
+    // be used outside of the process which created them.
+    RT_META_BLOB_FLAG_SKIP_POINTER  = (1 << 0),
+} RTMetaBlobFlag;
+
+typedef struct _RTMetaBlobHeader {
+    UINT32 magic;
+    UINT16 version;
+    UINT16 headerSize;
+    UINT32 count;
+    UINT32 totalSize;
+} RTMetaBlobHeader;
+
+typedef struct _RTMetaBlobEntry {
+    UINT64 key;
+    UINT32 type;
+    UINT32 size;
+} RTMetaBlobEntry;
+
+class RtMetaDataCodec {
+ public:
+    /*
+     * encodes meta into buf. when buf is RT_NULL only the needed size
+     * is returned by written. pointer entries return RT_ERR_UNSUPPORT
+     * unless RT_META_BLOB_FLAG_SKIP_POINTER is given.
+     */
+    static RT_RET encode(const RtMetaData *meta, void *buf, UINT32 capacity,
+                         UINT32 *written, UINT32 flags = RT_META_BLOB_FLAG_NONE) {
+        if (meta == RT_NULL || written == RT_NULL) {
+            return RT_ERR_NULL_PTR;
+        }
+
+        std::vector<UINT64> keys;
+        meta->getKeys(&keys);
+
+        UINT8 *dst   = reinterpret_cast<UINT8 *>(buf);
+        UINT32 pos   = RT_META_BLOB_ALIGN(sizeof(RTMetaBlobHeader));
+        UINT32 count = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            UINT32      type = 0;
+            UINT32      size = 0;
+            const void *data = RT_NULL;
+            if (!meta->findData(keys[i], &type, &data, &size)) {
+                continue;
+            }
+            if (type == RtMetaData::TYPE_POINTER) {
+                if (flags & RT_META_BLOB_FLAG_SKIP_POINTER) {
+                    continue;
+                }
+                return RT_ERR_UNSUPPORT;
+            }
+            if (type == RtMetaData::TYPE_C_STRING) {
+                size = data ? static_cast<UINT32>(strlen(reinterpret_cast<const char *>(data))) + 1 : 0;
+            }
+
+            UINT32 next = pos + RT_META_BLOB_ALIGN(sizeof(RTMetaBlobEntry)) + RT_META_BLOB_ALIGN(size);
+            if (dst != RT_NULL) {
+                if (next > capacity) {
+                    return RT_ERR_NO_BUFFER;
+                }
+                RTMetaBlobEntry entry;
+                entry.key  = keys[i];
+                entry.type = type;
+                entry.size = size;
+                memcpy(dst + pos, &entry, sizeof(entry));
+                UINT8 *payload = dst + pos + RT_META_BLOB_ALIGN(sizeof(RTMetaBlobEntry));
+                if (size > 0) {
+                    memcpy(payload, data, size);
+                }
+                memset(payload + size, 0, RT_META_BLOB_ALIGN(size) - size);
+            }
+            pos = next;
+            count++;
+        }
+
+        if (dst != RT_NULL) {
+            if (pos > capacity) {
+                return RT_ERR_NO_BUFFER;
+            }
+            RTMetaBlobHeader header;
+            memset(&header, 0, sizeof(header));
+            header.magic      = RT_META_BLOB_MAGIC;
+            header.version    = RT_META_BLOB_VERSION;
+            header.headerSize = RT_META_BLOB_ALIGN(sizeof(RTMetaBlobHeader));
+            header.count      = count;
+            header.totalSize  = pos;
+            memcpy(dst, &header, sizeof(header));
+        }
+        *written = pos;
+        return RT_OK;
+    }
+
+    static RT_RET encode(const RtMetaData *meta, std::vector<UINT8> *out,
+                         UINT32 flags = RT_META_BLOB_FLAG_NONE) {
+        UINT32 size = 0;
+        RT_RET ret = encode(meta, RT_NULL, 0, &size, flags);
+        if (ret != RT_OK) {
+            return ret;
+        }
+        out->resize(size);
+        return encode(meta, out->data(), size, &size, flags);
+    }
+
+    // copies every entry of the blob into meta.
+    static RT_RET decode(const void *buf, UINT32 size, RtMetaData *meta);
+};
+
+/*
+ * zero-copy reader of an encoded blob. the blob must stay valid and
+ * unmodified while the view is used, C-string and struct lookups return
+ * pointers into it.
+ */
+class RtMetaDataView {
+ public:
+    RtMetaDataView() {}
+
+    RT_RET parse(const void *buf, UINT32 size) {
+        mEntries.clear();
+        const UINT8 *src = reinterpret_cast<const UINT8 *>(buf);
+        if (src == RT_NULL) {
+            return RT_ERR_NULL_PTR;
+        }
+        if (size < sizeof(RTMetaBlobHeader)) {
+            return RT_ERR_VALUE;
+        }
+
+        RTMetaBlobHeader header;
+        memcpy(&header, src, sizeof(header));
+        if (header.magic != RT_META_BLOB_MAGIC) {
+            return RT_ERR_VALUE;
+        }
+        if (header.version > RT_META_BLOB_VERSION) {
+            return RT_ERR_UNSUPPORT;
+        }
+        if (header.headerSize < sizeof(RTMetaBlobHeader)) {
+            return RT_ERR_VALUE;
+        }
+        if (header.totalSize > size || header.headerSize > header.totalSize) {
+            return RT_ERR_OUTOF_RANGE;
+        }
+
+        UINT32 pos = header.headerSize;
+        for (UINT32 i = 0; i < header.count; i++) {
+            UINT32 payload = pos + RT_META_BLOB_ALIGN(sizeof(RTMetaBlobEntry));
+            if (payload > header.totalSize) {
+                mEntries.clear();
+                return RT_ERR_OUTOF_RANGE;
+            }
+            RTMetaBlobEntry entry;
+            memcpy(&entry, src + pos, sizeof(entry));
+            if (entry.size > header.totalSize - payload) {
+                mEntries.clear();
+                return RT_ERR_OUTOF_RANGE;
+            }
+            // a pointer from another process must never reach a RtMetaData.
+            if (!isBlobType(entry.type, entry.size)) {
+                mEntries.clear();
+                return RT_ERR_VALUE;
+            }
+            if (entry.type == RtMetaData::TYPE_C_STRING &&
+                    (entry.size == 0 || src[payload + entry.size - 1] != '\0')) {
+                mEntries.clear();
+                return RT_ERR_VALUE;
+            }
+
+            Item item;
+            item.key  = entry.key;
+            item.type = entry.type;
+            item.size = entry.size;
+            item.data = src + payload;
+            mEntries.push_back(item);
+            pos = payload + RT_META_BLOB_ALIGN(entry.size);
+        }
+        return RT_OK;
+    }
+
+    INT32   size() const { return static_cast<INT32>(mEntries.size()); }
+
+    RT_BOOL findData(UINT64 key, UINT32 *type, const void **data, UINT32 *size) const {
+        for (size_t i = 0; i < mEntries.size(); i++) {
+            if (mEntries[i].key == key) {
+                *type = mEntries[i].type;
+                *data = mEntries[i].data;
+                *size = mEntries[i].size;
+                return RT_TRUE;
+            }
+        }
+        return RT_FALSE;
+    }
+
+    RT_BOOL findCString(UINT64 key, const char **value) const {
+        const void *data = findTyped(key, RtMetaData::TYPE_C_STRING, 0);
+        *value = reinterpret_cast<const char *>(data);
+        return data != RT_NULL;
+    }
+    RT_BOOL findStructData(UINT64 key, const void **value, UINT32 size) const {
+        *value = findTyped(key, RtMetaData::TYPE_STRUCT, size);
+        return *value != RT_NULL;
+    }
+    RT_BOOL findInt32(UINT64 key, INT32 *value) const {
+        return copyTyped(key, RtMetaData::TYPE_INT32, value, sizeof(*value));
+    }
+    RT_BOOL findInt64(UINT64 key, INT64 *value) const {
+        return copyTyped(key, RtMetaData::TYPE_INT64, value, sizeof(*value));
+    }
+    RT_BOOL findFloat(UINT64 key, float *value) const {
+        return copyTyped(key, RtMetaData::TYPE_FLOAT, value, sizeof(*value));
+    }
+    RT_BOOL findInt16(UINT64 key, INT16 *value) const {
+        return copyTyped(key, RtMetaData::TYPE_INT16, value, sizeof(*value));
+    }
+    RT_BOOL findInt8(UINT64 key, INT8 *value) const {
+        return copyTyped(key, RtMetaData::TYPE_INT8, value, sizeof(*value));
+    }
+
+    // copies all entries into meta, the view itself is not needed afterwards.
+    RT_RET  copyTo(RtMetaData *meta) const {
+        if (meta == RT_NULL) {
+            return RT_ERR_NULL_PTR;
+        }
+        for (size_t i = 0; i < mEntries.size(); i++) {
+            const Item &item = mEntries[i];
+            if (!meta->setData(item.key, item.type, item.data, item.size)) {
+                return RT_ERR_BAD;
+            }
+        }
+        return RT_OK;
+    }
+
+ private:
+    struct Item {
+        UINT64       key;
+        UINT32       type;
+        UINT32       size;
+        const UINT8 *data;
+    };
+
+    // the types encode() writes, values with their own size.
+    static RT_BOOL isBlobType(UINT32 type, UINT32 size) {
+        switch (type) {
+          case RtMetaData::TYPE_C_STRING:
+          case RtMetaData::TYPE_STRUCT:
+            return RT_TRUE;
+          case RtMetaData::TYPE_INT32: return (size == sizeof(INT32)) ? RT_TRUE : RT_FALSE;
+          case RtMetaData::TYPE_INT64: return (size == sizeof(INT64)) ? RT_TRUE : RT_FALSE;
+          case RtMetaData::TYPE_FLOAT: return (size == sizeof(float)) ? RT_TRUE : RT_FALSE;
+          case RtMetaData::TYPE_INT8:  return (size == sizeof(INT8)) ? RT_TRUE : RT_FALSE;
+          case RtMetaData::TYPE_INT16: return (size == sizeof(INT16)) ? RT_TRUE : RT_FALSE;
+          default:
+            return RT_FALSE;
+        }
+    }
+
+    const void* findTyped(UINT64 key, UINT32 type, UINT32 size) const {
+        UINT32      realType = 0;
+        UINT32      realSize = 0;
+        const void *data     = RT_NULL;
+        if (!findData(key, &realType, &data, &realSize) || realType != type) {
+            return RT_NULL;
+        }
+        if (size != 0 && size != realSize) {
+            return RT_NULL;
+        }
+        return data;
+    }
+
+    RT_BOOL copyTyped(UINT64 key, UINT32 type, void *value, UINT32 size) const {
+        const void *data = findTyped(key, type, size);
+        if (data == RT_NULL) {
+            return RT_FALSE;
+        }
+        memcpy(value, data, size);
+        return RT_TRUE;
+    }
+
+ private:
+    std::vector<Item> mEntries;
+};
+
+inline RT_RET RtMetaDataCodec::decode(const void *buf, UINT32 size, RtMetaData *meta) {
+    RtMetaDataView view;
+    RT_RET ret = view.parse(buf, size);
+    if (ret != RT_OK) {
+        return ret;
+    }
+    return view.copyTo(meta);
+}
+
+#endif  // INCLUDE_RT_BASE_RT_METADATA_CODEC_H_
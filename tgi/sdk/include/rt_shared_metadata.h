@@ -0,0 +1,164 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: copy-on-write handle of RtMetaData
+ */
+
+#ifndef INCLUDE_RT_BASE_RT_SHARED_METADATA_H_
+#define INCLUDE_RT_BASE_RT_SHARED_METADATA_H_
+
+#include <atomic>
+
+#include "rt_metadata.h"  // NOLINT
+
+/*
+ * RtSharedMetaData shares one RtMetaData between copies until one of them
+ * asks for write access through an Editor. Only then the entries are
+ * deep-copied (RtMetaData copy constructor), so metadata which is passed
+ * down a chain of nodes without being modified costs one reference count
+ * per hop.
+ *
+ * const accessors are safe to use from several threads at the same time,
+ * an Editor must only be made by the owner of the handle.
+ *
+ *   RtSharedMetaData::Editor editor(&meta);
+ *   editor->setInt32(kKeyFrameW, 1920);
+ */
+class RtSharedMetaData {
+ public:
+    RtSharedMetaData() : mShared(RT_NULL) {}
+    // takes the ownership of meta
+    explicit RtSharedMetaData(RtMetaData *meta)
+            : mShared(meta ? new Shared(meta) : RT_NULL) {}
+    RtSharedMetaData(const RtSharedMetaData &from)
+            : mShared(RT_NULL) {
+        share(from);
+    }
+    RtSharedMetaData& operator = (const RtSharedMetaData &from) {
+        if (mShared != from.mShared) {
+            Shared *old = mShared;
+            share(from);
+            decRef(old);
+        }
+        return *this;
+    }
+    ~RtSharedMetaData() { decRef(mShared); }
+
+ public:
+    const RtMetaData* get() const { return mShared ? mShared->mMeta : RT_NULL; }
+    const RtMetaData* operator -> () const { return get(); }
+    RT_BOOL           isNull() const { return mShared == RT_NULL; }
+    RT_BOOL           isShared() const {
+        return mShared && mShared->mRefs.load(std::memory_order_acquire) > 1;
+    }
+    INT32             useCount() const {
+        return mShared ? mShared->mRefs.load(std::memory_order_acquire) : 0;
+    }
+
+    /*
+     * write access to the RtMetaData of a handle, owned by that handle only:
+     * the entries are deep-copied first if other handles still reference
+     * the same storage. while an editor lives, copies of the handle get
+     * their own entries, so writes never reach them. the handle must not
+     * be reset or assigned to before its editors are gone.
+     */
+    class Editor {
+     public:
+        explicit Editor(RtSharedMetaData *owner) : mOwner(owner), mMeta(owner->editBegin()) {}
+        ~Editor() { mOwner->editEnd(); }
+
+        RtMetaData* get() const { return mMeta; }
+        RtMetaData* operator -> () const { return mMeta; }
+
+     private:
+        Editor(const Editor &);
+        Editor& operator = (const Editor &);
+
+     private:
+        RtSharedMetaData   *mOwner;
+        RtMetaData         *mMeta;
+    };
+
+    void              reset() {
+        decRef(mShared);
+        mShared = RT_NULL;
+    }
+
+    // number of deep copies made for editors in this process, for statistics.
+    static UINT64     deepCopyCount() {
+        return deepCopies().load(std::memory_order_relaxed);
+    }
+
+ private:
+    struct Shared {
+        explicit Shared(RtMetaData *meta) : mMeta(meta), mRefs(1), mEditors(0) {}
+        ~Shared() { delete mMeta; }
+        RtMetaData         *mMeta;
+        std::atomic<INT32>  mRefs;
+        INT32               mEditors;   // only touched by the owner of the handle
+    };
+
+    // shares the storage of from, or copies it while from is being edited.
+    void share(const RtSharedMetaData &from) {
+        if (from.mShared && from.mShared->mEditors > 0) {
+            mShared = new Shared(new RtMetaData(*from.mShared->mMeta));
+            deepCopies().fetch_add(1, std::memory_order_relaxed);
+        } else {
+            mShared = from.mShared;
+            addRef();
+        }
+    }
+
+    RtMetaData* editBegin() {
+        if (mShared == RT_NULL) {
+            mShared = new Shared(new RtMetaData());
+        } else if (isShared()) {
+            Shared *old = mShared;
+            mShared = new Shared(new RtMetaData(*old->mMeta));
+            deepCopies().fetch_add(1, std::memory_order_relaxed);
+            decRef(old);
+        }
+        mShared->mEditors++;
+        return mShared->mMeta;
+    }
+
+    void editEnd() {
+        if (mShared && mShared->mEditors > 0) {
+            mShared->mEditors--;
+        }
+    }
+
+    void addRef() {
+        if (mShared) {
+            mShared->mRefs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static std::atomic<UINT64>& deepCopies() {
+        static std::atomic<UINT64> count(0);
+        return count;
+    }
+
+    static void decRef(Shared *shared) {
+        if (shared && shared->mRefs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete shared;
+        }
+    }
+
+ private:
+    Shared *mShared;
+};
+
+#endif  // INCLUDE_RT_BASE_RT_SHARED_METADATA_H_
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2021 Rockchip Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * module: simd selection of the software media kernels
+ */
+
+#ifndef INCLUDE_RT_BASE_RT_SIMD_H_
+#define INCLUDE_RT_BASE_RT_SIMD_H_
+
+/*
+ * the kernels are written once with NEON for the arm cores and once with
+ * SSE2 for host builds, next to a scalar version that is the reference for
+ * both. every simd kernel must give bit-exact results to its scalar one,
+ * build with RT_SIMD_DISABLE to force the scalar code.
+ */
+#if !defined(RT_SIMD_DISABLE) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define RT_SIMD_NEON    1
+#elif !defined(RT_SIMD_DISABLE) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define RT_SIMD_SSE2    1
+#endif
+
+#if defined(RT_SIMD_NEON) || defined(RT_SIMD_SSE2)
+#define RT_SIMD_ENABLE  1
+#endif
+
+static inline const char* rt_simd_name() {
+#if defined(RT_SIMD_NEON)
+    return "neon";
+#elif defined(RT_SIMD_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+#endif  // INCLUDE_RT_BASE_RT_SIMD_H_